@@ -0,0 +1,558 @@
+"""Host-side benchmarks for the Flock You dashboard.
+
+    python bench.py protocol     JSON lines vs binary frames: bytes per
+                                 detection, link-limited detections/s and
+                                 decode throughput
+    python bench.py store        cumulative store ingest rate and load time
+                                 at 10k/100k/1M records, against the old
+                                 scan-and-repickle path
+    python bench.py gps          GPS matching rate and position error at
+                                 highway speed, against the old nearest-fix
+                                 scan of a 100-entry list
+    python bench.py fanout       Socket.IO events and read-to-emit latency
+                                 for a burst of serial detections, against
+                                 one event per line and per detection
+    python bench.py oui          OUI load time (text parse vs compiled cache),
+                                 MAC lookup and name search, on synthetic
+                                 registries the size of the IEEE ones
+    python bench.py export       time to first byte and peak memory of the
+                                 streamed CSV/KML/GeoJSON exports, against
+                                 building the whole file before sending
+"""
+import argparse
+from datetime import datetime, timedelta
+import json
+import math
+import os
+import pickle
+import random
+import tempfile
+import time
+import tracemalloc
+
+import exports
+from detection_store import DetectionStore
+from gps_track import GPS_MATCH_THRESHOLD, GpsTrack
+from socket_fanout import SocketFanout
+from oui_index import OuiIndex
+from flock_protocol import DETECTION_HEADER, MSG_DETECTION, PROTOCOL_VERSION, StreamDecoder, encode_frame
+
+BAUD_RATE = 115200
+BYTES_PER_SECOND = BAUD_RATE / 10  # 8N1: start + 8 data + stop bits
+
+
+def _sample_wifi_json():
+    """Beacon detection as printed by output_wifi_detection_json()"""
+    return {
+        "timestamp": 123456, "detection_time": "123.456s", "protocol": "wifi",
+        "detection_method": "beacon", "alert_level": "HIGH", "device_category": "FLOCK_SAFETY",
+        "ssid": "Flock-A1B2C3", "ssid_length": 12, "rssi": -61, "signal_strength": "MEDIUM",
+        "channel": 6, "mac_address": "58:8e:81:a1:b2:c3", "mac_prefix": "58:8e:81",
+        "vendor_oui": "58:8e:81", "matched_ssid_pattern": "flock", "ssid_match_confidence": "HIGH",
+        "matched_mac_pattern": "58:8e:81", "mac_match_confidence": "HIGH",
+        "detection_criteria": "SSID_AND_MAC", "threat_score": 100, "frame_type": "BEACON",
+        "frame_description": "Device advertising its network", "report_reason": "summary",
+        "hit_count": 291, "first_seen_ms": 81234, "last_seen_ms": 111301, "rssi_min": -71,
+        "rssi_max": -58, "rssi_avg": -63, "channels_seen": [6],
+    }
+
+
+def _sample_ble_json():
+    """Name detection as printed by output_ble_detection_json()"""
+    return {
+        "timestamp": 123456, "detection_time": "123.456s", "protocol": "bluetooth_le",
+        "detection_method": "device_name", "alert_level": "HIGH", "device_category": "FLOCK_SAFETY",
+        "mac_address": "c4:d3:6a:11:22:33", "rssi": -74, "signal_strength": "WEAK",
+        "device_name": "Penguin-1234", "device_name_length": 12, "has_device_name": True,
+        "mac_prefix": "c4:d3:6a", "vendor_oui": "c4:d3:6a", "matched_name_pattern": "penguin",
+        "name_match_confidence": "HIGH", "detection_criteria": "NAME_ONLY", "threat_score": 85,
+        "advertisement_type": "BLE_ADVERTISEMENT",
+        "advertisement_description": "Bluetooth Low Energy device advertisement",
+        "primary_indicator": "DEVICE_NAME", "detection_reason": "Device name matches Flock Safety pattern",
+        "report_reason": "first_seen", "hit_count": 1, "first_seen_ms": 123456,
+        "last_seen_ms": 123456, "rssi_min": -74, "rssi_max": -74, "rssi_avg": -74,
+    }
+
+
+def _binary_record(mac, rssi, channel, method, family, match_flags, report, pattern_id,
+                   hits, first_seen, last_seen, rssi_min, rssi_max, rssi_avg, channels, name):
+    name = name.encode()
+    header = DETECTION_HEADER.pack(PROTOCOL_VERSION, MSG_DETECTION, 123456, bytes.fromhex(mac.replace(':', '')),
+                                   rssi, channel, method, family, match_flags, report, pattern_id, 0,
+                                   hits, first_seen, last_seen, rssi_min, rssi_max, rssi_avg, channels,
+                                   len(name))
+    return encode_frame(header + name)
+
+
+def bench_protocol(iterations):
+    samples = [
+        ('wifi beacon', _sample_wifi_json(),
+         _binary_record('58:8e:81:a1:b2:c3', -61, 6, 3, 0, 0x03, 3, 0, 291, 81234, 111301, -71, -58, -63,
+                        1 << 6, 'Flock-A1B2C3')),
+        ('ble name', _sample_ble_json(),
+         _binary_record('c4:d3:6a:11:22:33', -74, 0, 6, 1, 0x04, 1, 2, 1, 123456, 123456, -74, -74, -74,
+                        0, 'Penguin-1234')),
+    ]
+
+    print(f"Serial link: {BAUD_RATE} baud 8N1 = {BYTES_PER_SECOND:.0f} bytes/s\n")
+    print(f"{'record':<12} {'mode':<7} {'bytes':>6} {'max det/s':>10} {'host decode/s':>14}")
+    for label, doc, frame in samples:
+        line = (json.dumps(doc, separators=(',', ':')) + '\r\n').encode()
+
+        start = time.perf_counter()
+        for _ in range(iterations):
+            json.loads(line)
+        json_rate = iterations / (time.perf_counter() - start)
+
+        stream = frame * iterations
+        decoder = StreamDecoder()
+        start = time.perf_counter()
+        count = sum(1 for _ in decoder.feed(stream))
+        binary_rate = count / (time.perf_counter() - start)
+
+        print(f"{label:<12} {'json':<7} {len(line):>6} {BYTES_PER_SECOND / len(line):>10.1f} {json_rate:>14.0f}")
+        print(f"{label:<12} {'binary':<7} {len(frame):>6} {BYTES_PER_SECOND / len(frame):>10.1f} {binary_rate:>14.0f}")
+        print(f"{'':<12} ratio   {len(line) / len(frame):>6.1f}x")
+
+
+def _store_record(i):
+    """Cumulative record, trimmed to the fields every detection carries"""
+    return {
+        'mac_address': f"{(i >> 40) & 0xff:02x}:{(i >> 32) & 0xff:02x}:{(i >> 24) & 0xff:02x}:"
+                       f"{(i >> 16) & 0xff:02x}:{(i >> 8) & 0xff:02x}:{i & 0xff:02x}",
+        'protocol': 'wifi', 'detection_method': 'beacon', 'ssid': 'Flock-A1B2C3', 'rssi': -61,
+        'channel': 6, 'id': i, 'detection_count': 1, 'first_seen': '2024-05-01T12:00:00',
+        'last_seen': '2024-05-01T12:00:00',
+        'gps': {'latitude': 37.0 + i * 1e-6, 'longitude': -122.0, 'fix_quality': 1},
+    }
+
+
+def _store_hits(existing, count, new_share=0.1):
+    """Detections for the ingest loop: mostly repeat hits on known MACs"""
+    rng = random.Random(1)
+    hits = []
+    for n in range(count):
+        i = existing + n if rng.random() < new_share else rng.randrange(existing)
+        hits.append(_store_record(i))
+    return hits
+
+
+def _ingest_store(store, hits):
+    # The cumulative part of add_detection_from_serial()
+    for hit in hits:
+        mac = hit['mac_address']
+        if store.find(mac) is not None:
+            store.update(mac, {'last_seen': hit['last_seen'], 'rssi': hit['rssi']})
+        else:
+            store.append(hit)
+
+
+def _ingest_legacy(records, path, hits, budget):
+    # The old path: scan for the MAC, then re-pickle everything. Stops after
+    # budget seconds (at least 3 detections) since it is O(n) per detection.
+    start = time.perf_counter()
+    done = 0
+    for hit in hits:
+        for rec in records:
+            if rec['mac_address'] == hit['mac_address']:
+                rec.update({'last_seen': hit['last_seen'], 'rssi': hit['rssi']})
+                break
+        else:
+            records.append(hit)
+        with open(path, 'wb') as f:
+            pickle.dump(records, f)
+        done += 1
+        if done >= 3 and time.perf_counter() - start > budget:
+            break
+    return done, time.perf_counter() - start
+
+
+def bench_store(sizes, detections, legacy_budget):
+    print(f"{detections} detections per size, 90% repeat hits; legacy path capped at {legacy_budget:.0f} s\n")
+    print(f"{'records':>9} {'store det/s':>12} {'legacy det/s':>13} {'speedup':>8} {'journal':>8} "
+          f"{'load snap':>10} {'load +journal':>14}")
+    for size in sizes:
+        with tempfile.TemporaryDirectory() as tmp:
+            snapshot = os.path.join(tmp, 'cumulative_detections.pkl')
+            journal = os.path.join(tmp, 'cumulative_detections.journal')
+            records = [_store_record(i) for i in range(size)]
+            with open(snapshot, 'wb') as f:
+                pickle.dump(records, f, protocol=pickle.HIGHEST_PROTOCOL)
+            hits = _store_hits(size, detections)
+
+            legacy_done, legacy_s = _ingest_legacy(records, os.path.join(tmp, 'legacy.pkl'),
+                                                   [dict(h) for h in hits], legacy_budget)
+            del records
+
+            store = DetectionStore(snapshot, journal)
+            start = time.perf_counter()
+            store.load()
+            load_s = time.perf_counter() - start
+            store.start()
+            start = time.perf_counter()
+            _ingest_store(store, hits)
+            store.close()
+            store_s = time.perf_counter() - start
+            journal_lines = store.journal_lines
+
+            reloaded = DetectionStore(snapshot, journal)
+            start = time.perf_counter()
+            reloaded.load()
+            reload_s = time.perf_counter() - start
+
+            store_rate = detections / store_s
+            legacy_rate = legacy_done / legacy_s
+            print(f"{size:>9} {store_rate:>12.0f} {legacy_rate:>13.1f} {store_rate / legacy_rate:>7.0f}x "
+                  f"{journal_lines:>8} {load_s:>9.3f}s {reload_s:>13.3f}s")
+
+
+EARTH_RADIUS_M = 6371000.0
+
+
+def _track_position(t, speed, radius=1000.0):
+    """Vehicle going round a 1 km radius curve at speed m/s"""
+    angle = speed * t / radius
+    north = radius * math.sin(angle)
+    east = radius * (1.0 - math.cos(angle))
+    lat = 37.0 + math.degrees(north / EARTH_RADIUS_M)
+    lon = -122.0 + math.degrees(east / (EARTH_RADIUS_M * math.cos(math.radians(37.0))))
+    return lat, lon
+
+
+def _distance_m(a, b):
+    dlat = math.radians(a[0] - b[0])
+    dlon = math.radians(a[1] - b[1]) * math.cos(math.radians(a[0]))
+    return EARTH_RADIUS_M * math.hypot(dlat, dlon)
+
+
+def _nearest_fix_legacy(history, t):
+    # The old find_best_gps_match(): scan every entry for the closest one
+    best, best_diff = None, float('inf')
+    for entry in history:
+        diff = abs(t - entry['system_timestamp'])
+        if diff < best_diff and diff <= GPS_MATCH_THRESHOLD:
+            best, best_diff = entry, diff
+    return best
+
+
+def bench_gps(rates, speed, minutes, lookups):
+    print(f"Vehicle at {speed:.0f} m/s on a 1 km radius curve; {lookups} detections at random times in the last "
+          f"{minutes:.0f} min, half of them live (after the newest fix)\n")
+    print(f"{'fix rate':>8} {'fixes':>6} {'old lookups/s':>14} {'new lookups/s':>14} "
+          f"{'old err p50/p95':>16} {'new err p50/p95':>16}")
+    rng = random.Random(1)
+    for rate in rates:
+        duration = minutes * 60.0
+        count = int(duration * rate)
+        track = GpsTrack(minutes=minutes)
+        history = []
+        for n in range(count):
+            t = n / rate
+            lat, lon = _track_position(t, speed)
+            fix = {'latitude': lat, 'longitude': lon, 'altitude': 10.0, 'fix_quality': 1, 'satellites': 9}
+            track.add(fix, t)
+            history.append(dict(fix, system_timestamp=t))
+        legacy_history = history[-100:]  # MAX_GPS_HISTORY
+        end = (count - 1) / rate
+        # Odd: anywhere in the history. Even: live, up to one fix interval
+        # after the newest fix (the usual case for a detection off the serial port)
+        times = [end - rng.random() * duration if k % 2 else end + rng.random() / rate for k in range(lookups)]
+
+        start = time.perf_counter()
+        old = [_nearest_fix_legacy(legacy_history, t) for t in times]
+        old_rate = lookups / (time.perf_counter() - start)
+        start = time.perf_counter()
+        new = [track.lookup(t) for t in times]
+        new_rate = lookups / (time.perf_counter() - start)
+
+        def errors(matches, ts):
+            errs = sorted(_distance_m((m['latitude'], m['longitude']), _track_position(t, speed))
+                          for m, t in zip(matches, ts))
+            if not errs:
+                return 'no matches'
+            return f"{errs[len(errs) // 2]:.1f}/{errs[int(len(errs) * 0.95)]:.1f} m"
+
+        # The old history only reaches 100 fixes back; compare errors on the
+        # detections it could place
+        placed = [k for k, m in enumerate(old) if m]
+        placed_times = [times[k] for k in placed]
+        old_err = errors([old[k] for k in placed], placed_times)
+        new_err = errors([new[k] for k in placed], placed_times)
+        print(f"{rate:>6.0f}Hz {count:>6} {old_rate:>14.0f} {new_rate:>14.0f} {old_err:>16} {new_err:>16}")
+        missed_old = lookups - len(placed)
+        missed_new = sum(1 for m in new if not m)
+        print(f"{'':>8} unplaced detections: old {missed_old}, new {missed_new}")
+
+
+def bench_fanout(rates, seconds, macs):
+    print(f"{seconds:.0f} s of serial detections over {macs} MACs, read in 10 ms chunks; "
+          f"the old reader slept 0.1 s per readline (10 lines/s)\n")
+    print(f"{'lines/s':>8} {'old events':>11} {'old backlog':>12} {'new events':>11} "
+          f"{'batches':>8} {'emit p50/p95/max':>20}")
+    line = json.dumps(_sample_wifi_json())
+    for rate in rates:
+        events = []
+        fanout = SocketFanout(lambda event, data, room=None: events.append(event))
+        fanout.start()
+        ids = {}
+        sent = 0
+        start = time.monotonic()
+        while True:
+            now = time.monotonic()
+            if now - start >= seconds:
+                break
+            # Everything that arrived since the last read, as flock_reader sees it
+            due = int((now - start) * rate)
+            for n in range(sent, due):
+                fanout.line(line, now)
+                mac = n % macs
+                fanout.detection('updated' if mac in ids else 'new', {'id': mac + 1, 'detection_count': n}, now)
+                ids[mac] = True
+            sent = due
+            time.sleep(0.01)
+        time.sleep(fanout.interval * 3)
+        old_events = sent * 2  # serial_data plus new_detection/detection_updated
+        backlog = max(0, sent - int(seconds * 10))
+        lat = fanout.stats()['read_to_emit']
+        lat_text = f"{lat['p50_ms']:.0f}/{lat['p95_ms']:.0f}/{lat['max_ms']:.0f} ms" if lat else '-'
+        print(f"{rate:>8.0f} {old_events:>11} {backlog:>9} ln {len(events):>11} "
+              f"{fanout.batches:>8} {lat_text:>20}")
+
+
+_NAME_WORDS = ('Shenzhen', 'Cisco', 'Systems', 'Apple', 'Samsung', 'Electronics', 'Huawei', 'Technologies',
+               'Intel', 'Corporate', 'Texas', 'Instruments', 'Murata', 'Manufacturing', 'Espressif', 'Nokia',
+               'Hon', 'Hai', 'Precision', 'Juniper', 'Networks', 'Guangzhou', 'Smart', 'Home', 'Flock', 'Safety',
+               'Axis', 'Communications', 'Hikvision', 'Digital', 'Motorola', 'Solutions', 'Zhejiang', 'Dahua')
+_NAME_SUFFIXES = ('Inc.', 'Co., Ltd.', 'GmbH', 'LLC', 'Corporation', 'AB', 'S.A.', 'Limited')
+
+
+def _write_registries(directory, ma_l, ma_m, ma_s, rng):
+    """IEEE-format oui.txt, mam.txt and oui36.txt with random assignments"""
+    def company():
+        words = rng.sample(_NAME_WORDS, rng.randint(1, 3))
+        return f"{' '.join(words)} {rng.choice(_NAME_SUFFIXES)}"
+
+    names = [company() for _ in range(ma_l // 2)]  # Many companies hold several OUIs
+    ouis = rng.sample(range(1 << 24), ma_l + 2)
+    with open(os.path.join(directory, 'oui.txt'), 'w') as f:
+        f.write("OUI/MA-L\t\t\tOrganization\ncompany_id\t\t\tOrganization\n\t\t\t\tAddress\n\n")
+        for oui in ouis[:ma_l]:
+            name = rng.choice(names)
+            h = f"{oui:06X}"
+            f.write(f"{h[0:2]}-{h[2:4]}-{h[4:6]}   (hex)\t\t{name}\n{h}     (base 16)\t\t{name}\n"
+                    f"\t\t\t\t{rng.randint(1, 999)} Industrial Road\n\t\t\t\tShenzhen  Guangdong  518000\n"
+                    f"\t\t\t\tCN\n\n")
+    for path, parent, count, bits in (('mam.txt', ouis[-2], ma_m, 28), ('oui36.txt', ouis[-1], ma_s, 36)):
+        h = f"{parent:06X}"
+        step = 1 << (48 - bits)
+        blocks = rng.sample(range((1 << 24) // step), min(count, (1 << 24) // step))
+        with open(os.path.join(directory, path), 'w') as f:
+            for block in blocks:
+                name = company()
+                lo = block * step
+                f.write(f"{h[0:2]}-{h[2:4]}-{h[4:6]}   (hex)\t\t{name}\n"
+                        f"{lo:06X}-{lo + step - 1:06X}     (base 16)\t\t{name}\n\t\t\t\tTaipei  TW\n\n")
+    return ouis[:ma_l], names
+
+
+def _load_oui_legacy(path):
+    oui_database = {}
+    with open(path, 'r', encoding='utf-8', errors='ignore') as f:
+        for line in f:
+            line = line.strip()
+            if line and not line.startswith('#') and '(hex)' in line:
+                parts = line.split('(hex)')
+                if len(parts) == 2:
+                    mac_prefix = parts[0].strip().replace('-', '').replace(' ', '').upper()
+                    manufacturer = parts[1].strip()
+                    if mac_prefix and manufacturer and len(mac_prefix) == 6:
+                        oui_database[mac_prefix] = manufacturer
+    return oui_database
+
+
+def bench_oui(ma_l, ma_m, ma_s, lookups, searches):
+    rng = random.Random(1)
+    with tempfile.TemporaryDirectory() as tmp:
+        ouis, names = _write_registries(tmp, ma_l, ma_m, ma_s, rng)
+        cache = os.path.join(tmp, 'oui_index.bin')
+        size = sum(os.path.getsize(os.path.join(tmp, n)) for n in ('oui.txt', 'mam.txt', 'oui36.txt'))
+        print(f"Registries: {ma_l} MA-L, {ma_m} MA-M, {ma_s} MA-S ({size / 1e6:.1f} MB of text)\n")
+
+        start = time.perf_counter()
+        legacy = _load_oui_legacy(os.path.join(tmp, 'oui.txt'))
+        t_legacy = time.perf_counter() - start
+        start = time.perf_counter()
+        index, rebuilt = OuiIndex.load(tmp, cache)
+        t_compile = time.perf_counter() - start
+        assert rebuilt
+        start = time.perf_counter()
+        index, rebuilt = OuiIndex.load(tmp, cache)
+        t_mapped = time.perf_counter() - start
+        assert not rebuilt
+        print(f"{'load':<28} {'time':>10}")
+        print(f"{'old: parse oui.txt':<28} {t_legacy * 1000:>8.1f}ms")
+        print(f"{'new: compile + write cache':<28} {t_compile * 1000:>8.1f}ms  (first start, or after a refresh)")
+        print(f"{'new: map cache':<28} {t_mapped * 1000:>8.2f}ms  ({os.path.getsize(cache) / 1e6:.1f} MB)")
+
+        macs = [f"{rng.choice(ouis):06X}{rng.getrandbits(24):06X}" for _ in range(lookups)]
+        start = time.perf_counter()
+        for mac in macs:
+            legacy.get(mac[:6], "Unknown Manufacturer")
+        old_rate = lookups / (time.perf_counter() - start)
+        start = time.perf_counter()
+        for mac in macs:
+            index.lookup(mac)
+        new_rate = lookups / (time.perf_counter() - start)
+        print(f"\nMAC lookups/s: old {old_rate:,.0f} (24-bit only), new {new_rate:,.0f} (36/28/24-bit)")
+
+        queries = [' '.join(rng.choice(names).split()[:2]).lower() for _ in range(searches)]
+        start = time.perf_counter()
+        for q in queries:
+            results = []
+            for mac, manufacturer in legacy.items():
+                if q in manufacturer.lower():
+                    results.append(mac)
+                    if len(results) >= 100:
+                        break
+        old_ms = (time.perf_counter() - start) / searches * 1000
+        start = time.perf_counter()
+        index.search_name(queries[0])
+        t_tokens = time.perf_counter() - start
+        start = time.perf_counter()
+        for q in queries:
+            index.search_name(q)
+        new_ms = (time.perf_counter() - start) / searches * 1000
+        print(f"Name search: old {old_ms:.2f} ms/query (substring scan), new {new_ms:.2f} ms/query "
+              f"(token index, built on first search in {t_tokens * 1000:.0f} ms)")
+
+
+def _export_record(i, rng):
+    """Cumulative record with GPS along a drive through a city, over a month"""
+    t = datetime(2024, 5, 1) + timedelta(seconds=i * 26)
+    return {
+        'mac_address': f"58:8e:81:{(i >> 16) & 0xff:02x}:{(i >> 8) & 0xff:02x}:{i & 0xff:02x}",
+        'protocol': rng.choice(('wifi', 'wifi', 'bluetooth_le')), 'detection_method': 'probe_request',
+        'ssid': f"Flock-{i:06X}", 'device_name': '', 'manufacturer': 'Example Networks Inc.', 'alias': '',
+        'rssi': rng.randint(-95, -40), 'last_rssi': rng.randint(-95, -40), 'channel': rng.choice((1, 6, 11)),
+        'id': i, 'detection_count': rng.randint(1, 40), 'timestamp': t.isoformat(),
+        'detection_time': t.strftime('%Y-%m-%d %H:%M:%S'), 'server_timestamp': t.isoformat(),
+        'first_seen': t.isoformat(), 'last_seen': (t + timedelta(seconds=rng.randint(0, 600))).isoformat(),
+        'timestamp_source': 'gps',
+        'gps': {'latitude': 37.70 + rng.random() * 0.12, 'longitude': -122.50 + rng.random() * 0.14,
+                'altitude': 20.0, 'satellites': 9, 'fix_quality': 1, 'timestamp': t.isoformat(),
+                'time_diff': rng.random() * 3, 'match_quality': 'interpolated'},
+    }
+
+
+def _measure(produce):
+    """Seconds to the first rows (past the header), seconds in total, peak
+    traced bytes and output size. Timed without tracemalloc, which slows
+    allocation-heavy code several times over."""
+    start = time.perf_counter()
+    first = None
+    size = 0
+    for chunk in produce():
+        size += len(chunk)
+        if first is None and size > 1024:
+            first = time.perf_counter() - start
+    total = time.perf_counter() - start
+    tracemalloc.start()
+    for _ in produce():
+        pass
+    peak = tracemalloc.get_traced_memory()[1]
+    tracemalloc.stop()
+    return first or total, total, peak, size
+
+
+def _csv_legacy(records, directory):
+    # The old export_csv: write exports/<name>.csv, then send_file it
+    path = os.path.join(directory, 'export.csv')
+    with open(path, 'w', newline='', encoding='utf-8') as f:
+        for chunk in exports.csv_chunks(enumerate(records)):
+            f.write(chunk)
+    with open(path, 'rb') as f:
+        # send_file starts once the file is complete, then streams it
+        for block in iter(lambda: f.read(65536), b''):
+            yield block
+
+
+def _kml_legacy(records):
+    # The old export_kml: one string, concatenated placemark by placemark
+    kml = '<?xml version="1.0" encoding="UTF-8"?>\n<kml><Document>\n'
+    for i, detection in enumerate(records):
+        if detection.get('gps'):
+            kml += exports._kml_placemark(i, detection, detection['gps'])
+    kml += '</Document>\n</kml>'
+    yield kml
+
+
+def bench_export(count):
+    rng = random.Random(1)
+    records = [_export_record(i, rng) for i in range(count)]
+    print(f"{count} cumulative detections with GPS; peak is memory allocated during the export\n")
+    print(f"{'export':<34} {'first rows':>11} {'total':>9} {'peak mem':>10} {'size':>9}")
+    with tempfile.TemporaryDirectory() as tmp:
+        selected = lambda filters=None: exports.select(records, filters or {})
+        week = {'since': '2024-05-08T00:00:00', 'until': '2024-05-15T00:00:00'}
+        downtown = {'bbox': [-122.43, 37.76, -122.39, 37.80]}
+        cases = [
+            ('csv, old (file, then send_file)', lambda: _csv_legacy(records, tmp)),
+            ('csv, streamed', lambda: exports.csv_chunks(selected())),
+            ('kml, old (string)', lambda: _kml_legacy(records)),
+            ('kml, streamed', lambda: exports.kml_chunks(selected(), 'bench')),
+            ('geojson, streamed', lambda: exports.geojson_chunks(selected())),
+            ('geojson, cluster=100m', lambda: exports.geojson_chunks(selected(), 100)),
+            ('geojson, cluster=500m', lambda: exports.geojson_chunks(selected(), 500)),
+            ('csv, one week', lambda: exports.csv_chunks(selected(week))),
+            ('geojson, bbox', lambda: exports.geojson_chunks(selected(downtown))),
+        ]
+        for label, produce in cases:
+            first, total, peak, size = _measure(produce)
+            print(f"{label:<34} {first * 1000:>9.1f}ms {total:>8.2f}s {peak / 1e6:>8.1f}MB {size / 1e6:>7.1f}MB")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='command', required=True)
+    proto = sub.add_parser('protocol', help='compare JSON and binary serial encodings')
+    proto.add_argument('--iterations', type=int, default=20000)
+    store = sub.add_parser('store', help='cumulative detection store ingest and load')
+    store.add_argument('--sizes', type=int, nargs='+', default=[10000, 100000, 1000000])
+    store.add_argument('--detections', type=int, default=20000)
+    store.add_argument('--legacy-budget', type=float, default=5.0,
+                       help='seconds spent timing the old path per size')
+    gps = sub.add_parser('gps', help='GPS history matching rate and position error')
+    gps.add_argument('--rates', type=float, nargs='+', default=[1, 10])
+    gps.add_argument('--speed', type=float, default=30.0, help='vehicle speed in m/s')
+    gps.add_argument('--minutes', type=float, default=10.0)
+    gps.add_argument('--lookups', type=int, default=20000)
+    fan = sub.add_parser('fanout', help='batched Socket.IO fan-out of serial bursts')
+    fan.add_argument('--rates', type=float, nargs='+', default=[10, 100, 1000])
+    fan.add_argument('--seconds', type=float, default=3.0)
+    fan.add_argument('--macs', type=int, default=20)
+    oui = sub.add_parser('oui', help='OUI index load time, lookup and search')
+    oui.add_argument('--ma-l', type=int, default=38000)
+    oui.add_argument('--ma-m', type=int, default=5500)
+    oui.add_argument('--ma-s', type=int, default=6500)
+    oui.add_argument('--lookups', type=int, default=200000)
+    oui.add_argument('--searches', type=int, default=200)
+    export = sub.add_parser('export', help='streamed export first byte and peak memory')
+    export.add_argument('--detections', type=int, default=100000)
+    args = parser.parse_args()
+
+    if args.command == 'protocol':
+        bench_protocol(args.iterations)
+    elif args.command == 'store':
+        bench_store(args.sizes, args.detections, args.legacy_budget)
+    elif args.command == 'gps':
+        bench_gps(args.rates, args.speed, args.minutes, args.lookups)
+    elif args.command == 'fanout':
+        bench_fanout(args.rates, args.seconds, args.macs)
+    elif args.command == 'oui':
+        bench_oui(args.ma_l, args.ma_m, args.ma_s, args.lookups, args.searches)
+    elif args.command == 'export':
+        bench_export(args.detections)
+
+
+if __name__ == '__main__':
+    main()
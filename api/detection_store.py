@@ -0,0 +1,214 @@
+"""Cumulative detection store: MAC index, snapshot and append-only journal.
+
+Records live in one list, as before, with a dict from MAC address to the
+first record for that MAC, so a repeat hit is a dict lookup instead of a scan.
+Nothing is rewritten on each detection. A change only marks the record's
+position dirty, and a committer thread writes the dirty records to the
+journal once per COMMIT_INTERVAL (or sooner after COMMIT_BATCH changes).
+Each write is one JSON line per record, and the batch is flushed and fsynced
+together (group commit). Several hits on one MAC between commits cost one
+line.
+
+On disk:
+    cumulative_detections.pkl      snapshot, a pickled list (the old format)
+    cumulative_detections.journal  lines of [position, record]
+
+Loading reads the snapshot, then replays the journal on top of it. A
+position equal to the list length appends; a lower one replaces the record
+there, so replaying a line twice is harmless. When the journal has more lines
+than the snapshot has records (and at least COMPACT_MIN), the committer
+writes a new snapshot and empties the journal. A torn last line from a crash
+is skipped.
+"""
+import json
+import os
+import pickle
+import threading
+
+COMMIT_INTERVAL = 1.0  # Seconds a change may wait before it is on disk
+COMMIT_BATCH = 256  # Dirty records that trigger an early commit
+COMPACT_MIN = 10000  # Journal lines before a compaction is considered
+
+
+class DetectionStore:
+    def __init__(self, snapshot_path, journal_path, commit_interval=COMMIT_INTERVAL):
+        self.snapshot_path = snapshot_path
+        self.journal_path = journal_path
+        self.commit_interval = commit_interval
+        self.records = []
+        self._by_mac = {}
+        self._dirty = set()
+        self._lock = threading.RLock()
+        self._io_lock = threading.Lock()
+        self._wake = threading.Event()
+        self._stop = False
+        self._thread = None
+        self._journal = None
+        self.journal_lines = 0
+        self.commits = 0
+        self.compactions = 0
+
+    def __len__(self):
+        return len(self.records)
+
+    def load(self):
+        """Read the snapshot and replay the journal. Returns the record count."""
+        records = []
+        if os.path.exists(self.snapshot_path):
+            with open(self.snapshot_path, 'rb') as f:
+                records = pickle.load(f)
+        lines = 0
+        if os.path.exists(self.journal_path):
+            with open(self.journal_path, 'r', encoding='utf-8') as f:
+                for line in f:
+                    try:
+                        pos, rec = json.loads(line)
+                    except ValueError:
+                        continue  # Torn write at the end of the file
+                    if pos == len(records):
+                        records.append(rec)
+                    elif pos < len(records):
+                        records[pos] = rec
+                    lines += 1
+        with self._lock:
+            self.records = records
+            self._by_mac = {}
+            for pos, rec in enumerate(records):
+                mac = rec.get('mac_address')
+                if mac:
+                    self._by_mac.setdefault(mac, pos)
+            self._dirty.clear()
+            self.journal_lines = lines
+        return len(records)
+
+    def find(self, mac):
+        """First record for a MAC address, or None"""
+        pos = self._by_mac.get(mac)
+        return None if pos is None else self.records[pos]
+
+    def append(self, record):
+        """Add a record; returns it"""
+        with self._lock:
+            pos = len(self.records)
+            self.records.append(record)
+            mac = record.get('mac_address')
+            if mac:
+                self._by_mac.setdefault(mac, pos)
+            self._mark(pos)
+        return record
+
+    def update(self, mac, fields):
+        """Merge fields into the first record for mac. Returns False if there is none."""
+        with self._lock:
+            pos = self._by_mac.get(mac)
+            if pos is None:
+                return False
+            self.records[pos].update(fields)
+            self._mark(pos)
+        return True
+
+    def _mark(self, pos):
+        self._dirty.add(pos)
+        if len(self._dirty) >= COMMIT_BATCH:
+            self._wake.set()
+
+    def start(self):
+        """Start the committer thread"""
+        if self._thread is None:
+            self._thread = threading.Thread(target=self._run, name='detection-store', daemon=True)
+            self._thread.start()
+
+    def close(self):
+        """Stop the committer and write what is left"""
+        self._stop = True
+        self._wake.set()
+        if self._thread is not None:
+            self._thread.join()
+            self._thread = None
+        self.commit()
+        with self._io_lock:
+            if self._journal is not None:
+                self._journal.close()
+                self._journal = None
+
+    def _run(self):
+        while not self._stop:
+            self._wake.wait(self.commit_interval)
+            self._wake.clear()
+            try:
+                self.commit()
+            except OSError as e:
+                print(f"Error committing cumulative detections: {e}")
+
+    def commit(self):
+        """Write dirty records to the journal as one batch. Returns the line count."""
+        with self._io_lock:
+            with self._lock:
+                if not self._dirty:
+                    return 0
+                # Ascending order keeps appends in sequence on replay
+                positions = sorted(self._dirty)
+                lines = [json.dumps([pos, self.records[pos]], separators=(',', ':'), default=str)
+                         for pos in positions]
+                self._dirty.clear()
+            try:
+                if self._journal is None:
+                    self._journal = self._open_journal()
+                self._journal.write('\n'.join(lines) + '\n')
+                self._journal.flush()
+                os.fsync(self._journal.fileno())
+            except OSError:
+                # Try again with the next batch
+                with self._lock:
+                    self._dirty.update(positions)
+                raise
+            self.journal_lines += len(lines)
+            self.commits += 1
+            if self.journal_lines >= COMPACT_MIN and self.journal_lines > len(self.records):
+                self._compact()
+            return len(lines)
+
+    def _open_journal(self):
+        f = open(self.journal_path, 'a+', encoding='utf-8')
+        # Start on a fresh line after a torn write
+        if f.tell() > 0:
+            f.seek(f.tell() - 1)
+            if f.read(1) != '\n':
+                f.write('\n')
+        return f
+
+    def compact(self):
+        """Write a fresh snapshot and empty the journal"""
+        with self._io_lock:
+            self._compact()
+
+    def _compact(self):
+        with self._lock:
+            data = pickle.dumps(self.records, protocol=pickle.HIGHEST_PROTOCOL)
+            pending = bool(self._dirty)
+        # Changes made while the snapshot is written stay dirty and go to the
+        # new journal; any already in the old one are replayed idempotently
+        tmp = f"{self.snapshot_path}.tmp"
+        with open(tmp, 'wb') as f:
+            f.write(data)
+            f.flush()
+            os.fsync(f.fileno())
+        os.replace(tmp, self.snapshot_path)
+        if self._journal is not None:
+            self._journal.close()
+        self._journal = open(self.journal_path, 'w', encoding='utf-8')
+        self.journal_lines = 0
+        self.compactions += 1
+        if pending:
+            self._wake.set()
+
+    def stats(self):
+        return {
+            'records': len(self.records),
+            'macs': len(self._by_mac),
+            'pending': len(self._dirty),
+            'journal_lines': self.journal_lines,
+            'commits': self.commits,
+            'compactions': self.compactions,
+        }
+
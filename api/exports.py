@@ -0,0 +1,322 @@
+"""Streaming detection exports: CSV, KML and GeoJSON.
+
+Each format is a generator of text chunks, handed to Flask as a streamed
+response, so nothing is built in memory or written to disk first and the
+first rows go out while the rest are still being formatted. Records are read
+by position from the live list (appends during an export are not included;
+the cumulative store replaces records in place, never removes them).
+
+Filters, all optional (query parameters of the export routes):
+    since, until  ISO 8601 time or Unix seconds; a detection matches if it
+                  was seen at any point in the range (first_seen..last_seen).
+                  A time with an offset or Z is converted to server local time
+    bbox          min_lon,min_lat,max_lon,max_lat; only detections with GPS
+    protocol      comma-separated: wifi, bluetooth_le, bluetooth_classic,
+                  or ble for both Bluetooth protocols
+
+GeoJSON can cluster on the server (cluster=<metres>): detections are binned
+into a grid of that cell size and each cell with more than one becomes a
+single point at their centroid, with counts. Output is then bounded by the
+area covered rather than the number of detections. Clustering needs the
+whole pass before the first feature can be written.
+"""
+import csv
+import io
+import json
+import math
+from datetime import datetime
+from xml.sax.saxutils import escape
+
+EXPORT_CHUNK_ROWS = 500  # Rows formatted per yielded chunk
+CLUSTER_MAX_MACS = 10  # MAC addresses listed per cluster
+METRES_PER_DEGREE = 111320.0
+
+CSV_FIELDS = [
+    'timestamp', 'detection_time', 'server_timestamp', 'protocol', 'detection_method',
+    'ssid', 'device_name', 'mac_address', 'manufacturer', 'alias', 'rssi', 'last_rssi',
+    'signal_strength', 'channel', 'last_channel', 'detection_count',
+    'latitude', 'longitude', 'altitude', 'gps_timestamp', 'satellites', 'fix_quality', 'gps_time_diff', 'gps_match_quality', 'timestamp_source'
+]
+
+PROTOCOL_ALIASES = {'ble': ('bluetooth_le', 'bluetooth_classic')}
+
+
+def _parse_time(value):
+    """Naive local isoformat() string, the form detection timestamps are stored in"""
+    try:
+        number = float(value)
+    except ValueError:
+        if value.endswith(('Z', 'z')):
+            value = value[:-1] + '+00:00'  # fromisoformat() takes Z only from 3.11
+        parsed = datetime.fromisoformat(value)
+        if parsed.tzinfo is not None:
+            parsed = parsed.astimezone().replace(tzinfo=None)
+        return parsed.isoformat()
+    try:
+        return datetime.fromtimestamp(number).isoformat()
+    except (ValueError, OverflowError, OSError):
+        # inf, nan or an epoch outside what the platform can convert
+        raise ValueError(f'{value} is not a usable Unix time')
+
+
+def parse_filters(args):
+    """Filters from request arguments; raises ValueError on a malformed one"""
+    filters = {}
+    for key in ('since', 'until'):
+        if args.get(key):
+            filters[key] = _parse_time(args[key])
+    if args.get('bbox'):
+        bbox = [float(v) for v in args['bbox'].split(',')]
+        if len(bbox) != 4 or not all(map(math.isfinite, bbox)) or bbox[0] > bbox[2] or bbox[1] > bbox[3]:
+            raise ValueError('bbox must be min_lon,min_lat,max_lon,max_lat')
+        filters['bbox'] = bbox
+    if args.get('protocol'):
+        protocols = set()
+        for name in args['protocol'].split(','):
+            name = name.strip().lower()
+            protocols.update(PROTOCOL_ALIASES.get(name, (name,)))
+        filters['protocol'] = protocols
+    return filters
+
+
+def parse_cluster(args):
+    """GeoJSON cluster cell size in metres, or None; raises ValueError on a bad one"""
+    if not args.get('cluster'):
+        return None
+    cluster = float(args['cluster'])
+    if not (math.isfinite(cluster) and cluster > 0):
+        raise ValueError('cluster must be a distance in metres')
+    return cluster
+
+
+def _position(detection):
+    gps = detection.get('gps') or {}
+    lat, lon = gps.get('latitude'), gps.get('longitude')
+    if lat and lon:
+        return lat, lon
+    return None
+
+
+def select(records, filters):
+    """(position, detection) for the records that pass the filters"""
+    since, until = filters.get('since'), filters.get('until')
+    bbox = filters.get('bbox')
+    protocols = filters.get('protocol')
+    for i in range(len(records)):
+        if i >= len(records):
+            break  # The session was cleared meanwhile
+        detection = records[i]
+        if protocols and detection.get('protocol') not in protocols:
+            continue
+        if since or until:
+            # Timestamps are all local isoformat() strings, so they compare as text
+            first = detection.get('first_seen') or detection.get('server_timestamp')
+            last = detection.get('last_seen') or first
+            if not first or (since and last < since) or (until and first > until):
+                continue
+        if bbox:
+            pos = _position(detection)
+            if not pos or not (bbox[1] <= pos[0] <= bbox[3] and bbox[0] <= pos[1] <= bbox[2]):
+                continue
+        yield i, detection
+
+
+def csv_chunks(selected):
+    buf = io.StringIO()
+    writer = csv.DictWriter(buf, fieldnames=CSV_FIELDS)
+    writer.writeheader()
+    rows = 0
+    for _, detection in selected:
+        gps_data = detection.get('gps') or {}
+        writer.writerow({
+            'timestamp': detection.get('timestamp'),
+            'detection_time': detection.get('detection_time'),
+            'server_timestamp': detection.get('server_timestamp'),
+            'protocol': detection.get('protocol'),
+            'detection_method': detection.get('detection_method'),
+            'ssid': detection.get('ssid', ''),
+            'device_name': detection.get('device_name', ''),
+            'mac_address': detection.get('mac_address'),
+            'manufacturer': detection.get('manufacturer', 'Unknown'),
+            'alias': detection.get('alias', ''),
+            'rssi': detection.get('rssi'),
+            'last_rssi': detection.get('last_rssi'),
+            'signal_strength': detection.get('signal_strength'),
+            'channel': detection.get('channel'),
+            'last_channel': detection.get('last_channel'),
+            'detection_count': detection.get('detection_count', 1),
+            'latitude': gps_data.get('latitude'),
+            'longitude': gps_data.get('longitude'),
+            'altitude': gps_data.get('altitude'),
+            'gps_timestamp': gps_data.get('timestamp'),
+            'satellites': gps_data.get('satellites'),
+            'fix_quality': gps_data.get('fix_quality'),
+            'gps_time_diff': gps_data.get('time_diff'),
+            'gps_match_quality': gps_data.get('match_quality'),
+            'timestamp_source': detection.get('timestamp_source', 'unknown')
+        })
+        rows += 1
+        if rows % EXPORT_CHUNK_ROWS == 0:
+            yield buf.getvalue()
+            buf.seek(0)
+            buf.truncate()
+    yield buf.getvalue()
+
+
+def _kml_placemark(i, detection, gps):
+    # Use alias if available, otherwise use detection number
+    placemark_name = escape(detection.get('alias') or f"Detection {i+1}")
+
+    # GPS accuracy indicator
+    if gps.get('time_diff') is not None:
+        time_diff = gps.get('time_diff')
+        if time_diff < 5:
+            gps_accuracy = f" (✓ Precise: {time_diff:.1f}s)"
+        elif time_diff < 15:
+            gps_accuracy = f" (~ Good: {time_diff:.1f}s)"
+        else:
+            gps_accuracy = f" (⚠ Approximate: {time_diff:.1f}s)"
+    else:
+        gps_accuracy = " (? Unknown accuracy)"
+
+    # Build device info
+    device_info = ""
+    if detection.get('ssid'):
+        device_info += f"<b>SSID:</b> {detection.get('ssid')}<br/>"
+    if detection.get('device_name'):
+        device_info += f"<b>Device Name:</b> {detection.get('device_name')}<br/>"
+
+    rssi_info = detection.get('last_rssi') or detection.get('rssi', 'N/A')
+    channel_info = detection.get('last_channel') or detection.get('channel', 'N/A')
+
+    return f"""
+    <Placemark>
+        <name>{placemark_name}</name>
+        <description>
+            <![CDATA[
+            <b>Protocol:</b> {detection.get('protocol')}<br/>
+            <b>Detection Method:</b> {detection.get('detection_method')}<br/>
+            {device_info}
+            <b>MAC Address:</b> {detection.get('mac_address')}<br/>
+            <b>Manufacturer:</b> {detection.get('manufacturer', 'Unknown')}<br/>
+            <b>Alias:</b> {detection.get('alias', 'None')}<br/>
+            <b>RSSI:</b> {rssi_info} dBm<br/>
+            <b>Signal Strength:</b> {detection.get('signal_strength', 'N/A')}<br/>
+            <b>Channel:</b> {channel_info}<br/>
+            <b>Detection Count:</b> {detection.get('detection_count', 1)}<br/>
+            <b>Detection Time:</b> {detection.get('detection_time', 'N/A')}<br/>
+            <b>Server Timestamp:</b> {detection.get('server_timestamp', 'N/A')}<br/>
+            <hr/>
+            <b>GPS Coordinates:</b> {gps.get('latitude'):.6f}, {gps.get('longitude'):.6f}{gps_accuracy}<br/>
+            <b>GPS Altitude:</b> {gps.get('altitude', 'N/A')} m<br/>
+            <b>GPS Satellites:</b> {gps.get('satellites', 'N/A')}<br/>
+            <b>GPS Fix Quality:</b> {gps.get('fix_quality', 'N/A')}<br/>
+            <b>GPS Match Quality:</b> {gps.get('match_quality', 'N/A')}<br/>
+            <b>GPS Timestamp:</b> {gps.get('timestamp', 'N/A')}<br/>
+            <b>Timestamp Source:</b> {detection.get('timestamp_source', 'Unknown').upper()}
+            ]]>
+        </description>
+        <Point>
+            <coordinates>{gps.get('longitude')},{gps.get('latitude')},{gps.get('altitude', 0)}</coordinates>
+        </Point>
+    </Placemark>
+"""
+
+
+def kml_chunks(selected, document_name):
+    yield f"""<?xml version="1.0" encoding="UTF-8"?>
+<kml xmlns="http://www.opengis.net/kml/2.2">
+<Document>
+    <name>{escape(document_name)}</name>
+    <description>Surveillance device detections with GPS coordinates</description>
+"""
+    chunk = []
+    for i, detection in selected:
+        if _position(detection):
+            chunk.append(_kml_placemark(i, detection, detection['gps']))
+            if len(chunk) >= EXPORT_CHUNK_ROWS:
+                yield ''.join(chunk)
+                chunk = []
+    yield ''.join(chunk) + """
+</Document>
+</kml>"""
+
+
+def _feature(detection, lat, lon):
+    gps = detection['gps']
+    return {
+        'type': 'Feature',
+        'geometry': {'type': 'Point', 'coordinates': [lon, lat]},
+        'properties': {
+            'mac_address': detection.get('mac_address'),
+            'alias': detection.get('alias', ''),
+            'protocol': detection.get('protocol'),
+            'detection_method': detection.get('detection_method'),
+            'manufacturer': detection.get('manufacturer'),
+            'rssi': detection.get('last_rssi') or detection.get('rssi'),
+            'detection_count': detection.get('detection_count', 1),
+            'first_seen': detection.get('first_seen'),
+            'last_seen': detection.get('last_seen'),
+            'gps_match_quality': gps.get('match_quality'),
+        },
+    }
+
+
+def _clusters(selected, metres):
+    """Grid cells of about metres on a side: {cell: [first, n, lat_sum, lon_sum, ...]}"""
+    cell_lat = metres / METRES_PER_DEGREE
+    cells = {}
+    for _, detection in selected:
+        pos = _position(detection)
+        if not pos:
+            continue
+        lat, lon = pos
+        row = math.floor(lat / cell_lat)
+        # Narrower cells in longitude away from the equator keep them square
+        cell_lon = cell_lat / max(math.cos(math.radians((row + 0.5) * cell_lat)), 0.01)
+        key = (row, math.floor(lon / cell_lon))
+        cell = cells.get(key)
+        if cell is None:
+            cells[key] = [detection, 1, lat, lon, detection.get('detection_count', 1),
+                          {detection.get('protocol')}, [detection.get('mac_address')]]
+            continue
+        cell[1] += 1
+        cell[2] += lat
+        cell[3] += lon
+        cell[4] += detection.get('detection_count', 1)
+        cell[5].add(detection.get('protocol'))
+        if len(cell[6]) < CLUSTER_MAX_MACS:
+            cell[6].append(detection.get('mac_address'))
+    return cells
+
+
+def geojson_chunks(selected, cluster_metres=None):
+    yield '{"type":"FeatureCollection","features":['
+    if cluster_metres:
+        features = []
+        for first, n, lat_sum, lon_sum, hits, protocols, macs in _clusters(selected, cluster_metres).values():
+            if n == 1:
+                features.append(_feature(first, lat_sum, lon_sum))
+                continue
+            features.append({
+                'type': 'Feature',
+                'geometry': {'type': 'Point', 'coordinates': [round(lon_sum / n, 7), round(lat_sum / n, 7)]},
+                'properties': {
+                    'cluster': True,
+                    'point_count': n,
+                    'detection_count': hits,
+                    'protocols': sorted(p for p in protocols if p),
+                    'mac_addresses': macs,
+                },
+            })
+    else:
+        features = (_feature(d, *_position(d)) for _, d in selected if _position(d))
+    chunk = []
+    first = True
+    for feature in features:
+        chunk.append(('' if first else ',') + json.dumps(feature))
+        first = False
+        if len(chunk) >= EXPORT_CHUNK_ROWS:
+            yield ''.join(chunk)
+            chunk = []
+    yield ''.join(chunk) + ']}'
@@ -0,0 +1,343 @@
+"""Decoder for the Flock You serial stream.
+
+The firmware writes either newline-terminated JSON/text lines or, in binary
+mode, COBS-encoded detection records wrapped in 0x00 delimiters (see
+src/serial_protocol.h). Text never contains 0x00, so StreamDecoder can take
+raw bytes from the port and hand back both kinds in arrival order. Binary
+records are expanded into the same dict layout as the JSON detections so the
+rest of the dashboard does not care which mode the device is in.
+
+Detections that went through the device's journal arrive as MSG_JOURNAL
+frames and decode with two extra keys: 'seq' (the journal sequence number, as
+in the JSON lines) and 'replayed' (True when read back from flash after a
+"replay" command rather than sent live).
+"""
+import binascii
+import struct
+
+PROTOCOL_VERSION = 1
+MSG_DETECTION = 1
+MSG_JOURNAL = 2
+MSG_STATS = 3
+
+JOURNAL_REPLAYED = 0x01
+
+# Packed wire_journal_t up to (not including) the detection record
+JOURNAL_HEADER = struct.Struct('<BBIB')
+
+# Packed little-endian wire_detection_t up to (not including) name[]
+DETECTION_HEADER = struct.Struct('<BBI6sbBBBBBBBIIIbbbHB')
+
+# Packed wire_stats_t (src/instrumentation.h): header, then stage_count
+# stage records, counter_count counters and WiFi frames for channels 1-14
+STATS_HEADER = struct.Struct('<BBIHBB')
+STATS_STAGE = struct.Struct('<IIIBB')
+STATS_STAGES = ['capture_wifi', 'parse', 'capture_ble', 'match', 'format', 'emit', 'notify']
+STATS_COUNTERS = ['ble_adverts', 'notify_calls', 'notify_congested',
+                  'serial_writes', 'serial_bytes', 'serial_blocked']
+STATS_WIFI_CHANNELS = 14
+STATS_HIST_SHIFT = 8
+
+MAX_FRAME = 256
+
+METHODS = {
+    1: ('wifi', 'probe_request'),
+    2: ('wifi', 'probe_request_mac'),
+    3: ('wifi', 'beacon'),
+    4: ('wifi', 'beacon_mac'),
+    5: ('bluetooth_le', 'mac_prefix'),
+    6: ('bluetooth_le', 'device_name'),
+    7: ('bluetooth_le', 'raven_service_uuid'),
+    8: ('wifi', 'probe_response'),
+    9: ('wifi', 'probe_response_mac'),
+}
+
+FAMILIES = ['Flock Safety', 'Penguin', 'Pigvision', 'Raven (Gunshot Detector)']
+
+REPORT_REASONS = ['none', 'first_seen', 'rssi_change', 'summary']
+
+MATCH_SSID = 0x01
+MATCH_MAC = 0x02
+MATCH_NAME = 0x04
+MATCH_KNOWN = 0x10  # full MAC is in the firmware's known-device filter
+
+# Same order as raven_service_uuids[] in src/main.cpp (bit i = entry i); a
+# signature pack with its own Raven list changes the order
+RAVEN_SERVICES = [
+    (0x180a, 'Device Information (Serial, Model, Firmware)'),
+    (0x3100, 'GPS Location Service (Lat/Lon/Alt)'),
+    (0x3200, 'Power Management (Battery/Solar)'),
+    (0x3300, 'Network Status (LTE/WiFi)'),
+    (0x3400, 'Upload Statistics Service'),
+    (0x3500, 'Error/Failure Tracking Service'),
+    (0x1809, 'Health/Temperature Service (Legacy)'),
+    (0x1819, 'Location Service (Legacy)'),
+]
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, as computed by wire_crc16() on the device"""
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def cobs_decode(data):
+    """Decode one COBS block (without delimiters). Raises ValueError if malformed."""
+    out = bytearray()
+    i = 0
+    n = len(data)
+    while i < n:
+        code = data[i]
+        if code == 0 or i + code > n:
+            raise ValueError('bad COBS code')
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < n:
+            out.append(0)
+    return bytes(out)
+
+
+def cobs_encode(data):
+    """Encode a block with COBS (used by tests and the throughput benchmark)"""
+    out = bytearray([0])
+    code_pos = 0
+    code = 1
+    for b in data:
+        if b == 0:
+            out[code_pos] = code
+            code_pos = len(out)
+            out.append(0)
+            code = 1
+        else:
+            out.append(b)
+            code += 1
+            if code == 0xFF:
+                out[code_pos] = code
+                code_pos = len(out)
+                out.append(0)
+                code = 1
+    out[code_pos] = code
+    return bytes(out)
+
+
+def encode_frame(payload):
+    """Delimited frame for a payload, mirroring wire_frame() on the device"""
+    crc = crc16(payload)
+    return b'\x00' + cobs_encode(payload + bytes((crc & 0xFF, crc >> 8))) + b'\x00'
+
+
+def _signal_strength(rssi):
+    return 'STRONG' if rssi > -50 else ('MEDIUM' if rssi > -70 else 'WEAK')
+
+
+def _estimate_raven_firmware(mask):
+    has_new_gps = bool(mask & (1 << 1))
+    has_power = bool(mask & (1 << 2))
+    has_old_location = bool(mask & (1 << 7))
+    if has_old_location and not has_new_gps:
+        return '1.1.x (Legacy)'
+    if has_new_gps and not has_power:
+        return '1.2.x'
+    if has_new_gps and has_power:
+        return '1.3.x (Latest)'
+    return 'Unknown Version'
+
+
+def decode_detection(payload):
+    """Expand a binary detection record into the JSON detection layout"""
+    if len(payload) < DETECTION_HEADER.size:
+        raise ValueError('short detection record')
+    (version, msg_type, timestamp, mac, rssi, channel, method, family, match_flags,
+     report, pattern_id, raven_mask, hits, first_seen, last_seen, rssi_min, rssi_max,
+     rssi_avg, channels, name_len) = DETECTION_HEADER.unpack_from(payload)
+    if len(payload) != DETECTION_HEADER.size + name_len:
+        raise ValueError('detection record length mismatch')
+    name = payload[DETECTION_HEADER.size:].decode('utf-8', errors='replace')
+    protocol, detection_method = METHODS.get(method, ('unknown', 'unknown'))
+
+    mac_address = ':'.join(f'{b:02x}' for b in mac)
+    mac_prefix = mac_address[:8]
+    ssid_or_name_match = bool(match_flags & (MATCH_SSID | MATCH_NAME))
+    mac_match = bool(match_flags & (MATCH_MAC | MATCH_KNOWN))
+
+    data = {
+        'timestamp': timestamp,
+        'detection_time': f'{timestamp // 1000}.{timestamp % 1000:03d}s',
+        'protocol': protocol,
+        'detection_method': detection_method,
+        'alert_level': 'HIGH',
+        'device_category': 'FLOCK_SAFETY',
+        'mac_address': mac_address,
+        'mac_prefix': mac_prefix,
+        'vendor_oui': mac_prefix,
+        'rssi': rssi,
+        'signal_strength': _signal_strength(rssi),
+        'device_type': FAMILIES[family] if family < len(FAMILIES) else 'Unknown',
+        'threat_score': 100 if ssid_or_name_match and mac_match else (85 if ssid_or_name_match or mac_match else 70),
+        'report_reason': REPORT_REASONS[report] if report < len(REPORT_REASONS) else 'none',
+        'hit_count': hits,
+        'first_seen_ms': first_seen,
+        'last_seen_ms': last_seen,
+        'rssi_min': rssi_min,
+        'rssi_max': rssi_max,
+        'rssi_avg': rssi_avg,
+        'encoding': 'binary',
+    }
+    if pattern_id != 0xFF:
+        data['matched_pattern_id'] = pattern_id
+    if match_flags & MATCH_MAC:
+        data['matched_mac_pattern'] = mac_prefix
+    if match_flags & MATCH_KNOWN:
+        data['known_device'] = True
+    if channels:
+        data['channels_seen'] = [ch for ch in range(1, 16) if channels & (1 << ch)]
+
+    if protocol == 'wifi':
+        data['ssid'] = name
+        data['ssid_length'] = name_len
+        data['channel'] = channel
+        if detection_method.startswith('probe_request'):
+            data['frame_type'] = 'PROBE_REQUEST'
+        elif detection_method.startswith('probe_response'):
+            data['frame_type'] = 'PROBE_RESPONSE'
+        else:
+            data['frame_type'] = 'BEACON'
+        data['detection_criteria'] = ('SSID_AND_MAC' if ssid_or_name_match and mac_match
+                                      else ('SSID_ONLY' if ssid_or_name_match else 'MAC_ONLY'))
+    else:
+        data['device_name'] = name
+        data['device_name_length'] = name_len
+        data['has_device_name'] = name_len > 0
+        data['detection_criteria'] = ('NAME_AND_MAC' if ssid_or_name_match and mac_match
+                                      else ('NAME_ONLY' if ssid_or_name_match else 'MAC_ONLY'))
+
+    if raven_mask:
+        services = [(uuid, desc) for bit, (uuid, desc) in enumerate(RAVEN_SERVICES) if raven_mask & (1 << bit)]
+        data['device_type'] = 'RAVEN_GUNSHOT_DETECTOR'
+        data['manufacturer'] = 'SoundThinking/ShotSpotter'
+        data['raven_service_uuid'] = f'0000{services[0][0]:04x}-0000-1000-8000-00805f9b34fb'
+        data['raven_service_description'] = services[0][1]
+        data['raven_firmware_version'] = _estimate_raven_firmware(raven_mask)
+        data['service_uuids'] = [f'0000{uuid:04x}-0000-1000-8000-00805f9b34fb' for uuid, _ in services]
+        data['threat_level'] = 'CRITICAL'
+        data['threat_score'] = 100
+    return data
+
+
+def decode_stats(payload):
+    """Expand a compact stats record into the layout of the JSON stats line
+    (without the histograms)"""
+    if len(payload) < STATS_HEADER.size:
+        raise ValueError('short stats record')
+    _, _, timestamp, mhz, stage_count, counter_count = STATS_HEADER.unpack_from(payload)
+    expected = (STATS_HEADER.size + stage_count * STATS_STAGE.size +
+                (counter_count + STATS_WIFI_CHANNELS) * 4)
+    if len(payload) != expected:
+        raise ValueError('stats record length mismatch')
+
+    def us(cycles):
+        return round(cycles / mhz, 3) if mhz else 0
+
+    stages = {}
+    offset = STATS_HEADER.size
+    for i in range(stage_count):
+        count, mean, peak, p50, p99 = STATS_STAGE.unpack_from(payload, offset)
+        offset += STATS_STAGE.size
+        name = STATS_STAGES[i] if i < len(STATS_STAGES) else f'stage_{i}'
+        stages[name] = {
+            'count': count,
+            'mean_us': us(mean),
+            'p50_us': us(min(1 << (STATS_HIST_SHIFT + p50), peak)),
+            'p99_us': us(min(1 << (STATS_HIST_SHIFT + p99), peak)),
+            'max_us': us(peak),
+        }
+    counters = struct.unpack_from(f'<{counter_count}I', payload, offset)
+    offset += counter_count * 4
+    wifi_frames = list(struct.unpack_from(f'<{STATS_WIFI_CHANNELS}I', payload, offset))
+    named = dict(zip(STATS_COUNTERS, counters))
+    return {
+        'event': 'stats',
+        'timestamp': timestamp,
+        'cpu_mhz': mhz,
+        'stages': stages,
+        'wifi_frames': wifi_frames,
+        'ble_adverts': named.get('ble_adverts', 0),
+        'notify': {'calls': named.get('notify_calls', 0), 'congested': named.get('notify_congested', 0)},
+        'serial': {'writes': named.get('serial_writes', 0), 'bytes': named.get('serial_bytes', 0),
+                   'blocked': named.get('serial_blocked', 0)},
+        'encoding': 'binary',
+    }
+
+
+def decode_frame(body):
+    """Decode one frame body (COBS data between delimiters) into a dict"""
+    raw = cobs_decode(body)
+    if len(raw) < 4:
+        raise ValueError('short frame')
+    payload, crc = raw[:-2], raw[-2] | (raw[-1] << 8)
+    if crc16(payload) != crc:
+        raise ValueError('CRC mismatch')
+    if payload[0] != PROTOCOL_VERSION:
+        raise ValueError(f'unsupported protocol version {payload[0]}')
+    if payload[1] == MSG_DETECTION:
+        return decode_detection(payload)
+    if payload[1] == MSG_JOURNAL:
+        if len(payload) < JOURNAL_HEADER.size:
+            raise ValueError('short journal record')
+        _, _, seq, flags = JOURNAL_HEADER.unpack_from(payload)
+        data = decode_detection(payload[JOURNAL_HEADER.size:])
+        data['seq'] = seq
+        data['replayed'] = bool(flags & JOURNAL_REPLAYED)
+        return data
+    if payload[1] == MSG_STATS:
+        return decode_stats(payload)
+    raise ValueError(f'unknown message type {payload[1]}')
+
+
+class StreamDecoder:
+    """Incremental decoder for a mixed text/binary serial stream.
+
+    feed() takes whatever bytes the port returned and yields ('line', str) for
+    each complete text line and ('frame', dict) for each valid binary record.
+    """
+
+    def __init__(self):
+        self._buf = bytearray()
+        self._in_frame = False
+        self.frames = 0
+        self.lines = 0
+        self.errors = 0
+
+    def feed(self, data):
+        for b in data:
+            if self._in_frame:
+                if b != 0:
+                    if len(self._buf) < MAX_FRAME:
+                        self._buf.append(b)
+                    continue
+                if not self._buf:
+                    # Back-to-back delimiters: still waiting for a frame body
+                    continue
+                try:
+                    record = decode_frame(bytes(self._buf))
+                except ValueError:
+                    # Probably joined mid-frame and took a closing delimiter for
+                    # an opening one; this 0x00 opens the next frame
+                    self.errors += 1
+                    self._buf.clear()
+                    continue
+                self._buf.clear()
+                self._in_frame = False
+                self.frames += 1
+                yield 'frame', record
+            elif b == 0:
+                # Partial text before a frame is line noise
+                self._buf.clear()
+                self._in_frame = True
+            elif b == 0x0A:
+                line = self._buf.decode('utf-8', errors='ignore').strip()
+                self._buf.clear()
+                if line:
+                    self.lines += 1
+                    yield 'line', line
+            elif len(self._buf) < 4096:
+                self._buf.append(b)
@@ -1,6 +1,6 @@
-from flask import Flask, render_template, request, jsonify, send_file
+from flask import Flask, Response, render_template, request, jsonify
 import json
-import csv
+import logging
 import os
 from datetime import datetime
 import time
@@ -10,28 +10,39 @@ import serial
 import serial.tools.list_ports
 import queue
 import uuid
-import pickle
+from collections import OrderedDict, deque
 from pathlib import Path
+from flock_protocol import StreamDecoder
+from detection_store import DetectionStore
+from gps_track import GPS_INTERPOLATE_MAX_GAP, GpsTrack
+from socket_fanout import SERIAL_ROOM, SocketFanout
+from oui_index import OUI_WIDTHS, OuiIndex, parse_registry
+import exports
 
 app = Flask(__name__)
+# Per-detection traces; the serial reader thread must not block on console output
+log = logging.getLogger('flockyou')
 app.config['SECRET_KEY'] = os.environ.get('SECRET_KEY', 'flockyou_dev_key_2024')
 socketio = SocketIO(app, cors_allowed_origins="*", async_mode='threading', logger=True, engineio_logger=True)
 
 # Global variables
 detections = []
-cumulative_detections = []
+detections_by_mac = {}  # Session detection for each MAC address
+cumulative_detections = []  # cumulative_store.records once loaded
 session_start_time = datetime.now()
 gps_data = None
-gps_history = []  # Buffer of recent GPS readings for temporal matching
-MAX_GPS_HISTORY = 100  # Keep last 100 GPS readings
-GPS_MATCH_THRESHOLD = 30  # Max seconds between detection and GPS reading
+gps_track = GpsTrack()  # Recent GPS fixes for temporal matching (see gps_track.py)
+# Detections placed before the fix after them arrived: id -> (time, detection).
+# The GPS reader re-resolves them against each new fix.
+gps_pending = OrderedDict()
+gps_pending_lock = threading.Lock()
 serial_connection = None
 gps_enabled = False
 flock_device_connected = False
 flock_device_port = None
 flock_serial_connection = None
-oui_database = {}
-serial_data_buffer = []
+oui_index = OuiIndex()  # Compiled IEEE registries (see oui_index.py)
+serial_data_buffer = deque(maxlen=1000)  # Recent terminal lines
 reconnect_attempts = {'flock': 0, 'gps': 0}
 max_reconnect_attempts = 5
 reconnect_delay = 3  # seconds
@@ -40,35 +51,47 @@ serial_queue = queue.Queue()
 next_detection_id = 1  # Unique ID counter
 settings = {'gps_port': '', 'flock_port': '', 'filter': 'all'}
 
+# Device journal: detections carry a sequence number; the device resends
+# everything after the last one we acknowledged when asked to "replay"
+JOURNAL_ACK_INTERVAL = 5  # Seconds between "ack" commands
+JOURNAL_SEEN_MAX = 4096  # Recent sequence numbers kept for de-duplication
+journal_seen_seqs = set()
+journal_seen_order = deque()
+journal_max_seq = 0
+
 # Data storage paths
 DATA_DIR = Path('data')
 CUMULATIVE_DATA_FILE = DATA_DIR / 'cumulative_detections.pkl'
+CUMULATIVE_JOURNAL_FILE = DATA_DIR / 'cumulative_detections.journal'
 SETTINGS_FILE = DATA_DIR / 'settings.json'
+OUI_CACHE_FILE = DATA_DIR / 'oui_index.bin'
+OUI_PAGE_SIZE = 1000  # Default /api/oui/all page
 
 # Ensure data directory exists
 DATA_DIR.mkdir(exist_ok=True)
 
+# Cumulative detections: snapshot plus append-only journal, committed in
+# batches by the store's own thread (see detection_store.py)
+cumulative_store = DetectionStore(CUMULATIVE_DATA_FILE, CUMULATIVE_JOURNAL_FILE)
+
 # Persistent storage functions
 def load_cumulative_detections():
-    """Load cumulative detections from disk"""
+    """Load cumulative detections from disk and start the committer"""
     global cumulative_detections
     try:
-        if CUMULATIVE_DATA_FILE.exists():
-            with open(CUMULATIVE_DATA_FILE, 'rb') as f:
-                cumulative_detections = pickle.load(f)
-            print(f"Loaded {len(cumulative_detections)} cumulative detections")
-        else:
-            cumulative_detections = []
+        start = time.perf_counter()
+        count = cumulative_store.load()
+        print(f"Loaded {count} cumulative detections in {time.perf_counter() - start:.3f}s "
+              f"({cumulative_store.journal_lines} journal entries)")
     except Exception as e:
         print(f"Error loading cumulative detections: {e}")
-        cumulative_detections = []
+    cumulative_detections = cumulative_store.records
+    cumulative_store.start()
 
 def save_cumulative_detections():
-    """Save cumulative detections to disk"""
+    """Write pending cumulative changes and stop the committer"""
     try:
-        with open(CUMULATIVE_DATA_FILE, 'wb') as f:
-            pickle.dump(cumulative_detections, f)
-        print(f"Saved {len(cumulative_detections)} cumulative detections")
+        cumulative_store.close()
     except Exception as e:
         print(f"Error saving cumulative detections: {e}")
 
@@ -94,21 +117,14 @@ def save_settings():
 
 # Load OUI database
 def load_oui_database():
-    """Load the IEEE OUI database for manufacturer lookups"""
-    global oui_database
+    """Map the compiled OUI index, rebuilding it if the IEEE files changed"""
+    global oui_index
     try:
-        with open('oui.txt', 'r', encoding='utf-8', errors='ignore') as f:
-            for line in f:
-                line = line.strip()
-                if line and not line.startswith('#') and '(hex)' in line:
-                    # Parse OUI line format: "28-6F-B9   (hex)                Nokia Shanghai Bell Co., Ltd."
-                    parts = line.split('(hex)')
-                    if len(parts) == 2:
-                        mac_prefix = parts[0].strip().replace('-', '').replace(' ', '').upper()
-                        manufacturer = parts[1].strip()
-                        if mac_prefix and manufacturer and len(mac_prefix) == 6:
-                            oui_database[mac_prefix] = manufacturer
-        print(f"Loaded {len(oui_database)} OUI entries")
+        start = time.perf_counter()
+        oui_index, rebuilt = OuiIndex.load('.', str(OUI_CACHE_FILE))
+        counts = ', '.join(f"{k.upper().replace('_', '-')} {v}" for k, v in oui_index.counts().items())
+        print(f"Loaded {len(oui_index)} OUI entries ({counts}) in {time.perf_counter() - start:.3f}s"
+              f"{' (cache rebuilt)' if rebuilt else ''}")
     except Exception as e:
         print(f"Error loading OUI database: {e}")
 
@@ -116,13 +132,7 @@ def lookup_manufacturer(mac_address):
     """Look up manufacturer information for a MAC address"""
     if not mac_address:
         return None
-    
-    # Extract first 6 characters (3 bytes) of MAC address
-    mac_clean = mac_address.replace(':', '').replace('-', '').upper()
-    if len(mac_clean) >= 6:
-        oui = mac_clean[:6]
-        return oui_database.get(oui, "Unknown Manufacturer")
-    return "Unknown Manufacturer"
+    return oui_index.lookup(mac_address) or "Unknown Manufacturer"
 
 # GPS Dongle Configuration
 GPS_BAUDRATE = 9600
@@ -205,6 +215,9 @@ def safe_socket_emit(event, data, room=None):
     except Exception as e:
         print(f"Socket emit error for {event}: {e}")
 
+# Serial lines and detection changes go out in batches (see socket_fanout.py)
+fanout = SocketFanout(safe_socket_emit)
+
 def gps_reader():
     """Background thread for reading GPS data"""
     global gps_data, serial_connection, gps_enabled
@@ -212,10 +225,14 @@ def gps_reader():
     while gps_enabled:
         if serial_connection and serial_connection.is_open:
             try:
+                # Blocks (up to the port timeout) for the next line, so lines
+                # are taken as fast as a 10 Hz receiver sends them and each
+                # fix is stamped when it was read
                 line = serial_connection.readline().decode('utf-8', errors='ignore')
+                read_time = time.time()
                 if line:
                     # Send raw GPS data to serial terminal
-                    safe_socket_emit('serial_data', f"GPS: {line.strip()}", room='serial_terminal')
+                    fanout.line(f"GPS: {line.strip()}")
                     
                     parsed = parse_nmea_sentence(line)
                     if parsed:
@@ -223,60 +240,101 @@ def gps_reader():
                         
                         # Add to GPS history with timestamp for temporal matching
                         if parsed.get('fix_quality') > 0:
-                            gps_entry = parsed.copy()
-                            gps_entry['system_timestamp'] = time.time()
-                            gps_history.append(gps_entry)
-                            
-                            # Keep only recent GPS readings
-                            if len(gps_history) > MAX_GPS_HISTORY:
-                                gps_history.pop(0)
+                            gps_track.add(parsed, read_time)
+                            resolve_pending_gps(read_time)
                         
                         safe_socket_emit('gps_update', parsed)
                         
                         # Also send parsed GPS data to terminal
                         if parsed.get('fix_quality') > 0:
                             gps_info = f"GPS Fix: {parsed.get('latitude', 'N/A')}, {parsed.get('longitude', 'N/A')} - {parsed.get('satellites', 0)} satellites"
-                            safe_socket_emit('serial_data', gps_info, room='serial_terminal')
+                            fanout.line(gps_info)
             except Exception as e:
                 print(f"GPS read error: {e}")
                 with connection_lock:
                     gps_enabled = False
                 safe_socket_emit('gps_disconnected', {})
                 break
+            continue
         time.sleep(0.1)
 
+def send_flock_command(command):
+    """Write one newline-terminated command to the Flock device"""
+    try:
+        if flock_serial_connection and flock_serial_connection.is_open:
+            flock_serial_connection.write(f"{command}\n".encode())
+            return True
+    except Exception as e:
+        print(f"Flock device write error: {e}")
+    return False
+
+def journal_is_duplicate(seq):
+    """Record a journal sequence number; True if it was already seen (a replay overlap)"""
+    global journal_max_seq
+    if seq in journal_seen_seqs:
+        return True
+    journal_seen_seqs.add(seq)
+    journal_seen_order.append(seq)
+    if len(journal_seen_order) > JOURNAL_SEEN_MAX:
+        journal_seen_seqs.discard(journal_seen_order.popleft())
+    journal_max_seq = max(journal_max_seq, seq)
+    return False
+
 def flock_reader():
-    """Background thread for reading Flock device data"""
-    global flock_serial_connection, flock_device_connected, serial_data_buffer
-    
+    """Background thread for reading Flock device data (JSON lines or binary frames)"""
+    global flock_serial_connection, flock_device_connected
+    
+    decoder = StreamDecoder()
+    # Catch up on detections made while disconnected. Acks wait until the
+    # replay is done so an interrupted replay can resume where it left off.
+    replay_pending = send_flock_command('replay')
+    acked_seq = 0
+    last_ack = time.time()
     with app.app_context():
         while flock_device_connected:
             if flock_serial_connection and flock_serial_connection.is_open:
                 try:
-                    line = flock_serial_connection.readline().decode('utf-8', errors='ignore')
-                    if line:
-                        line = line.strip()
-                        if line:
-                            # Store in buffer for terminal
-                            serial_data_buffer.append(line)
-                            if len(serial_data_buffer) > 1000:  # Keep last 1000 lines
-                                serial_data_buffer.pop(0)
-                            
-                            # Forward to all serial terminal clients
-                            safe_socket_emit('serial_data', line, room='serial_terminal')
-                            print(f"Serial data sent to terminal: {line}")
-                            
-                            # Try to parse as detection data
-                            try:
-                                data = json.loads(line)
-                                if 'detection_method' in data:
-                                    # This is a detection, add it
-                                    add_detection_from_serial(data)
-                                else:
-                                    print(f"JSON data without detection_method: {data}")
-                            except json.JSONDecodeError:
-                                # Not JSON, just log it
-                                print(f"Flock device (non-JSON): {line}")
+                    # Everything waiting, or block (up to the port timeout) for the next byte
+                    chunk = flock_serial_connection.read(flock_serial_connection.in_waiting or 1)
+                    received = time.monotonic()
+                    for kind, item in decoder.feed(chunk):
+                        if kind == 'frame':
+                            # Binary detection, already expanded to the JSON layout
+                            line = json.dumps(item)
+                        else:
+                            line = item
+                        
+                        # Store in buffer for terminal and queue for its clients
+                        serial_data_buffer.append(line)
+                        fanout.line(line, received)
+                        
+                        if kind == 'frame':
+                            if 'detection_method' not in item:
+                                continue
+                            if 'seq' not in item or not journal_is_duplicate(item['seq']):
+                                add_detection_from_serial(item, received)
+                            continue
+                        
+                        # Try to parse as detection data
+                        try:
+                            data = json.loads(line)
+                            if 'detection_method' in data:
+                                # This is a detection, add it
+                                if 'seq' not in data or not journal_is_duplicate(data['seq']):
+                                    add_detection_from_serial(data, received)
+                            elif data.get('event') == 'journal_replay' and data.get('consumer') == 'serial':
+                                replay_pending = False
+                            else:
+                                print(f"JSON data without detection_method: {data}")
+                        except json.JSONDecodeError:
+                            # Not JSON, just log it
+                            print(f"Flock device (non-JSON): {line}")
+                    if (not replay_pending and journal_max_seq > acked_seq and
+                            time.time() - last_ack >= JOURNAL_ACK_INTERVAL):
+                        if send_flock_command(f"ack {journal_max_seq}"):
+                            acked_seq = journal_max_seq
+                        last_ack = time.time()
+                    continue
                                 
                 except Exception as e:
                     print(f"Flock device read error: {e}")
@@ -288,41 +346,65 @@ def flock_reader():
                     break
             time.sleep(0.1)
 
-def find_best_gps_match(detection_timestamp):
-    """Find the GPS reading closest in time to the detection timestamp"""
-    global gps_history
-    
-    if not gps_history:
-        return None
-    
-    try:
-        # Convert detection timestamp to epoch time
-        if isinstance(detection_timestamp, str):
-            # Try parsing ISO format first
-            try:
-                dt = datetime.fromisoformat(detection_timestamp.replace('Z', '+00:00'))
-            except:
-                # Try parsing the display format
-                dt = datetime.strptime(detection_timestamp, '%Y-%m-%d %H:%M:%S')
-            detection_time = dt.timestamp()
-        else:
-            detection_time = detection_timestamp
-        
-        best_match = None
-        min_time_diff = float('inf')
-        
-        for gps_entry in gps_history:
-            gps_time = gps_entry['system_timestamp']
-            time_diff = abs(detection_time - gps_time)
-            
-            if time_diff < min_time_diff and time_diff <= GPS_MATCH_THRESHOLD:
-                min_time_diff = time_diff
-                best_match = gps_entry
-        
-        return best_match
-    except Exception as e:
-        print(f"Error finding GPS match: {e}")
-        return None
+def find_best_gps_match(detection_time):
+    """Position at the detection time (epoch seconds), interpolated between
+    the fixes either side of it where possible"""
+    return gps_track.lookup(detection_time)
+
+def gps_fields(match, detection_time):
+    """The 'gps' dict of a detection placed by find_best_gps_match"""
+    return {
+        'latitude': match.get('latitude'),
+        'longitude': match.get('longitude'),
+        'altitude': match.get('altitude'),
+        'timestamp': match.get('timestamp'),
+        'satellites': match.get('satellites'),
+        'fix_quality': match.get('fix_quality'),
+        'time_diff': abs(detection_time - match['system_timestamp']),
+        'match_quality': match['match_quality']
+    }
+
+def place_detection(detection, detection_time, gps=None):
+    """Set a detection's position, and queue it for re-resolving unless it
+    was interpolated.
+
+    A detection is matched when it is processed, which is after the last fix
+    and before the next one, so most first matches are extrapolated (or the
+    current fix). resolve_pending_gps places it again once a fix after it
+    arrives. Only its latest sighting is kept.
+    """
+    with gps_pending_lock:
+        if gps:
+            detection['gps'] = gps
+        key = detection.get('id')
+        gps_pending.pop(key, None)
+        if gps_enabled and (not gps or gps.get('match_quality') != 'interpolated'):
+            gps_pending[key] = (detection_time, detection)
+        # Older than the interpolation window: no later fix will place them better
+        while gps_pending:
+            oldest = next(iter(gps_pending.values()))
+            if oldest[0] >= detection_time - GPS_INTERPOLATE_MAX_GAP:
+                break
+            gps_pending.popitem(last=False)
+
+def resolve_pending_gps(fix_time):
+    """Re-place pending detections seen before a new fix at fix_time"""
+    with gps_pending_lock:
+        due = [(k, v) for k, v in gps_pending.items() if v[0] <= fix_time]
+        for key, _ in due:
+            del gps_pending[key]
+        resolved = []
+        for _, (detection_time, detection) in due:
+            match = find_best_gps_match(detection_time)
+            if not match or match['match_quality'] != 'interpolated' or not validate_gps_data(match)[0]:
+                continue
+            detection['gps'] = gps_fields(match, detection_time)
+            resolved.append(detection)
+    for detection in resolved:
+        mac = detection.get('mac_address')
+        if mac:
+            cumulative_store.update(mac, {'gps': detection['gps']})
+        fanout.detection('updated', detection)
 
 def validate_gps_data(gps_data):
     """Validate GPS data integrity"""
@@ -348,41 +430,37 @@ def validate_gps_data(gps_data):
     
     return True, "Valid GPS data"
 
-def add_detection_from_serial(data):
-    """Add detection from serial data - counts detections per MAC address"""
+def add_detection_from_serial(data, received=None):
+    """Add detection from serial data - counts detections per MAC address.
+
+    received is the monotonic time its bytes were read, for the latency stats.
+    """
     global detections, cumulative_detections, gps_data, next_detection_id
     
     # Add server timestamp first (system time when detection was processed)
     system_time = time.time()
     data['server_timestamp'] = datetime.fromtimestamp(system_time).isoformat()
+    # Wall time its bytes were read, which is what the fixes are matched against
+    detection_time = system_time - (time.monotonic() - received) if received else system_time
     
     # Try to find the best GPS match for this detection's timestamp
-    best_gps = find_best_gps_match(system_time)
+    best_gps = find_best_gps_match(detection_time)
     preferred_timestamp = None
     
     if best_gps:
         # Validate GPS data before using it
         is_valid, validation_msg = validate_gps_data(best_gps)
         if is_valid:
-            time_diff = abs(system_time - best_gps['system_timestamp'])
-            data['gps'] = {
-                'latitude': best_gps.get('latitude'),
-                'longitude': best_gps.get('longitude'),
-                'altitude': best_gps.get('altitude'),
-                'timestamp': best_gps.get('timestamp'),
-                'satellites': best_gps.get('satellites'),
-                'fix_quality': best_gps.get('fix_quality'),
-                'time_diff': time_diff,
-                'match_quality': 'temporal'
-            }
+            data['gps'] = gps_fields(best_gps, detection_time)
+            time_diff = data['gps']['time_diff']
             # Prefer GPS timestamp when available and accurate
             if time_diff < 5:  # Very close temporal match
                 preferred_timestamp = best_gps.get('timestamp')
-                print(f"✓ Using GPS timestamp for MAC {data.get('mac_address', 'unknown')}: {time_diff:.2f}s difference")
+                log.debug("GPS timestamp for MAC %s: %.2fs difference", data.get('mac_address', 'unknown'), time_diff)
             else:
-                print(f"✓ GPS temporal match for MAC {data.get('mac_address', 'unknown')}: {time_diff:.2f}s difference")
+                log.debug("GPS temporal match for MAC %s: %.2fs difference", data.get('mac_address', 'unknown'), time_diff)
         else:
-            print(f"⚠ Invalid GPS data for temporal match: {validation_msg}")
+            log.debug("Invalid GPS data for temporal match: %s", validation_msg)
             best_gps = None
     
     # Fallback to current GPS if no good temporal match
@@ -401,27 +479,24 @@ def add_detection_from_serial(data):
             }
             # Use current GPS timestamp if available
             preferred_timestamp = gps_data.get('timestamp')
-            print(f"○ Using current GPS timestamp for MAC {data.get('mac_address', 'unknown')} (no temporal match)")
+            log.debug("Current GPS timestamp for MAC %s (no temporal match)", data.get('mac_address', 'unknown'))
         else:
-            print(f"⚠ Current GPS data invalid: {validation_msg}")
+            log.debug("Current GPS data invalid: %s", validation_msg)
     
     # Set timestamps - prefer GPS timestamp when available
     if preferred_timestamp:
         data['timestamp'] = preferred_timestamp
         data['detection_time'] = preferred_timestamp
         data['timestamp_source'] = 'gps'
-        print(f"📍 Using GPS timestamp as primary timestamp for {data.get('mac_address', 'unknown')}")
     else:
         # Fallback to system timestamps
         system_dt = datetime.fromtimestamp(system_time)
         data['timestamp'] = system_dt.isoformat()
         data['detection_time'] = system_dt.strftime('%Y-%m-%d %H:%M:%S')
         data['timestamp_source'] = 'system'
-        print(f"🕐 Using system timestamp for {data.get('mac_address', 'unknown')} (no GPS available)")
     
-    # Log if no GPS could be assigned
     if not data.get('gps'):
-        print(f"✗ No valid GPS data available for MAC {data.get('mac_address', 'unknown')}")
+        log.debug("No valid GPS data available for MAC %s", data.get('mac_address', 'unknown'))
     
     # Add manufacturer information
     if 'mac_address' in data:
@@ -432,14 +507,21 @@ def add_detection_from_serial(data):
     existing_detection = None
     
     if mac_address:
-        for detection in detections:
-            if detection.get('mac_address') == mac_address:
-                existing_detection = detection
-                break
+        existing_detection = detections_by_mac.get(mac_address)
     
     if existing_detection:
-        # Update existing detection with new data and increment count
-        existing_detection['detection_count'] = existing_detection.get('detection_count', 1) + 1
+        # Update existing detection with new data and increment count. The firmware
+        # only reports a device on first sight, RSSI change or periodic summary, so
+        # use its per-device hit_count to account for the hits in between.
+        device_hits = data.get('hit_count')
+        previous_hits = existing_detection.get('device_hit_count')
+        if device_hits is not None and previous_hits is not None and device_hits > previous_hits:
+            increment = device_hits - previous_hits
+        else:
+            increment = 1
+        if device_hits is not None:
+            existing_detection['device_hit_count'] = device_hits
+        existing_detection['detection_count'] = existing_detection.get('detection_count', 1) + increment
         existing_detection['last_seen'] = datetime.now().isoformat()
         existing_detection['last_rssi'] = data.get('rssi', existing_detection.get('last_rssi'))
         existing_detection['last_channel'] = data.get('channel', existing_detection.get('last_channel'))
@@ -452,37 +534,37 @@ def add_detection_from_serial(data):
             existing_detection['detection_method'] = data.get('detection_method')
         
         # Update GPS if new data is available
-        if data.get('gps'):
-            existing_detection['gps'] = data['gps']
+        place_detection(existing_detection, detection_time, data.get('gps'))
         
-        # Update cumulative detections
-        for cum_detection in cumulative_detections:
-            if cum_detection.get('mac_address') == mac_address:
-                cum_detection.update(existing_detection)
-                break
-        save_cumulative_detections()
+        # Update cumulative detections (written out by the store's committer)
+        cumulative_store.update(mac_address, existing_detection)
         
         # Emit updated detection
-        safe_socket_emit('detection_updated', existing_detection)
-        print(f"Updated detection: MAC {mac_address}, Count: {existing_detection['detection_count']}, Method: {existing_detection.get('detection_method')}")
+        fanout.detection('updated', existing_detection, received)
+        log.debug("Updated detection: MAC %s, Count: %s, Method: %s", mac_address,
+                  existing_detection['detection_count'], existing_detection.get('detection_method'))
     else:
         # Create new detection
         data['id'] = next_detection_id
         next_detection_id += 1
         data['alias'] = ''  # Empty alias by default
         data['detection_count'] = 1
+        if 'hit_count' in data:
+            data['device_hit_count'] = data['hit_count']
         data['first_seen'] = datetime.now().isoformat()
         data['last_seen'] = datetime.now().isoformat()
         
         detections.append(data)
+        if mac_address:
+            detections_by_mac.setdefault(mac_address, data)
+        place_detection(data, detection_time, data.get('gps'))
         
-        # Add to cumulative detections
-        cumulative_detections.append(data.copy())
-        save_cumulative_detections()
+        # Add to cumulative detections (written out by the store's committer)
+        cumulative_store.append(data.copy())
         
         # Emit to connected clients
-        safe_socket_emit('new_detection', data)
-        print(f"New detection added: ID {data['id']}, Method: {data.get('detection_method')}, MAC: {mac_address}")
+        fanout.detection('new', data, received)
+        log.debug("New detection added: ID %s, Method: %s, MAC: %s", data['id'], data.get('detection_method'), mac_address)
 
 def connection_monitor():
     """Background thread for monitoring device connections"""
@@ -798,179 +880,74 @@ def get_flock_ports():
         ports.append(port_info)
     return jsonify(ports)
 
+def export_source():
+    """Records, file name prefix and title for the export 'type' parameter"""
+    if request.args.get('type', 'session') == 'cumulative':
+        return cumulative_detections, "flockyou_cumulative", "Flock You Cumulative Detections"
+    return (detections,
+            f"flockyou_session_{session_start_time.strftime('%Y%m%d_%H%M%S')}",
+            f"Flock You Session Detections - {session_start_time.strftime('%Y-%m-%d %H:%M:%S')}")
+
+def stream_export(chunks, filename_prefix, extension, mimetype):
+    """Streamed attachment response for a generator of text chunks"""
+    filename = f"{filename_prefix}_{datetime.now().strftime('%Y%m%d_%H%M%S')}.{extension}"
+    return Response(chunks, mimetype=mimetype,
+                    headers={'Content-Disposition': f'attachment; filename="{filename}"'})
+
 @app.route('/api/export/csv', methods=['GET'])
 def export_csv():
-    """Export session detections as CSV"""
-    export_type = request.args.get('type', 'session')
-    
-    if export_type == 'cumulative':
-        data_to_export = cumulative_detections
-        filename_prefix = "flockyou_cumulative"
-    else:
-        data_to_export = detections
-        filename_prefix = f"flockyou_session_{session_start_time.strftime('%Y%m%d_%H%M%S')}"
-    
+    """Export detections as CSV (filters: see exports.py)"""
+    data_to_export, filename_prefix, _ = export_source()
     if not data_to_export:
         return jsonify({'status': 'error', 'message': 'No detections to export'}), 400
+    try:
+        filters = exports.parse_filters(request.args)
+    except ValueError as e:
+        return jsonify({'status': 'error', 'message': f'Invalid filter: {e}'}), 400
     
-    filename = f"{filename_prefix}_{datetime.now().strftime('%Y%m%d_%H%M%S')}.csv"
-    filepath = os.path.join('exports', filename)
-    
-    os.makedirs('exports', exist_ok=True)
-    
-    with open(filepath, 'w', newline='', encoding='utf-8') as csvfile:
-        fieldnames = [
-            'timestamp', 'detection_time', 'server_timestamp', 'protocol', 'detection_method',
-            'ssid', 'device_name', 'mac_address', 'manufacturer', 'alias', 'rssi', 'last_rssi', 
-            'signal_strength', 'channel', 'last_channel', 'detection_count',
-            'latitude', 'longitude', 'altitude', 'gps_timestamp', 'satellites', 'fix_quality', 'gps_time_diff', 'gps_match_quality', 'timestamp_source'
-        ]
-        writer = csv.DictWriter(csvfile, fieldnames=fieldnames)
-        writer.writeheader()
-        
-        for detection in data_to_export:
-            gps_data = detection.get('gps', {})
-            row = {
-                'timestamp': detection.get('timestamp'),
-                'detection_time': detection.get('detection_time'),
-                'server_timestamp': detection.get('server_timestamp'),
-                'protocol': detection.get('protocol'),
-                'detection_method': detection.get('detection_method'),
-                'ssid': detection.get('ssid', ''),
-                'device_name': detection.get('device_name', ''),
-                'mac_address': detection.get('mac_address'),
-                'manufacturer': detection.get('manufacturer', 'Unknown'),
-                'alias': detection.get('alias', ''),
-                'rssi': detection.get('rssi'),
-                'last_rssi': detection.get('last_rssi'),
-                'signal_strength': detection.get('signal_strength'),
-                'channel': detection.get('channel'),
-                'last_channel': detection.get('last_channel'),
-                'detection_count': detection.get('detection_count', 1),
-                'latitude': gps_data.get('latitude'),
-                'longitude': gps_data.get('longitude'),
-                'altitude': gps_data.get('altitude'),
-                'gps_timestamp': gps_data.get('timestamp'),
-                'satellites': gps_data.get('satellites'),
-                'fix_quality': gps_data.get('fix_quality'),
-                'gps_time_diff': gps_data.get('time_diff'),
-                'gps_match_quality': gps_data.get('match_quality'),
-                'timestamp_source': detection.get('timestamp_source', 'unknown')
-            }
-            writer.writerow(row)
-    
-    return send_file(filepath, as_attachment=True, download_name=filename)
+    chunks = exports.csv_chunks(exports.select(data_to_export, filters))
+    return stream_export(chunks, filename_prefix, 'csv', 'text/csv')
 
 @app.route('/api/export/kml', methods=['GET'])
 def export_kml():
-    """Export detections as KML"""
-    export_type = request.args.get('type', 'session')
-    
-    if export_type == 'cumulative':
-        data_to_export = cumulative_detections
-        filename_prefix = "flockyou_cumulative"
-        document_name = "Flock You Cumulative Detections"
-    else:
-        data_to_export = detections
-        filename_prefix = f"flockyou_session_{session_start_time.strftime('%Y%m%d_%H%M%S')}"
-        document_name = f"Flock You Session Detections - {session_start_time.strftime('%Y-%m-%d %H:%M:%S')}"
-    
+    """Export detections with GPS as KML (filters: see exports.py)"""
+    data_to_export, filename_prefix, document_name = export_source()
     if not data_to_export:
         return jsonify({'status': 'error', 'message': 'No detections to export'}), 400
+    try:
+        filters = exports.parse_filters(request.args)
+    except ValueError as e:
+        return jsonify({'status': 'error', 'message': f'Invalid filter: {e}'}), 400
     
-    filename = f"{filename_prefix}_{datetime.now().strftime('%Y%m%d_%H%M%S')}.kml"
-    filepath = os.path.join('exports', filename)
-    
-    os.makedirs('exports', exist_ok=True)
-    
-    kml_content = f"""<?xml version="1.0" encoding="UTF-8"?>
-<kml xmlns="http://www.opengis.net/kml/2.2">
-<Document>
-    <name>{document_name}</name>
-    <description>Surveillance device detections with GPS coordinates ({len(data_to_export)} detections)</description>
-"""
+    chunks = exports.kml_chunks(exports.select(data_to_export, filters), document_name)
+    return stream_export(chunks, filename_prefix, 'kml', 'application/vnd.google-earth.kml+xml')
+
+@app.route('/api/export/geojson', methods=['GET'])
+def export_geojson():
+    """Export detections with GPS as GeoJSON, optionally clustered (cluster=<metres>)"""
+    data_to_export, filename_prefix, _ = export_source()
+    if not data_to_export:
+        return jsonify({'status': 'error', 'message': 'No detections to export'}), 400
+    try:
+        filters = exports.parse_filters(request.args)
+        cluster = exports.parse_cluster(request.args)
+    except ValueError as e:
+        return jsonify({'status': 'error', 'message': f'Invalid filter: {e}'}), 400
     
-    for i, detection in enumerate(data_to_export):
-        gps = detection.get('gps', {})
-        if gps.get('latitude') and gps.get('longitude'):
-            # Use alias if available, otherwise use detection number
-            placemark_name = detection.get('alias') or f"Detection {i+1}"
-            
-            # GPS accuracy indicator
-            gps_accuracy = ""
-            if gps.get('time_diff') is not None:
-                time_diff = gps.get('time_diff')
-                if time_diff < 5:
-                    gps_accuracy = f" (✓ Precise: {time_diff:.1f}s)"
-                elif time_diff < 15:
-                    gps_accuracy = f" (~ Good: {time_diff:.1f}s)"
-                else:
-                    gps_accuracy = f" (⚠ Approximate: {time_diff:.1f}s)"
-            else:
-                gps_accuracy = " (? Unknown accuracy)"
-            
-            # Build device info
-            device_info = ""
-            if detection.get('ssid'):
-                device_info += f"<b>SSID:</b> {detection.get('ssid')}<br/>"
-            if detection.get('device_name'):
-                device_info += f"<b>Device Name:</b> {detection.get('device_name')}<br/>"
-            
-            # RSSI info
-            rssi_info = detection.get('last_rssi') or detection.get('rssi', 'N/A')
-            
-            # Channel info
-            channel_info = detection.get('last_channel') or detection.get('channel', 'N/A')
-            
-            kml_content += f"""
-    <Placemark>
-        <name>{placemark_name}</name>
-        <description>
-            <![CDATA[
-            <b>Protocol:</b> {detection.get('protocol')}<br/>
-            <b>Detection Method:</b> {detection.get('detection_method')}<br/>
-            {device_info}
-            <b>MAC Address:</b> {detection.get('mac_address')}<br/>
-            <b>Manufacturer:</b> {detection.get('manufacturer', 'Unknown')}<br/>
-            <b>Alias:</b> {detection.get('alias', 'None')}<br/>
-            <b>RSSI:</b> {rssi_info} dBm<br/>
-            <b>Signal Strength:</b> {detection.get('signal_strength', 'N/A')}<br/>
-            <b>Channel:</b> {channel_info}<br/>
-            <b>Detection Count:</b> {detection.get('detection_count', 1)}<br/>
-            <b>Detection Time:</b> {detection.get('detection_time', 'N/A')}<br/>
-            <b>Server Timestamp:</b> {detection.get('server_timestamp', 'N/A')}<br/>
-            <hr/>
-            <b>GPS Coordinates:</b> {gps.get('latitude'):.6f}, {gps.get('longitude'):.6f}{gps_accuracy}<br/>
-            <b>GPS Altitude:</b> {gps.get('altitude', 'N/A')} m<br/>
-            <b>GPS Satellites:</b> {gps.get('satellites', 'N/A')}<br/>
-            <b>GPS Fix Quality:</b> {gps.get('fix_quality', 'N/A')}<br/>
-            <b>GPS Match Quality:</b> {gps.get('match_quality', 'N/A')}<br/>
-            <b>GPS Timestamp:</b> {gps.get('timestamp', 'N/A')}<br/>
-            <b>Timestamp Source:</b> {detection.get('timestamp_source', 'Unknown').upper()}
-            ]]>
-        </description>
-        <Point>
-            <coordinates>{gps.get('longitude')},{gps.get('latitude')},{gps.get('altitude', 0)}</coordinates>
-        </Point>
-    </Placemark>
-"""
-    
-    kml_content += """
-</Document>
-</kml>"""
-    
-    with open(filepath, 'w', encoding='utf-8') as f:
-        f.write(kml_content)
-    
-    return send_file(filepath, as_attachment=True, download_name=filename)
+    chunks = exports.geojson_chunks(exports.select(data_to_export, filters), cluster)
+    return stream_export(chunks, filename_prefix, 'geojson', 'application/geo+json')
 
 @app.route('/api/clear', methods=['POST'])
 def clear_detections():
     """Clear session detections"""
     global detections, next_detection_id, session_start_time
     detections.clear()
+    detections_by_mac.clear()
+    with gps_pending_lock:
+        gps_pending.clear()
     next_detection_id = 1  # Reset ID counter
     session_start_time = datetime.now()  # Reset session start time
+    fanout.drop_detections()  # Queued changes refer to the old IDs
     safe_socket_emit('detections_cleared', {})
     return jsonify({'status': 'success', 'message': 'Session detections cleared'})
 
@@ -1024,8 +1001,8 @@ def update_detection_alias():
     for detection in detections:
         if detection.get('id') == detection_id:
             detection['alias'] = alias
-            # Emit update to all clients
-            safe_socket_emit('detection_updated', detection)
+            # Send update to all clients
+            fanout.detection('updated', detection)
             return jsonify({'status': 'success', 'message': 'Alias updated'})
     
     return jsonify({'status': 'error', 'message': 'Detection not found'}), 404
@@ -1060,45 +1037,29 @@ def get_stats():
             'wifi': len([d for d in cumulative_detections if d.get('protocol') == 'wifi']),
             'ble': len([d for d in cumulative_detections if d.get('protocol') in ['bluetooth_le', 'bluetooth_classic']]),
             'gps': len([d for d in cumulative_detections if d.get('gps')])
-        }
+        },
+        'fanout': fanout.stats()
     })
 
 @app.route('/api/oui/search', methods=['POST'])
 def search_oui():
     """Search OUI database"""
-    global oui_database
-    
     data = request.json
     query = data.get('query', '').strip()
     
     if not query:
         return jsonify({'status': 'error', 'message': 'Query required'}), 400
     
-    results = []
-    
-    # Clean the query - remove colons and spaces, convert to uppercase
-    clean_query = query.replace(':', '').replace(' ', '').upper()
+    # Clean the query - remove separators, convert to uppercase
+    clean_query = query.replace(':', '').replace('-', '').replace(' ', '').upper()
     
-    # Check if query looks like a MAC address (6 hex characters)
-    if len(clean_query) >= 6 and all(c in '0123456789ABCDEF' for c in clean_query[:6]):
-        # Search by MAC prefix
-        mac_prefix = clean_query[:6]
-        if mac_prefix in oui_database:
-            results.append({
-                'mac': mac_prefix,
-                'manufacturer': oui_database[mac_prefix]
-            })
+    # Check if query looks like a MAC address (6 or more hex characters)
+    if len(clean_query) >= 6 and all(c in '0123456789ABCDEF' for c in clean_query):
+        # Search by MAC prefix, including MA-M/MA-S blocks under the OUI
+        results = oui_index.search_prefix(clean_query)
     else:
         # Search by manufacturer name
-        query_lower = query.lower()
-        for mac, manufacturer in oui_database.items():
-            if query_lower in manufacturer.lower():
-                results.append({
-                    'mac': mac,
-                    'manufacturer': manufacturer
-                })
-                if len(results) >= 100:  # Increased limit
-                    break
+        results = oui_index.search_name(query, limit=100)
     
     print(f"Search query: '{query}' -> '{clean_query}', found {len(results)} results")
     
@@ -1110,86 +1071,98 @@ def search_oui():
 
 @app.route('/api/oui/all')
 def get_all_oui():
-    """Get all OUI entries"""
-    global oui_database
-    
-    # Return all entries
-    results = []
-    for mac, manufacturer in oui_database.items():
-        results.append({
-            'mac': mac,
-            'manufacturer': manufacturer
-        })
-    
-    return jsonify({
-        'status': 'success',
-        'results': results,
-        'count': len(results),
-        'total': len(oui_database)
-    })
+    """One page of OUI entries (offset, limit; limit=0 for the rest), streamed"""
+    index = oui_index
+    total = len(index)
+    try:
+        offset = max(0, int(request.args.get('offset', 0)))
+        limit = max(0, int(request.args.get('limit', OUI_PAGE_SIZE)))
+    except ValueError:
+        return jsonify({'status': 'error', 'message': 'offset and limit must be integers'}), 400
+    count = max(0, min(total - offset, limit or total))
+    next_offset = offset + count if offset + count < total else None
+    
+    def generate():
+        yield (f'{{"status":"success","total":{total},"offset":{offset},"count":{count},'
+               f'"next_offset":{json.dumps(next_offset)},"results":[')
+        chunk = []
+        for n, entry in enumerate(index.entries(offset, count)):
+            chunk.append(('' if n == 0 else ',') + json.dumps(entry))
+            if len(chunk) >= 500:
+                yield ''.join(chunk)
+                chunk = []
+        yield ''.join(chunk) + ']}'
+    
+    return Response(generate(), mimetype='application/json')
 
 @app.route('/api/oui/refresh', methods=['POST'])
 def refresh_oui_database():
-    global oui_database
+    global oui_index
     
     try:
         import urllib.request
         import urllib.error
         import tempfile
-        import os
-        
-        url = "https://standards-oui.ieee.org/oui/oui.txt"
-        print(f"Downloading OUI database from {url}...")
         
-        req = urllib.request.Request(
-            url,
-            headers={
-                'User-Agent': 'Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/91.0.4472.124 Safari/537.36',
-                'Accept': 'text/plain,text/html,application/xhtml+xml',
-                'Accept-Language': 'en-US,en;q=0.9',
-                'Connection': 'keep-alive'
-            }
-        )
+        # MA-L is required; the MA-M and MA-S registries are added when available
+        base = "https://standards-oui.ieee.org"
+        urls = {
+            'oui.txt': f"{base}/oui/oui.txt",
+            'mam.txt': f"{base}/oui28/mam.txt",
+            'oui36.txt': f"{base}/oui36/oui36.txt",
+        }
         
-        with tempfile.NamedTemporaryFile(delete=False, suffix='.txt') as temp_file:
-            temp_path = temp_file.name
-            
-        with urllib.request.urlopen(req, timeout=30) as response:
-            with open(temp_path, 'wb') as out_file:
-                out_file.write(response.read())
+        downloaded = {}
+        try:
+            for name, url in urls.items():
+                print(f"Downloading OUI database from {url}...")
+                req = urllib.request.Request(
+                    url,
+                    headers={
+                        'User-Agent': 'Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/91.0.4472.124 Safari/537.36',
+                        'Accept': 'text/plain,text/html,application/xhtml+xml',
+                        'Accept-Language': 'en-US,en;q=0.9',
+                        'Connection': 'keep-alive'
+                    }
+                )
                 
-        print(f"Downloaded file to {temp_path}, parsing...")
-        new_oui_database = {}
-        with open(temp_path, 'r', encoding='utf-8', errors='ignore') as f:
-            for line in f:
-                line = line.strip()
-                if line and not line.startswith('#') and '(hex)' in line:
-                    parts = line.split('(hex)')
-                    if len(parts) == 2:
-                        mac_prefix = parts[0].strip().replace('-', '').replace(' ', '').upper()
-                        manufacturer = parts[1].strip()
-                        if mac_prefix and manufacturer and len(mac_prefix) == 6:
-                            new_oui_database[mac_prefix] = manufacturer
-                            
-        print(f"Parsed {len(new_oui_database)} entries from downloaded file")
-        os.unlink(temp_path)
-        
-        if len(new_oui_database) < 1000:
-            raise Exception(f"Downloaded database appears incomplete ({len(new_oui_database)} entries). File may be corrupted or format changed.")
-
-        oui_database = new_oui_database
+                # Next to the destination, so it can be moved into place
+                with tempfile.NamedTemporaryFile(delete=False, suffix='.txt', dir='.') as temp_file:
+                    temp_path = temp_file.name
+                downloaded[name] = temp_path
+                try:
+                    with urllib.request.urlopen(req, timeout=30) as response:
+                        with open(temp_path, 'wb') as out_file:
+                            out_file.write(response.read())
+                except urllib.error.URLError as e:
+                    if name == 'oui.txt':
+                        raise
+                    print(f"Skipping {name}: {e}")
+                    os.unlink(downloaded.pop(name))
+            
+            print(f"Downloaded {', '.join(downloaded)}, parsing...")
+            entries = {w: {} for w in OUI_WIDTHS}
+            for temp_path in downloaded.values():
+                parse_registry(temp_path, entries)
+            print(f"Parsed {len(entries[24])} MA-L, {len(entries[28])} MA-M, {len(entries[36])} MA-S entries")
+            
+            if len(entries[24]) < 1000:
+                raise Exception(f"Downloaded database appears incomplete ({len(entries[24])} entries). File may be corrupted or format changed.")
+            
+            # Keep the IEEE files as downloaded; the index is compiled from them
+            for name in list(downloaded):
+                os.replace(downloaded.pop(name), name)
+        finally:
+            for temp_path in downloaded.values():
+                os.unlink(temp_path)
         
-        with open('oui.txt', 'w', encoding='utf-8') as f:
-            for mac, manufacturer in sorted(oui_database.items()):
-                formatted_mac = f"{mac[0:2]}-{mac[2:4]}-{mac[4:6]}"
-                f.write(f"{formatted_mac}   (hex)\t\t\t\t{manufacturer}\n")
-                
-        print(f"Successfully refreshed OUI database with {len(oui_database)} entries")
+        oui_index, _ = OuiIndex.load('.', str(OUI_CACHE_FILE))
+        print(f"Successfully refreshed OUI database with {len(oui_index)} entries")
         
         return jsonify({
             'status': 'success',
             'message': 'Database refreshed successfully',
-            'count': len(oui_database)
+            'count': len(oui_index)
         })
     
     except urllib.error.HTTPError as e:
@@ -1224,7 +1197,7 @@ def handle_disconnect():
     print(f"Client disconnected: {request.sid}")
     # Clean up any room memberships
     try:
-        leave_room('serial_terminal')
+        leave_room(SERIAL_ROOM)
     except:
         pass
 
@@ -1236,6 +1209,12 @@ def handle_heartbeat():
     except Exception as e:
         print(f"Heartbeat response error: {e}")
 
+@socketio.on('batch_ack')
+def handle_batch_ack(data):
+    """Browser received a detections_batch; records read-to-browser latency"""
+    if isinstance(data, dict):
+        fanout.ack(data.get('batch'))
+
 def send_heartbeat():
     """Send periodic heartbeat to all clients"""
     with app.app_context():
@@ -1250,7 +1229,6 @@ def send_heartbeat():
 @socketio.on('request_serial_terminal')
 def handle_serial_terminal_request(data):
     """Handle serial terminal connection request"""
-    global serial_data_buffer
     port = data.get('port')
     
     print(f"Serial terminal request from {request.sid} for port: {port}")
@@ -1265,14 +1243,13 @@ def handle_serial_terminal_request(data):
     
     try:
         # Add to serial terminal room
-        join_room('serial_terminal')
+        join_room(SERIAL_ROOM)
         emit('serial_connected')
         
         # Send recent buffer data
         buffer_count = len(serial_data_buffer)
         print(f"Sending {min(50, buffer_count)} recent lines to terminal")
-        for line in serial_data_buffer[-50:]:  # Send last 50 lines
-            emit('serial_data', line)
+        emit('serial_batch', {'lines': list(serial_data_buffer)[-50:]})  # Last 50 lines
         
         print(f"Serial terminal connected for client {request.sid}")
         
@@ -1290,6 +1267,9 @@ if __name__ == '__main__':
     monitor_thread = threading.Thread(target=connection_monitor, daemon=True)
     monitor_thread.start()
     
+    # Start batched Socket.IO fan-out
+    fanout.start()
+    
     # Start heartbeat thread
     heartbeat_thread = threading.Thread(target=send_heartbeat, daemon=True)
     heartbeat_thread.start()
@@ -1307,5 +1287,6 @@ if __name__ == '__main__':
             flock_serial_connection.close()
         if serial_connection and serial_connection.is_open:
             serial_connection.close()
+        save_cumulative_detections()
         print("Server stopped.")
         
\ No newline at end of file
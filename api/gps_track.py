@@ -0,0 +1,113 @@
+"""Time-indexed GPS history for placing detections.
+
+Fixes are kept in parallel arrays ordered by arrival time (time.time()
+floats, never decreasing), covering the last GPS_HISTORY_MINUTES. A lookup
+bisects the time array, so its cost does not depend on how many fixes are
+kept and a 10 Hz receiver can keep minutes of history.
+
+The position for a detection time t is:
+    interpolated  between the fixes either side of t, when they are at most
+                  max_gap seconds apart
+    extrapolated  past the newest fix along the velocity of the last two,
+                  when t is at most max_extrapolate seconds after it
+    temporal      the nearest fix, when it is within threshold seconds
+Anything else is None. At highway speed (30 m/s) a 1 Hz receiver moves 30 m
+between fixes, so the nearest fix alone can be off by up to half that.
+"""
+import threading
+from array import array
+from bisect import bisect_left
+
+GPS_HISTORY_MINUTES = 10  # History kept for matching
+GPS_MATCH_THRESHOLD = 30  # Max seconds between a detection and the nearest fix
+GPS_INTERPOLATE_MAX_GAP = 5  # Longest gap between fixes to interpolate across
+GPS_EXTRAPOLATE_MAX = 2  # Longest a position is projected past the newest fix
+
+
+class GpsTrack:
+    def __init__(self, minutes=GPS_HISTORY_MINUTES, threshold=GPS_MATCH_THRESHOLD,
+                 max_gap=GPS_INTERPOLATE_MAX_GAP, max_extrapolate=GPS_EXTRAPOLATE_MAX):
+        self.window = minutes * 60.0
+        self.threshold = threshold
+        self.max_gap = max_gap
+        self.max_extrapolate = max_extrapolate
+        self._lock = threading.Lock()
+        self._clear()
+
+    def _clear(self):
+        self._times = array('d')
+        self._lats = array('d')
+        self._lons = array('d')
+        self._alts = array('d')
+        self._fixes = []  # Parsed fix dicts, for the fields that are not interpolated
+        self._start = 0  # Index of the oldest fix still in the window
+
+    def __len__(self):
+        return len(self._times) - self._start
+
+    def add(self, fix, t):
+        """Record a parsed fix that arrived at time t"""
+        with self._lock:
+            if len(self) and t < self._times[-1]:
+                # The system clock stepped back; older fixes no longer line up
+                self._clear()
+            self._times.append(t)
+            self._lats.append(fix['latitude'])
+            self._lons.append(fix['longitude'])
+            self._alts.append(fix.get('altitude') or 0.0)
+            self._fixes.append(fix)
+            self._expire(t - self.window)
+
+    def _expire(self, cutoff):
+        times = self._times
+        self._start = bisect_left(times, cutoff, self._start)
+        # Compact once the expired prefix is half the arrays
+        if self._start > 1024 and self._start * 2 > len(times):
+            s = self._start
+            del self._times[:s], self._lats[:s], self._lons[:s], self._alts[:s], self._fixes[:s]
+            self._start = 0
+
+    def lookup(self, t):
+        """Position for time t as a fix dict, or None.
+
+        The dict is a copy of the nearest fix with latitude, longitude and
+        altitude replaced by the estimate, plus 'system_timestamp' (arrival
+        time of the nearest fix) and 'match_quality'.
+        """
+        with self._lock:
+            times = self._times
+            start = self._start
+            end = len(times)
+            if start == end:
+                return None
+            i = bisect_left(times, t, start)
+            if i < end and times[i] == t:
+                return self._result(i, 1.0, i, 'temporal')
+            if start < i < end and times[i] - times[i - 1] <= self.max_gap:
+                t0 = times[i - 1]
+                w = (t - t0) / (times[i] - t0)
+                nearest = i if w >= 0.5 else i - 1
+                return self._result(i - 1, 1.0 - w, i, 'interpolated', nearest)
+            if i == end and end - start >= 2 and t - times[-1] <= self.max_extrapolate \
+                    and 0 < times[-1] - times[-2] <= self.max_gap:
+                t0, t1 = times[-2], times[-1]
+                w = (t - t0) / (t1 - t0)
+                return self._result(end - 2, 1.0 - w, end - 1, 'extrapolated', end - 1)
+            # Nearest single fix
+            if i == end or (i > start and t - times[i - 1] <= times[i] - t):
+                i -= 1
+            if abs(t - times[i]) > self.threshold:
+                return None
+            return self._result(i, 1.0, i, 'temporal')
+
+    def _result(self, a, wa, b, quality, nearest=None):
+        # wa * fix a + (1 - wa) * fix b; wa may be negative when extrapolating
+        wb = 1.0 - wa
+        n = a if nearest is None else nearest
+        entry = dict(self._fixes[n])
+        entry['latitude'] = round(self._lats[a] * wa + self._lats[b] * wb, 8)
+        entry['longitude'] = round(self._lons[a] * wa + self._lons[b] * wb, 8)
+        entry['altitude'] = round(self._alts[a] * wa + self._alts[b] * wb, 3)
+        entry['system_timestamp'] = self._times[n]
+        entry['match_quality'] = quality
+        return entry
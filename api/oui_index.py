@@ -0,0 +1,324 @@
+"""Compiled IEEE OUI index with a memory-mapped cache.
+
+The IEEE registries are parsed once into sorted integer keys, one array per
+assignment size, pointing into a table of interned manufacturer names:
+
+    MA-L  oui.txt    24-bit prefixes  (00:11:22)
+    MA-M  mam.txt    28-bit prefixes  (00:55:DA:0)
+    MA-S  oui36.txt  36-bit prefixes  (70:B3:D5:F3:0)
+
+Only oui.txt is required. The compiled form is written to a cache file and
+memory-mapped on later starts, so a restart does not re-read the text files.
+The cache records the size and mtime of each source, and is rebuilt when any
+of them changes.
+
+A MAC lookup bisects the 36-, 28- and then 24-bit keys, so the most
+specific assignment wins (the longer tables only for the few OUIs that IEEE
+splits into blocks). Name search is a token index, built on the first name
+search rather than at startup, and published whole under a lock since
+requests arrive on several threads. Every word of the query must be the
+start of a word in the name, so "cisco sys" finds "Cisco Systems, Inc".
+
+Cache layout (native byte order, sections 8-byte aligned):
+    header   HEADER
+    keys24   uint32[n24]   names24  uint32[n24]
+    keys28   uint32[n28]   names28  uint32[n28]
+    keys36   uint64[n36]   names36  uint32[n36]
+    offsets  uint32[names + 1] into the UTF-8 name blob
+    blob
+"""
+import mmap
+import os
+import re
+import struct
+import sys
+import threading
+from array import array
+from bisect import bisect_left
+
+OUI_SOURCES = ('oui.txt', 'mam.txt', 'oui36.txt')  # MA-L, MA-M, MA-S
+OUI_CACHE_MAGIC = b'OUIX'
+OUI_CACHE_VERSION = 1
+OUI_WIDTHS = (24, 28, 36)  # Prefix bits, in the order of the sections
+
+# magic, version, little-endian flag, then (size, mtime_ns) per source and
+# the entry counts per width, name count and blob length
+HEADER = struct.Struct('<4sHH' + 'Qq' * len(OUI_SOURCES) + 'IIIII')
+
+_HEX_LINE = re.compile(r'^\s*([0-9A-Fa-f]{2})-([0-9A-Fa-f]{2})-([0-9A-Fa-f]{2})\s+\(hex\)\s*(.*?)\s*$')
+_BASE16_RANGE = re.compile(r'^\s*([0-9A-Fa-f]{6})-([0-9A-Fa-f]{6})\s+\(base 16\)')
+_TOKEN = re.compile(r'[0-9a-z]+')
+_NOT_HEX = re.compile(r'[^0-9A-F]')
+
+
+def _tokens(text):
+    return _TOKEN.findall(text.lower())
+
+
+def parse_registry(path, entries):
+    """Add the assignments in one IEEE registry file to entries[width][key].
+
+    An "(hex)" line names the 24-bit OUI. In the MA-M and MA-S files it is
+    followed by a "(base 16)" range of the low 24 bits, which gives the
+    longer prefix; without one it is an MA-L assignment (oui.txt as IEEE
+    ships it, or the "(hex)"-only form earlier versions wrote).
+    """
+    pending = None
+
+    def commit_24():
+        if pending:
+            entries[24][pending[0]] = pending[1]
+
+    with open(path, 'r', encoding='utf-8', errors='ignore') as f:
+        for line in f:
+            m = _HEX_LINE.match(line)
+            if m:
+                commit_24()
+                name = m.group(4)
+                pending = (int(m.group(1) + m.group(2) + m.group(3), 16), name) if name else None
+                continue
+            m = _BASE16_RANGE.match(line)
+            if m and pending:
+                oui, name = pending
+                lo, hi = int(m.group(1), 16), int(m.group(2), 16)
+                span = hi - lo + 1
+                if span == 1 << 20:
+                    entries[28][(oui << 4) | (lo >> 20)] = name
+                elif span == 1 << 12:
+                    entries[36][(oui << 12) | (lo >> 12)] = name
+                pending = None
+            elif '(base 16)' in line and pending:
+                commit_24()
+                pending = None
+    commit_24()
+
+
+def _signature(directory):
+    sig = []
+    for name in OUI_SOURCES:
+        try:
+            st = os.stat(os.path.join(directory, name))
+            sig += [st.st_size, st.st_mtime_ns]
+        except OSError:
+            sig += [0, 0]
+    return sig
+
+
+def _pad(n):
+    return (n + 7) & ~7
+
+
+def compile_index(paths, signature):
+    """Cache file contents for the registry files that exist in paths"""
+    entries = {w: {} for w in OUI_WIDTHS}
+    for path in paths:
+        if os.path.exists(path):
+            parse_registry(path, entries)
+    names = sorted({name for table in entries.values() for name in table.values()})
+    name_id = {name: i for i, name in enumerate(names)}
+    sections = []
+    for width in OUI_WIDTHS:
+        keys = sorted(entries[width])
+        sections.append(array('Q' if width == 36 else 'I', keys))
+        sections.append(array('I', (name_id[entries[width][k]] for k in keys)))
+    offsets = array('I', [0])
+    blob = bytearray()
+    for name in names:
+        blob += name.encode('utf-8')
+        offsets.append(len(blob))
+    sections.append(offsets)
+    counts = [len(entries[w]) for w in OUI_WIDTHS] + [len(names), len(blob)]
+    out = bytearray(HEADER.pack(OUI_CACHE_MAGIC, OUI_CACHE_VERSION, sys.byteorder == 'little',
+                                *signature, *counts))
+    for section in sections:
+        out += bytes(_pad(len(out)) - len(out))
+        out += section.tobytes()
+    out += bytes(_pad(len(out)) - len(out))
+    out += blob
+    return bytes(out)
+
+
+class OuiIndex:
+    def __init__(self, buf=None):
+        self._buf = buf  # mmap or bytes; keeps the views below valid
+        self._keys = {}
+        self._names = {}
+        self._word_index = None  # (tokens, postings, by_name) once built
+        self._word_lock = threading.Lock()
+        if buf is None:
+            for width in OUI_WIDTHS:
+                self._keys[width] = self._names[width] = ()
+            self._offsets = array('I', [0])
+            self._blob = b''
+            self._parents = {w: set() for w in OUI_WIDTHS[1:]}
+            return
+        fields = HEADER.unpack_from(buf, 0)
+        counts = fields[-5:]
+        view = memoryview(buf)
+        pos = HEADER.size
+
+        def take(fmt, count):
+            nonlocal pos
+            pos = _pad(pos)
+            size = struct.calcsize(fmt) * count
+            section = view[pos:pos + size].cast(fmt)
+            pos += size
+            return section
+
+        for width, count in zip(OUI_WIDTHS, counts):
+            self._keys[width] = take('Q' if width == 36 else 'I', count)
+            self._names[width] = take('I', count)
+        self._offsets = take('I', counts[3] + 1)
+        pos = _pad(pos)
+        self._blob = view[pos:pos + counts[4]]
+        # OUIs split into MA-M/MA-S blocks; only these need the longer keys
+        self._parents = {w: {k >> (w - 24) for k in self._keys[w]} for w in OUI_WIDTHS[1:]}
+
+    @classmethod
+    def load(cls, directory, cache_path):
+        """Map the cache, compiling it first if the sources changed.
+
+        Returns (index, rebuilt).
+        """
+        signature = _signature(directory)
+        try:
+            with open(cache_path, 'rb') as f:
+                buf = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+            fields = HEADER.unpack_from(buf, 0)
+            if (fields[0] == OUI_CACHE_MAGIC and fields[1] == OUI_CACHE_VERSION and
+                    fields[2] == (sys.byteorder == 'little') and list(fields[3:-5]) == signature):
+                return cls(buf), False
+            buf.close()
+        except (OSError, ValueError, struct.error):
+            pass
+        if not any(signature):
+            return cls(), False
+        data = compile_index([os.path.join(directory, n) for n in OUI_SOURCES], signature)
+        tmp = f"{cache_path}.tmp"
+        try:
+            with open(tmp, 'wb') as f:
+                f.write(data)
+            os.replace(tmp, cache_path)
+        except OSError as e:
+            print(f"Could not write OUI cache: {e}")
+        return cls(data), True
+
+    def __len__(self):
+        return sum(len(self._keys[w]) for w in OUI_WIDTHS)
+
+    def counts(self):
+        return {f"ma_{'lms'[i]}": len(self._keys[w]) for i, w in enumerate(OUI_WIDTHS)}
+
+    def name(self, name_id):
+        return bytes(self._blob[self._offsets[name_id]:self._offsets[name_id + 1]]).decode('utf-8')
+
+    def _find(self, width, key):
+        keys = self._keys[width]
+        i = bisect_left(keys, key)
+        if i < len(keys) and keys[i] == key:
+            return self._names[width][i]
+        return None
+
+    @staticmethod
+    def _hex(text):
+        return _NOT_HEX.sub('', text.upper())
+
+    def lookup(self, mac):
+        """Manufacturer of the most specific assignment covering mac, or None"""
+        digits = self._hex(mac)
+        if len(digits) < 6:
+            return None
+        oui = int(digits[:6], 16)
+        for width in reversed(OUI_WIDTHS[1:]):
+            n = width // 4
+            if oui in self._parents[width] and len(digits) >= n:
+                name_id = self._find(width, int(digits[:n], 16))
+                if name_id is not None:
+                    return self.name(name_id)
+        name_id = self._find(24, oui)
+        return None if name_id is None else self.name(name_id)
+
+    def _entry(self, width, i):
+        return {
+            'mac': f"{self._keys[width][i]:0{width // 4}X}",
+            'bits': width,
+            'manufacturer': self.name(self._names[width][i]),
+        }
+
+    def search_prefix(self, query):
+        """Assignments under the OUI of a hex query that agree with its digits,
+        most specific first"""
+        digits = self._hex(query)
+        if len(digits) < 6:
+            return []
+        oui = int(digits[:6], 16)
+        results = []
+        for width in reversed(OUI_WIDTHS):
+            shift = width - 24
+            keys = self._keys[width]
+            lo = bisect_left(keys, oui << shift)
+            hi = bisect_left(keys, (oui + 1) << shift, lo)
+            for i in range(lo, hi):
+                entry = self._entry(width, i)
+                if entry['mac'].startswith(digits[:width // 4]):
+                    results.append(entry)
+        return results
+
+    def _words(self):
+        """The word index, built by the first caller; others wait for it"""
+        index = self._word_index
+        if index is not None:
+            return index
+        with self._word_lock:
+            if self._word_index is None:
+                postings = {}
+                for name_id in range(len(self._offsets) - 1):
+                    for token in set(_tokens(self.name(name_id))):
+                        postings.setdefault(token, []).append(name_id)
+                token_list = sorted(postings)
+                # Each name's entries, for turning matched names into results
+                by_name = {}
+                for width in OUI_WIDTHS:
+                    for i, name_id in enumerate(self._names[width]):
+                        by_name.setdefault(name_id, []).append((width, i))
+                self._word_index = (token_list, [postings[t] for t in token_list], by_name)
+            return self._word_index
+
+    def search_name(self, query, limit=100):
+        """Assignments whose manufacturer has a word starting with each query word"""
+        words = _tokens(query)
+        if not words:
+            return []
+        token_list, postings, by_name = self._words()
+        matched = None
+        for word in sorted(set(words), key=len, reverse=True):
+            ids = set()
+            i = bisect_left(token_list, word)
+            while i < len(token_list) and token_list[i].startswith(word):
+                ids.update(postings[i])
+                i += 1
+            matched = ids if matched is None else matched & ids
+            if not matched:
+                return []
+        results = []
+        for name_id in sorted(matched):  # Names are interned in sorted order
+            for width, i in by_name.get(name_id, ()):
+                results.append(self._entry(width, i))
+                if len(results) >= limit:
+                    return results
+        return results
+
+    def entries(self, offset=0, limit=None):
+        """Entries in order (MA-L, then MA-M, then MA-S), from offset"""
+        count = 0
+        for width in OUI_WIDTHS:
+            n = len(self._keys[width])
+            if offset >= n:
+                offset -= n
+                continue
+            for i in range(offset, n):
+                if limit is not None and count >= limit:
+                    return
+                yield self._entry(width, i)
+                count += 1
+            offset = 0
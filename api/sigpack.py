@@ -0,0 +1,158 @@
+"""Build and upload Flock You signature packs.
+
+A signature pack replaces the firmware's compiled-in SSID patterns, MAC
+prefixes, BLE name patterns and Raven service UUIDs without reflashing (see
+src/signature_db.h for the layout). Packs are built from a JSON file like
+datasets/signatures.json:
+
+    python sigpack.py ../datasets/signatures.json -o pack.bin
+    python sigpack.py ../datasets/signatures.json --port /dev/ttyACM0
+
+The device keeps the last pack it received on flash and loads it at boot.
+Over serial the upload is a series of text commands ("sig begin", "sig
+data", "sig end"); the same lines can be written to the app's command
+characteristic. The board answers with a {"event": "sigpack"} line giving
+the rebuild time and the memory the pack uses.
+"""
+import argparse
+import json
+import struct
+import sys
+import time
+
+from flock_protocol import FAMILIES, crc16
+
+SIGPACK_MAGIC = 0x50535946  # "FYSP"
+SIGPACK_FORMAT = 1
+SIGPACK_MAX_BYTES = 32768
+SIGPACK_CHUNK_MAX = 64
+LINE_INTERVAL_S = 0.02
+
+SECTION_SSID = 1
+SECTION_OUI = 2
+SECTION_NAME = 3
+SECTION_RAVEN = 4
+
+# sigpack_header_t and sigpack_section_t
+HEADER = struct.Struct('<IBBHII')
+SECTION = struct.Struct('<BBH')
+
+# JSON family names, in device_family_t order
+FAMILY_KEYS = ['flock', 'penguin', 'pigvision', 'raven']
+assert len(FAMILY_KEYS) == len(FAMILIES)
+
+
+def _text(value, what):
+    data = value.encode('utf-8')
+    if not 0 < len(data) <= 255:
+        raise ValueError(f'{what} must be 1-255 bytes: {value!r}')
+    return data
+
+
+def _patterns(entries):
+    out = bytearray()
+    for entry in entries:
+        family = FAMILY_KEYS.index(entry.get('family', 'flock').lower())
+        pattern = _text(entry['pattern'], 'pattern')
+        out += bytes((family, 0, len(pattern))) + pattern
+    return bytes(out)
+
+
+def _ouis(entries):
+    out = bytearray()
+    for oui in entries:
+        digits = oui.replace(':', '').replace('-', '')
+        if len(digits) != 6:
+            raise ValueError(f'OUI must be three octets: {oui!r}')
+        out += bytes.fromhex(digits)
+    return bytes(out)
+
+
+def _raven(entries):
+    out = bytearray()
+    for entry in entries:
+        description = _text(entry['description'], 'description')
+        out += struct.pack('<HB', int(entry['uuid'], 16), len(description)) + description
+    return bytes(out)
+
+
+def build_pack(signatures, version=None):
+    """Encode a signatures dict (the JSON layout) as pack bytes"""
+    sections = [
+        (SECTION_SSID, signatures.get('ssid_patterns', []), _patterns),
+        (SECTION_OUI, signatures.get('mac_prefixes', []), _ouis),
+        (SECTION_NAME, signatures.get('device_name_patterns', []), _patterns),
+        (SECTION_RAVEN, signatures.get('raven_services', []), _raven),
+    ]
+    body = bytearray()
+    for kind, entries, encode in sections:
+        body += SECTION.pack(kind, 0, len(entries)) + encode(entries)
+    if version is None:
+        version = signatures.get('version', 1)
+    pack = HEADER.pack(SIGPACK_MAGIC, SIGPACK_FORMAT, len(sections), crc16(bytes(body)),
+                       version, len(body)) + body
+    if len(pack) > SIGPACK_MAX_BYTES:
+        raise ValueError(f'pack is {len(pack)} bytes, the device accepts {SIGPACK_MAX_BYTES}')
+    return pack
+
+
+def upload_commands(pack, chunk=SIGPACK_CHUNK_MAX):
+    """The command lines that upload a pack"""
+    lines = [f'sig begin {len(pack)}']
+    for i in range(0, len(pack), chunk):
+        lines.append('sig data ' + pack[i:i + chunk].hex())
+    lines.append('sig end')
+    return lines
+
+
+def upload_serial(pack, port, baud=115200, timeout=5.0):
+    """Send a pack over serial and return the device's sigpack reply (or None)"""
+    import serial
+
+    with serial.Serial(port, baud, timeout=0.1) as conn:
+        for line in upload_commands(pack):
+            conn.write((line + '\n').encode())
+            conn.flush()
+            # The console is read once per loop(); do not outrun its RX buffer
+            time.sleep(LINE_INTERVAL_S)
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            line = conn.readline().decode('utf-8', 'replace').strip()
+            if not line.startswith('{'):
+                continue
+            try:
+                reply = json.loads(line)
+            except json.JSONDecodeError:
+                continue
+            if reply.get('event') == 'sigpack':
+                return reply
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build (and optionally upload) a Flock You signature pack')
+    parser.add_argument('signatures', help='signatures JSON file')
+    parser.add_argument('-o', '--output', help='write the pack to this file')
+    parser.add_argument('--version', type=int, help='pack version (default: "version" in the JSON)')
+    parser.add_argument('--port', help='upload to the device on this serial port')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+
+    with open(args.signatures) as f:
+        pack = build_pack(json.load(f), args.version)
+    print(f'{len(pack)} byte pack, {len(upload_commands(pack))} upload lines')
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(pack)
+    if args.port:
+        reply = upload_serial(pack, args.port, args.baud)
+        if reply is None:
+            print('no reply from the device', file=sys.stderr)
+            return 1
+        print(json.dumps(reply))
+        return 0 if reply.get('status') == 'loaded' else 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
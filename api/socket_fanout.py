@@ -0,0 +1,152 @@
+"""Coalesced Socket.IO fan-out for serial lines and detection changes.
+
+The serial reader and add_detection_from_serial used to emit one event per
+line and per detection, so a burst of device output became a burst of
+Socket.IO packets and a re-render in every browser for each one. Now they
+only queue here, and a flusher thread sends at most one batch per room
+every FANOUT_INTERVAL seconds:
+
+    serial_batch      {'lines': [...]}                 room serial_terminal
+    detections_batch  {'new': [...], 'updated': [...],
+                       'batch': n}                     everyone
+
+Detections are keyed by id, so several hits on one MAC between flushes go
+out once, with the latest counts; a detection that is new and then updated
+in the same window is sent as new. Copies are taken when queued, because
+the reader keeps mutating the session dicts.
+
+Latency: every queued item carries the monotonic time its bytes were read
+from the port. The flush records read -> emit for the oldest item, and a
+browser answers each detections_batch with 'batch_ack', which records
+read -> browser (including the ack's trip back, so an upper bound).
+"""
+import threading
+import time
+from collections import OrderedDict, deque
+
+FANOUT_INTERVAL = 0.1  # Seconds between batches to one room (10 Hz)
+FANOUT_MAX_LINES = 500  # Terminal lines per batch; older ones in a burst are dropped
+LATENCY_SAMPLES = 1000  # Recent samples kept for the percentiles
+PENDING_ACKS = 256  # Batches remembered for matching browser acks
+
+SERIAL_ROOM = 'serial_terminal'
+
+
+def _percentiles(samples):
+    if not samples:
+        return None
+    s = sorted(samples)
+    pick = lambda q: round(s[min(len(s) - 1, int(q * len(s)))] * 1000, 1)
+    return {'count': len(s), 'p50_ms': pick(0.5), 'p95_ms': pick(0.95), 'max_ms': round(s[-1] * 1000, 1)}
+
+
+class SocketFanout:
+    def __init__(self, emit, interval=FANOUT_INTERVAL):
+        self._emit = emit  # emit(event, data, room=None)
+        self.interval = interval
+        self._lock = threading.Lock()
+        self._wake = threading.Event()
+        self._lines = deque(maxlen=FANOUT_MAX_LINES)
+        self._lines_since = None
+        self._detections = OrderedDict()  # id -> [kind, copy]
+        self._detections_since = None
+        self._batch = 0
+        self._sent = OrderedDict()  # batch -> read time of its oldest detection
+        self._emit_latency = deque(maxlen=LATENCY_SAMPLES)
+        self._browser_latency = deque(maxlen=LATENCY_SAMPLES)
+        self.lines_queued = 0
+        self.lines_dropped = 0
+        self.detections_queued = 0
+        self.detections_sent = 0
+        self.batches = 0
+        self._thread = None
+
+    def start(self):
+        if self._thread is None:
+            self._thread = threading.Thread(target=self._run, name='socket-fanout', daemon=True)
+            self._thread.start()
+
+    def line(self, text, received=None):
+        """Queue a terminal line"""
+        with self._lock:
+            if len(self._lines) == self._lines.maxlen:
+                self.lines_dropped += 1
+            self._lines.append(text)
+            self.lines_queued += 1
+            if self._lines_since is None:
+                self._lines_since = received or time.monotonic()
+        self._wake.set()
+
+    def detection(self, kind, detection, received=None):
+        """Queue a 'new' or 'updated' detection"""
+        key = detection.get('id')
+        with self._lock:
+            entry = self._detections.get(key)
+            if entry is None:
+                self._detections[key] = [kind, dict(detection)]
+            else:
+                entry[1] = dict(detection)  # Stays 'new' if it was
+            self.detections_queued += 1
+            if self._detections_since is None:
+                self._detections_since = received or time.monotonic()
+        self._wake.set()
+
+    def drop_detections(self):
+        """Forget queued detection changes (the session was cleared)"""
+        with self._lock:
+            self._detections.clear()
+            self._detections_since = None
+
+    def ack(self, batch):
+        """A browser received detections_batch number batch"""
+        with self._lock:
+            received = self._sent.pop(batch, None)
+        if received is not None:
+            self._browser_latency.append(time.monotonic() - received)
+
+    def _run(self):
+        while True:
+            self._wake.wait()
+            self._wake.clear()
+            # Let the rest of a burst arrive, then send it as one batch
+            time.sleep(self.interval)
+            self.flush()
+
+    def flush(self):
+        with self._lock:
+            lines, lines_since = list(self._lines), self._lines_since
+            self._lines.clear()
+            self._lines_since = None
+            pending, detections_since = self._detections, self._detections_since
+            self._detections = OrderedDict()
+            self._detections_since = None
+            if pending:
+                self._batch += 1
+                batch = self._batch
+                self._sent[batch] = detections_since
+                if len(self._sent) > PENDING_ACKS:
+                    self._sent.popitem(last=False)
+        if lines:
+            self._emit('serial_batch', {'lines': lines}, room=SERIAL_ROOM)
+            self._emit_latency.append(time.monotonic() - lines_since)
+        if pending:
+            delta = {'new': [], 'updated': [], 'batch': batch}
+            for kind, detection in pending.values():
+                delta[kind].append(detection)
+            self._emit('detections_batch', delta)
+            self._emit_latency.append(time.monotonic() - detections_since)
+            self.detections_sent += len(pending)
+        if lines or pending:
+            self.batches += 1
+
+    def stats(self):
+        return {
+            'interval': self.interval,
+            'batches': self.batches,
+            'lines': self.lines_queued,
+            'lines_dropped': self.lines_dropped,
+            'detection_events': self.detections_queued,
+            'detections_sent': self.detections_sent,
+            'read_to_emit': _percentiles(list(self._emit_latency)),
+            'read_to_browser': _percentiles(list(self._browser_latency)),
+        }
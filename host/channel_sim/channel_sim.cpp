@@ -0,0 +1,311 @@
+// Channel hopping simulator, built by [env:channel_sim].
+//
+// Replays a timeline of 802.11 management frames against the firmware's
+// ChannelScheduler (src/channel_scheduler.h) in adaptive and round-robin mode.
+// A frame is heard only while the radio is tuned to its channel. Reports
+// time-to-first-detection (first frame a target sent -> first frame heard)
+// and how many targets were never heard at all.
+//
+//   .pio/build/channel_sim/program [--pcap file.pcap] [--timeline file.txt]
+//                                  [--runs N] [--seed N] [--switch-ms N]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "channel_scheduler.h"
+#include "ieee80211.h"
+#include "capture.h"
+
+#define SIM_TICK_MS 10            // loop() interval (LOOP_INTERVAL_MS)
+#define SIM_ROUND_ROBIN_MS 500    // CHANNEL_HOP_INTERVAL
+
+typedef struct {
+    uint32_t t_ms;
+    uint8_t channel;
+    int32_t target;               // Index into the target list, -1 for background traffic
+} sim_frame_t;
+
+typedef struct {
+    std::vector<sim_frame_t> frames;
+    std::vector<uint32_t> target_first_ms;   // When each target's first frame was sent
+} sim_timeline_t;
+
+typedef struct {
+    std::vector<double> ttfd_ms;  // Per detected target
+    size_t targets = 0;
+    size_t missed = 0;
+    uint64_t target_frames = 0;
+    uint64_t target_frames_heard = 0;
+    uint64_t hops = 0;
+    uint64_t duration_ms = 0;
+} sim_result_t;
+
+static uint32_t next_rand(uint32_t* state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static double rand_unit(uint32_t* state) { return (next_rand(state) & 0xFFFFFF) / (double)0x1000000; }
+
+// 2.4 GHz channels of the Flock APs in datasets/Flock-*.csv (WiGLE export)
+static const uint16_t flock_channel_weights[14] = {0, 239, 1, 1, 0, 1, 195, 26, 3, 0, 1, 182, 0, 0};
+// Background APs: mostly the non-overlapping channels
+static const uint16_t background_channel_weights[14] = {0, 30, 3, 3, 3, 3, 30, 3, 3, 3, 3, 30, 3, 2};
+
+static uint8_t pick_channel(const uint16_t* weights, uint32_t* rng)
+{
+    uint32_t total = 0;
+    for (int ch = 1; ch <= 13; ch++) total += weights[ch];
+    uint32_t r = next_rand(rng) % total;
+    for (int ch = 1; ch <= 13; ch++) {
+        if (r < weights[ch]) return (uint8_t)ch;
+        r -= weights[ch];
+    }
+    return 1;
+}
+
+// Drive-by model: targets come into range at random times for 4-20 s and
+// beacon every 102.4 ms (80% received); background APs beacon throughout and
+// clients send probe bursts across all channels.
+static void synthesize_timeline(uint32_t seed, uint32_t duration_ms, size_t targets, sim_timeline_t* tl)
+{
+    uint32_t rng = seed;
+    tl->frames.clear();
+    tl->target_first_ms.assign(targets, UINT32_MAX);
+
+    for (size_t i = 0; i < targets; i++) {
+        uint8_t ch = pick_channel(flock_channel_weights, &rng);
+        uint32_t start = next_rand(&rng) % (duration_ms - 25000);
+        uint32_t stay = 4000 + next_rand(&rng) % 16000;
+        for (double t = start + rand_unit(&rng) * 102.4; t < start + stay; t += 102.4) {
+            if (rand_unit(&rng) < 0.8) {
+                tl->frames.push_back({(uint32_t)t, ch, (int32_t)i});
+                if ((uint32_t)t < tl->target_first_ms[i]) tl->target_first_ms[i] = (uint32_t)t;
+            }
+        }
+    }
+    for (int ap = 0; ap < 60; ap++) {
+        uint8_t ch = pick_channel(background_channel_weights, &rng);
+        for (double t = rand_unit(&rng) * 102.4; t < duration_ms; t += 102.4) {
+            tl->frames.push_back({(uint32_t)t, ch, -1});
+        }
+    }
+    for (int client = 0; client < 20; client++) {
+        for (uint32_t t = next_rand(&rng) % 30000; t < duration_ms; t += 20000 + next_rand(&rng) % 20000) {
+            for (uint8_t ch = 1; ch <= 13; ch++) {
+                tl->frames.push_back({t + ch * 15u, ch, -1});
+            }
+        }
+    }
+    std::sort(tl->frames.begin(), tl->frames.end(),
+              [](const sim_frame_t& a, const sim_frame_t& b) { return a.t_ms < b.t_ms; });
+}
+
+static const char* default_patterns[] = {"flock", "fs ext battery", "penguin", "pigvision"};
+
+static bool ssid_is_target(const uint8_t* ssid, size_t len)
+{
+    std::string lower;
+    for (size_t i = 0; i < len; i++) lower += (char)tolower(ssid[i]);
+    for (const char* p : default_patterns) {
+        if (lower.find(p) != std::string::npos) return true;
+    }
+    return false;
+}
+
+// Targets are transmitters whose SSID matches the firmware's default patterns
+static bool load_pcap_timeline(const char* path, sim_timeline_t* tl, std::string* error)
+{
+    std::vector<wifi_capture_frame_t> wifi;
+    std::vector<ble_capture_adv_t> ble;
+    if (!load_pcap(path, &wifi, &ble, error)) return false;
+
+    std::vector<std::string> target_macs;
+    for (const wifi_capture_frame_t& rec : wifi) {
+        wlan_mgmt_info_t info;
+        if (rec.channel < CHANNEL_FIRST || rec.channel > MAX_CHANNEL ||
+            !wlan_parse_mgmt(rec.frame.data(), rec.frame.size(), &info)) {
+            continue;
+        }
+        int32_t target = -1;
+        std::string mac((const char*)info.addr2, 6);
+        auto it = std::find(target_macs.begin(), target_macs.end(), mac);
+        if (it != target_macs.end()) {
+            target = (int32_t)(it - target_macs.begin());
+        } else if (info.ssid && ssid_is_target(info.ssid, info.ssid_len)) {
+            target = (int32_t)target_macs.size();
+            target_macs.push_back(mac);
+            tl->target_first_ms.push_back((uint32_t)(rec.ts_us / 1000));
+        }
+        tl->frames.push_back({(uint32_t)(rec.ts_us / 1000), rec.channel, target});
+    }
+    return true;
+}
+
+// One frame per line: "<t_ms> <channel> <target id, or -1 for background>"
+static bool load_text_timeline(const char* path, sim_timeline_t* tl, std::string* error)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        *error = std::string("cannot open ") + path;
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        unsigned long t;
+        unsigned ch;
+        long target;
+        if (sscanf(line, "%lu %u %ld", &t, &ch, &target) != 3 || ch < CHANNEL_FIRST || ch > MAX_CHANNEL) {
+            *error = std::string("bad timeline line: ") + line;
+            fclose(f);
+            return false;
+        }
+        if (target >= 0) {
+            if ((size_t)target >= tl->target_first_ms.size()) tl->target_first_ms.resize(target + 1, UINT32_MAX);
+            if (t < tl->target_first_ms[target]) tl->target_first_ms[target] = (uint32_t)t;
+        }
+        tl->frames.push_back({(uint32_t)t, (uint8_t)ch, (int32_t)target});
+    }
+    fclose(f);
+    std::stable_sort(tl->frames.begin(), tl->frames.end(),
+                     [](const sim_frame_t& a, const sim_frame_t& b) { return a.t_ms < b.t_ms; });
+    return true;
+}
+
+static void simulate(const sim_timeline_t& tl, bool adaptive, uint32_t phase_ms, uint32_t switch_ms,
+                     sim_result_t* out)
+{
+    ChannelScheduler sched;
+    std::vector<uint32_t> first_heard(tl.target_first_ms.size(), UINT32_MAX);
+    uint32_t now = 0;
+    uint32_t deaf_until = 0;
+    sched.begin(now, 1 + phase_ms % 13, adaptive, SIM_ROUND_ROBIN_MS);
+    // Start the round-robin at a random point of its dwell
+    uint32_t offset = phase_ms % SIM_ROUND_ROBIN_MS;
+
+    for (const sim_frame_t& f : tl.frames) {
+        while (now + SIM_TICK_MS <= f.t_ms + offset) {
+            now += SIM_TICK_MS;
+            if (sched.tick(now)) {
+                out->hops++;
+                deaf_until = now + switch_ms;
+            }
+        }
+        uint32_t t = f.t_ms + offset;
+        bool heard = f.channel == sched.current() && t >= deaf_until;
+        if (f.target >= 0) out->target_frames++;
+        if (!heard) continue;
+        sched.noteFrame(f.channel);
+        if (f.target >= 0) {
+            out->target_frames_heard++;
+            sched.noteDetection(f.channel, t);
+            if (first_heard[f.target] == UINT32_MAX) first_heard[f.target] = f.t_ms;
+        }
+    }
+    for (size_t i = 0; i < first_heard.size(); i++) {
+        if (tl.target_first_ms[i] == UINT32_MAX) continue;
+        out->targets++;
+        if (first_heard[i] == UINT32_MAX) {
+            out->missed++;
+        } else {
+            out->ttfd_ms.push_back((double)(first_heard[i] - tl.target_first_ms[i]));
+        }
+    }
+    if (!tl.frames.empty()) out->duration_ms += tl.frames.back().t_ms;
+}
+
+static double percentile(std::vector<double> v, double p)
+{
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t idx = (size_t)(p * (v.size() - 1) + 0.5);
+    return v[idx];
+}
+
+static void print_result(const char* name, const sim_result_t& r)
+{
+    double mean = 0;
+    for (double v : r.ttfd_ms) mean += v;
+    if (!r.ttfd_ms.empty()) mean /= r.ttfd_ms.size();
+    printf("  %-22s %7zu %7zu %9.0f %9.0f %9.0f %9.0f %8.1f%% %8.1f\n", name, r.targets, r.missed, mean,
+           percentile(r.ttfd_ms, 0.5), percentile(r.ttfd_ms, 0.9), percentile(r.ttfd_ms, 1.0),
+           r.target_frames ? 100.0 * r.target_frames_heard / r.target_frames : 0.0,
+           r.duration_ms ? r.hops * 1000.0 / r.duration_ms : 0.0);
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [--pcap file.pcap] [--timeline file.txt] [--runs N] [--seed N] [--switch-ms N]\n"
+            "  --pcap       802.11 capture; targets are transmitters with a matching SSID\n"
+            "  --timeline   text lines \"t_ms channel target_id\" (target_id -1 = background)\n"
+            "  --runs       synthetic drive-by timelines, or phase offsets for a recorded one (default 20)\n"
+            "  --seed       first synthetic seed (default 1)\n"
+            "  --switch-ms  time the radio is deaf after a channel switch (default 2)\n",
+            prog);
+}
+
+int main(int argc, char** argv)
+{
+    const char* pcap = nullptr;
+    const char* timeline = nullptr;
+    int runs = 20;
+    uint32_t seed = 1;
+    uint32_t switch_ms = 2;
+
+    for (int i = 1; i < argc; i++) {
+        const char* val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!val) {
+            usage(argv[0]);
+            return 2;
+        }
+        if (strcmp(argv[i], "--pcap") == 0) pcap = val;
+        else if (strcmp(argv[i], "--timeline") == 0) timeline = val;
+        else if (strcmp(argv[i], "--runs") == 0) runs = atoi(val);
+        else if (strcmp(argv[i], "--seed") == 0) seed = (uint32_t)strtoul(val, nullptr, 10);
+        else if (strcmp(argv[i], "--switch-ms") == 0) switch_ms = (uint32_t)strtoul(val, nullptr, 10);
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    sim_timeline_t recorded;
+    if (pcap || timeline) {
+        std::string error;
+        bool ok = pcap ? load_pcap_timeline(pcap, &recorded, &error) : load_text_timeline(timeline, &recorded, &error);
+        if (!ok) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    sim_result_t round_robin, adaptive;
+    uint32_t rng = seed * 2654435761u;
+    for (int run = 0; run < runs; run++) {
+        const sim_timeline_t* tl = &recorded;
+        sim_timeline_t synthetic;
+        if (!pcap && !timeline) {
+            synthesize_timeline(seed + run, 600000, 30, &synthetic);
+            tl = &synthetic;
+        }
+        uint32_t phase = next_rand(&rng);
+        simulate(*tl, false, phase, switch_ms, &round_robin);
+        simulate(*tl, true, phase, switch_ms, &adaptive);
+    }
+
+    printf("\n=== Channel hopping: time to first detection ===\n");
+    printf("Input: %s, %d runs, %u ms deaf after each switch\n\n",
+           pcap ? pcap : (timeline ? timeline : "synthetic drive-by (30 targets, 600 s)"), runs, switch_ms);
+    printf("  %-22s %7s %7s %9s %9s %9s %9s %9s %8s\n", "scheduler", "targets", "missed", "mean ms", "p50 ms",
+           "p90 ms", "max ms", "heard", "hops/s");
+    print_result("round-robin 500 ms", round_robin);
+    print_result("adaptive", adaptive);
+    return 0;
+}
@@ -0,0 +1,414 @@
+// Capture loading for the replay harness. See capture.h.
+#include "capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINKTYPE_IEEE802_11          105
+#define LINKTYPE_IEEE802_11_RADIOTAP 127
+#define LINKTYPE_BLE_LL_WITH_PHDR    251
+#define LINKTYPE_BLE_LL              256
+
+#define BLE_ADV_ACCESS_ADDRESS 0x8E89BED6
+
+static uint16_t rd16(const uint8_t* p, bool swap)
+{
+    return swap ? (uint16_t)((p[0] << 8) | p[1]) : (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t rd32(const uint8_t* p, bool swap)
+{
+    return swap ? ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]
+                : (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint8_t channel_from_freq(uint16_t mhz)
+{
+    if (mhz == 2484) return 14;
+    if (mhz >= 2412 && mhz < 2484) return (uint8_t)((mhz - 2407) / 5);
+    return 0;
+}
+
+// Channel from the DS Parameter Set element, for captures without radiotap
+static uint8_t channel_from_ies(const std::vector<uint8_t>& frame)
+{
+    if (frame.size() < 24) return 0;
+    uint8_t subtype = (frame[0] >> 4) & 0x0F;
+    size_t pos = 24 + ((subtype == 0x05 || subtype == 0x08) ? 12 : 0);
+    while (pos + 2 <= frame.size()) {
+        uint8_t id = frame[pos];
+        uint8_t len = frame[pos + 1];
+        if (pos + 2 + len > frame.size()) break;
+        if (id == 3 && len == 1) return frame[pos + 2];
+        pos += 2 + len;
+    }
+    return 0;
+}
+
+// Radiotap header: pull out the channel and antenna signal, return the header
+// length (0 if malformed). Only the fields up to dBm antenna signal are walked.
+static size_t parse_radiotap(const uint8_t* p, size_t len, uint8_t* channel, int8_t* rssi, bool* has_fcs)
+{
+    if (len < 8 || p[0] != 0) return 0;
+    size_t hdr_len = rd16(p + 2, false);
+    if (hdr_len > len) return 0;
+
+    uint32_t present = rd32(p + 4, false);
+    size_t pos = 8;
+    uint32_t word = present;
+    while ((word & 0x80000000u) && pos + 4 <= hdr_len) {
+        word = rd32(p + pos, false);
+        pos += 4;
+    }
+
+    static const uint8_t align[] = { 8, 1, 1, 2, 1, 1 };
+    static const uint8_t size[] = { 8, 1, 1, 4, 2, 1 };
+    for (int field = 0; field < 6; field++) {
+        if (!(present & (1u << field))) continue;
+        pos = (pos + align[field] - 1) & ~(size_t)(align[field] - 1);
+        if (pos + size[field] > hdr_len) break;
+        if (field == 1) *has_fcs = (p[pos] & 0x10) != 0;
+        if (field == 3) *channel = channel_from_freq(rd16(p + pos, false));
+        if (field == 5) *rssi = (int8_t)p[pos];
+        pos += size[field];
+    }
+    return hdr_len;
+}
+
+static void add_wifi(const uint8_t* p, size_t len, uint64_t ts_us, int8_t rssi, uint8_t channel, bool has_fcs,
+                     std::vector<wifi_capture_frame_t>* wifi)
+{
+    // Management frames only (type 0), as the promiscuous filter delivers them
+    if (len < 24 || ((p[0] >> 2) & 0x03) != 0) return;
+    wifi_capture_frame_t rec;
+    rec.ts_us = ts_us;
+    rec.rssi = rssi;
+    rec.frame.assign(p, p + len);
+    if (!has_fcs) rec.frame.insert(rec.frame.end(), 4, 0);
+    rec.channel = channel ? channel : channel_from_ies(rec.frame);
+    if (!rec.channel) rec.channel = 1;
+    wifi->push_back(std::move(rec));
+}
+
+static void add_ble(const uint8_t* p, size_t len, uint64_t ts_us, int8_t rssi, std::vector<ble_capture_adv_t>* ble)
+{
+    // access address (4) | header (2) | AdvA (6) | AdvData
+    if (len < 12 || rd32(p, false) != BLE_ADV_ACCESS_ADDRESS) return;
+    uint8_t pdu_type = p[4] & 0x0F;
+    uint8_t pdu_len = p[5];
+    // ADV_IND, ADV_NONCONN_IND, SCAN_RSP, ADV_SCAN_IND carry AdvA + AdvData
+    if (pdu_type != 0 && pdu_type != 2 && pdu_type != 4 && pdu_type != 6) return;
+    if (pdu_len < 6 || 6 + (size_t)pdu_len > len) return;
+    ble_capture_adv_t rec;
+    rec.ts_us = ts_us;
+    rec.rssi = rssi;
+    for (int i = 0; i < 6; i++) rec.addr[i] = p[6 + 5 - i];
+    rec.adv.assign(p + 12, p + 6 + pdu_len);
+    ble->push_back(std::move(rec));
+}
+
+bool load_pcap(const char* path, std::vector<wifi_capture_frame_t>* wifi,
+               std::vector<ble_capture_adv_t>* ble, std::string* error)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        *error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    uint8_t gh[24];
+    if (fread(gh, 1, sizeof(gh), f) != sizeof(gh)) {
+        fclose(f);
+        *error = std::string(path) + ": short pcap header";
+        return false;
+    }
+    uint32_t magic = rd32(gh, false);
+    bool swap = false;
+    bool nanos = false;
+    if (magic == 0xa1b2c3d4) {
+    } else if (magic == 0xd4c3b2a1) {
+        swap = true;
+    } else if (magic == 0xa1b23c4d) {
+        nanos = true;
+    } else if (magic == 0x4d3cb2a1) {
+        swap = true;
+        nanos = true;
+    } else {
+        fclose(f);
+        *error = std::string(path) + ": not a pcap file (pcapng is not supported)";
+        return false;
+    }
+    uint32_t linktype = rd32(gh + 20, swap) & 0x0FFFFFFF;
+    if (linktype != LINKTYPE_IEEE802_11 && linktype != LINKTYPE_IEEE802_11_RADIOTAP &&
+        linktype != LINKTYPE_BLE_LL_WITH_PHDR && linktype != LINKTYPE_BLE_LL) {
+        fclose(f);
+        *error = std::string(path) + ": unsupported link type " + std::to_string(linktype);
+        return false;
+    }
+
+    std::vector<uint8_t> buf;
+    uint64_t first_us = 0;
+    bool have_first = false;
+    uint8_t rh[16];
+    while (fread(rh, 1, sizeof(rh), f) == sizeof(rh)) {
+        uint64_t ts_us = (uint64_t)rd32(rh, swap) * 1000000 + rd32(rh + 4, swap) / (nanos ? 1000 : 1);
+        uint32_t incl = rd32(rh + 8, swap);
+        if (incl > 262144) break;
+        buf.resize(incl);
+        if (fread(buf.data(), 1, incl, f) != incl) break;
+        if (!have_first) {
+            first_us = ts_us;
+            have_first = true;
+        }
+        ts_us -= first_us;
+
+        const uint8_t* p = buf.data();
+        size_t len = incl;
+        switch (linktype) {
+            case LINKTYPE_IEEE802_11:
+                add_wifi(p, len, ts_us, -60, 0, false, wifi);
+                break;
+            case LINKTYPE_IEEE802_11_RADIOTAP: {
+                uint8_t channel = 0;
+                int8_t rssi = -60;
+                bool has_fcs = false;
+                size_t hdr = parse_radiotap(p, len, &channel, &rssi, &has_fcs);
+                if (hdr) add_wifi(p + hdr, len - hdr, ts_us, rssi, channel, has_fcs, wifi);
+                break;
+            }
+            case LINKTYPE_BLE_LL_WITH_PHDR: {
+                if (len < 10) break;
+                bool power_valid = rd16(p + 8, false) & 0x0002;
+                add_ble(p + 10, len - 10, ts_us, power_valid ? (int8_t)p[1] : -70, ble);
+                break;
+            }
+            case LINKTYPE_BLE_LL:
+                add_ble(p, len, ts_us, -70, ble);
+                break;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static bool parse_hex(const char* s, std::vector<uint8_t>* out)
+{
+    out->clear();
+    while (*s && *s != '\n' && *s != '\r') {
+        if (*s == ' ' || *s == ':') {
+            s++;
+            continue;
+        }
+        char byte[3] = { s[0], s[1], 0 };
+        char* end;
+        if (!s[1]) return false;
+        out->push_back((uint8_t)strtoul(byte, &end, 16));
+        if (*end) return false;
+        s += 2;
+    }
+    return true;
+}
+
+bool load_ble_text(const char* path, std::vector<ble_capture_adv_t>* ble, std::string* error)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        *error = std::string("cannot open ") + path;
+        return false;
+    }
+    char line[1024];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+        double ts_ms;
+        unsigned mac[6];
+        int rssi;
+        int consumed = 0;
+        if (sscanf(line, "%lf %x:%x:%x:%x:%x:%x %d %n", &ts_ms, &mac[0], &mac[1], &mac[2], &mac[3],
+                   &mac[4], &mac[5], &rssi, &consumed) != 8) {
+            fclose(f);
+            *error = std::string(path) + ":" + std::to_string(lineno) + ": expected <ts_ms> <mac> <rssi> <hex>";
+            return false;
+        }
+        ble_capture_adv_t rec;
+        rec.ts_us = (uint64_t)(ts_ms * 1000);
+        rec.rssi = (int8_t)rssi;
+        for (int i = 0; i < 6; i++) rec.addr[i] = (uint8_t)mac[i];
+        if (!parse_hex(line + consumed, &rec.adv)) {
+            fclose(f);
+            *error = std::string(path) + ":" + std::to_string(lineno) + ": bad hex payload";
+            return false;
+        }
+        ble->push_back(std::move(rec));
+    }
+    fclose(f);
+    return true;
+}
+
+// ============================================================================
+// SYNTHETIC TRAFFIC
+// ============================================================================
+
+static uint32_t next_rand(uint32_t* state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static const char* const common_ssids[] = {
+    "xfinitywifi", "NETGEAR42", "MyHome-5G", "ATT8s7Fk2", "Starbucks WiFi", "linksys",
+    "DIRECT-7F-HP OfficeJet", "TP-Link_3A1C", "Verizon_X7KQ9P", "CoxWiFi", "eduroam", ""
+};
+
+static const uint32_t flock_ouis[] = { 0x588e81, 0x70c94e, 0x3c9180, 0xd8f3bc };
+
+void synthesize_wifi(size_t count, uint32_t seed, std::vector<wifi_capture_frame_t>* wifi)
+{
+    uint32_t rng = seed;
+    for (size_t n = 0; n < count; n++) {
+        uint32_t r = next_rand(&rng);
+        bool beacon = (r % 10) < 7;
+        bool flock_ssid = (r % 100) == 42;
+        bool flock_mac = (r % 97) == 13;
+        // A few hundred distinct transmitters, so duplicates dominate as on the road
+        uint32_t station = next_rand(&rng) % 300;
+
+        uint8_t mac[6];
+        uint32_t oui = flock_mac ? flock_ouis[station % 4] : (0x020000 | (station * 2654435761u >> 8)) & 0xFEFFFF;
+        mac[0] = oui >> 16;
+        mac[1] = oui >> 8;
+        mac[2] = oui;
+        mac[3] = station >> 8;
+        mac[4] = station;
+        mac[5] = 0x5A;
+
+        char ssid[33];
+        if (flock_ssid) {
+            snprintf(ssid, sizeof(ssid), "Flock-%06X", station * 7919u & 0xFFFFFF);
+        } else {
+            snprintf(ssid, sizeof(ssid), "%s", common_ssids[station % (sizeof(common_ssids) / sizeof(common_ssids[0]))]);
+        }
+        size_t ssid_len = strlen(ssid);
+
+        wifi_capture_frame_t rec;
+        rec.ts_us = n * 500;  // 2000 frames/s
+        rec.rssi = (int8_t)(-40 - (int)(next_rand(&rng) % 50));
+        rec.channel = (uint8_t)(1 + station % 11);
+        std::vector<uint8_t>& f = rec.frame;
+        f.push_back(beacon ? 0x80 : 0x40);
+        f.push_back(0x00);
+        f.insert(f.end(), 2, 0);                              // duration
+        for (int i = 0; i < 6; i++) f.push_back(0xFF);         // addr1 broadcast
+        f.insert(f.end(), mac, mac + 6);                      // addr2
+        if (beacon) {
+            f.insert(f.end(), mac, mac + 6);                  // addr3 = BSSID
+        } else {
+            for (int i = 0; i < 6; i++) f.push_back(0xFF);
+        }
+        f.push_back((n << 4) & 0xFF);
+        f.push_back((n >> 4) & 0xFF);
+        if (beacon) {
+            f.insert(f.end(), 8, 0);                          // timestamp
+            f.push_back(0x64);                                // beacon interval 100 TU
+            f.push_back(0x00);
+            f.push_back(0x01);                                // capabilities
+            f.push_back(0x04);
+        }
+        f.push_back(0);
+        f.push_back((uint8_t)ssid_len);
+        f.insert(f.end(), ssid, ssid + ssid_len);
+        static const uint8_t rates[] = { 0x01, 0x08, 0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24 };
+        f.insert(f.end(), rates, rates + sizeof(rates));
+        if (beacon) {
+            f.push_back(3);
+            f.push_back(1);
+            f.push_back(rec.channel);
+        }
+        f.insert(f.end(), 4, 0);                              // FCS
+        wifi->push_back(std::move(rec));
+    }
+}
+
+static void push_ad(std::vector<uint8_t>* adv, uint8_t type, const uint8_t* data, size_t len)
+{
+    adv->push_back((uint8_t)(len + 1));
+    adv->push_back(type);
+    adv->insert(adv->end(), data, data + len);
+}
+
+void synthesize_ble(size_t count, uint32_t seed, std::vector<ble_capture_adv_t>* ble)
+{
+    static const char* const names[] = { "", "", "", "JBL Flip 5", "Tile", "[TV] Samsung", "LE-Bose QC45", "MX Keys" };
+    uint32_t rng = seed;
+    for (size_t n = 0; n < count; n++) {
+        uint32_t r = next_rand(&rng);
+        uint32_t device = next_rand(&rng) % 200;
+        ble_capture_adv_t rec;
+        rec.ts_us = n * 2000;  // 500 advertisements/s
+        rec.rssi = (int8_t)(-50 - (int)(next_rand(&rng) % 45));
+        rec.addr[0] = 0xC0 | (device & 0x3F);
+        rec.addr[1] = device >> 6;
+        rec.addr[2] = 0x11;
+        rec.addr[3] = 0x22;
+        rec.addr[4] = device;
+        rec.addr[5] = 0x33;
+
+        uint8_t flags = 0x06;
+        push_ad(&rec.adv, 0x01, &flags, 1);
+
+        const char* name = names[device % (sizeof(names) / sizeof(names[0]))];
+        if ((r % 100) == 7) name = "FS Ext Battery";
+        if ((r % 100) == 8) name = "Penguin-2041";
+        if (name[0]) push_ad(&rec.adv, 0x09, (const uint8_t*)name, strlen(name));
+
+        if ((r % 100) == 9) {
+            // Raven 1.3.x service set
+            static const uint8_t raven[] = { 0x0a, 0x18, 0x00, 0x31, 0x00, 0x32, 0x00, 0x33 };
+            push_ad(&rec.adv, 0x03, raven, sizeof(raven));
+        } else if (device % 3 == 0) {
+            static const uint8_t svc[] = { 0x0f, 0x18, 0x0d, 0x18 };
+            push_ad(&rec.adv, 0x03, svc, sizeof(svc));
+        }
+        ble->push_back(std::move(rec));
+    }
+}
+
+void ble_device_from_capture(const ble_capture_adv_t& adv, NimBLEAdvertisedDevice* device)
+{
+    uint8_t native[6];
+    for (int i = 0; i < 6; i++) native[i] = adv.addr[5 - i];
+    device->address = NimBLEAddress(native);
+    device->rssi = adv.rssi;
+    device->name.clear();
+    device->services.clear();
+
+    size_t pos = 0;
+    const std::vector<uint8_t>& d = adv.adv;
+    while (pos + 1 < d.size()) {
+        uint8_t len = d[pos];
+        if (len == 0 || pos + 1 + len > d.size()) break;
+        uint8_t type = d[pos + 1];
+        const uint8_t* data = &d[pos + 2];
+        size_t data_len = len - 1;
+        switch (type) {
+            case 0x08:  // Shortened local name
+            case 0x09:  // Complete local name
+                device->name.assign((const char*)data, data_len);
+                break;
+            case 0x02:
+            case 0x03:
+                for (size_t i = 0; i + 2 <= data_len; i += 2) device->services.emplace_back(data + i, 2, false);
+                break;
+            case 0x04:
+            case 0x05:
+                for (size_t i = 0; i + 4 <= data_len; i += 4) device->services.emplace_back(data + i, 4, false);
+                break;
+            case 0x06:
+            case 0x07:
+                for (size_t i = 0; i + 16 <= data_len; i += 16) device->services.emplace_back(data + i, 16, false);
+                break;
+        }
+        pos += 1 + len;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef REPLAY_CAPTURE_H
+#define REPLAY_CAPTURE_H
+// Capture loading for the replay harness: 802.11 management frames and BLE
+// advertisements from pcap files, BLE text recordings, or a synthetic mix.
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <NimBLEDevice.h>
+
+typedef struct {
+    uint64_t ts_us;              // Relative to the first record in the capture
+    int8_t rssi;
+    uint8_t channel;
+    std::vector<uint8_t> frame;  // 802.11 MPDU including the 4-byte FCS, as the ESP32 delivers it
+} wifi_capture_frame_t;
+
+typedef struct {
+    uint64_t ts_us;
+    uint8_t addr[6];             // Display order (aa:bb:cc:dd:ee:ff)
+    int8_t rssi;
+    std::vector<uint8_t> adv;    // Raw AD structures (advertising or scan response data)
+} ble_capture_adv_t;
+
+// pcap/pcap-ns with link type 105 (802.11), 127 (radiotap), 251 (BLE LL with
+// PHDR) or 256 (BLE LL). Non-management 802.11 frames and non-advertising BLE
+// PDUs are skipped.
+bool load_pcap(const char* path, std::vector<wifi_capture_frame_t>* wifi,
+               std::vector<ble_capture_adv_t>* ble, std::string* error);
+
+// One advertisement per line: "<ts_ms> <aa:bb:cc:dd:ee:ff> <rssi> <hex AD data>",
+// blank lines and lines starting with '#' are ignored
+bool load_ble_text(const char* path, std::vector<ble_capture_adv_t>* ble, std::string* error);
+
+// Deterministic mix of ordinary traffic with a few percent of matching devices
+void synthesize_wifi(size_t count, uint32_t seed, std::vector<wifi_capture_frame_t>* wifi);
+void synthesize_ble(size_t count, uint32_t seed, std::vector<ble_capture_adv_t>* ble);
+
+// Fill a shim advertised device from a recorded advertisement
+void ble_device_from_capture(const ble_capture_adv_t& adv, NimBLEAdvertisedDevice* device);
+
+#endif
@@ -0,0 +1,711 @@
+// Frame-replay benchmark for the detection pipeline, built by [env:native].
+//
+// Runs the firmware's own setup(), then feeds captured (or synthetic) 802.11
+// management frames through wifi_sniffer_packet_handler() and BLE
+// advertisements through the registered onResult() callback. By default the
+// pipeline tasks are not started and each stage (capture, match, output) is
+// called and timed on this thread; reports ns and heap allocations per call.
+// With --threads the tasks run on their own threads against the real clock
+// and the report is sustained throughput, queue drops and the firmware's own
+// pipeline stats. With --journal the detection journal is kept in a host
+// directory and, after the run, replayed in full to time the read-back.
+// With --sigpack the pack is uploaded through the "sig" console commands
+// after setup() and swapped in before the run. Both modes end with the
+// firmware's "stats" report; its cycle counts are host nanoseconds. The
+// single-thread mode also times MAC prefix lookups on the input's addresses:
+// the original snprintf + strncasecmp loop against the integer OUI table.
+// With --led-compare the passes alternate between an idle LED and one kept
+// busy by forced detection alerts, and the capture and match stages are
+// reported for each so LED timing can be ruled out of detection latency.
+//
+//   .pio/build/native/program [--wifi file.pcap] [--ble file.pcap|file.txt]
+//                             [--synthetic N] [--passes N] [--threads [--rate N]]
+//                             [--journal DIR] [--sigpack FILE] [--led-compare] [--echo]
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include "esp_wifi.h"
+#include "host_hooks.h"
+#include "pattern_matcher.h"
+#include "oui_table.h"
+#include "capture.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Firmware entry points (src/main.cpp)
+void setup();
+void loop();
+size_t drain_wifi_frames();
+size_t drain_ble_adverts();
+size_t drain_serial_events();
+size_t drain_notify_events();
+size_t drain_led_events();
+size_t service_led();
+bool led_animating();
+void flock_detected_led_sequence();
+size_t drain_serial_tx();
+void bleStreamTick();
+void report_pipeline_stats();
+void report_journal_stats();
+void report_ble_scan_stats();
+void service_journal();
+bool journal_replaying();
+bool service_signature_build();
+void apply_signature_swap();
+bool check_ssid_pattern(const char* ssid, size_t len, ac_result_t* result);
+bool check_mac_prefix(const uint8_t* mac);
+
+// ============================================================================
+// ALLOCATION COUNTING
+// ============================================================================
+// With glibc every malloc is counted (ArduinoJson, std::string, String);
+// elsewhere only operator new is.
+
+static std::atomic<bool> alloc_tracking{false};
+static std::atomic<uint64_t> alloc_count{0};
+static std::atomic<uint64_t> alloc_bytes{0};
+
+#define JOURNAL_HOST_FS_BYTES 0xCE0000   // LittleFS partition of the FeatherS3 table
+
+static inline void note_alloc(size_t n)
+{
+    if (alloc_tracking.load(std::memory_order_relaxed)) {
+        alloc_count.fetch_add(1, std::memory_order_relaxed);
+        alloc_bytes.fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+#if defined(__GLIBC__)
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+extern "C" void __libc_free(void*);
+
+extern "C" void* malloc(size_t n) { note_alloc(n); return __libc_malloc(n); }
+extern "C" void* calloc(size_t c, size_t n) { note_alloc(c * n); return __libc_calloc(c, n); }
+extern "C" void* realloc(void* p, size_t n) { note_alloc(n); return __libc_realloc(p, n); }
+extern "C" void free(void* p) { __libc_free(p); }
+#else
+void* operator new(size_t n)
+{
+    note_alloc(n);
+    void* p = malloc(n);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t n) { return operator new(n); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+#endif
+
+// ============================================================================
+// STAGE TIMING
+// ============================================================================
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct Stage {
+    const char* name;
+    uint64_t calls = 0;
+    uint64_t ns = 0;
+    uint64_t allocs = 0;
+    uint64_t min_ns = UINT64_MAX;
+    uint64_t max_ns = 0;
+};
+
+static uint64_t timer_overhead_ns = 0;
+
+static void add_sample(Stage* stage, uint64_t ns, uint64_t allocs)
+{
+    stage->calls++;
+    stage->ns += ns;
+    stage->allocs += allocs;
+    if (ns < stage->min_ns) stage->min_ns = ns;
+    if (ns > stage->max_ns) stage->max_ns = ns;
+}
+
+// Times one call into stage and, when given, into the same stage of the
+// current --led-compare run
+template <typename Fn>
+static void timed(Stage* stage, Fn&& fn, Stage* run_stage = nullptr)
+{
+    uint64_t allocs_before = alloc_count.load(std::memory_order_relaxed);
+    auto t0 = bench_clock::now();
+    fn();
+    auto t1 = bench_clock::now();
+    uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    ns = ns > timer_overhead_ns ? ns - timer_overhead_ns : 0;
+    uint64_t allocs = alloc_count.load(std::memory_order_relaxed) - allocs_before;
+    add_sample(stage, ns, allocs);
+    if (run_stage) add_sample(run_stage, ns, allocs);
+}
+
+static void calibrate_timer()
+{
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 10000; i++) {
+        auto t0 = bench_clock::now();
+        auto t1 = bench_clock::now();
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        if (ns < best) best = ns;
+    }
+    timer_overhead_ns = best;
+}
+
+static void print_stage(const Stage& s)
+{
+    if (!s.calls) return;
+    printf("  %-26s %10llu %10.1f %10llu %10llu %12.3f\n", s.name, (unsigned long long)s.calls,
+           (double)s.ns / s.calls, (unsigned long long)s.min_ns, (unsigned long long)s.max_ns,
+           (double)s.allocs / s.calls);
+}
+
+// ============================================================================
+// LED COMPARISON
+// ============================================================================
+// Capture and match stages of the passes run with the LED idle and with an
+// alert animation always running. Pass 0 only warms the device table, and
+// the rest run idle, busy, busy, idle, ... so drift falls on both alike.
+
+struct LedRun {
+    Stage rx{"wifi rx handler"};
+    Stage ble{"ble onResult"};
+    Stage consume{"match (wifi + ble)"};
+    Stage match{"wifi match (ssid + oui)"};
+    uint32_t alerts = 0;
+};
+
+static LedRun* led_run_for_pass(LedRun* runs, int pass)
+{
+    if (pass == 0) return nullptr;
+    int n = pass - 1;
+    return &runs[(n ^ (n >> 1)) & 1];
+}
+
+static double stage_ns(const Stage& s) { return s.calls ? (double)s.ns / s.calls : 0.0; }
+
+static void print_led_row(const Stage& idle, const Stage& busy)
+{
+    if (!idle.calls && !busy.calls) return;
+    double a = stage_ns(idle), b = stage_ns(busy);
+    printf("  %-26s %12.1f %12.1f %12llu %12llu %+9.1f%%\n", idle.name, a, b, (unsigned long long)idle.max_ns,
+           (unsigned long long)busy.max_ns, a > 0 ? (b - a) * 100.0 / a : 0.0);
+}
+
+static void print_led_compare(const LedRun* runs)
+{
+    printf("\nLED idle vs busy (%u forced alerts):\n", runs[1].alerts);
+    printf("  %-26s %12s %12s %12s %12s %10s\n", "stage", "idle ns", "busy ns", "idle max", "busy max", "change");
+    print_led_row(runs[0].rx, runs[1].rx);
+    print_led_row(runs[0].ble, runs[1].ble);
+    print_led_row(runs[0].consume, runs[1].consume);
+    print_led_row(runs[0].match, runs[1].match);
+}
+
+// ============================================================================
+// MAC PREFIX LOOKUP
+// ============================================================================
+// The string path check_mac_prefix() used before the OUI table, with the
+// built-in prefix list as it was, against a binary search of the same
+// prefixes as integers and the firmware's own check_mac_prefix().
+
+static const char* legacy_mac_prefixes[] = {
+    "58:8e:81", "cc:cc:cc", "ec:1b:bd", "90:35:ea", "04:0d:84",
+    "f0:82:c0", "1c:34:f1", "38:5b:44", "94:34:69", "b4:e3:f9",
+    "70:c9:4e", "3c:91:80", "d8:f3:bc", "80:30:49", "14:5a:fc",
+    "74:4c:a1", "08:3a:88", "9c:2f:9d", "94:08:53", "e4:aa:ea"
+};
+
+static bool legacy_check_mac_prefix(const uint8_t* mac)
+{
+    char mac_str[9];
+    snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x", mac[0], mac[1], mac[2]);
+    for (size_t i = 0; i < sizeof(legacy_mac_prefixes) / sizeof(legacy_mac_prefixes[0]); i++) {
+        if (strncasecmp(mac_str, legacy_mac_prefixes[i], 8) == 0) return true;
+    }
+    return false;
+}
+
+// ns per lookup over every address, repeated until about 100 ms has passed
+template <typename Fn>
+static double time_lookups(const std::vector<const uint8_t*>& macs, Fn&& lookup, size_t* hits)
+{
+    uint64_t lookups = 0;
+    size_t found = 0;
+    auto start = bench_clock::now();
+    double elapsed;
+    do {
+        found = 0;
+        for (const uint8_t* mac : macs) found += lookup(mac) ? 1 : 0;
+        lookups += macs.size();
+        elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+    } while (elapsed < 0.1);
+    *hits = found;
+    return elapsed * 1e9 / lookups;
+}
+
+static void bench_mac_prefix(const std::vector<wifi_capture_frame_t>& wifi, const std::vector<ble_capture_adv_t>& ble)
+{
+    std::vector<const uint8_t*> macs;
+    for (const wifi_capture_frame_t& rec : wifi) {
+        if (rec.frame.size() >= 16) macs.push_back(&rec.frame[10]);
+    }
+    for (const ble_capture_adv_t& rec : ble) macs.push_back(rec.addr);
+    if (macs.empty()) return;
+
+    std::vector<uint32_t> keys;
+    for (const char* prefix : legacy_mac_prefixes) {
+        unsigned a, b, c;
+        sscanf(prefix, "%x:%x:%x", &a, &b, &c);
+        keys.push_back((a << 16) | (b << 8) | c);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    size_t legacy_hits, table_hits, firmware_hits;
+    double legacy_ns = time_lookups(macs, legacy_check_mac_prefix, &legacy_hits);
+    double table_ns = time_lookups(macs, [&](const uint8_t* mac) {
+        return oui_lookup(keys.data(), keys.size(), oui_from_mac(mac)) >= 0;
+    }, &table_hits);
+    double firmware_ns = time_lookups(macs, check_mac_prefix, &firmware_hits);
+
+    printf("\nMAC prefix lookup (%zu addresses, %zu prefixes):\n", macs.size(), keys.size());
+    printf("  %-34s %10s %8s\n", "implementation", "ns/lookup", "matches");
+    printf("  %-34s %10.1f %8zu\n", "snprintf + strncasecmp (old)", legacy_ns, legacy_hits);
+    printf("  %-34s %10.1f %8zu\n", "oui_lookup (integer table)", table_ns, table_hits);
+    printf("  %-34s %10.1f %8zu\n", "check_mac_prefix (signature set)", firmware_ns, firmware_hits);
+    if (legacy_hits != table_hits) printf("  WARNING: the old and new lookups disagree\n");
+}
+
+// ============================================================================
+// REPLAY
+// ============================================================================
+
+// ESP-IDF hands the callback a wifi_promiscuous_pkt_t: rx_ctrl followed by the MPDU
+struct PromiscuousPacket {
+    std::vector<uint8_t> storage;
+    wifi_promiscuous_pkt_t* pkt() { return (wifi_promiscuous_pkt_t*)storage.data(); }
+};
+
+static PromiscuousPacket make_packet(const wifi_capture_frame_t& rec)
+{
+    PromiscuousPacket p;
+    p.storage.resize(sizeof(wifi_promiscuous_pkt_t) + rec.frame.size() + 8);
+    wifi_promiscuous_pkt_t* pkt = p.pkt();
+    pkt->rx_ctrl.rssi = rec.rssi;
+    pkt->rx_ctrl.channel = rec.channel;
+    pkt->rx_ctrl.sig_len = rec.frame.size();
+    memcpy(pkt->payload, rec.frame.data(), rec.frame.size());
+    return p;
+}
+
+// What the matching stage sees: addr2 and the SSID element if it leads the body
+static void frame_match_inputs(const wifi_capture_frame_t& rec, const uint8_t** mac, const char** ssid, size_t* len)
+{
+    const std::vector<uint8_t>& f = rec.frame;
+    *mac = &f[10];
+    *ssid = "";
+    *len = 0;
+    uint8_t subtype = (f[0] >> 4) & 0x0F;
+    size_t pos = 24 + ((subtype == 0x05 || subtype == 0x08) ? 12 : 0);
+    if (pos + 2 <= f.size() && f[pos] == 0 && f[pos + 1] <= 32 && pos + 2 + f[pos + 1] <= f.size()) {
+        *ssid = (const char*)&f[pos + 2];
+        *len = f[pos + 1];
+    }
+}
+
+// ============================================================================
+// THREADED RUN
+// ============================================================================
+// The main thread plays both radio drivers and feeds the input at --rate
+// records/s (flat out by default); loop() gets a thread of its own. The
+// capture queues drop what the matching task cannot keep up with, exactly as
+// on the device.
+
+static int run_threaded(std::vector<PromiscuousPacket>& packets, std::vector<NimBLEAdvertisedDevice>& devices,
+                        int passes, uint32_t rate, wifi_promiscuous_cb_t rx, NimBLEAdvertisedDeviceCallbacks* on_result,
+                        int saved_stdout)
+{
+    std::atomic<bool> running{true};
+    std::thread loop_thread([&running] {
+        while (running.load(std::memory_order_relaxed)) loop();
+    });
+
+    uint64_t serial_start = host_serial_bytes();
+    auto start = bench_clock::now();
+    uint64_t offered = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        size_t wi = 0, bi = 0;
+        // Keep the capture mix: one advertisement per packets/devices frames
+        while (wi < packets.size() || bi < devices.size()) {
+            if (wi < packets.size() && (bi >= devices.size() || wi * devices.size() <= bi * packets.size())) {
+                rx(packets[wi++].pkt(), WIFI_PKT_MGMT);
+            } else {
+                on_result->onResult(&devices[bi++]);
+            }
+            offered++;
+            // Pace in bursts of 32, the way the driver delivers a busy channel
+            if (rate && (offered & 31) == 0) {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(offered * 1000000000ULL / rate));
+            }
+        }
+    }
+    double feed_s = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    // Let the tasks finish what was queued before sampling the stats
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    running = false;
+    loop_thread.join();
+    uint64_t serial_bytes = host_serial_bytes() - serial_start;
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    printf("\n=== Flock You replay benchmark (threads) ===\n");
+    printf("Offered: %llu records in %.3f s (%.0f records/s)\n", (unsigned long long)offered, feed_s,
+           offered / feed_s);
+    printf("Serial output: %llu bytes\n", (unsigned long long)serial_bytes);
+    printf("Pipeline stats (queue drops are records the matching task could not keep up with):\n");
+    fflush(stdout);
+    host_serial_echo(true);
+    report_pipeline_stats();
+    host_serial_inject("stats\n");
+    loop();
+    // Give the serial_tx task time to write the reports out
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    fflush(stdout);
+    // The task threads never return; skip static destructors they might still touch
+    _exit(0);
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [--wifi file.pcap] [--ble file.pcap|file.txt] [--synthetic N] [--passes N]\n"
+            "          [--threads [--rate N]] [--journal DIR] [--sigpack FILE] [--led-compare] [--echo]\n"
+            "  --wifi       802.11 capture (pcap, link type 105 or 127), repeatable\n"
+            "  --ble        BLE capture (pcap, link type 251 or 256) or text recording, repeatable\n"
+            "  --synthetic  synthetic WiFi frames when no --wifi is given (default 4096; BLE gets N/4)\n"
+            "  --passes     times to replay the captures (default 10)\n"
+            "  --threads    run the pipeline tasks on threads and measure sustained throughput\n"
+            "  --rate       records/s fed in --threads mode (default 0 = as fast as possible)\n"
+            "  --journal    keep the detection journal in DIR (an existing directory) and time a full replay\n"
+            "  --sigpack    upload this signature pack (api/sigpack.py) before the run\n"
+            "  --led-compare  alternate passes with the LED idle and with forced alerts, compare capture and match\n"
+            "  --echo       print the firmware's serial output\n",
+            prog);
+}
+
+static bool ends_with(const char* s, const char* suffix)
+{
+    size_t a = strlen(s), b = strlen(suffix);
+    return a >= b && strcmp(s + a - b, suffix) == 0;
+}
+
+// Push a pack through the same console commands api/sigpack.py sends, then
+// build and swap it in (the builder and matching tasks do this with --threads)
+static bool upload_sigpack(const char* path, bool threads)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    std::vector<uint8_t> pack;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) pack.insert(pack.end(), buf, buf + n);
+    fclose(f);
+
+    std::string cmds = "sig begin " + std::to_string(pack.size()) + "\n";
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < pack.size(); i += 64) {
+        cmds += "sig data ";
+        for (size_t j = i; j < pack.size() && j < i + 64; j++) {
+            cmds += hex[pack[j] >> 4];
+            cmds += hex[pack[j] & 0x0F];
+        }
+        cmds += "\n";
+    }
+    cmds += "sig end\n";
+    host_serial_inject(cmds.c_str());
+    loop();
+    if (threads) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    } else {
+        service_signature_build();
+        apply_signature_swap();
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<wifi_capture_frame_t> wifi;
+    std::vector<ble_capture_adv_t> ble;
+    size_t synthetic = 4096;
+    int passes = 10;
+    bool echo = false;
+    bool threads = false;
+    uint32_t rate = 0;
+    bool have_wifi_input = false;
+    bool have_ble_input = false;
+    const char* journal_dir = nullptr;
+    const char* sigpack_path = nullptr;
+    bool led_compare = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string error;
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--wifi") == 0 && val) {
+            std::vector<ble_capture_adv_t> ignored;
+            if (!load_pcap(val, &wifi, &ignored, &error)) {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+            have_wifi_input = true;
+            i++;
+        } else if (strcmp(arg, "--ble") == 0 && val) {
+            std::vector<wifi_capture_frame_t> ignored;
+            bool ok = ends_with(val, ".pcap") ? load_pcap(val, &ignored, &ble, &error)
+                                              : load_ble_text(val, &ble, &error);
+            if (!ok) {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+            have_ble_input = true;
+            i++;
+        } else if (strcmp(arg, "--synthetic") == 0 && val) {
+            synthetic = (size_t)strtoul(val, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--passes") == 0 && val) {
+            passes = atoi(val);
+            i++;
+        } else if (strcmp(arg, "--rate") == 0 && val) {
+            rate = (uint32_t)strtoul(val, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--journal") == 0 && val) {
+            journal_dir = val;
+            i++;
+        } else if (strcmp(arg, "--sigpack") == 0 && val) {
+            sigpack_path = val;
+            i++;
+        } else if (strcmp(arg, "--threads") == 0) {
+            threads = true;
+        } else if (strcmp(arg, "--led-compare") == 0) {
+            led_compare = true;
+        } else if (strcmp(arg, "--echo") == 0) {
+            echo = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (led_compare && (threads || passes < 3)) {
+        fprintf(stderr, "--led-compare needs the single-thread mode and at least 3 passes\n");
+        return 2;
+    }
+    if (!have_wifi_input && !have_ble_input) {
+        synthesize_wifi(synthetic, 0x5EED, &wifi);
+        synthesize_ble(synthetic / 4, 0xB1E, &ble);
+    }
+
+    // Bring up the firmware on a virtual clock so delay() and capture gaps cost
+    // nothing, or on the real clock with live tasks for --threads
+    host_clock_virtual(!threads);
+    host_clock_set_ms(0);
+    host_tasks_start(threads);
+    host_serial_echo(echo);
+    if (journal_dir) host_fs_root(journal_dir, JOURNAL_HOST_FS_BYTES);
+    // Anything the firmware writes to stdout other than through Serial only shows with --echo
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (!echo) {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+    setup();
+    if (sigpack_path && !upload_sigpack(sigpack_path, threads)) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        fprintf(stderr, "cannot read %s\n", sigpack_path);
+        return 1;
+    }
+
+    wifi_promiscuous_cb_t rx = host_wifi_rx_cb();
+    NimBLEAdvertisedDeviceCallbacks* on_result = NimBLEDevice::getScan()->callbacks;
+    if (!rx || !on_result) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        fprintf(stderr, "setup() did not register the WiFi RX callback and BLE scan callbacks\n");
+        return 1;
+    }
+
+    // Everything the timed loop touches is built up front
+    std::vector<PromiscuousPacket> packets;
+    packets.reserve(wifi.size());
+    for (const wifi_capture_frame_t& rec : wifi) packets.push_back(make_packet(rec));
+    std::vector<NimBLEAdvertisedDevice> devices(ble.size());
+    for (size_t i = 0; i < ble.size(); i++) ble_device_from_capture(ble[i], &devices[i]);
+
+    uint64_t capture_us = 0;
+    if (!wifi.empty()) capture_us = wifi.back().ts_us;
+    if (!ble.empty() && ble.back().ts_us > capture_us) capture_us = ble.back().ts_us;
+    capture_us += 1000000;
+
+    if (threads) {
+        return run_threaded(packets, devices, passes, rate, rx, on_result, saved_stdout);
+    }
+
+    calibrate_timer();
+
+    Stage rx_stage{"wifi rx handler"};
+    Stage ble_stage{"ble onResult"};
+    Stage consume_stage{"match (wifi + ble)"};
+    Stage match_stage{"wifi match (ssid + oui)"};
+    Stage output_stage{"output (serial/ble/led)"};
+    Stage loop_stage{"loop()"};
+    LedRun led_runs[2];
+
+    uint64_t serial_start = host_serial_bytes();
+    uint64_t base_ms = millis();
+    auto wall_start = bench_clock::now();
+    alloc_tracking = true;
+
+    for (int pass = 0; pass < passes; pass++) {
+        uint64_t pass_base_us = (base_ms + 1) * 1000 + (uint64_t)pass * capture_us;
+        size_t wi = 0, bi = 0;
+        uint64_t next_loop_us = pass_base_us;
+        LedRun* run = led_compare ? led_run_for_pass(led_runs, pass) : nullptr;
+        bool force_alerts = run == &led_runs[1];
+        while (wi < wifi.size() || bi < ble.size()) {
+            // Interleave both captures by timestamp
+            bool take_wifi = bi >= ble.size() || (wi < wifi.size() && wifi[wi].ts_us <= ble[bi].ts_us);
+            uint64_t ts = pass_base_us + (take_wifi ? wifi[wi].ts_us : ble[bi].ts_us);
+            while (next_loop_us <= ts) {
+                host_clock_set_ms(next_loop_us / 1000);
+                timed(&loop_stage, [] { loop(); });
+                // The BLE output task's periodic stream flush and the LED task's frame
+                timed(&output_stage, [] { bleStreamTick(); });
+                if (force_alerts && !led_animating()) {
+                    flock_detected_led_sequence();
+                    run->alerts++;
+                }
+                timed(&output_stage, [] { service_led(); });
+                next_loop_us += 10000;  // LOOP_INTERVAL_MS
+            }
+            host_clock_set_ms(ts / 1000);
+
+            if (take_wifi) {
+                wifi_promiscuous_pkt_t* pkt = packets[wi].pkt();
+                timed(&rx_stage, [&] { rx(pkt, WIFI_PKT_MGMT); }, run ? &run->rx : nullptr);
+                timed(&consume_stage, [] { drain_wifi_frames(); }, run ? &run->consume : nullptr);
+                timed(&output_stage, [] {
+                    drain_serial_events();
+                    service_journal();
+                    drain_notify_events();
+                    drain_led_events();
+                    drain_serial_tx();
+                });
+
+                const uint8_t* mac;
+                const char* ssid;
+                size_t len;
+                frame_match_inputs(wifi[wi], &mac, &ssid, &len);
+                timed(&match_stage, [&] {
+                    ac_result_t result;
+                    check_ssid_pattern(ssid, len, &result);
+                    check_mac_prefix(mac);
+                }, run ? &run->match : nullptr);
+                wi++;
+            } else {
+                NimBLEAdvertisedDevice* dev = &devices[bi];
+                timed(&ble_stage, [&] { on_result->onResult(dev); }, run ? &run->ble : nullptr);
+                timed(&consume_stage, [] { drain_ble_adverts(); }, run ? &run->consume : nullptr);
+                timed(&output_stage, [] {
+                    drain_serial_events();
+                    service_journal();
+                    drain_notify_events();
+                    drain_led_events();
+                    drain_serial_tx();
+                });
+                bi++;
+            }
+        }
+    }
+
+    drain_serial_tx();
+    alloc_tracking = false;
+    double wall_s = std::chrono::duration<double>(bench_clock::now() - wall_start).count();
+    uint64_t serial_bytes = host_serial_bytes() - serial_start;
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    printf("\n=== Flock You replay benchmark ===\n");
+    printf("Input: %zu WiFi frames, %zu BLE advertisements%s, %d passes\n", wifi.size(), ble.size(),
+           (have_wifi_input || have_ble_input) ? "" : " (synthetic)", passes);
+    printf("Timer overhead subtracted: %llu ns\n\n", (unsigned long long)timer_overhead_ns);
+    printf("  %-26s %10s %10s %10s %10s %12s\n", "stage", "calls", "ns/call", "min ns", "max ns", "allocs/call");
+    print_stage(rx_stage);
+    print_stage(ble_stage);
+    print_stage(consume_stage);
+    print_stage(match_stage);
+    print_stage(output_stage);
+    print_stage(loop_stage);
+
+    uint64_t records = rx_stage.calls + ble_stage.calls;
+    double pipeline_ns = (double)(rx_stage.ns + ble_stage.ns + consume_stage.ns + output_stage.ns);
+    printf("\n");
+    if (records) {
+        printf("Pipeline: %.0f records/s on one thread (capture + match + output), %.3f allocs/record\n",
+               records / (pipeline_ns / 1e9),
+               (double)(rx_stage.allocs + ble_stage.allocs + consume_stage.allocs + output_stage.allocs) / records);
+    }
+    printf("Serial output: %llu bytes (%.1f bytes/record)\n", (unsigned long long)serial_bytes,
+           records ? (double)serial_bytes / records : 0.0);
+    printf("Heap: %llu allocations, %llu bytes\n", (unsigned long long)alloc_count.load(),
+           (unsigned long long)alloc_bytes.load());
+    printf("Wall time: %.3f s\n", wall_s);
+    if (led_compare) print_led_compare(led_runs);
+    bench_mac_prefix(wifi, ble);
+
+    // Advertisements per scan mode and the probes the passive scans asked
+    // for, then the firmware's own per-stage cycle histograms
+    printf("\n");
+    fflush(stdout);
+    host_serial_echo(true);
+    report_ble_scan_stats();
+    host_serial_inject("stats\n");
+    loop();
+    drain_serial_tx();
+    fflush(stdout);
+    host_serial_echo(echo);
+
+    if (journal_dir) {
+        // Everything after seq 0, as a host that never acknowledged would ask for
+        host_serial_inject("replay 0\n");
+        loop();
+        uint64_t replay_start = host_serial_bytes();
+        auto start = bench_clock::now();
+        while (journal_replaying()) {
+            service_journal();
+            drain_serial_tx();
+        }
+        drain_serial_tx();
+        double replay_s = std::chrono::duration<double>(bench_clock::now() - start).count();
+        printf("\nJournal replay: %llu bytes in %.3f ms\n",
+               (unsigned long long)(host_serial_bytes() - replay_start), replay_s * 1000.0);
+        fflush(stdout);
+        host_serial_echo(true);
+        report_journal_stats();
+        drain_serial_tx();
+        fflush(stdout);
+    }
+    return 0;
+}
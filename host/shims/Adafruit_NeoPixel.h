@@ -0,0 +1,19 @@
+#ifndef HOST_ADAFRUIT_NEOPIXEL_H
+#define HOST_ADAFRUIT_NEOPIXEL_H
+#include <stdint.h>
+#define NEO_GRB 0
+#define NEO_KHZ800 0
+class Adafruit_NeoPixel {
+public:
+    Adafruit_NeoPixel(uint16_t, int16_t, int) {}
+    void begin() {}
+    void setBrightness(uint8_t) {}
+    void clear() { color_ = 0; }
+    void show() {}
+    void setPixelColor(uint16_t, uint32_t c) { color_ = c; }
+    uint32_t getPixelColor(uint16_t) const { return color_; }
+    static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) { return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b; }
+private:
+    uint32_t color_ = 0;
+};
+#endif
@@ -0,0 +1,70 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+// Host shim for the subset of the Arduino core used by the firmware.
+// Definitions and the harness controls are in host_shims.cpp / host_hooks.h.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+
+// The host heap stands in for PSRAM
+inline bool psramFound() { return true; }
+inline void* ps_malloc(size_t size) { return malloc(size); }
+
+class String : public std::string {
+public:
+    String() {}
+    String(const char* s) : std::string(s ? s : "") {}
+    String(const std::string& s) : std::string(s) {}
+    String(double v, int decimals) { char b[48]; snprintf(b, sizeof(b), "%.*f", decimals, v); assign(b); }
+    String(int v) : std::string(std::to_string(v)) {}
+    String(unsigned long v) : std::string(std::to_string(v)) {}
+    String operator+(const char* s) const { String r(*this); r.append(s); return r; }
+    String operator+(const String& s) const { String r(*this); r.append(s); return r; }
+    const char* c_str() const { return std::string::c_str(); }
+};
+
+class HardwareSerial {
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t len);
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t println() { return write("\n"); }
+    size_t println(const char* s) { return print(s) + println(); }
+    size_t println(const String& s) { return print(s) + println(); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+    int available();
+    int availableForWrite() { return 4096; }
+    int read();
+    operator bool() const { return true; }
+};
+extern HardwareSerial Serial;
+
+// Cycle counter: nanoseconds of the real clock, so 1000 "MHz"
+class EspClass {
+public:
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz() { return 1000; }
+};
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+// Host shim for the Arduino FS API used by the journal. Files live under a
+// host directory set with host_fs_root() (host_hooks.h); definitions are in
+// host_shims.cpp.
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct HostFile;
+
+class File {
+public:
+    File() {}
+    explicit File(std::shared_ptr<HostFile> impl) : impl_(impl) {}
+    size_t write(const uint8_t* buf, size_t size);
+    size_t read(uint8_t* buf, size_t size);
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void flush();
+    void close() { impl_.reset(); }
+    bool isDirectory() const;
+    const char* name() const;   // Last path component, as on arduino-esp32 2.x
+    const char* path() const;
+    File openNextFile(const char* mode = FILE_READ);
+    operator bool() const { return impl_ != nullptr; }
+
+private:
+    std::shared_ptr<HostFile> impl_;
+};
+
+class FS {
+public:
+    File open(const char* path, const char* mode = FILE_READ, bool create = false);
+    bool exists(const char* path);
+    bool remove(const char* path);
+    bool rename(const char* from, const char* to);
+    bool mkdir(const char* path);
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif
@@ -0,0 +1,5 @@
+#ifndef HOST_NIMBLE_ADVERTISED_DEVICE_H
+#define HOST_NIMBLE_ADVERTISED_DEVICE_H
+// Everything lives in NimBLEDevice.h, as in NimBLE-Arduino
+#include "NimBLEDevice.h"
+#endif
@@ -0,0 +1,230 @@
+#ifndef HOST_NIMBLE_DEVICE_H
+#define HOST_NIMBLE_DEVICE_H
+// Host shim for the subset of the NimBLE-Arduino 1.4 API used by the firmware.
+// Advertised devices are plain data records so recordings can be replayed.
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define BLE_ADDR_PUBLIC 0
+#define BLE_ADDR_RANDOM 1
+#define BLE_UUID_TYPE_16 16
+#define BLE_UUID_TYPE_32 32
+#define BLE_UUID_TYPE_128 128
+#define BLE_HCI_ADV_TYPE_ADV_IND 0
+#define BLE_HCI_ADV_TYPE_ADV_DIRECT_IND_HD 1
+#define BLE_HCI_ADV_TYPE_ADV_SCAN_IND 2
+#define BLE_HCI_ADV_TYPE_ADV_NONCONN_IND 3
+#define BLE_HCI_SCAN_FILT_NO_WL 0
+#define BLE_HCI_SCAN_FILT_USE_WL 1
+
+typedef struct { uint8_t type; uint8_t val[6]; } ble_addr_t;
+
+typedef struct { uint8_t type; } ble_uuid_t;
+typedef struct { ble_uuid_t u; uint16_t value; } ble_uuid16_t;
+typedef struct { ble_uuid_t u; uint32_t value; } ble_uuid32_t;
+typedef struct { ble_uuid_t u; uint8_t value[16]; } ble_uuid128_t;
+typedef union { ble_uuid_t u; ble_uuid16_t u16; ble_uuid32_t u32; ble_uuid128_t u128; } ble_uuid_any_t;
+
+class NimBLEAddress {
+public:
+    NimBLEAddress() { memset(addr_, 0, 6); }
+    // Native order is little-endian, as in NimBLE
+    NimBLEAddress(const uint8_t native[6], uint8_t type = BLE_ADDR_PUBLIC) : type_(type) { memcpy(addr_, native, 6); }
+    NimBLEAddress(ble_addr_t addr) : type_(addr.type) { memcpy(addr_, addr.val, 6); }
+    bool operator==(const NimBLEAddress& o) const { return type_ == o.type_ && memcmp(addr_, o.addr_, 6) == 0; }
+    const uint8_t* getNative() const { return addr_; }
+    uint8_t getType() const { return type_; }
+    std::string toString() const {
+        char b[18];
+        snprintf(b, sizeof(b), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 addr_[5], addr_[4], addr_[3], addr_[2], addr_[1], addr_[0]);
+        return b;
+    }
+private:
+    uint8_t addr_[6];
+    uint8_t type_ = BLE_ADDR_PUBLIC;
+};
+
+class NimBLEUUID {
+public:
+    NimBLEUUID() { memset(&uuid_, 0, sizeof(uuid_)); }
+    NimBLEUUID(uint16_t v) { memset(&uuid_, 0, sizeof(uuid_)); uuid_.u.type = BLE_UUID_TYPE_16; uuid_.u16.value = v; }
+    NimBLEUUID(uint32_t v) { memset(&uuid_, 0, sizeof(uuid_)); uuid_.u.type = BLE_UUID_TYPE_32; uuid_.u32.value = v; }
+    // Advertising data order (little-endian) when msbFirst is false
+    NimBLEUUID(const uint8_t* data, size_t size, bool msbFirst) {
+        memset(&uuid_, 0, sizeof(uuid_));
+        uint8_t le[16] = {0};
+        for (size_t i = 0; i < size && i < 16; i++) le[i] = msbFirst ? data[size - 1 - i] : data[i];
+        if (size == 2) {
+            uuid_.u.type = BLE_UUID_TYPE_16;
+            uuid_.u16.value = (uint16_t)(le[0] | (le[1] << 8));
+        } else if (size == 4) {
+            uuid_.u.type = BLE_UUID_TYPE_32;
+            uuid_.u32.value = (uint32_t)le[0] | ((uint32_t)le[1] << 8) | ((uint32_t)le[2] << 16) | ((uint32_t)le[3] << 24);
+        } else if (size == 16) {
+            uuid_.u.type = BLE_UUID_TYPE_128;
+            memcpy(uuid_.u128.value, le, 16);
+        }
+    }
+    NimBLEUUID(const char*) { memset(&uuid_, 0, sizeof(uuid_)); }
+    uint8_t bitSize() const { return uuid_.u.type; }
+    const ble_uuid_any_t* getNative() const { return &uuid_; }
+    std::string toString() const {
+        char b[40];
+        if (uuid_.u.type == BLE_UUID_TYPE_16) {
+            snprintf(b, sizeof(b), "0000%04x-0000-1000-8000-00805f9b34fb", uuid_.u16.value);
+        } else if (uuid_.u.type == BLE_UUID_TYPE_32) {
+            snprintf(b, sizeof(b), "%08x-0000-1000-8000-00805f9b34fb", uuid_.u32.value);
+        } else {
+            const uint8_t* v = uuid_.u128.value;
+            snprintf(b, sizeof(b), "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+                     v[15], v[14], v[13], v[12], v[11], v[10], v[9], v[8],
+                     v[7], v[6], v[5], v[4], v[3], v[2], v[1], v[0]);
+        }
+        return b;
+    }
+private:
+    ble_uuid_any_t uuid_;
+};
+
+class NimBLEAdvertisedDevice {
+public:
+    NimBLEAddress address;
+    int rssi = -127;
+    std::string name;
+    std::vector<NimBLEUUID> services;
+    uint8_t advType = BLE_HCI_ADV_TYPE_ADV_IND;
+
+    NimBLEAddress getAddress() { return address; }
+    int getRSSI() { return rssi; }
+    bool haveName() { return !name.empty(); }
+    std::string getName() { return name; }
+    bool haveServiceUUID() { return !services.empty(); }
+    int getServiceUUIDCount() { return (int)services.size(); }
+    NimBLEUUID getServiceUUID(int i) { return services[i]; }
+    uint8_t getAdvType() { return advType; }
+};
+
+class NimBLEAdvertisedDeviceCallbacks {
+public:
+    virtual ~NimBLEAdvertisedDeviceCallbacks() {}
+    virtual void onResult(NimBLEAdvertisedDevice* advertisedDevice) = 0;
+};
+
+class NimBLEScanResults {};
+
+class NimBLEScan {
+public:
+    void setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks* cb, bool wantDuplicates = false) { callbacks = cb; (void)wantDuplicates; }
+    void setActiveScan(bool active) { activeScan = active; }
+    void setInterval(uint16_t) {}
+    void setWindow(uint16_t) {}
+    void setDuplicateFilter(bool enabled) { duplicateFilter = enabled; }
+    void setFilterPolicy(uint8_t policy) { filterPolicy = policy; }
+    bool start(uint32_t, void (*cb)(NimBLEScanResults), bool = false) { scanning = true; completeCB = cb; return true; }
+    NimBLEScanResults start(uint32_t, bool = false) { return NimBLEScanResults(); }
+    bool stop() { scanning = false; return true; }
+    bool isScanning() { return scanning; }
+    void clearResults() {}
+
+    NimBLEAdvertisedDeviceCallbacks* callbacks = nullptr;
+    void (*completeCB)(NimBLEScanResults) = nullptr;
+    bool activeScan = false;
+    bool duplicateFilter = false;
+    uint8_t filterPolicy = BLE_HCI_SCAN_FILT_NO_WL;
+    bool scanning = false;
+};
+
+class NimBLECharacteristic;
+
+namespace NIMBLE_PROPERTY {
+    enum { READ = 0x02, WRITE_NR = 0x04, WRITE = 0x08, NOTIFY = 0x10 };
+}
+
+class NimBLECharacteristicCallbacks {
+public:
+    enum Status { SUCCESS_INDICATE, SUCCESS_NOTIFY, ERROR_INDICATE_DISABLED, ERROR_NOTIFY_DISABLED,
+                  ERROR_GATT, ERROR_NO_CLIENT, ERROR_INDICATE_TIMEOUT, ERROR_INDICATE_FAILURE };
+    virtual ~NimBLECharacteristicCallbacks() {}
+    virtual void onWrite(NimBLECharacteristic*) {}
+    virtual void onStatus(NimBLECharacteristic*, Status, int) {}
+};
+
+class NimBLECharacteristic {
+public:
+    void setValue(const uint8_t* data, size_t len) { value.assign((const char*)data, len); }
+    void setValue(const std::string& v) { value = v; }
+    std::string getValue() { return value; }
+    void notify(bool = true);
+    void setCallbacks(NimBLECharacteristicCallbacks* cb) { callbacks = cb; }
+
+    std::string value;
+    NimBLECharacteristicCallbacks* callbacks = nullptr;
+    uint32_t notifyCount = 0;
+    size_t notifyBytes = 0;
+};
+
+class NimBLEService {
+public:
+    NimBLECharacteristic* createCharacteristic(const char*, uint32_t) { return new NimBLECharacteristic(); }
+    bool start() { return true; }
+};
+
+struct ble_gap_conn_desc { uint16_t conn_handle; };
+
+class NimBLEServer;
+class NimBLEServerCallbacks {
+public:
+    virtual ~NimBLEServerCallbacks() {}
+    virtual void onConnect(NimBLEServer*) {}
+    virtual void onDisconnect(NimBLEServer*) {}
+    virtual void onMTUChange(uint16_t, ble_gap_conn_desc*) {}
+};
+
+class NimBLEServer {
+public:
+    void setCallbacks(NimBLEServerCallbacks* cb) { callbacks = cb; }
+    NimBLEService* createService(const char*) { return new NimBLEService(); }
+
+    NimBLEServerCallbacks* callbacks = nullptr;
+};
+
+class NimBLEAdvertising {
+public:
+    void reset() {}
+    void addServiceUUID(const char*) {}
+    void setAppearance(uint16_t) {}
+    void setScanResponse(bool) {}
+    void setMinPreferred(uint16_t) {}
+    void setMaxPreferred(uint16_t) {}
+};
+
+class NimBLEDevice {
+public:
+    static void init(const std::string&) {}
+    static NimBLEScan* getScan();
+    static NimBLEServer* createServer();
+    static NimBLEAdvertising* getAdvertising();
+    static bool startAdvertising() { return true; }
+    static std::string toString() { return "host"; }
+    static bool setMTU(uint16_t) { return true; }
+    static void setScanFilterMode(uint8_t) {}
+    static void setScanDuplicateCacheSize(uint16_t) {}
+    static bool whiteListAdd(const NimBLEAddress& a) { whiteList().push_back(a); return true; }
+    static bool whiteListRemove(const NimBLEAddress& a) {
+        std::vector<NimBLEAddress>& wl = whiteList();
+        for (size_t i = 0; i < wl.size(); i++) {
+            if (wl[i] == a) { wl.erase(wl.begin() + i); return true; }
+        }
+        return false;
+    }
+    static size_t getWhiteListCount() { return whiteList().size(); }
+    static NimBLEAddress getWhiteListAddress(size_t i) { return whiteList()[i]; }
+private:
+    static std::vector<NimBLEAddress>& whiteList() { static std::vector<NimBLEAddress> wl; return wl; }
+};
+
+#endif
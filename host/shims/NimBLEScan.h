@@ -0,0 +1,5 @@
+#ifndef HOST_NIMBLE_SCAN_H
+#define HOST_NIMBLE_SCAN_H
+// Everything lives in NimBLEDevice.h, as in NimBLE-Arduino
+#include "NimBLEDevice.h"
+#endif
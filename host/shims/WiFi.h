@@ -0,0 +1,6 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+#define WIFI_STA 1
+struct HostWiFi { void mode(int) {} void disconnect() {} };
+extern HostWiFi WiFi;
+#endif
@@ -0,0 +1,31 @@
+#ifndef HOST_HOOKS_H
+#define HOST_HOOKS_H
+// Controls the replay harness uses to drive the shimmed firmware.
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_wifi.h"
+
+// Clock: real (steady_clock since start) or virtual (advanced by the harness
+// and by delay(), so replays run at full speed with capture timing)
+void host_clock_virtual(bool enabled);
+void host_clock_set_ms(uint64_t ms);
+
+// Serial: bytes written by the firmware, optional echo to stdout, and input
+// injected as if typed on the console
+uint64_t host_serial_bytes();
+void host_serial_echo(bool enabled);
+void host_serial_inject(const char* text);
+
+// Tasks: recorded but not started (the harness calls the firmware's drain
+// functions itself), or each run on its own std::thread. Set before setup().
+void host_tasks_start(bool enabled);
+
+// Filesystem: LittleFS is backed by this host directory and reports capacity
+// as its size. Without a root LittleFS.begin() fails, as on an unformatted
+// board. Set before setup().
+void host_fs_root(const char* dir, size_t capacity);
+
+// Promiscuous RX callback registered by setup()
+wifi_promiscuous_cb_t host_wifi_rx_cb();
+
+#endif
@@ -0,0 +1,387 @@
+// Definitions for the host shims (Arduino core, LittleFS, esp_wifi, FreeRTOS tasks
+// and the NimBLE singletons). Only built by [env:native].
+#include <Arduino.h>
+#include <WiFi.h>
+#include <NimBLEDevice.h>
+#include <LittleFS.h>
+#include "esp_wifi.h"
+#include "host_hooks.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ============================================================================
+// CLOCK
+// ============================================================================
+
+static const auto clock_start = std::chrono::steady_clock::now();
+static bool clock_is_virtual = false;
+static uint64_t virtual_us = 0;
+
+void host_clock_virtual(bool enabled) { clock_is_virtual = enabled; }
+void host_clock_set_ms(uint64_t ms) { virtual_us = ms * 1000; }
+
+unsigned long micros()
+{
+    if (clock_is_virtual) return (unsigned long)virtual_us;
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - clock_start).count();
+}
+
+unsigned long millis()
+{
+    if (clock_is_virtual) return (unsigned long)(virtual_us / 1000);
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - clock_start).count();
+}
+
+// Not virtualised: it times real work even when the harness runs on virtual time
+uint32_t EspClass::getCycleCount()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - clock_start).count();
+}
+
+EspClass ESP;
+
+void delay(unsigned long ms)
+{
+    if (clock_is_virtual) {
+        virtual_us += (uint64_t)ms * 1000;
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+}
+
+// ============================================================================
+// SERIAL
+// ============================================================================
+
+HardwareSerial Serial;
+HostWiFi WiFi;
+
+static std::mutex serial_mutex;
+static uint64_t serial_bytes = 0;
+static bool serial_echo = false;
+static std::deque<char> serial_input;
+
+uint64_t host_serial_bytes() { return serial_bytes; }
+void host_serial_echo(bool enabled) { serial_echo = enabled; }
+
+void host_serial_inject(const char* text)
+{
+    std::lock_guard<std::mutex> lock(serial_mutex);
+    while (*text) serial_input.push_back(*text++);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len)
+{
+    std::lock_guard<std::mutex> lock(serial_mutex);
+    serial_bytes += len;
+    if (serial_echo) fwrite(buf, 1, len, stdout);
+    return len;
+}
+
+size_t HardwareSerial::printf(const char* fmt, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) return 0;
+    return write((const uint8_t*)buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+int HardwareSerial::available()
+{
+    std::lock_guard<std::mutex> lock(serial_mutex);
+    return (int)serial_input.size();
+}
+
+int HardwareSerial::read()
+{
+    std::lock_guard<std::mutex> lock(serial_mutex);
+    if (serial_input.empty()) return -1;
+    char c = serial_input.front();
+    serial_input.pop_front();
+    return (uint8_t)c;
+}
+
+// ============================================================================
+// ESP_WIFI
+// ============================================================================
+
+static wifi_promiscuous_cb_t wifi_rx_cb = nullptr;
+
+wifi_promiscuous_cb_t host_wifi_rx_cb() { return wifi_rx_cb; }
+
+esp_err_t esp_wifi_set_promiscuous(bool) { return ESP_OK; }
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb) { wifi_rx_cb = cb; return ESP_OK; }
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t*) { return ESP_OK; }
+esp_err_t esp_wifi_set_channel(uint8_t, wifi_second_chan_t) { return ESP_OK; }
+
+// ============================================================================
+// FILESYSTEM
+// ============================================================================
+// Paths are relative to the root directory; the journal only needs flat
+// directories, sequential reads/appends and whole-file removal.
+
+static std::string fs_root;
+static size_t fs_capacity = 0;
+static bool fs_mounted = false;
+
+fs::LittleFSFS LittleFS;
+
+void host_fs_root(const char* dir, size_t capacity)
+{
+    fs_root = dir ? dir : "";
+    fs_capacity = capacity;
+}
+
+namespace fs {
+
+struct HostFile {
+    FILE* fp = nullptr;
+    DIR* dir = nullptr;
+    std::string path;   // As passed to open()
+    std::string name;
+    ~HostFile() {
+        if (fp) fclose(fp);
+        if (dir) closedir(dir);
+    }
+};
+
+static std::string host_path(const char* path)
+{
+    return fs_root + (path[0] == '/' ? "" : "/") + path;
+}
+
+static File open_host_file(const std::string& path, const char* mode)
+{
+    if (!fs_mounted) return File();
+    std::string full = host_path(path.c_str());
+    auto impl = std::make_shared<HostFile>();
+    impl->path = path;
+    size_t slash = path.find_last_of('/');
+    impl->name = slash == std::string::npos ? path : path.substr(slash + 1);
+    struct stat st;
+    if (stat(full.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        impl->dir = opendir(full.c_str());
+        if (!impl->dir) return File();
+        return File(impl);
+    }
+    const char* host_mode = mode[0] == 'w' ? "wb" : (mode[0] == 'a' ? "ab" : "rb");
+    impl->fp = fopen(full.c_str(), host_mode);
+    if (!impl->fp) return File();
+    return File(impl);
+}
+
+size_t File::write(const uint8_t* buf, size_t size)
+{
+    return impl_ && impl_->fp ? fwrite(buf, 1, size, impl_->fp) : 0;
+}
+
+size_t File::read(uint8_t* buf, size_t size)
+{
+    return impl_ && impl_->fp ? fread(buf, 1, size, impl_->fp) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    int whence = mode == SeekCur ? SEEK_CUR : (mode == SeekEnd ? SEEK_END : SEEK_SET);
+    return impl_ && impl_->fp && fseek(impl_->fp, pos, whence) == 0;
+}
+
+size_t File::position() const
+{
+    return impl_ && impl_->fp ? (size_t)ftell(impl_->fp) : 0;
+}
+
+size_t File::size() const
+{
+    if (!impl_ || !impl_->fp) return 0;
+    fflush(impl_->fp);
+    struct stat st;
+    return fstat(fileno(impl_->fp), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+void File::flush()
+{
+    if (impl_ && impl_->fp) fflush(impl_->fp);
+}
+
+bool File::isDirectory() const { return impl_ && impl_->dir; }
+const char* File::name() const { return impl_ ? impl_->name.c_str() : ""; }
+const char* File::path() const { return impl_ ? impl_->path.c_str() : ""; }
+
+File File::openNextFile(const char* mode)
+{
+    if (!impl_ || !impl_->dir) return File();
+    while (struct dirent* entry = readdir(impl_->dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        return open_host_file(impl_->path + "/" + entry->d_name, mode);
+    }
+    return File();
+}
+
+File FS::open(const char* path, const char* mode, bool)
+{
+    return open_host_file(path, mode);
+}
+
+bool FS::exists(const char* path)
+{
+    struct stat st;
+    return fs_mounted && stat(host_path(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path)
+{
+    return fs_mounted && unlink(host_path(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to)
+{
+    return fs_mounted && ::rename(host_path(from).c_str(), host_path(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path)
+{
+    return fs_mounted && (::mkdir(host_path(path).c_str(), 0755) == 0 || errno == EEXIST);
+}
+
+bool LittleFSFS::begin(bool, const char*, uint8_t, const char*)
+{
+    struct stat st;
+    fs_mounted = !fs_root.empty() && stat(fs_root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    return fs_mounted;
+}
+
+void LittleFSFS::end() { fs_mounted = false; }
+
+size_t LittleFSFS::totalBytes() { return fs_mounted ? fs_capacity : 0; }
+
+static size_t dir_bytes(const std::string& full)
+{
+    size_t total = 0;
+    DIR* dir = opendir(full.c_str());
+    if (!dir) return 0;
+    while (struct dirent* entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        std::string child = full + "/" + entry->d_name;
+        struct stat st;
+        if (stat(child.c_str(), &st) != 0) continue;
+        total += S_ISDIR(st.st_mode) ? dir_bytes(child) : (size_t)st.st_size;
+    }
+    closedir(dir);
+    return total;
+}
+
+size_t LittleFSFS::usedBytes() { return fs_mounted ? dir_bytes(fs_root) : 0; }
+
+} // namespace fs
+
+// ============================================================================
+// FREERTOS TASKS
+// ============================================================================
+// By default tasks are recorded but not started: the harness drives the
+// firmware's processing functions directly so each stage can be timed on one
+// thread. Notifications are still counted so ulTaskNotifyTake() behaves.
+// With host_tasks_start(true) every task runs on its own detached thread;
+// core pinning and priorities are ignored.
+
+struct HostTask {
+    TaskFunction_t fn;
+    void* param;
+    uint32_t stack;
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifications = 0;
+};
+
+static thread_local HostTask* current_task = nullptr;
+static bool tasks_start = false;
+
+void host_tasks_start(bool enabled) { tasks_start = enabled; }
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char*, uint32_t stack, void* param,
+                                   UBaseType_t, TaskHandle_t* handle, BaseType_t)
+{
+    HostTask* task = new HostTask();
+    task->fn = fn;
+    task->param = param;
+    task->stack = stack;
+    if (handle) *handle = task;
+    if (tasks_start) {
+        std::thread([task] {
+            current_task = task;
+            task->fn(task->param);
+        }).detach();
+    }
+    return pdPASS;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return task ? task->stack : 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    HostTask* task = current_task;
+    if (!task) return 0;
+    std::unique_lock<std::mutex> lock(task->mutex);
+    task->cv.wait_for(lock, std::chrono::milliseconds(wait), [task] { return task->notifications > 0; });
+    uint32_t count = task->notifications;
+    if (clear) {
+        task->notifications = 0;
+    } else if (count) {
+        task->notifications--;
+    }
+    return count;
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+    if (!task) return;
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifications++;
+    task->cv.notify_one();
+}
+
+// ============================================================================
+// NIMBLE
+// ============================================================================
+
+NimBLEScan* NimBLEDevice::getScan()
+{
+    static NimBLEScan scan;
+    return &scan;
+}
+
+NimBLEServer* NimBLEDevice::createServer()
+{
+    static NimBLEServer server;
+    return &server;
+}
+
+NimBLEAdvertising* NimBLEDevice::getAdvertising()
+{
+    static NimBLEAdvertising advertising;
+    return &advertising;
+}
+
+// No client is ever connected on the host
+void NimBLECharacteristic::notify(bool)
+{
+    notifyCount++;
+    notifyBytes += value.size();
+    if (callbacks) callbacks->onStatus(this, NimBLECharacteristicCallbacks::ERROR_NO_CLIENT, 0);
+}
@@ -0,0 +1,268 @@
+"""Compile the WiGLE exports into the firmware's known-device filter.
+
+Every CSV with a `netid` column (WiGLE's export format: datasets/FS+Ext+
+Battery_*.csv, datasets/Flock-*.csv and any export you add) contributes its
+full MAC addresses. They are built into an xor filter (see src/known_macs.h)
+written to known_macs_data.h in the build directory, so each MAC check on
+the device is three table reads and no false negatives.
+
+PlatformIO runs this before every build of an environment that lists it in
+extra_scripts. Per environment:
+
+    custom_known_macs_bits = 16            ; fingerprint bits, 8 or 16
+    custom_known_macs_sources = datasets/*.csv, ~/wigle/my_area.csv
+
+It can also run on its own:
+
+    python scripts/known_macs.py --report            # every env that uses it
+    python scripts/known_macs.py --env native --out build/known_macs
+"""
+import argparse
+import configparser
+import csv
+import glob
+import math
+import os
+import random
+import re
+import sys
+
+MASK64 = (1 << 64) - 1
+MAC_RE = re.compile(r'^[0-9a-fA-F]{2}([:-][0-9a-fA-F]{2}){5}$')
+DEFAULT_SOURCES = 'datasets/*.csv'
+DEFAULT_BITS = 16
+HEADER_NAME = 'known_macs_data.h'
+FP_TRIALS = 200000
+
+
+def mix64(x):
+    """murmur3 fmix64, as known_macs_hash() in src/known_macs.h"""
+    x ^= x >> 33
+    x = (x * 0xff51afd7ed558ccd) & MASK64
+    x ^= x >> 33
+    x = (x * 0xc4ceb9fe1a85ec53) & MASK64
+    x ^= x >> 33
+    return x
+
+
+def rotl64(x, r):
+    return ((x << r) | (x >> (64 - r))) & MASK64
+
+
+def reduce32(x, n):
+    return ((x & 0xFFFFFFFF) * n) >> 32
+
+
+def probes(h, block_length):
+    return (reduce32(h, block_length),
+            reduce32(rotl64(h, 21), block_length) + block_length,
+            reduce32(rotl64(h, 42), block_length) + 2 * block_length)
+
+
+def fingerprint(h, bits):
+    return (h ^ (h >> 32)) & ((1 << bits) - 1)
+
+
+def mac_key(mac):
+    return int(mac.replace(':', '').replace('-', ''), 16)
+
+
+def load_macs(patterns, root):
+    """Unique 48-bit MACs from every CSV with a netid column"""
+    macs = set()
+    files = []
+    for pattern in patterns:
+        path = os.path.expanduser(pattern.strip())
+        if not path:
+            continue
+        if not os.path.isabs(path):
+            path = os.path.join(root, path)
+        for name in sorted(glob.glob(path)):
+            with open(name, newline='', encoding='utf-8-sig', errors='replace') as f:
+                reader = csv.DictReader(f)
+                if 'netid' not in (reader.fieldnames or []):
+                    continue
+                before = len(macs)
+                for row in reader:
+                    netid = (row.get('netid') or '').strip()
+                    if MAC_RE.match(netid):
+                        macs.add(mac_key(netid))
+                files.append((os.path.relpath(name, root), len(macs) - before))
+    return sorted(macs), files
+
+
+def build_filter(keys, bits, seed=0x5EED):
+    """Xor filter over keys. Returns (seed, block_length, table)."""
+    capacity = 32 + int(math.ceil(1.23 * len(keys)))
+    block_length = capacity // 3
+    capacity = 3 * block_length
+    rng = random.Random(seed)
+    for _ in range(100):
+        seed = rng.getrandbits(64)
+        hashes = [mix64((k + seed) & MASK64) for k in keys]
+        slots = [probes(h, block_length) for h in hashes]
+        count = [0] * capacity
+        xor_index = [0] * capacity
+        for i, s in enumerate(slots):
+            for j in s:
+                count[j] += 1
+                xor_index[j] ^= i
+        # Peel slots that only one key maps to
+        queue = [j for j in range(capacity) if count[j] == 1]
+        stack = []
+        while queue:
+            j = queue.pop()
+            if count[j] != 1:
+                continue
+            i = xor_index[j]
+            stack.append((i, j))
+            for k in slots[i]:
+                count[k] -= 1
+                xor_index[k] ^= i
+                if count[k] == 1:
+                    queue.append(k)
+        if len(stack) != len(keys):
+            continue
+        table = [0] * capacity
+        for i, j in reversed(stack):
+            a, b, c = slots[i]
+            table[j] = fingerprint(hashes[i], bits) ^ table[a] ^ table[b] ^ table[c] ^ table[j]
+        return seed, block_length, table
+    raise RuntimeError('xor filter construction failed')
+
+
+def contains(key, seed, block_length, table, bits):
+    h = mix64((key + seed) & MASK64)
+    a, b, c = probes(h, block_length)
+    return fingerprint(h, bits) == table[a] ^ table[b] ^ table[c]
+
+
+def measure_fp(seed, block_length, table, bits, keys, trials=FP_TRIALS):
+    """False-positive rate over random MACs that are not in the set"""
+    members = set(keys)
+    rng = random.Random(1)
+    hits = tested = 0
+    while tested < trials:
+        key = rng.getrandbits(48)
+        if key in members:
+            continue
+        tested += 1
+        hits += contains(key, seed, block_length, table, bits)
+    return hits / tested
+
+
+def write_header(path, keys, files, bits, seed, block_length, table):
+    ctype = 'uint16_t' if bits == 16 else 'uint8_t'
+    width = 4 if bits == 16 else 2
+    lines = [
+        '// Generated by scripts/known_macs.py - do not edit',
+        '#ifndef KNOWN_MACS_DATA_H',
+        '#define KNOWN_MACS_DATA_H',
+        '',
+    ]
+    for name, added in files:
+        lines.append(f'// {name}: {added} MACs')
+    lines += [
+        f'#define KNOWN_MACS_COUNT {len(keys)}',
+        f'#define KNOWN_MACS_FINGERPRINT_BITS {bits}',
+        f'#define KNOWN_MACS_SEED 0x{seed:016x}ULL',
+        f'#define KNOWN_MACS_BLOCK_LENGTH {block_length}',
+        f'typedef {ctype} known_macs_fingerprint_t;',
+        f'static const known_macs_fingerprint_t known_macs_table[3 * KNOWN_MACS_BLOCK_LENGTH] = {{',
+    ]
+    per_line = 12 if bits == 16 else 16
+    for i in range(0, len(table), per_line):
+        lines.append('    ' + ', '.join(f'0x{v:0{width}x}' for v in table[i:i + per_line]) + ',')
+    lines += ['};', '', '#endif // KNOWN_MACS_DATA_H', '']
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    tmp = path + '.tmp'
+    with open(tmp, 'w') as f:
+        f.write('\n'.join(lines))
+    os.replace(tmp, path)
+
+
+def compile_filter(root, sources, bits, out_dir=None):
+    """Build the filter, optionally write the header, return a stats dict"""
+    if bits not in (8, 16):
+        raise ValueError('custom_known_macs_bits must be 8 or 16')
+    keys, files = load_macs(sources, root)
+    if not keys:
+        return {'macs': 0, 'bytes': 0, 'fp_rate': 0.0, 'fp_measured': 0.0, 'files': files}
+    seed, block_length, table = build_filter(keys, bits)
+    if out_dir:
+        write_header(os.path.join(out_dir, HEADER_NAME), keys, files, bits, seed, block_length, table)
+    return {
+        'macs': len(keys),
+        'bytes': len(table) * bits // 8,
+        'bits_per_mac': len(table) * bits / len(keys),
+        'fp_rate': 2.0 ** -bits,
+        'fp_measured': measure_fp(seed, block_length, table, bits, keys),
+        'files': files,
+    }
+
+
+def describe(env_name, bits, stats):
+    if not stats['macs']:
+        return f'known_macs [{env_name}]: no MACs found - filter disabled'
+    return (f"known_macs [{env_name}]: {stats['macs']} MACs, xor{bits} filter, "
+            f"{stats['bytes']} bytes ({stats['bits_per_mac']:.1f} bits/MAC), "
+            f"false positives {stats['fp_rate'] * 100:.4f}% expected, "
+            f"{stats['fp_measured'] * 100:.4f}% measured over {FP_TRIALS} random MACs")
+
+
+def env_settings(options):
+    bits = int(options.get('custom_known_macs_bits', DEFAULT_BITS))
+    sources = options.get('custom_known_macs_sources', DEFAULT_SOURCES)
+    return bits, [s for s in re.split(r'[,\n]', sources) if s.strip()]
+
+
+def read_envs(root):
+    """(name, options) for every [env:...] section of platformio.ini that runs this script"""
+    config = configparser.ConfigParser(interpolation=None)
+    config.read(os.path.join(root, 'platformio.ini'))
+    return [(section[4:], dict(config[section])) for section in config.sections()
+            if section.startswith('env:') and 'known_macs.py' in config[section].get('extra_scripts', '')]
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    parser = argparse.ArgumentParser(description='Compile WiGLE exports into the known-device filter')
+    parser.add_argument('--report', action='store_true', help='print size and false-positive rate per env')
+    parser.add_argument('--env', help='use this environment\'s settings')
+    parser.add_argument('--out', help='write known_macs_data.h into this directory')
+    args = parser.parse_args()
+
+    envs = read_envs(root)
+    if args.report:
+        for name, options in envs:
+            bits, sources = env_settings(options)
+            print(describe(name, bits, compile_filter(root, sources, bits)))
+        return 0
+    options = dict(envs).get(args.env, {}) if args.env else {}
+    bits, sources = env_settings(options)
+    stats = compile_filter(root, sources, bits, args.out)
+    for name, added in stats['files']:
+        print(f'  {name}: {added} MACs')
+    print(describe(args.env or 'default', bits, stats))
+    return 0
+
+
+def pio_pre_build(env):
+    """extra_scripts hook: generate the header for this env and add it to the include path"""
+    root = env.subst('$PROJECT_DIR')
+    bits = int(env.GetProjectOption('custom_known_macs_bits', str(DEFAULT_BITS)))
+    sources = env.GetProjectOption('custom_known_macs_sources', DEFAULT_SOURCES)
+    out_dir = os.path.join(env.subst('$BUILD_DIR'), 'known_macs')
+    stats = compile_filter(root, [s for s in re.split(r'[,\n]', sources) if s.strip()], bits, out_dir)
+    print(describe(env.subst('$PIOENV'), bits, stats))
+    if stats['macs']:
+        env.Append(CPPPATH=[out_dir])
+
+
+try:
+    Import('env')  # noqa: F821 - provided by SCons when PlatformIO runs this script
+except NameError:
+    if __name__ == '__main__':
+        sys.exit(main())
+else:
+    pio_pre_build(env)  # noqa: F821
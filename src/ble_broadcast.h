@@ -3,6 +3,11 @@
 
 #include <NimBLEDevice.h>
 #include <ArduinoJson.h>
+#include <mutex>
+#include "ble_stream.h"
+#include "instrumentation.h"
+#include "serial_tx.h"
+#include "ieee80211.h"
 
 // ============================================================================
 // BLE BROADCAST SERVICE FOR IOS APP
@@ -15,18 +20,47 @@
 #define DETECTION_CHAR_UUID          "beb5483e-36e1-4688-b7f5-ea07361b26a8"
 #define COMMAND_CHAR_UUID            "beb5483e-36e1-4688-b7f5-ea07361b26a9"
 #define STREAM_CHAR_UUID             "beb5483e-36e1-4688-b7f5-ea07361b26aa"  // New: Live scan stream
+#define STREAM_STATS_CHAR_UUID       "beb5483e-36e1-4688-b7f5-ea07361b26ab"  // Stream sent/dropped counters
+
+#define DETECTION_RETRY_SLOTS 4          // Detection notifications kept for retry under congestion
+#define DETECTION_PAYLOAD_MAX 256
+#define STREAM_STATS_UPDATE_INTERVAL 1000
 
 // BLE Server objects
 static NimBLEServer* pServer = nullptr;
 static NimBLECharacteristic* pDetectionCharacteristic = nullptr;
 static NimBLECharacteristic* pCommandCharacteristic = nullptr;
 static NimBLECharacteristic* pStreamCharacteristic = nullptr;  // New: Stream characteristic
+static NimBLECharacteristic* pStreamStatsCharacteristic = nullptr;
 static bool deviceConnected = false;
 static bool oldDeviceConnected = false;
 static bool streamingEnabled = true;  // Enable/disable streaming
 
 // Forward declaration for detection callback
 void (*onCommandReceived)(const char* command) = nullptr;
+// Wakes the BLE output task when a stream batch is sealed
+void (*onStreamBatchReady)() = nullptr;
+
+// Batched scan stream. Records are encoded by the matching task and loop();
+// only the BLE output task sends, and it sends without holding the mutex, so
+// a producer never waits on the BLE host.
+static BleStreamEncoder bleStream;
+static std::mutex bleStreamMutex;
+static unsigned long lastStreamStatsUpdate = 0;
+
+// Detection retry queue: the BLE output task and the serial task (journal
+// replay) notify detections; the NimBLE host task clears it on disconnect
+static std::mutex bleDetectionMutex;
+
+typedef struct {
+    uint16_t len;
+    uint8_t data[DETECTION_PAYLOAD_MAX];
+} pending_detection_t;
+
+static pending_detection_t pendingDetections[DETECTION_RETRY_SLOTS];
+static uint8_t pendingDetectionHead = 0;
+static uint8_t pendingDetectionCount = 0;
+static uint32_t detectionRetryOverflows = 0;
 
 // ============================================================================
 // BLE SERVER CALLBACKS
@@ -35,12 +69,26 @@ void (*onCommandReceived)(const char* command) = nullptr;
 class ServerCallbacks : public NimBLEServerCallbacks {
     void onConnect(NimBLEServer* pServer) {
         deviceConnected = true;
-        Serial.println("[BLE Server] iOS app connected!");
+        serial_log("[BLE Server] iOS app connected!\n");
+    }
+
+    void onMTUChange(uint16_t MTU, ble_gap_conn_desc* desc) {
+        std::lock_guard<std::mutex> lock(bleStreamMutex);
+        bleStream.setMtu(MTU);
+        serial_log("[BLE Server] MTU negotiated: %u\n", MTU);
     }
 
     void onDisconnect(NimBLEServer* pServer) {
         deviceConnected = false;
-        Serial.println("[BLE Server] iOS app disconnected");
+        {
+            std::lock_guard<std::mutex> lock(bleStreamMutex);
+            bleStream.reset();
+        }
+        {
+            std::lock_guard<std::mutex> lock(bleDetectionMutex);
+            pendingDetectionCount = 0;
+        }
+        serial_log("[BLE Server] iOS app disconnected\n");
         // Restart advertising
         NimBLEDevice::startAdvertising();
     }
@@ -50,15 +98,15 @@ class CommandCallbacks : public NimBLECharacteristicCallbacks {
     void onWrite(NimBLECharacteristic* pCharacteristic) {
         std::string value = pCharacteristic->getValue();
         if (value.length() > 0) {
-            Serial.printf("[BLE Server] Command received: %s\n", value.c_str());
+            serial_log("[BLE Server] Command received: %s\n", value.c_str());
             
             // Handle built-in commands
             if (value == "stream_on") {
                 streamingEnabled = true;
-                Serial.println("[BLE Server] Streaming ENABLED");
+                serial_log("[BLE Server] Streaming ENABLED\n");
             } else if (value == "stream_off") {
                 streamingEnabled = false;
-                Serial.println("[BLE Server] Streaming DISABLED");
+                serial_log("[BLE Server] Streaming DISABLED\n");
             } else if (onCommandReceived) {
                 onCommandReceived(value.c_str());
             }
@@ -66,12 +114,60 @@ class CommandCallbacks : public NimBLECharacteristicCallbacks {
     }
 };
 
+// Records the outcome of the last notify(); NimBLE reports it synchronously
+class NotifyStatusCallbacks : public NimBLECharacteristicCallbacks {
+public:
+    void onStatus(NimBLECharacteristic* pCharacteristic, Status s, int code) {
+        lastStatus = s;
+    }
+
+    Status lastStatus = SUCCESS_NOTIFY;
+};
+
+static NotifyStatusCallbacks* detectionNotifyStatus = nullptr;
+static NotifyStatusCallbacks* streamNotifyStatus = nullptr;
+
+// Notify and classify the result for the stream encoder's backpressure logic
+static ble_stream_send_t notifyWithStatus(NimBLECharacteristic* pCharacteristic, NotifyStatusCallbacks* status,
+                                          const uint8_t* data, size_t len) {
+    if (!deviceConnected || !pCharacteristic) {
+        return STREAM_SEND_NO_SUBSCRIBER;
+    }
+    status->lastStatus = NimBLECharacteristicCallbacks::SUCCESS_NOTIFY;
+    {
+        INSTRUMENT_SCOPE(STAGE_NOTIFY);
+        pCharacteristic->setValue(data, len);
+        pCharacteristic->notify();
+    }
+    INSTRUMENT_COUNT(COUNTER_NOTIFY_CALLS, 1);
+    switch (status->lastStatus) {
+        case NimBLECharacteristicCallbacks::SUCCESS_NOTIFY:
+            return STREAM_SEND_OK;
+        case NimBLECharacteristicCallbacks::ERROR_GATT:
+            INSTRUMENT_COUNT(COUNTER_NOTIFY_CONGESTED, 1);
+            return STREAM_SEND_CONGESTED;
+        default:
+            return STREAM_SEND_NO_SUBSCRIBER;
+    }
+}
+
+static ble_stream_send_t sendStreamBatch(const uint8_t* data, size_t len) {
+    if (!streamingEnabled) {
+        return STREAM_SEND_NO_SUBSCRIBER;
+    }
+    return notifyWithStatus(pStreamCharacteristic, streamNotifyStatus, data, len);
+}
+
 // ============================================================================
 // INITIALIZATION
 // ============================================================================
 
 void initBLEBroadcast() {
-    Serial.println("[BLE Server] Initializing BLE broadcast service...");
+    serial_log("[BLE Server] Initializing BLE broadcast service...\n");
+    
+    // Ask for the largest ATT MTU so one notification can carry a full stream batch
+    NimBLEDevice::setMTU(BLE_STREAM_MAX_PAYLOAD + 3);
+    bleStream.reset();
     
     // Create server
     pServer = NimBLEDevice::createServer();
@@ -85,6 +181,8 @@ void initBLEBroadcast() {
         DETECTION_CHAR_UUID,
         NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
     );
+    detectionNotifyStatus = new NotifyStatusCallbacks();
+    pDetectionCharacteristic->setCallbacks(detectionNotifyStatus);
     
     // Create command characteristic (receive from iOS app)
     pCommandCharacteristic = pService->createCharacteristic(
@@ -98,6 +196,14 @@ void initBLEBroadcast() {
         STREAM_CHAR_UUID,
         NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
     );
+    streamNotifyStatus = new NotifyStatusCallbacks();
+    pStreamCharacteristic->setCallbacks(streamNotifyStatus);
+    
+    // Create stream statistics characteristic (ble_stream_stats_t, read by the app)
+    pStreamStatsCharacteristic = pService->createCharacteristic(
+        STREAM_STATS_CHAR_UUID,
+        NIMBLE_PROPERTY::READ
+    );
     
     // Start the service
     pService->start();
@@ -124,13 +230,13 @@ void initBLEBroadcast() {
     // Start advertising
     NimBLEDevice::startAdvertising();
     
-    Serial.println("[BLE Server] ========================================");
-    Serial.println("[BLE Server] BLE ADVERTISING ACTIVE");
-    Serial.printf("[BLE Server] Device Name: %s\n", NimBLEDevice::toString().c_str());
-    Serial.println("[BLE Server] Service UUID: " FLOCK_SERVICE_UUID);
-    Serial.println("[BLE Server] Open FlockFinder iOS app and tap 'Scan'");
-    Serial.println("[BLE Server] Note: BLE devices don't appear in iOS Settings!");
-    Serial.println("[BLE Server] ========================================");
+    serial_log("[BLE Server] ========================================\n");
+    serial_log("[BLE Server] BLE ADVERTISING ACTIVE\n");
+    serial_log("[BLE Server] Device Name: %s\n", NimBLEDevice::toString().c_str());
+    serial_log("[BLE Server] Service UUID: " FLOCK_SERVICE_UUID "\n");
+    serial_log("[BLE Server] Open FlockFinder iOS app and tap 'Scan'\n");
+    serial_log("[BLE Server] Note: BLE devices don't appear in iOS Settings!\n");
+    serial_log("[BLE Server] ========================================\n");
 }
 
 // ============================================================================
@@ -141,7 +247,43 @@ bool isAppConnected() {
     return deviceConnected;
 }
 
-void broadcastDetection(const char* deviceType, const char* macAddress, const char* ssid, int rssi, double confidence) {
+// Caller holds bleDetectionMutex. The oldest detection is dropped if all slots are full.
+static void queueDetectionRetry(const uint8_t* data, size_t len) {
+    if (pendingDetectionCount == DETECTION_RETRY_SLOTS) {
+        pendingDetectionHead = (pendingDetectionHead + 1) % DETECTION_RETRY_SLOTS;
+        pendingDetectionCount--;
+        detectionRetryOverflows++;
+    }
+    pending_detection_t* slot = &pendingDetections[(pendingDetectionHead + pendingDetectionCount) % DETECTION_RETRY_SLOTS];
+    slot->len = len;
+    memcpy(slot->data, data, len);
+    pendingDetectionCount++;
+}
+
+// Caller holds bleDetectionMutex. Returns true once the retry queue is empty.
+static bool retryPendingDetections() {
+    while (pendingDetectionCount) {
+        pending_detection_t* slot = &pendingDetections[pendingDetectionHead];
+        ble_stream_send_t rc = notifyWithStatus(pDetectionCharacteristic, detectionNotifyStatus, slot->data, slot->len);
+        if (rc == STREAM_SEND_CONGESTED) {
+            return false;
+        }
+        pendingDetectionHead = (pendingDetectionHead + 1) % DETECTION_RETRY_SLOTS;
+        pendingDetectionCount--;
+    }
+    return true;
+}
+
+// True while detection notifications are queued behind a congested link
+bool detectionRetryPending() {
+    std::lock_guard<std::mutex> lock(bleDetectionMutex);
+    return pendingDetectionCount > 0;
+}
+
+// seq is the journal sequence number (0 if not journaled); replayed marks
+// detections read back from the journal
+void broadcastDetection(const char* deviceType, const char* macAddress, const char* ssid, int rssi, double confidence,
+                        uint32_t seq = 0, bool replayed = false) {
     if (!deviceConnected || !pDetectionCharacteristic) {
         return;  // No app connected, skip broadcast
     }
@@ -154,89 +296,81 @@ void broadcastDetection(const char* deviceType, const char* macAddress, const ch
     doc["rssi"] = rssi;
     doc["confidence"] = confidence;
     doc["ts"] = millis();
+    if (seq) doc["seq"] = seq;
+    if (replayed) doc["replay"] = true;
     
     // Serialize to string
     char buffer[256];
     size_t len = serializeJson(doc, buffer);
     
-    // Send notification to iOS app
-    pDetectionCharacteristic->setValue((uint8_t*)buffer, len);
-    pDetectionCharacteristic->notify();
+    // Send notification to iOS app. Detections are never sampled: if the
+    // link is congested, or older detections are still queued, keep it for retry.
+    std::lock_guard<std::mutex> lock(bleDetectionMutex);
+    ble_stream_send_t rc = STREAM_SEND_CONGESTED;
+    if (pendingDetectionCount == 0) {
+        rc = notifyWithStatus(pDetectionCharacteristic, detectionNotifyStatus, (uint8_t*)buffer, len);
+    }
+    if (rc == STREAM_SEND_CONGESTED) {
+        queueDetectionRetry((uint8_t*)buffer, len);
+        return;
+    }
     
-    Serial.printf("[BLE Server] Broadcasted detection to iOS app: %s\n", deviceType);
+    if (!replayed) {
+        serial_log("[BLE Server] Broadcasted detection to iOS app: %s\n", deviceType);
+    }
 }
 
-// Overload for simpler calls
-void broadcastWiFiDetection(const char* ssid, const uint8_t* mac, int rssi) {
+// Overload for simpler calls (deviceType comes from the matched signature family)
+void broadcastWiFiDetection(const char* ssid, const uint8_t* mac, int rssi, const char* deviceType, uint32_t seq = 0) {
     char mac_str[18];
     snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x", 
              mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
     
-    // Determine device type from SSID pattern
-    const char* deviceType = "Flock Safety";
-    if (strcasestr(ssid, "penguin")) {
-        deviceType = "Penguin";
-    } else if (strcasestr(ssid, "pigvision")) {
-        deviceType = "Pigvision";
-    }
-    
-    broadcastDetection(deviceType, mac_str, ssid, rssi, 0.9);
+    broadcastDetection(deviceType, mac_str, ssid, rssi, 0.9, seq);
 }
 
-void broadcastBLEDetection(const char* deviceName, const char* macAddress, int rssi, const char* detectedType) {
+void broadcastBLEDetection(const char* deviceName, const char* macAddress, int rssi, const char* detectedType, uint32_t seq = 0) {
     const char* deviceType = detectedType ? detectedType : "Unknown";
-    broadcastDetection(deviceType, macAddress, deviceName, rssi, 0.85);
+    broadcastDetection(deviceType, macAddress, deviceName, rssi, 0.85, seq);
 }
 
 // ============================================================================
 // STREAM LIVE SCAN DATA TO IOS APP
 // ============================================================================
 
+// Encode one record; wakes the BLE output task if that sealed a batch
+template <typename Add>
+static void streamAppend(Add add) {
+    bool sealed;
+    {
+        std::lock_guard<std::mutex> lock(bleStreamMutex);
+        bool was_ready = bleStream.batchReady();
+        add();
+        sealed = !was_ready && bleStream.batchReady();
+    }
+    if (sealed && onStreamBatchReady) {
+        onStreamBatchReady();
+    }
+}
+
 // Stream a WiFi scan result to iOS app (all scanned devices, not just detections)
-void streamWiFiScan(const char* ssid, const uint8_t* mac, int rssi, int channel, const char* frameType) {
+void streamWiFiScan(const char* ssid, const uint8_t* mac, int rssi, int channel, uint8_t subtype) {
     if (!deviceConnected || !pStreamCharacteristic || !streamingEnabled) {
         return;
     }
     
-    StaticJsonDocument<200> doc;
-    doc["evt"] = "wifi_scan";
-    doc["ssid"] = ssid ? ssid : "";
-    
-    char mac_str[18];
-    snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x", 
-             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-    doc["mac"] = mac_str;
-    doc["rssi"] = rssi;
-    doc["ch"] = channel;
-    doc["type"] = frameType;
-    doc["ts"] = millis();
-    
-    char buffer[200];
-    size_t len = serializeJson(doc, buffer);
-    
-    pStreamCharacteristic->setValue((uint8_t*)buffer, len);
-    pStreamCharacteristic->notify();
+    uint8_t kind = subtype == WLAN_SUBTYPE_BEACON ? STREAM_WIFI_BEACON
+                 : subtype == WLAN_SUBTYPE_PROBE_RESP ? STREAM_WIFI_PROBE_RESPONSE : STREAM_WIFI_PROBE_REQUEST;
+    streamAppend([&] { bleStream.addWiFi(millis(), mac, (int8_t)rssi, (uint8_t)channel, kind, ssid); });
 }
 
 // Stream a BLE scan result to iOS app (all BLE devices found)
-void streamBLEScan(const char* name, const char* mac, int rssi, bool hasServices) {
+void streamBLEScan(const char* name, const uint8_t* mac, int rssi, bool hasServices) {
     if (!deviceConnected || !pStreamCharacteristic || !streamingEnabled) {
         return;
     }
     
-    StaticJsonDocument<200> doc;
-    doc["evt"] = "ble_scan";
-    doc["name"] = name ? name : "";
-    doc["mac"] = mac;
-    doc["rssi"] = rssi;
-    doc["svc"] = hasServices;
-    doc["ts"] = millis();
-    
-    char buffer[200];
-    size_t len = serializeJson(doc, buffer);
-    
-    pStreamCharacteristic->setValue((uint8_t*)buffer, len);
-    pStreamCharacteristic->notify();
+    streamAppend([&] { bleStream.addBLE(millis(), mac, (int8_t)rssi, hasServices, name); });
 }
 
 // Stream status/info messages to iOS app
@@ -245,16 +379,18 @@ void streamStatus(const char* message) {
         return;
     }
     
-    StaticJsonDocument<150> doc;
-    doc["evt"] = "status";
-    doc["msg"] = message;
-    doc["ts"] = millis();
-    
-    char buffer[150];
-    size_t len = serializeJson(doc, buffer);
+    streamAppend([&] { bleStream.addStatus(millis(), message); });
+}
+
+// Stream a binary stats record (wire_stats_t) to the app
+bool streamStats(const uint8_t* data, size_t len) {
+    if (!deviceConnected || !pStreamCharacteristic || !streamingEnabled) {
+        return false;
+    }
     
-    pStreamCharacteristic->setValue((uint8_t*)buffer, len);
-    pStreamCharacteristic->notify();
+    bool added = false;
+    streamAppend([&] { added = bleStream.addStats(millis(), data, len); });
+    return added;
 }
 
 // Stream channel hop notification
@@ -263,16 +399,47 @@ void streamChannelHop(int channel) {
         return;
     }
     
-    StaticJsonDocument<100> doc;
-    doc["evt"] = "channel";
-    doc["ch"] = channel;
-    doc["ts"] = millis();
+    streamAppend([&] { bleStream.addChannel(millis(), (uint8_t)channel); });
+}
+
+// BLE output task only (the one caller of notify for the stream): retries
+// queued detections, sends sealed stream batches and refreshes the stream
+// stats characteristic.
+void bleStreamTick() {
+    if (!deviceConnected) {
+        return;
+    }
     
-    char buffer[100];
-    size_t len = serializeJson(doc, buffer);
+    unsigned long now = millis();
+    // Detections go first; the scan stream waits while any are queued
+    bool detections_sent;
+    {
+        std::lock_guard<std::mutex> lock(bleDetectionMutex);
+        detections_sent = retryPendingDetections();
+    }
+    ble_stream_send_t rc = STREAM_SEND_OK;
+    while (detections_sent && rc == STREAM_SEND_OK) {
+        const uint8_t* batch;
+        size_t len = 0;
+        {
+            std::lock_guard<std::mutex> lock(bleStreamMutex);
+            batch = bleStream.takeBatch(now, &len);
+        }
+        if (!batch) break;
+        rc = sendStreamBatch(batch, len);
+        std::lock_guard<std::mutex> lock(bleStreamMutex);
+        bleStream.sent(rc);
+    }
     
-    pStreamCharacteristic->setValue((uint8_t*)buffer, len);
-    pStreamCharacteristic->notify();
+    if (pStreamStatsCharacteristic && now - lastStreamStatsUpdate >= STREAM_STATS_UPDATE_INTERVAL) {
+        ble_stream_stats_t stats;
+        {
+            std::lock_guard<std::mutex> lock(bleStreamMutex);
+            stats = bleStream.stats();
+        }
+        pStreamStatsCharacteristic->setValue((const uint8_t*)&stats, sizeof(stats));
+        lastStreamStatsUpdate = now;
+    }
 }
 
 // Set callback for commands from iOS app
@@ -280,4 +447,9 @@ void setCommandCallback(void (*callback)(const char*)) {
     onCommandReceived = callback;
 }
 
+// Set callback for a sealed stream batch (wake whichever task runs bleStreamTick())
+void setStreamReadyCallback(void (*callback)()) {
+    onStreamBatchReady = callback;
+}
+
 #endif // BLE_BROADCAST_H
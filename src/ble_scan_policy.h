@@ -0,0 +1,223 @@
+#ifndef BLE_SCAN_POLICY_H
+#define BLE_SCAN_POLICY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include "frame_queue.h"
+
+// ============================================================================
+// PASSIVE-FIRST BLE SCANNING
+// ============================================================================
+// An active scan makes the controller send a SCAN_REQ to every scannable
+// advertiser in range and wait for the response, which in a parking lot or
+// downtown is most of the BLE slot. Scans are passive instead, with the
+// controller's duplicate filter on, so each advertiser is reported once per
+// scan. The filter is cleared by restarting the scan at every BLE slot and
+// at least every BLE_DUPLICATE_RESET_MS.
+//
+// When the matching task sees a passive advertisement that looks like a
+// target (OUI match, a name that matches or ends part way into a name
+// pattern, or a Raven service UUID) it queues the address for a probe. The
+// next tick() switches to a short active burst with the controller
+// whitelist set to the queued addresses, so scan requests go to those
+// advertisers only, then back to passive. An address is probed at most
+// once per BLE_PROBE_HOLDOFF_MS.
+//
+// requestProbe() is called from the matching task, noteAdvert() from the
+// NimBLE host task, everything else from loop().
+
+#ifndef BLE_SCAN_PASSIVE_FIRST
+#define BLE_SCAN_PASSIVE_FIRST 1        // 0 = active scan throughout, no probes
+#endif
+#ifndef BLE_DUPLICATE_RESET_MS
+#define BLE_DUPLICATE_RESET_MS 1000     // Longest an advertiser stays filtered as a duplicate
+#endif
+#define BLE_DUPLICATE_CACHE_SIZE 200    // Controller duplicate filter entries
+#define BLE_DUPLICATE_MODE 2            // Filter on address and advertising data
+#ifndef BLE_PROBE_BURST_MS
+#define BLE_PROBE_BURST_MS 400          // Active scan time per probe burst
+#endif
+#define BLE_PROBE_MAX_TARGETS 4         // Addresses whitelisted per burst
+#define BLE_PROBE_QUEUE_SIZE 8          // Pending probe requests (power of two)
+#define BLE_PROBE_HOLDOFF_MS 60000      // Minimum time between probes of one address
+#define BLE_PROBE_MEMORY 32             // Recently probed addresses remembered
+#define BLE_PROBE_PARTIAL_MIN 3         // Pattern characters a truncated name must end with
+
+enum ble_scan_mode_t : uint8_t {
+    BLE_SCAN_PASSIVE = 0,
+    BLE_SCAN_ACTIVE,
+    BLE_SCAN_MODE_COUNT
+};
+
+typedef struct {
+    uint8_t mac[6];        // Display order
+    uint8_t addr_type;     // BLE_ADDR_PUBLIC / BLE_ADDR_RANDOM
+} ble_probe_t;
+
+typedef struct {
+    uint64_t airtime_ms;   // Time scanned in this mode
+    uint32_t adverts;      // Advertisements reported by the controller
+    uint32_t scannable;    // Of those, from scannable advertisers
+} ble_scan_mode_stats_t;
+
+class BleScanPolicy {
+public:
+    void begin(bool passive_first) {
+        passive_first_ = passive_first;
+        mode_.store(passive_first ? BLE_SCAN_PASSIVE : BLE_SCAN_ACTIVE, std::memory_order_relaxed);
+        in_slot_ = false;
+        target_count_ = 0;
+        recent_count_ = 0;
+        recent_next_ = 0;
+        for (int i = 0; i < BLE_SCAN_MODE_COUNT; i++) {
+            airtime_ms_[i] = 0;
+            adverts_[i].store(0, std::memory_order_relaxed);
+            scannable_[i].store(0, std::memory_order_relaxed);
+        }
+        probes_requested_ = 0;
+        probes_dropped_ = 0;
+        bursts_ = 0;
+        duplicate_resets_ = 0;
+    }
+
+    // Matching task: a passive advertisement looked like a target. Returns
+    // true if the address was queued for a probe.
+    bool requestProbe(const uint8_t* mac, uint8_t addr_type, uint32_t now) {
+        if (!passive_first_ || mode_.load(std::memory_order_relaxed) != BLE_SCAN_PASSIVE) return false;
+        for (uint8_t i = 0; i < recent_count_; i++) {
+            if (memcmp(recent_[i].mac, mac, 6) == 0 && now - recent_[i].at < BLE_PROBE_HOLDOFF_MS) {
+                return false;
+            }
+        }
+        ble_probe_t probe;
+        memcpy(probe.mac, mac, 6);
+        probe.addr_type = addr_type;
+        if (!probes_.push(probe)) {
+            probes_dropped_++;
+            return false;
+        }
+        // Remember it, replacing the oldest entry once the memory is full
+        recent_t* slot = &recent_[recent_next_];
+        recent_next_ = (recent_next_ + 1) % BLE_PROBE_MEMORY;
+        if (recent_count_ < BLE_PROBE_MEMORY) recent_count_++;
+        memcpy(slot->mac, mac, 6);
+        slot->at = now;
+        probes_requested_++;
+        return true;
+    }
+
+    // Scan callback: one advertisement reported in the current mode
+    void noteAdvert(bool scannable) {
+        uint8_t mode = mode_.load(std::memory_order_relaxed);
+        adverts_[mode].fetch_add(1, std::memory_order_relaxed);
+        if (scannable) scannable_[mode].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // A BLE slot begins: scan with mode() and targets()
+    void slotStarted(uint32_t now) {
+        target_count_ = 0;
+        setMode(passive_first_ ? BLE_SCAN_PASSIVE : BLE_SCAN_ACTIVE, now);
+        in_slot_ = true;
+    }
+
+    // The BLE slot ended; a burst in progress is abandoned
+    void slotEnded(uint32_t now) {
+        if (!in_slot_) return;
+        airtime_ms_[mode()] += now - mode_since_;
+        in_slot_ = false;
+        target_count_ = 0;
+    }
+
+    // During a BLE slot. Returns true when the scan must be restarted with
+    // mode() and targets(): a burst starts or ends, or the duplicate filter
+    // is due for a reset.
+    bool tick(uint32_t now) {
+        if (!in_slot_) return false;
+        if (mode() == BLE_SCAN_ACTIVE && passive_first_) {
+            if (now - scan_since_ < BLE_PROBE_BURST_MS) return false;
+            target_count_ = 0;
+            setMode(BLE_SCAN_PASSIVE, now);
+            return true;
+        }
+        if (passive_first_) {
+            ble_probe_t probe;
+            while (target_count_ < BLE_PROBE_MAX_TARGETS && probes_.pop(probe)) {
+                targets_[target_count_++] = probe;
+            }
+            if (target_count_) {
+                bursts_++;
+                setMode(BLE_SCAN_ACTIVE, now);
+                return true;
+            }
+        }
+        if (now - scan_since_ >= BLE_DUPLICATE_RESET_MS) {
+            scan_since_ = now;
+            duplicate_resets_++;
+            return true;
+        }
+        return false;
+    }
+
+    ble_scan_mode_t mode() const { return (ble_scan_mode_t)mode_.load(std::memory_order_relaxed); }
+    bool passiveFirst() const { return passive_first_; }
+
+    // Addresses to whitelist for the current scan (none outside a burst)
+    size_t targets(const ble_probe_t** out) const {
+        *out = targets_;
+        return target_count_;
+    }
+
+    ble_scan_mode_stats_t stats(ble_scan_mode_t mode, uint32_t now) const {
+        ble_scan_mode_stats_t s;
+        s.airtime_ms = airtime_ms_[mode] + (in_slot_ && mode == this->mode() ? now - mode_since_ : 0);
+        s.adverts = adverts_[mode].load(std::memory_order_relaxed);
+        s.scannable = scannable_[mode].load(std::memory_order_relaxed);
+        return s;
+    }
+
+    uint32_t probesRequested() const { return probes_requested_; }
+    uint32_t probesDropped() const { return probes_dropped_; }
+    uint32_t bursts() const { return bursts_; }
+    uint32_t duplicateResets() const { return duplicate_resets_; }
+
+private:
+    typedef struct {
+        uint8_t mac[6];
+        uint32_t at;
+    } recent_t;
+
+    void setMode(ble_scan_mode_t mode, uint32_t now) {
+        if (in_slot_) airtime_ms_[this->mode()] += now - mode_since_;
+        mode_.store(mode, std::memory_order_relaxed);
+        mode_since_ = now;
+        scan_since_ = now;
+    }
+
+    bool passive_first_ = true;
+    std::atomic<uint8_t> mode_{BLE_SCAN_PASSIVE};
+    bool in_slot_ = false;
+    uint32_t mode_since_ = 0;      // Airtime accounting start for the current mode
+    uint32_t scan_since_ = 0;      // Last scan (re)start
+
+    // Match task side
+    SpscQueue<ble_probe_t, BLE_PROBE_QUEUE_SIZE> probes_;
+    recent_t recent_[BLE_PROBE_MEMORY];
+    uint8_t recent_count_ = 0;
+    uint8_t recent_next_ = 0;
+    uint32_t probes_requested_ = 0;
+    uint32_t probes_dropped_ = 0;
+
+    // loop() side
+    ble_probe_t targets_[BLE_PROBE_MAX_TARGETS];
+    uint8_t target_count_ = 0;
+    uint64_t airtime_ms_[BLE_SCAN_MODE_COUNT];
+    uint32_t bursts_ = 0;
+    uint32_t duplicate_resets_ = 0;
+
+    std::atomic<uint32_t> adverts_[BLE_SCAN_MODE_COUNT];
+    std::atomic<uint32_t> scannable_[BLE_SCAN_MODE_COUNT];
+};
+
+#endif // BLE_SCAN_POLICY_H
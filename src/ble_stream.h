@@ -0,0 +1,289 @@
+#ifndef BLE_STREAM_H
+#define BLE_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ============================================================================
+// BATCHED BLE SCAN STREAM
+// ============================================================================
+// Packs compact binary scan records into one notification sized to the
+// negotiated ATT MTU instead of notifying a JSON document per sniffed packet.
+// Producers (the matching task, loop()) only encode: a batch is sealed when
+// the next record would not fit, and the BLE output task sends sealed batches
+// and seals any batch whose oldest record is BLE_STREAM_COALESCE_MS old. Only
+// one batch waits to be sent; while it does, records go into a second one,
+// and are dropped if that fills too. If a notification fails (the NimBLE host
+// is out of buffers because the client is not keeping up) the batch is kept
+// for the next attempt and raw scan records are sampled 1-in-2, 1-in-4, ...
+// until notifications succeed again. Status and channel records are never
+// sampled.
+//
+// The encoder does no locking; ble_broadcast.h keeps it behind a mutex but
+// sends the batch from takeBatch() without holding it (see sent()).
+//
+// Notification layout (little-endian):
+//   version u8 | seq u8 | base_ms u32 | record...
+// Each record starts with type u8 and dt_ms u16 (ms after base_ms):
+//   WIFI:    mac[6] rssi i8 channel u8 frame u8 (0 probe req, 1 beacon, 2 probe resp) len u8 ssid[len]
+//   BLE:     mac[6] rssi i8 flags u8 (bit 0 = has services) len u8 name[len]
+//   STATUS:  len u8 msg[len]
+//   CHANNEL: channel u8
+//   STATS:   wire_stats_t (instrumentation.h); needs an MTU that fits it
+// The first byte is never '{', so clients can still tell batches from the
+// JSON notifications older firmware sent.
+
+#define BLE_STREAM_VERSION 1
+
+#ifndef BLE_STREAM_COALESCE_MS
+#define BLE_STREAM_COALESCE_MS 100     // Longest a record waits for more to batch with
+#endif
+#ifndef BLE_STREAM_MAX_SAMPLE_SHIFT
+#define BLE_STREAM_MAX_SAMPLE_SHIFT 4  // Sample scan records down to 1 in 16 under backpressure
+#endif
+#define BLE_STREAM_RECOVER_AFTER 8     // Successful notifications before halving the sampling
+#define BLE_STREAM_MAX_PAYLOAD 244     // ATT MTU 247 minus the 3-byte notification header
+#define BLE_STREAM_MIN_PAYLOAD 20      // Default ATT MTU 23
+#define BLE_STREAM_HEADER_SIZE 6
+
+enum ble_stream_record_t : uint8_t {
+    STREAM_REC_WIFI = 1,
+    STREAM_REC_BLE,
+    STREAM_REC_STATUS,
+    STREAM_REC_CHANNEL,
+    STREAM_REC_STATS
+};
+
+enum ble_stream_wifi_frame_t : uint8_t {
+    STREAM_WIFI_PROBE_REQUEST = 0,
+    STREAM_WIFI_BEACON,
+    STREAM_WIFI_PROBE_RESPONSE
+};
+
+enum ble_stream_send_t : uint8_t {
+    STREAM_SEND_OK = 0,
+    STREAM_SEND_CONGESTED,      // Host out of buffers; keep the batch and back off
+    STREAM_SEND_NO_SUBSCRIBER   // Nobody listening; discard the batch
+};
+
+// Counters readable by clients (see STREAM_STATS_CHAR_UUID)
+typedef struct __attribute__((packed)) {
+    uint32_t records_sent;
+    uint32_t records_dropped;     // Both batch buffers full (link congested or slow to drain)
+    uint32_t records_sampled;     // Scan records skipped by the backpressure sampler
+    uint32_t notifications;
+    uint32_t notify_failures;
+    uint16_t payload_size;        // Current batch size limit (MTU - 3)
+    uint8_t sample_shift;         // Current sampling: keep 1 in 2^shift scan records
+} ble_stream_stats_t;
+
+class BleStreamEncoder {
+public:
+    // Drop any unsent batches and return to full rate (e.g. on disconnect).
+    // A batch being sent is discarded when its result comes in.
+    void reset() {
+        len_ = 0;
+        count_ = 0;
+        full_ = false;
+        if (sending_) {
+            discard_ = true;
+        } else {
+            ready_ = false;
+        }
+        sample_shift_ = 0;
+        successes_ = 0;
+        setMtu(23);
+    }
+
+    void setMtu(uint16_t mtu) {
+        size_t payload = mtu > 3 ? mtu - 3 : BLE_STREAM_MIN_PAYLOAD;
+        if (payload < BLE_STREAM_MIN_PAYLOAD) payload = BLE_STREAM_MIN_PAYLOAD;
+        if (payload > BLE_STREAM_MAX_PAYLOAD) payload = BLE_STREAM_MAX_PAYLOAD;
+        payload_ = payload;
+    }
+
+    void addWiFi(uint32_t now, const uint8_t* mac, int8_t rssi, uint8_t channel, uint8_t frame,
+                 const char* ssid) {
+        if (sampledOut()) return;
+        uint8_t fixed[9];
+        memcpy(fixed, mac, 6);
+        fixed[6] = (uint8_t)rssi;
+        fixed[7] = channel;
+        fixed[8] = frame;
+        append(now, STREAM_REC_WIFI, fixed, 9, ssid);
+    }
+
+    void addBLE(uint32_t now, const uint8_t* mac, int8_t rssi, bool has_services, const char* name) {
+        if (sampledOut()) return;
+        uint8_t fixed[8];
+        memcpy(fixed, mac, 6);
+        fixed[6] = (uint8_t)rssi;
+        fixed[7] = has_services ? 1 : 0;
+        append(now, STREAM_REC_BLE, fixed, 8, name);
+    }
+
+    void addStatus(uint32_t now, const char* message) {
+        append(now, STREAM_REC_STATUS, nullptr, 0, message);
+    }
+
+    void addChannel(uint32_t now, uint8_t channel) {
+        append(now, STREAM_REC_CHANNEL, &channel, 1, nullptr, false);
+    }
+
+    // Fixed-size binary record; false if it cannot fit a batch at the current MTU
+    bool addStats(uint32_t now, const uint8_t* data, size_t len) {
+        if (3 + len > payload_ - BLE_STREAM_HEADER_SIZE) {
+            stats_.records_dropped++;
+            return false;
+        }
+        append(now, STREAM_REC_STATS, data, len, nullptr, false);
+        return true;
+    }
+
+    // True while a sealed batch waits for the BLE output task
+    bool batchReady() const { return ready_; }
+
+    // BLE output task: the batch to send now, or nullptr. Seals the open
+    // batch once it is full or has waited BLE_STREAM_COALESCE_MS; a congested
+    // batch is handed out again until it goes. Producers leave the buffer
+    // alone until sent() is called.
+    const uint8_t* takeBatch(uint32_t now, size_t* len) {
+        if (sending_) return nullptr;
+        if (!ready_ && count_ && (full_ || now - base_ms_ >= BLE_STREAM_COALESCE_MS)) seal();
+        if (!ready_) return nullptr;
+        uint8_t* batch = buf_[fill_ ^ 1];
+        batch[1] = seq_;
+        sending_ = true;
+        *len = ready_len_;
+        return batch;
+    }
+
+    // BLE output task: the result of sending the batch from takeBatch()
+    void sent(ble_stream_send_t rc) {
+        sending_ = false;
+        if (discard_) {
+            discard_ = false;
+            ready_ = false;
+            return;
+        }
+        if (rc == STREAM_SEND_CONGESTED) {
+            stats_.notify_failures++;
+            successes_ = 0;
+            if (sample_shift_ < BLE_STREAM_MAX_SAMPLE_SHIFT) sample_shift_++;
+            return;
+        }
+        if (rc == STREAM_SEND_OK) {
+            stats_.records_sent += ready_count_;
+            stats_.notifications++;
+            seq_++;
+            if (sample_shift_ && ++successes_ >= BLE_STREAM_RECOVER_AFTER) {
+                sample_shift_--;
+                successes_ = 0;
+            }
+        } else {
+            stats_.records_dropped += ready_count_;
+        }
+        ready_ = false;
+    }
+
+    const ble_stream_stats_t& stats() {
+        stats_.payload_size = (uint16_t)payload_;
+        stats_.sample_shift = sample_shift_;
+        return stats_;
+    }
+
+private:
+    // Backpressure sampler for raw scan records
+    bool sampledOut() {
+        if (!sample_shift_) return false;
+        if ((sample_counter_++ & ((1u << sample_shift_) - 1)) == 0) return false;
+        stats_.records_sampled++;
+        return true;
+    }
+
+    // Hand the open batch to the output task and start the other buffer
+    void seal() {
+        uint8_t* batch = buf_[fill_];
+        batch[0] = BLE_STREAM_VERSION;
+        memcpy(&batch[2], &base_ms_, 4);
+        ready_len_ = len_;
+        ready_count_ = count_;
+        ready_ = true;
+        fill_ ^= 1;
+        len_ = 0;
+        count_ = 0;
+        full_ = false;
+    }
+
+    // Encode one record. Never sends: when the open batch is full it is
+    // sealed, or the record is dropped if the last sealed one is unsent.
+    void append(uint32_t now, uint8_t type, const uint8_t* fixed, size_t fixed_len,
+                const char* text, bool has_text = true) {
+        size_t text_len = (has_text && text) ? strlen(text) : 0;
+        size_t need = 3 + fixed_len + (has_text ? 1 : 0);
+        // Truncate names so a record always fits an empty batch, even at MTU 23
+        size_t room = payload_ - BLE_STREAM_HEADER_SIZE;
+        if (need + text_len > room) text_len = need < room ? room - need : 0;
+        need += text_len;
+
+        if (count_ && (len_ + need > payload_ || now - base_ms_ > 0xFFFF)) {
+            if (ready_) {
+                full_ = true;
+                stats_.records_dropped++;
+                return;
+            }
+            seal();
+        }
+        if (!count_) {
+            base_ms_ = now;
+            len_ = BLE_STREAM_HEADER_SIZE;
+        }
+
+        uint8_t* buf = buf_[fill_];
+        uint16_t dt = (uint16_t)(now - base_ms_);
+        buf[len_++] = type;
+        buf[len_++] = dt & 0xFF;
+        buf[len_++] = dt >> 8;
+        if (fixed_len) {
+            memcpy(&buf[len_], fixed, fixed_len);
+            len_ += fixed_len;
+        }
+        if (has_text) {
+            buf[len_++] = (uint8_t)text_len;
+            if (text_len) {
+                memcpy(&buf[len_], text, text_len);
+                len_ += text_len;
+            }
+        }
+        count_++;
+
+        if (len_ >= payload_) {
+            if (ready_) {
+                full_ = true;
+            } else {
+                seal();
+            }
+        }
+    }
+
+    uint8_t buf_[2][BLE_STREAM_MAX_PAYLOAD];  // Open batch and sealed batch
+    uint8_t fill_ = 0;                         // Index of the open batch
+    size_t len_ = 0;
+    size_t payload_ = BLE_STREAM_MIN_PAYLOAD;
+    uint16_t count_ = 0;
+    uint32_t base_ms_ = 0;
+    bool full_ = false;        // The open batch has turned a record away
+    size_t ready_len_ = 0;
+    uint16_t ready_count_ = 0;
+    bool ready_ = false;       // buf_[fill_ ^ 1] holds a sealed batch
+    bool sending_ = false;     // ... and the output task is sending it
+    bool discard_ = false;     // reset() came while it was being sent
+    uint8_t seq_ = 0;
+    uint8_t sample_shift_ = 0;
+    uint8_t successes_ = 0;
+    uint32_t sample_counter_ = 0;
+    ble_stream_stats_t stats_ = {};
+};
+
+#endif // BLE_STREAM_H
@@ -0,0 +1,79 @@
+#ifndef BLE_UUID_H
+#define BLE_UUID_H
+
+#include <NimBLEDevice.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// ============================================================================
+// BINARY BLE UUID HELPERS
+// ============================================================================
+// Work on the native NimBLE UUID representation so the scan callback can
+// compare service UUIDs without NimBLEUUID::toString() (which allocates a
+// std::string for every call). ble_uuid_any_t is plain data, so it is also
+// what detection events carry between tasks.
+
+// Bluetooth SIG base UUID 00000000-0000-1000-8000-00805f9b34fb, little-endian
+// as NimBLE stores it. Bytes 12-15 hold the 16/32-bit short form.
+static const uint8_t BLE_SIG_BASE_UUID[12] = {
+    0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00
+};
+
+// Reduce a UUID to its 16-bit SIG form. Returns false for vendor UUIDs that
+// are not built on the SIG base (or do not fit in 16 bits).
+static inline bool ble_uuid_to_sig16(const ble_uuid_any_t& uuid, uint16_t* out)
+{
+    switch (uuid.u.type) {
+        case BLE_UUID_TYPE_16:
+            *out = uuid.u16.value;
+            return true;
+        case BLE_UUID_TYPE_32:
+            if (uuid.u32.value > 0xFFFF) return false;
+            *out = (uint16_t)uuid.u32.value;
+            return true;
+        case BLE_UUID_TYPE_128: {
+            const uint8_t* v = uuid.u128.value;
+            if (memcmp(v, BLE_SIG_BASE_UUID, sizeof(BLE_SIG_BASE_UUID)) != 0) return false;
+            if (v[14] != 0 || v[15] != 0) return false;
+            *out = (uint16_t)(v[12] | (v[13] << 8));
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Format a 16-bit SIG UUID in full 128-bit form (buffer must hold 37 bytes)
+static inline void ble_uuid16_format(uint16_t value, char* out)
+{
+    snprintf(out, 37, "0000%04x-0000-1000-8000-00805f9b34fb", value);
+}
+
+// Format any UUID in full 128-bit form without heap allocation
+static inline void ble_uuid_format(const ble_uuid_any_t& uuid, char* out)
+{
+    uint16_t short_uuid;
+    if (uuid.u.type == BLE_UUID_TYPE_32) {
+        snprintf(out, 37, "%08x-0000-1000-8000-00805f9b34fb", (unsigned)uuid.u32.value);
+    } else if (ble_uuid_to_sig16(uuid, &short_uuid)) {
+        ble_uuid16_format(short_uuid, out);
+    } else {
+        const uint8_t* v = uuid.u128.value;
+        snprintf(out, 37, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+                 v[15], v[14], v[13], v[12], v[11], v[10], v[9], v[8],
+                 v[7], v[6], v[5], v[4], v[3], v[2], v[1], v[0]);
+    }
+}
+
+static inline bool ble_uuid_to_sig16(const NimBLEUUID& uuid, uint16_t* out)
+{
+    return ble_uuid_to_sig16(*uuid.getNative(), out);
+}
+
+static inline void ble_uuid_format(const NimBLEUUID& uuid, char* out)
+{
+    ble_uuid_format(*uuid.getNative(), out);
+}
+
+#endif // BLE_UUID_H
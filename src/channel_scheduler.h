@@ -0,0 +1,210 @@
+#ifndef CHANNEL_SCHEDULER_H
+#define CHANNEL_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// ============================================================================
+// ADAPTIVE CHANNEL HOPPING
+// ============================================================================
+// Decides which 2.4 GHz channel the sniffer listens on and for how long.
+// Dwell on each visit scales with the management-frame rate seen on that
+// channel, from CHANNEL_DWELL_MIN_MS on a quiet one to CHANNEL_DWELL_MAX_MS
+// on a busy one. A channel where a target was detected in the last
+// CHANNEL_DETECTION_HOLD_MS is pinned for CHANNEL_PIN_MS per visit and
+// extended while it keeps producing detections. The next channel is the one
+// with the largest weight x time-since-visit, with weights from activity,
+// detection history and a prior for 1/6/11 (where most Flock APs in the WiGLE
+// exports sit). Regardless of weights, any channel not visited for
+// CHANNEL_MAX_REVISIT_MS is visited next, and a pin is cut short for it.
+//
+// noteFrame()/noteDetection() are called from the matching task and
+// tick() from loop(), so the shared counters are atomics.
+
+#ifndef CHANNEL_HOP_ADAPTIVE
+#define CHANNEL_HOP_ADAPTIVE 1            // 0 = fixed round-robin every CHANNEL_HOP_INTERVAL
+#endif
+#ifndef CHANNEL_DWELL_MIN_MS
+#define CHANNEL_DWELL_MIN_MS 120          // Longer than one 102.4 ms beacon interval
+#endif
+#ifndef CHANNEL_DWELL_MAX_MS
+#define CHANNEL_DWELL_MAX_MS 600          // Dwell on the busiest channels
+#endif
+#ifndef CHANNEL_PIN_MS
+#define CHANNEL_PIN_MS 2000               // Dwell on a channel with a recent detection
+#endif
+#ifndef CHANNEL_DETECTION_HOLD_MS
+#define CHANNEL_DETECTION_HOLD_MS 15000   // How long a detection keeps its channel pinned
+#endif
+#ifndef CHANNEL_MAX_REVISIT_MS
+#define CHANNEL_MAX_REVISIT_MS 3000       // Every channel is visited at least this often
+#endif
+#define CHANNEL_ACTIVITY_FULL 200         // Frames/s that earns the full dwell
+#ifndef MAX_CHANNEL
+#define MAX_CHANNEL 13                    // Highest channel scanned (13 outside North America)
+#endif
+#define CHANNEL_FIRST 1
+
+class ChannelScheduler {
+public:
+    void begin(uint32_t now, uint8_t channel, bool adaptive, uint32_t round_robin_ms) {
+        adaptive_ = adaptive;
+        round_robin_ms_ = round_robin_ms;
+        for (int ch = 0; ch <= MAX_CHANNEL; ch++) {
+            frames_[ch].store(0, std::memory_order_relaxed);
+            last_detection_[ch].store(0, std::memory_order_relaxed);
+            detected_[ch].store(false, std::memory_order_relaxed);
+            activity_[ch] = 0;
+            last_visit_[ch] = now;
+        }
+        enter(channel, now);
+    }
+
+    // Every management frame received, by the channel the radio was tuned to
+    void noteFrame(uint8_t rx_channel) {
+        if (rx_channel >= CHANNEL_FIRST && rx_channel <= MAX_CHANNEL) {
+            frames_[rx_channel].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // A target was seen on this channel
+    void noteDetection(uint8_t channel, uint32_t now) {
+        if (channel >= CHANNEL_FIRST && channel <= MAX_CHANNEL) {
+            last_detection_[channel].store(now, std::memory_order_relaxed);
+            detected_[channel].store(true, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns the channel to switch to, or 0 to stay on the current one
+    uint8_t tick(uint32_t now) {
+        if (!adaptive_) {
+            if (now - entered_ < round_robin_ms_) return 0;
+            uint8_t next = current_ >= MAX_CHANNEL ? CHANNEL_FIRST : current_ + 1;
+            leave(now);
+            enter(next, now);
+            return next;
+        }
+
+        // Keep extending a pin while the channel keeps producing detections
+        if (pinned_) {
+            uint32_t seen = last_detection_[current_].load(std::memory_order_relaxed);
+            if ((int32_t)(seen - entered_) >= 0 && (int32_t)(seen + CHANNEL_PIN_MS - dwell_end_) > 0) {
+                dwell_end_ = seen + CHANNEL_PIN_MS;
+            }
+        }
+
+        uint8_t overdue = mostOverdue(now);
+        bool expired = (int32_t)(now - dwell_end_) >= 0;
+        if (!expired && !(pinned_ && overdue)) return 0;
+
+        leave(now);
+        uint8_t next = overdue ? overdue : bestChannel(now);
+        enter(next, now);
+        return next;
+    }
+
+    // The radio is lent to BLE between pause() and resume(); dwell and revisit
+    // times only count time spent listening
+    void pause(uint32_t now) { paused_at_ = now; }
+
+    void resume(uint32_t now) {
+        uint32_t away = now - paused_at_;
+        entered_ += away;
+        dwell_end_ += away;
+        for (int ch = 0; ch <= MAX_CHANNEL; ch++) last_visit_[ch] += away;
+    }
+
+    uint8_t current() const { return current_; }
+    uint32_t dwellMs() const { return dwell_end_ - entered_; }
+    bool pinned() const { return pinned_; }
+    // Smoothed frames/s heard on a channel
+    uint32_t activity(uint8_t channel) const { return activity_[channel] >> 4; }
+
+private:
+    bool recentDetection(uint8_t ch, uint32_t now) const {
+        return detected_[ch].load(std::memory_order_relaxed) &&
+               now - last_detection_[ch].load(std::memory_order_relaxed) < CHANNEL_DETECTION_HOLD_MS;
+    }
+
+    void enter(uint8_t ch, uint32_t now) {
+        current_ = ch;
+        entered_ = now;
+        frames_[ch].store(0, std::memory_order_relaxed);
+        pinned_ = adaptive_ && recentDetection(ch, now);
+        uint32_t dwell;
+        if (!adaptive_) {
+            dwell = round_robin_ms_;
+        } else if (pinned_) {
+            dwell = CHANNEL_PIN_MS;
+        } else {
+            uint32_t level = activity(ch);
+            if (level > CHANNEL_ACTIVITY_FULL) level = CHANNEL_ACTIVITY_FULL;
+            dwell = CHANNEL_DWELL_MIN_MS + (CHANNEL_DWELL_MAX_MS - CHANNEL_DWELL_MIN_MS) * level / CHANNEL_ACTIVITY_FULL;
+        }
+        dwell_end_ = now + dwell;
+    }
+
+    void leave(uint32_t now) {
+        uint8_t ch = current_;
+        uint32_t elapsed = now - entered_;
+        if (elapsed) {
+            // Frames/s in 1/16 units, smoothed 1/4 per visit
+            uint32_t rate = (uint32_t)((uint64_t)frames_[ch].load(std::memory_order_relaxed) * 16000 / elapsed);
+            activity_[ch] = activity_[ch] - (activity_[ch] >> 2) + (rate >> 2);
+        }
+        last_visit_[ch] = now;
+    }
+
+    uint8_t mostOverdue(uint32_t now) const {
+        uint8_t best = 0;
+        uint32_t best_age = CHANNEL_MAX_REVISIT_MS;
+        for (uint8_t ch = CHANNEL_FIRST; ch <= MAX_CHANNEL; ch++) {
+            if (ch == current_) continue;
+            uint32_t age = now - last_visit_[ch];
+            if (age >= best_age) {
+                best = ch;
+                best_age = age;
+            }
+        }
+        return best;
+    }
+
+    uint32_t weight(uint8_t ch, uint32_t now) const {
+        uint32_t w = 1;
+        if (ch == 1 || ch == 6 || ch == 11) w += 2;
+        uint32_t level = activity(ch);
+        w += (level > CHANNEL_ACTIVITY_FULL ? CHANNEL_ACTIVITY_FULL : level) * 4 / CHANNEL_ACTIVITY_FULL;
+        if (recentDetection(ch, now)) w += 8;
+        return w;
+    }
+
+    uint8_t bestChannel(uint32_t now) const {
+        uint8_t best = current_ >= MAX_CHANNEL ? CHANNEL_FIRST : current_ + 1;
+        uint64_t best_score = 0;
+        for (uint8_t ch = CHANNEL_FIRST; ch <= MAX_CHANNEL; ch++) {
+            if (ch == current_) continue;
+            uint64_t score = (uint64_t)weight(ch, now) * (now - last_visit_[ch]);
+            if (score > best_score) {
+                best = ch;
+                best_score = score;
+            }
+        }
+        return best;
+    }
+
+    bool adaptive_ = true;
+    uint32_t round_robin_ms_ = 500;
+    uint8_t current_ = CHANNEL_FIRST;
+    uint32_t entered_ = 0;
+    uint32_t dwell_end_ = 0;
+    bool pinned_ = false;
+    uint32_t paused_at_ = 0;
+    uint32_t activity_[MAX_CHANNEL + 1];      // Frames/s x 16, owned by tick()
+    uint32_t last_visit_[MAX_CHANNEL + 1];    // When the radio last left each channel
+    std::atomic<uint32_t> frames_[MAX_CHANNEL + 1];
+    std::atomic<uint32_t> last_detection_[MAX_CHANNEL + 1];
+    std::atomic<bool> detected_[MAX_CHANNEL + 1];
+};
+
+#endif // CHANNEL_SCHEDULER_H
@@ -0,0 +1,197 @@
+#ifndef DETECTION_EVENT_H
+#define DETECTION_EVENT_H
+
+#include <NimBLEDevice.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "device_table.h"
+#include "ieee80211.h"
+#include "pattern_matcher.h"
+#include "serial_protocol.h"
+
+// ============================================================================
+// DETECTION EVENTS AND OUTPUT SINKS
+// ============================================================================
+// The matching task fills one detection_event_t per reportable hit with
+// everything it already worked out: raw MAC bytes, the IDs of the matched
+// signatures, the criteria, the score, the frame type and the channel. Nothing
+// is formatted and nothing is looked up again downstream. The event holds no
+// pointers or strings (the SSID or BLE name travels as the raw bytes
+// received), so it is copied by value through the output queues.
+//
+// Each output task owns a list of sinks. A sink formats the event its own way
+// (JSON line, COBS record, GATT notify, LED alert) and only runs while it is
+// enabled, so disabled outputs cost neither formatting nor a queue slot.
+
+#define DETECTION_MAX_SIGNATURES 4     // Matched signature IDs kept per event
+#define BLE_ADV_MAX_SERVICES 8         // Service UUIDs kept per advertisement
+#define DETECTION_NO_SIGNATURE 0xFFFF
+
+#define DETECTION_SCORE_SINGLE 85      // One criterion matched
+#define DETECTION_SCORE_MULTIPLE 100   // Two or more, or a Raven service set
+
+typedef struct {
+    uint32_t seq;                // Journal sequence number, 0 if not journaled
+    uint32_t timestamp_ms;       // millis() when the hit was matched
+    uint8_t mac[6];              // Display order
+    int8_t rssi;
+    uint8_t protocol;            // device_protocol_t
+    uint8_t method;              // wire_method_t: frame type x primary criterion
+    uint8_t frame_type;          // WLAN_SUBTYPE_* (WiFi only)
+    uint8_t channel;             // DS channel (WiFi only)
+    uint8_t rx_channel;          // Channel the radio was tuned to (WiFi only)
+    uint8_t criteria;            // MATCH_* bits that matched this hit
+    uint8_t score;               // 0-100
+    uint8_t family;              // device_family_t
+    uint8_t report;              // device_report_t
+    uint8_t signature_count;     // Entries used in signatures[]
+    uint16_t signatures[DETECTION_MAX_SIGNATURES];  // SSID or name signature IDs, lowest first
+    uint8_t signature_set;       // SignatureDb slot the IDs and raven_mask refer to
+    uint32_t raven_mask;         // Bit per Raven service of the signature set (BLE only)
+    uint8_t max_rate;            // 500 kb/s units (WiFi only)
+    uint8_t vendor_count;        // Vendor IEs seen (WiFi only)
+    uint8_t vendor_ouis[WLAN_MAX_VENDOR_IES][3];
+    uint8_t service_count;       // Entries used in services[] (BLE only)
+    ble_uuid_any_t services[BLE_ADV_MAX_SERVICES];
+    uint8_t payload_len;
+    uint8_t payload[WIRE_NAME_MAX];  // SSID or BLE device name as received, not NUL-terminated
+    tracked_device_t dev;        // Device table entry after this hit
+} detection_event_t;
+
+typedef struct {
+    const char* name;
+    bool (*enabled)();
+    void (*emit)(const detection_event_t& event);
+} detection_sink_t;
+
+static inline uint8_t detection_score(uint8_t criteria)
+{
+    if (criteria & MATCH_RAVEN) return DETECTION_SCORE_MULTIPLE;
+    // A known full MAC and its listed OUI are one piece of evidence
+    if (criteria & MATCH_KNOWN) criteria = (criteria & ~MATCH_KNOWN) | MATCH_MAC;
+    return (criteria & (criteria - 1)) ? DETECTION_SCORE_MULTIPLE : DETECTION_SCORE_SINGLE;
+}
+
+// detection_criteria string of the JSON output
+static inline const char* detection_criteria_name(const detection_event_t& event)
+{
+    uint8_t primary = event.protocol == DEVICE_PROTO_WIFI ? MATCH_SSID : MATCH_NAME;
+    bool pattern = event.criteria & primary;
+    bool mac = event.criteria & (MATCH_MAC | MATCH_KNOWN);
+    if (event.protocol == DEVICE_PROTO_WIFI) {
+        return pattern && mac ? "SSID_AND_MAC" : (pattern ? "SSID_ONLY" : "MAC_ONLY");
+    }
+    return pattern && mac ? "NAME_AND_MAC" : (pattern ? "NAME_ONLY" : "MAC_ONLY");
+}
+
+// Common fields; the protocol-specific ones start out empty
+static inline void detection_event_init(detection_event_t* event, uint32_t now, uint8_t protocol,
+                                        uint8_t method, const uint8_t* mac, int8_t rssi,
+                                        uint8_t criteria, uint8_t family, uint8_t report,
+                                        const tracked_device_t& dev)
+{
+    event->seq = 0;
+    event->timestamp_ms = now;
+    memcpy(event->mac, mac, sizeof(event->mac));
+    event->rssi = rssi;
+    event->protocol = protocol;
+    event->method = method;
+    event->frame_type = 0;
+    event->channel = 0;
+    event->rx_channel = 0;
+    event->criteria = criteria;
+    event->score = detection_score(criteria);
+    event->family = family;
+    event->report = report;
+    event->signature_count = 0;
+    event->signature_set = 0;
+    event->raven_mask = 0;
+    event->max_rate = 0;
+    event->vendor_count = 0;
+    event->service_count = 0;
+    event->payload_len = 0;
+    event->dev = dev;
+}
+
+// Keep the lowest matched IDs (ids[] is in match order), so signatures[0] is
+// result.first
+static inline void detection_event_set_signatures(detection_event_t* event, const ac_result_t& result)
+{
+    uint16_t ids[AC_MAX_MATCHES];
+    uint8_t count = result.count < AC_MAX_MATCHES ? result.count : AC_MAX_MATCHES;
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t j = i;
+        for (; j > 0 && ids[j - 1] > result.ids[i]; j--) ids[j] = ids[j - 1];
+        ids[j] = result.ids[i];
+    }
+    event->signature_count = count < DETECTION_MAX_SIGNATURES ? count : DETECTION_MAX_SIGNATURES;
+    memcpy(event->signatures, ids, event->signature_count * sizeof(ids[0]));
+}
+
+static inline void detection_event_set_payload(detection_event_t* event, const char* data, size_t len)
+{
+    if (len > sizeof(event->payload)) len = sizeof(event->payload);
+    event->payload_len = (uint8_t)len;
+    if (len) memcpy(event->payload, data, len);
+}
+
+// Copy the payload out as a C string (out must hold WIRE_NAME_MAX + 1 bytes)
+static inline const char* detection_event_payload_str(const detection_event_t& event, char* out)
+{
+    memcpy(out, event.payload, event.payload_len);
+    out[event.payload_len] = '\0';
+    return out;
+}
+
+static inline uint16_t detection_event_first_signature(const detection_event_t& event)
+{
+    return event.signature_count ? event.signatures[0] : DETECTION_NO_SIGNATURE;
+}
+
+// Packed wire record for the binary output and the journal. Returns its
+// length (header and name).
+static inline size_t detection_event_to_wire(const detection_event_t& event, wire_detection_t* rec)
+{
+    size_t len = wire_detection_init(rec, event.timestamp_ms, event.mac, event.rssi, event.channel,
+                                     event.method, (const char*)event.payload, event.payload_len);
+    const tracked_device_t& dev = event.dev;
+    uint16_t signature = detection_event_first_signature(event);
+    rec->family = dev.family;
+    rec->match_flags = dev.match_flags;
+    rec->report = event.report;
+    rec->pattern_id = signature < WIRE_NO_PATTERN ? (uint8_t)signature : WIRE_NO_PATTERN;
+    rec->raven_mask = (uint8_t)event.raven_mask;
+    rec->hits = dev.hits;
+    rec->first_seen_ms = dev.first_seen;
+    rec->last_seen_ms = dev.last_seen;
+    rec->rssi_min = dev.rssi_min;
+    rec->rssi_max = dev.rssi_max;
+    rec->rssi_avg = device_rssi_avg(dev);
+    rec->channels = dev.channels;
+    return len;
+}
+
+// Run every enabled sink in a list. Returns how many ran.
+static inline size_t detection_sinks_emit(const detection_sink_t* sinks, size_t count,
+                                          const detection_event_t& event)
+{
+    size_t ran = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (sinks[i].enabled()) {
+            sinks[i].emit(event);
+            ran++;
+        }
+    }
+    return ran;
+}
+
+static inline bool detection_sinks_any_enabled(const detection_sink_t* sinks, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (sinks[i].enabled()) return true;
+    }
+    return false;
+}
+
+#endif // DETECTION_EVENT_H
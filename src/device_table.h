@@ -0,0 +1,253 @@
+#ifndef DEVICE_TABLE_H
+#define DEVICE_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ============================================================================
+// PER-MAC DETECTION TABLE
+// ============================================================================
+// Fixed-capacity open-addressing hash table (linear probing) keyed by the
+// 48-bit MAC address. Every matching frame or advertisement updates its
+// device's entry; observe() then says whether the hit is worth reporting:
+// first sight, a significant RSSI change, or a periodic summary. Everything
+// else is only counted, so one camera beaconing every 102 ms no longer floods
+// the serial link.
+
+#ifndef DEVICE_TABLE_SIZE
+#define DEVICE_TABLE_SIZE 256            // Tracked devices (must be a power of two)
+#endif
+#ifndef DEVICE_RSSI_DELTA_DB
+#define DEVICE_RSSI_DELTA_DB 8           // Smoothed RSSI change that triggers a report
+#endif
+#ifndef DEVICE_SUMMARY_INTERVAL_MS
+#define DEVICE_SUMMARY_INTERVAL_MS 30000 // Minimum time between summaries per device
+#endif
+#ifndef DEVICE_EXPIRY_MS
+#define DEVICE_EXPIRY_MS 300000          // Forget devices not seen for this long
+#endif
+
+// Criteria that matched a device (accumulated over all hits)
+#define MATCH_SSID   0x01
+#define MATCH_MAC    0x02
+#define MATCH_NAME   0x04
+#define MATCH_RAVEN  0x08
+#define MATCH_KNOWN  0x10   // Full MAC is in the known-device filter (known_macs.h)
+
+enum device_protocol_t : uint8_t {
+    DEVICE_PROTO_WIFI = 0,
+    DEVICE_PROTO_BLE
+};
+
+enum device_report_t : uint8_t {
+    DEVICE_REPORT_NONE = 0,     // Duplicate hit, counted only
+    DEVICE_REPORT_NEW,          // First sight of this MAC
+    DEVICE_REPORT_RSSI,         // Smoothed RSSI moved by DEVICE_RSSI_DELTA_DB
+    DEVICE_REPORT_SUMMARY       // DEVICE_SUMMARY_INTERVAL_MS since the last report
+};
+
+static inline const char* device_report_name(device_report_t reason)
+{
+    switch (reason) {
+        case DEVICE_REPORT_NEW:     return "first_seen";
+        case DEVICE_REPORT_RSSI:    return "rssi_change";
+        case DEVICE_REPORT_SUMMARY: return "summary";
+        default:                    return "none";
+    }
+}
+
+typedef struct {
+    uint64_t key;              // MAC in the low 48 bits, bit 48 set when occupied
+    uint32_t first_seen;       // millis()
+    uint32_t last_seen;
+    uint32_t last_report;
+    uint32_t hits;             // Total matching frames/advertisements
+    uint32_t hits_at_report;   // hits when the last report went out
+    int16_t rssi_ema_x16;      // Exponential moving average, 1/16 dB
+    int8_t rssi_min;
+    int8_t rssi_max;
+    int8_t rssi_last;
+    int8_t rssi_reported;      // Smoothed RSSI at the last report
+    uint16_t channels;         // Bit n set if seen on WiFi channel n
+    uint8_t family;            // device_family_t of the matched signature
+    uint8_t match_flags;       // MATCH_* criteria seen so far
+    uint8_t protocol;          // device_protocol_t
+} tracked_device_t;
+
+#define DEVICE_KEY_OCCUPIED (1ULL << 48)
+
+static inline uint64_t device_key_from_mac(const uint8_t* mac)
+{
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++) {
+        key = (key << 8) | mac[i];
+    }
+    return key | DEVICE_KEY_OCCUPIED;
+}
+
+static inline void device_key_to_mac(uint64_t key, uint8_t* mac)
+{
+    for (int i = 5; i >= 0; i--) {
+        mac[i] = key & 0xFF;
+        key >>= 8;
+    }
+}
+
+static inline int8_t device_rssi_avg(const tracked_device_t& dev)
+{
+    return (int8_t)(dev.rssi_ema_x16 / 16);
+}
+
+class DeviceTable {
+    static_assert((DEVICE_TABLE_SIZE & (DEVICE_TABLE_SIZE - 1)) == 0, "DEVICE_TABLE_SIZE must be a power of two");
+
+public:
+    DeviceTable() { clear(); }
+
+    void clear() {
+        memset(slots_, 0, sizeof(slots_));
+        count_ = 0;
+    }
+
+    // Record one matching hit. Returns the reason to report it (or NONE) and
+    // points *entry at the updated device record.
+    device_report_t observe(const uint8_t* mac, int8_t rssi, uint8_t channel, uint8_t family,
+                            uint8_t match_flags, uint8_t protocol, uint32_t now,
+                            const tracked_device_t** entry) {
+        uint64_t key = device_key_from_mac(mac);
+        size_t slot = find(key);
+        tracked_device_t* dev = &slots_[slot];
+
+        if (dev->key != key) {
+            if (count_ >= DEVICE_TABLE_SIZE * 3 / 4) {
+                expire(now, DEVICE_EXPIRY_MS);
+                if (count_ >= DEVICE_TABLE_SIZE * 3 / 4) {
+                    evictOldest();
+                }
+                slot = find(key);
+                dev = &slots_[slot];
+            }
+            memset(dev, 0, sizeof(*dev));
+            dev->key = key;
+            dev->first_seen = now;
+            dev->last_report = now;
+            dev->rssi_min = rssi;
+            dev->rssi_max = rssi;
+            dev->rssi_ema_x16 = (int16_t)(rssi * 16);
+            dev->rssi_reported = rssi;
+            dev->family = family;
+            dev->protocol = protocol;
+            count_++;
+            update(dev, rssi, channel, match_flags, now);
+            dev->hits_at_report = dev->hits;
+            *entry = dev;
+            return DEVICE_REPORT_NEW;
+        }
+
+        update(dev, rssi, channel, match_flags, now);
+        *entry = dev;
+
+        int delta = device_rssi_avg(*dev) - dev->rssi_reported;
+        if (delta >= DEVICE_RSSI_DELTA_DB || delta <= -DEVICE_RSSI_DELTA_DB) {
+            markReported(dev, now);
+            return DEVICE_REPORT_RSSI;
+        }
+        if (now - dev->last_report >= DEVICE_SUMMARY_INTERVAL_MS) {
+            markReported(dev, now);
+            return DEVICE_REPORT_SUMMARY;
+        }
+        return DEVICE_REPORT_NONE;
+    }
+
+    // Drop devices not seen for max_age_ms. Returns the number removed.
+    size_t expire(uint32_t now, uint32_t max_age_ms) {
+        size_t removed = 0;
+        for (size_t i = 0; i < DEVICE_TABLE_SIZE; i++) {
+            // Removal shifts later entries back, so re-check the same slot
+            while (slots_[i].key && now - slots_[i].last_seen >= max_age_ms) {
+                remove(i);
+                removed++;
+            }
+        }
+        return removed;
+    }
+
+    // Devices seen within the last window_ms
+    size_t activeCount(uint32_t now, uint32_t window_ms) const {
+        size_t active = 0;
+        for (size_t i = 0; i < DEVICE_TABLE_SIZE; i++) {
+            if (slots_[i].key && now - slots_[i].last_seen < window_ms) active++;
+        }
+        return active;
+    }
+
+    size_t size() const { return count_; }
+    static constexpr size_t capacity() { return DEVICE_TABLE_SIZE; }
+
+private:
+    static size_t hash(uint64_t key) {
+        return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 40) & (DEVICE_TABLE_SIZE - 1);
+    }
+
+    // Slot holding key, or the empty slot where it would be inserted
+    size_t find(uint64_t key) const {
+        size_t i = hash(key);
+        while (slots_[i].key && slots_[i].key != key) {
+            i = (i + 1) & (DEVICE_TABLE_SIZE - 1);
+        }
+        return i;
+    }
+
+    static void update(tracked_device_t* dev, int8_t rssi, uint8_t channel, uint8_t match_flags, uint32_t now) {
+        dev->hits++;
+        dev->last_seen = now;
+        dev->rssi_last = rssi;
+        if (rssi < dev->rssi_min) dev->rssi_min = rssi;
+        if (rssi > dev->rssi_max) dev->rssi_max = rssi;
+        // EMA with alpha = 1/8
+        dev->rssi_ema_x16 += (int16_t)((rssi * 16 - dev->rssi_ema_x16) / 8);
+        if (channel > 0 && channel < 16) dev->channels |= (uint16_t)(1u << channel);
+        dev->match_flags |= match_flags;
+    }
+
+    static void markReported(tracked_device_t* dev, uint32_t now) {
+        dev->last_report = now;
+        dev->hits_at_report = dev->hits;
+        dev->rssi_reported = device_rssi_avg(*dev);
+    }
+
+    void evictOldest() {
+        size_t oldest = DEVICE_TABLE_SIZE;
+        for (size_t i = 0; i < DEVICE_TABLE_SIZE; i++) {
+            if (slots_[i].key && (oldest == DEVICE_TABLE_SIZE || slots_[i].last_seen < slots_[oldest].last_seen)) {
+                oldest = i;
+            }
+        }
+        if (oldest < DEVICE_TABLE_SIZE) remove(oldest);
+    }
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    void remove(size_t i) {
+        size_t hole = i;
+        size_t j = i;
+        for (;;) {
+            j = (j + 1) & (DEVICE_TABLE_SIZE - 1);
+            if (!slots_[j].key) break;
+            size_t home = hash(slots_[j].key);
+            // Move j into the hole if its home slot is not in (hole, j]
+            bool in_range = (hole <= j) ? (home > hole && home <= j) : (home > hole || home <= j);
+            if (!in_range) {
+                slots_[hole] = slots_[j];
+                hole = j;
+            }
+        }
+        memset(&slots_[hole], 0, sizeof(slots_[hole]));
+        count_--;
+    }
+
+    tracked_device_t slots_[DEVICE_TABLE_SIZE];
+    size_t count_ = 0;
+};
+
+#endif // DEVICE_TABLE_H
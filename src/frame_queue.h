@@ -0,0 +1,90 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "ieee80211.h"
+
+// ============================================================================
+// LOCK-FREE SPSC FRAME QUEUE
+// ============================================================================
+// The WiFi promiscuous RX callback runs inside the WiFi driver task, so it
+// must not block. It copies the handful of fields we need into this ring and
+// returns; a dedicated consumer task drains the ring and does the matching
+// and output. One producer, one consumer, no locks.
+
+// Ring capacity for sniffed WiFi frames (must be a power of two)
+#ifndef WIFI_FRAME_QUEUE_SIZE
+#define WIFI_FRAME_QUEUE_SIZE 128
+#endif
+
+// Fields copied out of a management frame by the RX callback
+typedef struct {
+    uint8_t addr2[6];   // Sender address
+    char ssid[33];      // NUL-terminated SSID (empty if hidden)
+    uint8_t ssid_len;
+    int8_t rssi;
+    uint8_t channel;    // DS Parameter Set channel, or rx_channel if the frame has none
+    uint8_t rx_channel; // Channel the radio was tuned to
+    uint8_t subtype;    // 802.11 management subtype (0x04 probe req, 0x05 probe resp, 0x08 beacon)
+    uint8_t max_rate;   // Highest supported rate in 500 kb/s units (0 if none advertised)
+    uint8_t vendor_count;
+    uint8_t vendor_ouis[WLAN_MAX_VENDOR_IES][3];
+} sniffed_frame_t;
+
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    // Producer side. Returns false (and counts a drop) if the ring is full.
+    bool push(const T& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t used = head - tail;
+        if (used >= N) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+
+        // High-water mark is only written by the producer
+        if (used + 1 > high_water_.load(std::memory_order_relaxed)) {
+            high_water_.store(used + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Consumer side. Returns false if the ring is empty.
+    bool pop(T& out) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = slots_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t depth() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    static constexpr uint32_t capacity() { return N; }
+    uint32_t pushed() const { return pushed_.load(std::memory_order_relaxed); }
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint32_t highWater() const { return high_water_.load(std::memory_order_relaxed); }
+
+private:
+    T slots_[N];
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint32_t> pushed_{0};
+    std::atomic<uint32_t> dropped_{0};
+    std::atomic<uint32_t> high_water_{0};
+};
+
+#endif // FRAME_QUEUE_H
@@ -0,0 +1,174 @@
+#ifndef IEEE80211_H
+#define IEEE80211_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ============================================================================
+// 802.11 MANAGEMENT FRAME PARSING
+// ============================================================================
+// Zero-copy, bounds-checked walk over the tagged parameters (information
+// elements) of probe requests, probe responses and beacons. Every read is
+// checked against the received length (rx_ctrl.sig_len), so a truncated or
+// malformed frame is rejected at the offending element instead of reading
+// past the end of the driver's buffer.
+//
+// Frame layout (little-endian):
+//   frame_control u16 | duration u16 | addr1[6] | addr2[6] | addr3[6] | seq u16
+//   fixed parameters (probe response and beacon only):
+//     timestamp u64 | beacon_interval u16 | capability u16
+//   information elements: id u8 | len u8 | data[len] ...
+//   FCS u32 (included in sig_len)
+
+#define WLAN_HDR_LEN 24
+#define WLAN_FIXED_PARAMS_LEN 12
+#define WLAN_FCS_LEN 4
+
+#define WLAN_FC_TYPE_MGMT 0
+
+// Management frame subtypes we parse
+#define WLAN_SUBTYPE_PROBE_REQ 0x04
+#define WLAN_SUBTYPE_PROBE_RESP 0x05
+#define WLAN_SUBTYPE_BEACON 0x08
+
+// Information element IDs
+#define WLAN_EID_SSID 0
+#define WLAN_EID_SUPP_RATES 1
+#define WLAN_EID_DS_PARAMS 3
+#define WLAN_EID_EXT_SUPP_RATES 50
+#define WLAN_EID_VENDOR_SPECIFIC 221
+
+#define WLAN_SSID_MAX_LEN 32
+
+// Vendor-specific IE OUIs kept per frame
+#ifndef WLAN_MAX_VENDOR_IES
+#define WLAN_MAX_VENDOR_IES 4
+#endif
+
+typedef struct {
+    uint8_t id;
+    uint8_t len;
+    const uint8_t* data;  // Points into the frame buffer
+} wlan_ie_t;
+
+class WlanIeIterator {
+public:
+    WlanIeIterator(const uint8_t* data, size_t len) : pos_(data), end_(data + len) {}
+
+    // Next element, or false at the end of the body or on a truncated element
+    bool next(wlan_ie_t* ie) {
+        if (end_ - pos_ < 2) {
+            if (pos_ != end_) malformed_ = true;
+            pos_ = end_;
+            return false;
+        }
+        uint8_t len = pos_[1];
+        if ((size_t)(end_ - pos_ - 2) < len) {
+            malformed_ = true;
+            pos_ = end_;
+            return false;
+        }
+        ie->id = pos_[0];
+        ie->len = len;
+        ie->data = pos_ + 2;
+        pos_ += 2 + len;
+        return true;
+    }
+
+    // True if the walk stopped on an element that ran past the end of the frame
+    bool malformed() const { return malformed_; }
+
+private:
+    const uint8_t* pos_;
+    const uint8_t* end_;
+    bool malformed_ = false;
+};
+
+// What the sniffer needs from one management frame. Pointers reference the
+// frame buffer and are only valid inside the RX callback.
+typedef struct {
+    uint8_t subtype;            // WLAN_SUBTYPE_*
+    const uint8_t* addr2;       // Transmitter address
+    const uint8_t* ssid;        // SSID element data (nullptr if absent)
+    uint8_t ssid_len;
+    uint8_t ds_channel;         // DS Parameter Set channel (0 if absent)
+    uint8_t rate_count;         // Supported + extended supported rates
+    uint8_t max_rate;           // Highest rate in 500 kb/s units (basic-rate bit stripped)
+    uint8_t vendor_count;       // Vendor-specific IEs seen (may exceed WLAN_MAX_VENDOR_IES)
+    uint8_t vendor_ouis[WLAN_MAX_VENDOR_IES][3];
+    bool malformed;             // IE list was truncated; fields before the bad element are valid
+} wlan_mgmt_info_t;
+
+static inline uint8_t wlan_frame_type(const uint8_t* frame) { return (frame[0] >> 2) & 0x03; }
+static inline uint8_t wlan_frame_subtype(const uint8_t* frame) { return (frame[0] >> 4) & 0x0F; }
+
+// Parse a probe request, probe response or beacon. `len` is the received
+// length including the FCS. Returns false for other frames and for frames too
+// short to hold their header and fixed parameters.
+static bool wlan_parse_mgmt(const uint8_t* frame, size_t len, wlan_mgmt_info_t* info)
+{
+    if (len < WLAN_HDR_LEN + WLAN_FCS_LEN || wlan_frame_type(frame) != WLAN_FC_TYPE_MGMT) {
+        return false;
+    }
+    uint8_t subtype = wlan_frame_subtype(frame);
+    size_t body = WLAN_HDR_LEN;
+    if (subtype == WLAN_SUBTYPE_PROBE_RESP || subtype == WLAN_SUBTYPE_BEACON) {
+        body += WLAN_FIXED_PARAMS_LEN;
+    } else if (subtype != WLAN_SUBTYPE_PROBE_REQ) {
+        return false;
+    }
+    size_t end = len - WLAN_FCS_LEN;
+    if (body > end) {
+        return false;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->subtype = subtype;
+    info->addr2 = frame + 10;
+
+    WlanIeIterator it(frame + body, end - body);
+    wlan_ie_t ie;
+    bool have_ssid = false;
+    while (it.next(&ie)) {
+        switch (ie.id) {
+        case WLAN_EID_SSID:
+            // First SSID element wins; an oversized one is treated as malformed
+            if (!have_ssid) {
+                have_ssid = true;
+                if (ie.len > WLAN_SSID_MAX_LEN) {
+                    info->malformed = true;
+                } else {
+                    info->ssid = ie.data;
+                    info->ssid_len = ie.len;
+                }
+            }
+            break;
+        case WLAN_EID_DS_PARAMS:
+            if (ie.len >= 1) info->ds_channel = ie.data[0];
+            break;
+        case WLAN_EID_SUPP_RATES:
+        case WLAN_EID_EXT_SUPP_RATES:
+            for (uint8_t i = 0; i < ie.len; i++) {
+                uint8_t rate = ie.data[i] & 0x7F;
+                if (rate > info->max_rate) info->max_rate = rate;
+            }
+            info->rate_count += ie.len;
+            break;
+        case WLAN_EID_VENDOR_SPECIFIC:
+            if (ie.len >= 3) {
+                if (info->vendor_count < WLAN_MAX_VENDOR_IES) {
+                    memcpy(info->vendor_ouis[info->vendor_count], ie.data, 3);
+                }
+                if (info->vendor_count < 0xFF) info->vendor_count++;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    if (it.malformed()) info->malformed = true;
+    return true;
+}
+
+#endif // IEEE80211_H
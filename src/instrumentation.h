@@ -0,0 +1,268 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <Arduino.h>
+#include "serial_protocol.h"
+
+// ============================================================================
+// HOT-PATH INSTRUMENTATION
+// ============================================================================
+// Per-stage latency histograms in CPU cycles and a handful of event
+// counters, read by the "stats" command (serial and COMMAND_CHAR_UUID) and
+// the optional periodic stats record.
+//
+// Stages and the task that records each:
+//   capture_wifi  promiscuous RX callback (WiFi driver task), parse included
+//   parse         wlan_parse_mgmt() inside it (WiFi driver task)
+//   capture_ble   scan onResult() (NimBLE host task)
+//   match         one frame or advertisement (matching task)
+//   format        building one JSON line or binary frame (serial task)
+//   emit          one Serial.write (serial_tx writer task)
+//   notify        one GATT notification: stream batches and live detections
+//                 (BLE output task) and journal replays to the app (serial
+//                 task)
+//
+// Stages with one writer are read by loop() only, so their updates are
+// relaxed loads and stores rather than read-modify-write atomics; notify has
+// two writers and uses fetch_add (see instrument_stage_shared()). Histogram
+// bucket 0 holds samples under 2^INSTRUMENT_HIST_SHIFT cycles and each
+// further bucket doubles; the last one is open-ended.
+//
+// Built with INSTRUMENTATION 0, the macros below expand to nothing and none
+// of the state exists.
+
+#ifndef INSTRUMENTATION
+#define INSTRUMENTATION 1
+#endif
+#ifndef STATS_REPORT_INTERVAL_MS
+#define STATS_REPORT_INTERVAL_MS 0      // Periodic stats record; 0 = only on request
+#endif
+#define STATS_INTERVAL_MAX_S 86400      // Longest "stats every" period (keeps it in 32-bit ms)
+#define INSTRUMENT_HIST_BUCKETS 16
+#define INSTRUMENT_HIST_SHIFT 8         // Bucket 0: under 256 cycles (~1 us at 240 MHz)
+#define INSTRUMENT_WIFI_CHANNELS 14
+
+enum instrument_stage_t : uint8_t {
+    STAGE_CAPTURE_WIFI = 0,
+    STAGE_PARSE,
+    STAGE_CAPTURE_BLE,
+    STAGE_MATCH,
+    STAGE_FORMAT,
+    STAGE_EMIT,
+    STAGE_NOTIFY,
+    STAGE_COUNT
+};
+
+enum instrument_counter_t : uint8_t {
+    COUNTER_BLE_ADVERTS = 0,     // onResult() calls
+    COUNTER_NOTIFY_CALLS,        // notify() calls, detections and stream batches
+    COUNTER_NOTIFY_CONGESTED,    // Of those, refused for lack of host buffers
+    COUNTER_SERIAL_WRITES,       // Detection lines and frames queued
+    COUNTER_SERIAL_BYTES,
+    COUNTER_SERIAL_BLOCKED,      // Messages larger than the free TX buffer (sent in pieces)
+    COUNTER_COUNT
+};
+
+// Stages recorded from more than one task
+static inline bool instrument_stage_shared(uint8_t stage)
+{
+    return stage == STAGE_NOTIFY;
+}
+
+static inline const char* instrument_stage_name(uint8_t stage)
+{
+    static const char* const names[STAGE_COUNT] = {
+        "capture_wifi", "parse", "capture_ble", "match", "format", "emit", "notify"
+    };
+    return stage < STAGE_COUNT ? names[stage] : "unknown";
+}
+
+// Compact stats record: the periodic report, the binary-mode reply to
+// "stats" and the STREAM_REC_STATS record for the app. Percentiles are
+// histogram bucket indexes (upper bound 2^(INSTRUMENT_HIST_SHIFT + i) cycles).
+typedef struct __attribute__((packed)) {
+    uint32_t count;
+    uint32_t mean_cycles;
+    uint32_t max_cycles;
+    uint8_t p50_bucket;
+    uint8_t p99_bucket;
+} wire_stage_stats_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;           // SERIAL_PROTOCOL_VERSION
+    uint8_t type;              // WIRE_MSG_STATS
+    uint32_t timestamp_ms;
+    uint16_t cpu_mhz;
+    uint8_t stage_count;       // STAGE_COUNT
+    uint8_t counter_count;     // COUNTER_COUNT
+    wire_stage_stats_t stages[STAGE_COUNT];
+    uint32_t counters[COUNTER_COUNT];
+    uint32_t wifi_frames[INSTRUMENT_WIFI_CHANNELS];  // Management frames per channel 1-14
+} wire_stats_t;
+
+static_assert(sizeof(wire_stats_t) <= WIRE_PAYLOAD_MAX, "wire_stats_t exceeds WIRE_PAYLOAD_MAX");
+
+#if INSTRUMENTATION
+
+static inline uint32_t instrument_cycles()
+{
+    return ESP.getCycleCount();
+}
+
+static inline uint8_t instrument_bucket(uint32_t cycles)
+{
+    cycles >>= INSTRUMENT_HIST_SHIFT;
+    uint8_t bucket = 0;
+    while (cycles && bucket < INSTRUMENT_HIST_BUCKETS - 1) {
+        cycles >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+typedef struct {
+    uint32_t started;          // Cycle count at begin(), owned by the writing task
+    std::atomic<uint32_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint32_t> max;
+    std::atomic<uint32_t> hist[INSTRUMENT_HIST_BUCKETS];
+} instrument_stage_stats_t;
+
+class Instrumentation {
+public:
+    void begin(uint8_t stage) {
+        stages_[stage].started = instrument_cycles();
+    }
+
+    // Ends a sample started with begin(); ignored if none is open
+    void end(uint8_t stage) {
+        instrument_stage_stats_t& s = stages_[stage];
+        if (!s.started) return;
+        record(stage, instrument_cycles() - s.started);
+        s.started = 0;
+    }
+
+    void record(uint8_t stage, uint32_t cycles) {
+        instrument_stage_stats_t& s = stages_[stage];
+        if (instrument_stage_shared(stage)) {
+            s.count.fetch_add(1, std::memory_order_relaxed);
+            s.sum.fetch_add(cycles, std::memory_order_relaxed);
+            uint32_t max = s.max.load(std::memory_order_relaxed);
+            while (cycles > max && !s.max.compare_exchange_weak(max, cycles, std::memory_order_relaxed)) {}
+            s.hist[instrument_bucket(cycles)].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        s.count.store(s.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        s.sum.store(s.sum.load(std::memory_order_relaxed) + cycles, std::memory_order_relaxed);
+        if (cycles > s.max.load(std::memory_order_relaxed)) s.max.store(cycles, std::memory_order_relaxed);
+        std::atomic<uint32_t>& bucket = s.hist[instrument_bucket(cycles)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Counters may be bumped from more than one task
+    void count(uint8_t counter, uint32_t n = 1) {
+        counters_[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void countChannel(uint8_t channel) {
+        if (channel >= 1 && channel <= INSTRUMENT_WIFI_CHANNELS) {
+            std::atomic<uint32_t>& c = wifi_frames_[channel - 1];
+            c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    // Reader side (loop())
+    uint32_t samples(uint8_t stage) const { return stages_[stage].count.load(std::memory_order_relaxed); }
+    uint64_t sum(uint8_t stage) const { return stages_[stage].sum.load(std::memory_order_relaxed); }
+    uint32_t max(uint8_t stage) const { return stages_[stage].max.load(std::memory_order_relaxed); }
+    uint32_t bucket(uint8_t stage, uint8_t i) const {
+        return stages_[stage].hist[i].load(std::memory_order_relaxed);
+    }
+    uint32_t counter(uint8_t counter) const { return counters_[counter].load(std::memory_order_relaxed); }
+    uint32_t wifiFrames(uint8_t channel) const {
+        return wifi_frames_[channel - 1].load(std::memory_order_relaxed);
+    }
+
+    uint32_t meanCycles(uint8_t stage) const {
+        uint32_t n = samples(stage);
+        return n ? (uint32_t)(sum(stage) / n) : 0;
+    }
+
+    // Bucket holding the given fraction (per mille) of the samples
+    uint8_t percentileBucket(uint8_t stage, uint16_t per_mille) const {
+        uint32_t total = 0;
+        uint32_t hist[INSTRUMENT_HIST_BUCKETS];
+        for (uint8_t i = 0; i < INSTRUMENT_HIST_BUCKETS; i++) {
+            hist[i] = bucket(stage, i);
+            total += hist[i];
+        }
+        uint64_t target = ((uint64_t)total * per_mille + 999) / 1000;
+        uint32_t seen = 0;
+        for (uint8_t i = 0; i < INSTRUMENT_HIST_BUCKETS; i++) {
+            seen += hist[i];
+            if (seen >= target && seen) return i;
+        }
+        return 0;
+    }
+
+    size_t snapshot(wire_stats_t* out, uint32_t now, uint16_t cpu_mhz) const {
+        memset(out, 0, sizeof(*out));
+        out->version = SERIAL_PROTOCOL_VERSION;
+        out->type = WIRE_MSG_STATS;
+        out->timestamp_ms = now;
+        out->cpu_mhz = cpu_mhz;
+        out->stage_count = STAGE_COUNT;
+        out->counter_count = COUNTER_COUNT;
+        for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+            wire_stage_stats_t& st = out->stages[i];
+            st.count = samples(i);
+            st.mean_cycles = meanCycles(i);
+            st.max_cycles = max(i);
+            st.p50_bucket = percentileBucket(i, 500);
+            st.p99_bucket = percentileBucket(i, 990);
+        }
+        for (uint8_t i = 0; i < COUNTER_COUNT; i++) out->counters[i] = counter(i);
+        for (uint8_t ch = 1; ch <= INSTRUMENT_WIFI_CHANNELS; ch++) out->wifi_frames[ch - 1] = wifiFrames(ch);
+        return sizeof(*out);
+    }
+
+private:
+    instrument_stage_stats_t stages_[STAGE_COUNT] = {};
+    std::atomic<uint32_t> counters_[COUNTER_COUNT] = {};
+    std::atomic<uint32_t> wifi_frames_[INSTRUMENT_WIFI_CHANNELS] = {};
+};
+
+static Instrumentation instrumentation;
+
+// Times the enclosing scope as one sample of a stage
+class InstrumentScope {
+public:
+    explicit InstrumentScope(uint8_t stage) : stage_(stage), started_(instrument_cycles()) {}
+    ~InstrumentScope() { instrumentation.record(stage_, instrument_cycles() - started_); }
+
+private:
+    uint8_t stage_;
+    uint32_t started_;
+};
+
+#define INSTRUMENT_SCOPE(stage) InstrumentScope instrument_scope_(stage)
+#define INSTRUMENT_BEGIN(stage) instrumentation.begin(stage)
+#define INSTRUMENT_END(stage) instrumentation.end(stage)
+#define INSTRUMENT_COUNT(counter, n) instrumentation.count(counter, n)
+#define INSTRUMENT_CHANNEL(channel) instrumentation.countChannel(channel)
+
+#else
+
+#define INSTRUMENT_SCOPE(stage) do {} while (0)
+#define INSTRUMENT_BEGIN(stage) do {} while (0)
+#define INSTRUMENT_END(stage) do {} while (0)
+#define INSTRUMENT_COUNT(counter, n) do {} while (0)
+#define INSTRUMENT_CHANNEL(channel) do {} while (0)
+
+#endif // INSTRUMENTATION
+
+#endif // INSTRUMENTATION_H
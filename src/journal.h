@@ -0,0 +1,453 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <FS.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "serial_protocol.h"
+
+// ============================================================================
+// PERSISTENT DETECTION JOURNAL
+// ============================================================================
+// Every detection the serial task outputs is also appended, as its packed
+// wire_detection_t, to an append-only journal on the LittleFS partition, so a
+// host or app that was disconnected can ask for everything after the last
+// sequence number it acknowledged. Records get a sequence number at dispatch
+// (nextSeq() is called by the matching task) and carry it on every output.
+//
+// Appends go to a RAM write-back buffer (PSRAM when the board has it) that is
+// flushed in one write once JOURNAL_FLUSH_BYTES have collected, or after
+// JOURNAL_FLUSH_MS, so flash sees a few block-sized appends rather than one
+// small write per detection. The journal is a series of segment files named
+// by their first sequence number; a new segment starts at boot and every
+// JOURNAL_SEGMENT_BYTES, and the oldest whole segment is deleted once the
+// journal outgrows its capacity. Nothing is ever rewritten in place: LittleFS
+// spreads the appends and deletes over the partition, and the acknowledged
+// positions are saved at most every JOURNAL_ACK_SAVE_MS.
+//
+// On flash each record is a journal_record_header_t then the payload. A torn
+// write at power loss fails the CRC; reading a segment stops there, and the
+// next boot starts a fresh segment after the last valid record.
+//
+// The serial task owns the journal: append(), flush(), tick() and
+// replayStep() are only called from it. nextSeq(), ack() and requestReplay()
+// may be called from any task.
+
+#ifndef JOURNAL_MAX_BYTES
+#define JOURNAL_MAX_BYTES (4u * 1024 * 1024)   // Also capped at 3/4 of the partition
+#endif
+#ifndef JOURNAL_SEGMENT_BYTES
+#define JOURNAL_SEGMENT_BYTES (64u * 1024)
+#endif
+#define JOURNAL_MAX_SEGMENTS 256
+#ifndef JOURNAL_BUFFER_BYTES
+#define JOURNAL_BUFFER_BYTES (64u * 1024)      // Write-back buffer in PSRAM
+#endif
+#define JOURNAL_BUFFER_FALLBACK_BYTES 8192     // In internal RAM on boards without PSRAM
+#define JOURNAL_FLUSH_BYTES 4096               // One LittleFS block
+#ifndef JOURNAL_FLUSH_MS
+#define JOURNAL_FLUSH_MS 30000                 // Longest a record waits in RAM
+#endif
+#define JOURNAL_ACK_SAVE_MS 60000
+#define JOURNAL_DIR "/journal"
+#define JOURNAL_ACK_PATH JOURNAL_DIR "/ack"
+#define JOURNAL_ACK_MAGIC 0x4B43414A           // "JACK"
+
+// Each consumer acknowledges and replays independently
+enum journal_consumer_t : uint8_t {
+    JOURNAL_CONSUMER_SERIAL = 0,
+    JOURNAL_CONSUMER_BLE,
+    JOURNAL_CONSUMER_COUNT
+};
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint16_t len;      // Payload bytes that follow
+    uint16_t crc;      // wire_crc16 over seq, len and the payload
+} journal_record_header_t;
+
+#define JOURNAL_RECORD_MAX (sizeof(journal_record_header_t) + sizeof(wire_detection_t))
+
+typedef struct {
+    uint32_t next_seq;          // Sequence number the next record gets
+    uint32_t oldest_seq;        // First record still on flash, 0 if none
+    uint32_t acked[JOURNAL_CONSUMER_COUNT];
+    uint32_t segments;
+    uint32_t flash_bytes;
+    uint32_t capacity;
+    uint32_t buffered;          // Bytes waiting in RAM
+    uint32_t buffer_size;
+    uint32_t records;           // Appended since boot
+    uint32_t flushes;
+    uint32_t replayed;          // Records handed to replay callbacks
+    uint32_t dropped;           // Buffer full and flushing failed
+    uint32_t write_errors;
+    uint32_t pruned_segments;
+    uint32_t pruned_unacked;    // Records deleted before both consumers acknowledged them
+} journal_stats_t;
+
+// Called by replayStep() for each record after the requested sequence number
+typedef void (*journal_replay_fn)(uint32_t seq, const uint8_t* payload, size_t len);
+
+class DetectionJournal {
+public:
+    // Scan the journal directory and pick up after the last valid record.
+    // capacity is the most flash the segments may use; buffer (owned by the
+    // caller) must hold at least JOURNAL_RECORD_MAX bytes.
+    bool begin(fs::FS* fs, size_t capacity, uint8_t* buffer, size_t buffer_size) {
+        fs_ = fs;
+        capacity_ = capacity;
+        buf_ = buffer;
+        buf_size_ = buffer_size;
+        buf_len_ = 0;
+        seg_count_ = 0;
+        seg_open_ = false;
+        flash_bytes_ = 0;
+        if (!fs_ || !buf_ || buf_size_ < JOURNAL_RECORD_MAX) return false;
+        if (!fs_->exists(JOURNAL_DIR) && !fs_->mkdir(JOURNAL_DIR)) return false;
+        File dir = fs_->open(JOURNAL_DIR);
+        if (!dir || !dir.isDirectory()) return false;
+        for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+            uint32_t first;
+            if (parseSegmentName(f.name(), &first)) addSegment(first, f.size());
+        }
+        dir.close();
+
+        uint32_t last = 0;
+        if (seg_count_) {
+            last = seg_first_[seg_count_ - 1] - 1;
+            File f = fs_->open(segmentPath(seg_first_[seg_count_ - 1]).path);
+            journal_record_header_t hdr;
+            uint8_t payload[sizeof(wire_detection_t)];
+            while (f && readRecord(f, &hdr, payload)) last = hdr.seq;
+        }
+        loadAcks();
+        for (int i = 0; i < JOURNAL_CONSUMER_COUNT; i++) {
+            uint32_t acked = acked_[i].load(std::memory_order_relaxed);
+            if (acked > last) last = acked;
+        }
+        next_seq_.store(last + 1, std::memory_order_relaxed);
+        prune();
+        ready_.store(true, std::memory_order_release);
+        return true;
+    }
+
+    bool ready() const { return ready_.load(std::memory_order_acquire); }
+
+    // Any task. 0 while the journal is not ready.
+    uint32_t nextSeq() {
+        return ready() ? next_seq_.fetch_add(1, std::memory_order_relaxed) : 0;
+    }
+
+    // Buffer one record; flushes when a block's worth has collected
+    bool append(uint32_t seq, const uint8_t* payload, size_t len, uint32_t now) {
+        if (!ready() || !seq || len > sizeof(wire_detection_t)) return false;
+        size_t need = sizeof(journal_record_header_t) + len;
+        if (buf_len_ + need > buf_size_ && !flush()) {
+            stats_.dropped++;
+            return false;
+        }
+        journal_record_header_t hdr = { seq, (uint16_t)len, 0 };
+        hdr.crc = recordCrc(hdr, payload);
+        if (!buf_len_) {
+            buf_first_seq_ = seq;
+            buf_since_ = now;
+        }
+        memcpy(buf_ + buf_len_, &hdr, sizeof(hdr));
+        memcpy(buf_ + buf_len_ + sizeof(hdr), payload, len);
+        buf_len_ += need;
+        stats_.records++;
+        if (buf_len_ >= JOURNAL_FLUSH_BYTES) flush();
+        return true;
+    }
+
+    // Write the buffer to the current segment in one append
+    bool flush() {
+        if (!buf_len_) return true;
+        if ((!seg_open_ || seg_size_[seg_count_ - 1] >= JOURNAL_SEGMENT_BYTES) && !openSegment(buf_first_seq_)) {
+            stats_.write_errors++;
+            return false;
+        }
+        File f = fs_->open(segmentPath(seg_first_[seg_count_ - 1]).path, FILE_APPEND);
+        size_t written = f ? f.write(buf_, buf_len_) : 0;
+        f.close();
+        seg_size_[seg_count_ - 1] += written;
+        flash_bytes_ += written;
+        if (written != buf_len_) {
+            // The segment may end in a partial record now; retry into a new one
+            seg_open_ = false;
+            stats_.write_errors++;
+            return false;
+        }
+        buf_len_ = 0;
+        stats_.flushes++;
+        prune();
+        return true;
+    }
+
+    // Time-based flush and ack persistence
+    void tick(uint32_t now) {
+        if (buf_len_ && now - buf_since_ >= JOURNAL_FLUSH_MS) flush();
+        if (now - acks_saved_at_ >= JOURNAL_ACK_SAVE_MS) {
+            saveAcks();
+            acks_saved_at_ = now;
+        }
+    }
+
+    // Any task. Acknowledgements only move forward.
+    void ack(journal_consumer_t consumer, uint32_t seq) {
+        uint32_t limit = next_seq_.load(std::memory_order_relaxed) - 1;
+        if (seq > limit) seq = limit;
+        uint32_t cur = acked_[consumer].load(std::memory_order_relaxed);
+        while (seq > cur && !acked_[consumer].compare_exchange_weak(cur, seq, std::memory_order_relaxed)) {}
+    }
+
+    uint32_t acked(journal_consumer_t consumer) const {
+        return acked_[consumer].load(std::memory_order_relaxed);
+    }
+
+    // Any task. Replays every record with a sequence number above after_seq;
+    // a new request restarts a replay in progress.
+    void requestReplay(journal_consumer_t consumer, uint32_t after_seq) {
+        if (!ready()) return;
+        replay_[consumer].request.store(after_seq + 1, std::memory_order_release);
+    }
+
+    bool replaying(journal_consumer_t consumer) const {
+        return replay_[consumer].active || replay_[consumer].request.load(std::memory_order_relaxed);
+    }
+
+    // Hand up to max records of a pending replay to fn. Returns how many were
+    // sent; the replay ends once the newest segment has been read (records
+    // still in the buffer went out live).
+    size_t replayStep(journal_consumer_t consumer, size_t max, journal_replay_fn fn) {
+        ReplayCursor& r = replay_[consumer];
+        uint32_t request = r.request.exchange(0, std::memory_order_acquire);
+        if (request) {
+            flush();
+            r.active = true;
+            r.after = request - 1;
+            r.seg_first = 0;
+            r.offset = 0;
+            // Start in the last segment beginning at or before the first wanted record
+            for (uint16_t i = 0; i < seg_count_ && seg_first_[i] <= r.after + 1; i++) {
+                r.seg_first = seg_first_[i];
+            }
+        }
+        if (!r.active) return 0;
+
+        size_t sent = 0;
+        journal_record_header_t hdr;
+        uint8_t payload[sizeof(wire_detection_t)];
+        while (sent < max) {
+            // The segment being read may have been pruned; move on to the next one
+            int idx = -1;
+            for (uint16_t i = 0; i < seg_count_; i++) {
+                if (seg_first_[i] >= r.seg_first) { idx = i; break; }
+            }
+            if (idx < 0) {
+                r.active = false;
+                break;
+            }
+            if (seg_first_[idx] != r.seg_first) {
+                r.seg_first = seg_first_[idx];
+                r.offset = 0;
+            }
+            File f = fs_->open(segmentPath(r.seg_first).path);
+            bool segment_done = !f || !f.seek(r.offset);
+            while (!segment_done && sent < max) {
+                if (!readRecord(f, &hdr, payload)) {
+                    segment_done = true;
+                    break;
+                }
+                r.offset = f.position();
+                if (hdr.seq <= r.after) continue;
+                fn(hdr.seq, payload, hdr.len);
+                r.after = hdr.seq;
+                sent++;
+                stats_.replayed++;
+            }
+            f.close();
+            if (!segment_done) break;
+            if (idx + 1 >= seg_count_) {
+                r.active = false;
+                break;
+            }
+            r.seg_first = seg_first_[idx + 1];
+            r.offset = 0;
+        }
+        return sent;
+    }
+
+    void getStats(journal_stats_t* out) const {
+        *out = stats_;
+        out->next_seq = next_seq_.load(std::memory_order_relaxed);
+        out->oldest_seq = seg_count_ ? seg_first_[0] : 0;
+        for (int i = 0; i < JOURNAL_CONSUMER_COUNT; i++) out->acked[i] = acked((journal_consumer_t)i);
+        out->segments = seg_count_;
+        out->flash_bytes = flash_bytes_;
+        out->capacity = capacity_;
+        out->buffered = buf_len_;
+        out->buffer_size = buf_size_;
+    }
+
+private:
+    struct ReplayCursor {
+        std::atomic<uint32_t> request{0};   // after_seq + 1 of a pending request, 0 if none
+        bool active = false;
+        uint32_t after = 0;                 // Last sequence number sent
+        uint32_t seg_first = 0;             // Segment being read and the offset in it
+        uint32_t offset = 0;
+    };
+
+    struct SegmentPath {
+        char path[sizeof(JOURNAL_DIR) + 16];
+    };
+
+    static SegmentPath segmentPath(uint32_t first) {
+        SegmentPath p;
+        snprintf(p.path, sizeof(p.path), JOURNAL_DIR "/%08lx.log", (unsigned long)first);
+        return p;
+    }
+
+    static bool parseSegmentName(const char* name, uint32_t* first) {
+        const char* slash = strrchr(name, '/');
+        if (slash) name = slash + 1;
+        if (strlen(name) != 12 || strcmp(name + 8, ".log") != 0) return false;
+        uint32_t value = 0;
+        for (int i = 0; i < 8; i++) {
+            char c = name[i];
+            uint8_t digit = c >= '0' && c <= '9' ? c - '0' : (c >= 'a' && c <= 'f' ? c - 'a' + 10 : 0xFF);
+            if (digit == 0xFF) return false;
+            value = (value << 4) | digit;
+        }
+        *first = value;
+        return value != 0;
+    }
+
+    static uint16_t recordCrc(const journal_record_header_t& hdr, const uint8_t* payload) {
+        uint16_t crc = wire_crc16((const uint8_t*)&hdr, offsetof(journal_record_header_t, crc));
+        return wire_crc16(payload, hdr.len, crc);
+    }
+
+    // Sequential read of the next record. False at the end of the segment or
+    // at the first damaged record.
+    static bool readRecord(File& f, journal_record_header_t* hdr, uint8_t* payload) {
+        if (f.read((uint8_t*)hdr, sizeof(*hdr)) != sizeof(*hdr)) return false;
+        if (!hdr->seq || hdr->len > sizeof(wire_detection_t)) return false;
+        if (f.read(payload, hdr->len) != hdr->len) return false;
+        return recordCrc(*hdr, payload) == hdr->crc;
+    }
+
+    // Insert in sequence order (directory listings are unordered)
+    void addSegment(uint32_t first, uint32_t size) {
+        if (seg_count_ == JOURNAL_MAX_SEGMENTS) return;
+        uint16_t i = seg_count_;
+        for (; i > 0 && seg_first_[i - 1] > first; i--) {
+            seg_first_[i] = seg_first_[i - 1];
+            seg_size_[i] = seg_size_[i - 1];
+        }
+        seg_first_[i] = first;
+        seg_size_[i] = size;
+        seg_count_++;
+        flash_bytes_ += size;
+    }
+
+    bool openSegment(uint32_t first) {
+        File f = fs_->open(segmentPath(first).path, FILE_WRITE);
+        if (!f) return false;
+        f.close();
+        if (seg_count_ && seg_first_[seg_count_ - 1] == first) {
+            // A failed flush left this segment behind; it was just truncated
+            flash_bytes_ -= seg_size_[seg_count_ - 1];
+            seg_size_[seg_count_ - 1] = 0;
+        } else {
+            if (seg_count_ == JOURNAL_MAX_SEGMENTS) removeOldest();
+            addSegment(first, 0);
+        }
+        seg_open_ = true;
+        return true;
+    }
+
+    void removeOldest() {
+        fs_->remove(segmentPath(seg_first_[0]).path);
+        flash_bytes_ -= seg_size_[0];
+        stats_.pruned_segments++;
+        // Count the records in it that a consumer had not acknowledged yet
+        uint32_t end = seg_count_ > 1 ? seg_first_[1] : next_seq_.load(std::memory_order_relaxed);
+        uint32_t acked = acked_[0].load(std::memory_order_relaxed);
+        for (int i = 1; i < JOURNAL_CONSUMER_COUNT; i++) {
+            uint32_t a = acked_[i].load(std::memory_order_relaxed);
+            if (a < acked) acked = a;
+        }
+        uint32_t from = acked + 1 > seg_first_[0] ? acked + 1 : seg_first_[0];
+        if (end > from) stats_.pruned_unacked += end - from;
+        seg_count_--;
+        memmove(seg_first_, seg_first_ + 1, seg_count_ * sizeof(seg_first_[0]));
+        memmove(seg_size_, seg_size_ + 1, seg_count_ * sizeof(seg_size_[0]));
+    }
+
+    // The segment being appended to is never removed
+    void prune() {
+        while (seg_count_ > 1 && flash_bytes_ > capacity_) removeOldest();
+    }
+
+    void loadAcks() {
+        uint32_t data[2 + JOURNAL_CONSUMER_COUNT];
+        File f = fs_->open(JOURNAL_ACK_PATH);
+        bool ok = f && f.read((uint8_t*)data, sizeof(data)) == sizeof(data) && data[0] == JOURNAL_ACK_MAGIC &&
+                  data[1] == wire_crc16((const uint8_t*)&data[2], sizeof(data) - 2 * sizeof(uint32_t));
+        for (int i = 0; i < JOURNAL_CONSUMER_COUNT; i++) {
+            acked_[i].store(ok ? data[2 + i] : 0, std::memory_order_relaxed);
+            saved_acked_[i] = ok ? data[2 + i] : 0;
+        }
+    }
+
+    // Rewrites the ack file only if an acknowledgement moved
+    void saveAcks() {
+        uint32_t data[2 + JOURNAL_CONSUMER_COUNT];
+        bool changed = false;
+        for (int i = 0; i < JOURNAL_CONSUMER_COUNT; i++) {
+            data[2 + i] = acked_[i].load(std::memory_order_relaxed);
+            changed |= data[2 + i] != saved_acked_[i];
+        }
+        if (!changed) return;
+        data[0] = JOURNAL_ACK_MAGIC;
+        data[1] = wire_crc16((const uint8_t*)&data[2], sizeof(data) - 2 * sizeof(uint32_t));
+        File f = fs_->open(JOURNAL_ACK_PATH, FILE_WRITE);
+        if (!f || f.write((const uint8_t*)data, sizeof(data)) != sizeof(data)) {
+            stats_.write_errors++;
+            return;
+        }
+        f.close();
+        for (int i = 0; i < JOURNAL_CONSUMER_COUNT; i++) saved_acked_[i] = data[2 + i];
+    }
+
+    fs::FS* fs_ = nullptr;
+    std::atomic<bool> ready_{false};
+    std::atomic<uint32_t> next_seq_{1};
+    std::atomic<uint32_t> acked_[JOURNAL_CONSUMER_COUNT] = {};
+    uint32_t saved_acked_[JOURNAL_CONSUMER_COUNT] = {};
+    uint32_t acks_saved_at_ = 0;
+    size_t capacity_ = 0;
+
+    uint8_t* buf_ = nullptr;
+    size_t buf_size_ = 0;
+    size_t buf_len_ = 0;
+    uint32_t buf_first_seq_ = 0;
+    uint32_t buf_since_ = 0;
+
+    uint32_t seg_first_[JOURNAL_MAX_SEGMENTS];
+    uint32_t seg_size_[JOURNAL_MAX_SEGMENTS];
+    uint16_t seg_count_ = 0;
+    bool seg_open_ = false;      // Appends may go to the newest segment
+    uint32_t flash_bytes_ = 0;
+
+    ReplayCursor replay_[JOURNAL_CONSUMER_COUNT];
+    journal_stats_t stats_ = {};
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,83 @@
+#ifndef KNOWN_MACS_H
+#define KNOWN_MACS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// KNOWN DEVICE FILTER
+// ============================================================================
+// Full MAC addresses of devices seen in the field (the WiGLE exports under
+// datasets/ plus any added to custom_known_macs_sources) compiled into an
+// xor filter by scripts/known_macs.py at build time and kept in flash. A
+// lookup hashes the 48-bit address once and XORs three table entries, so
+// every frame and advertisement can be checked: there are no false
+// negatives, and false positives occur at 2^-KNOWN_MACS_FINGERPRINT_BITS
+// (the build prints the measured rate for each environment).
+//
+// Unlike the OUI list this catches units whose radios use an unlisted or
+// locally administered prefix. Without the generated header (a build that
+// did not run the script) the filter is empty and never matches.
+
+#if defined(__has_include)
+#if __has_include("known_macs_data.h")
+#include "known_macs_data.h"
+#endif
+#endif
+
+#ifndef KNOWN_MACS_COUNT
+#define KNOWN_MACS_COUNT 0
+#endif
+
+static inline uint64_t known_macs_hash(uint64_t x)
+{
+    // murmur3 fmix64; must match mix64() in scripts/known_macs.py
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline uint32_t known_macs_reduce(uint32_t x, uint32_t n)
+{
+    return (uint32_t)(((uint64_t)x * n) >> 32);
+}
+
+static inline uint64_t known_macs_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// MAC in display order
+static inline bool known_mac_contains(const uint8_t* mac)
+{
+#if KNOWN_MACS_COUNT > 0
+    uint64_t key = ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) | ((uint64_t)mac[2] << 24) |
+                   ((uint64_t)mac[3] << 16) | ((uint64_t)mac[4] << 8) | mac[5];
+    uint64_t h = known_macs_hash(key + KNOWN_MACS_SEED);
+    known_macs_fingerprint_t f = (known_macs_fingerprint_t)(h ^ (h >> 32));
+    uint32_t h0 = known_macs_reduce((uint32_t)h, KNOWN_MACS_BLOCK_LENGTH);
+    uint32_t h1 = known_macs_reduce((uint32_t)known_macs_rotl(h, 21), KNOWN_MACS_BLOCK_LENGTH) +
+                  KNOWN_MACS_BLOCK_LENGTH;
+    uint32_t h2 = known_macs_reduce((uint32_t)known_macs_rotl(h, 42), KNOWN_MACS_BLOCK_LENGTH) +
+                  2 * KNOWN_MACS_BLOCK_LENGTH;
+    return f == (known_macs_fingerprint_t)(known_macs_table[h0] ^ known_macs_table[h1] ^ known_macs_table[h2]);
+#else
+    (void)mac;
+    return false;
+#endif
+}
+
+// Flash used by the filter table
+static inline size_t known_macs_bytes()
+{
+#if KNOWN_MACS_COUNT > 0
+    return sizeof(known_macs_table);
+#else
+    return 0;
+#endif
+}
+
+#endif // KNOWN_MACS_H
@@ -0,0 +1,117 @@
+#ifndef LED_ENGINE_H
+#define LED_ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// ============================================================================
+// NON-BLOCKING LED ANIMATION ENGINE
+// ============================================================================
+// Animations are short lists of (color, duration) steps. Callers only post a
+// request, which is a single atomic store, so the WiFi consumer task and the
+// NimBLE callbacks never wait on the LED. led_tick() is called from loop()
+// and advances the running animation based on elapsed time. A request with a
+// higher priority preempts the running animation (a detection alert cuts a
+// heartbeat short); lower-priority requests are dropped while it runs.
+
+typedef struct {
+    uint32_t color;
+    uint16_t duration_ms;
+} led_step_t;
+
+typedef struct {
+    const led_step_t* steps;
+    uint8_t step_count;
+    uint8_t priority;      // Higher value wins
+} led_animation_t;
+
+typedef void (*led_output_fn)(uint32_t color);
+
+class LedEngine {
+public:
+    void begin(led_output_fn output, uint32_t idle_color) {
+        output_ = output;
+        idle_color_.store(idle_color, std::memory_order_relaxed);
+        shown_color_ = idle_color;
+        if (output_) output_(idle_color);
+    }
+
+    // Color shown when no animation is running (e.g. red while a device is in range)
+    void setIdleColor(uint32_t color) {
+        idle_color_.store(color, std::memory_order_relaxed);
+    }
+
+    // Request an animation. Never blocks; keeps the highest-priority pending request.
+    void request(const led_animation_t* anim) {
+        const led_animation_t* cur = pending_.load(std::memory_order_relaxed);
+        while (!cur || anim->priority >= cur->priority) {
+            if (pending_.compare_exchange_weak(cur, anim, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Advance the state machine. Call frequently (every few ms) from one task.
+    void tick(uint32_t now_ms) {
+        const led_animation_t* req = pending_.exchange(nullptr, std::memory_order_acquire);
+        if (req) {
+            if (!active_ || req->priority >= active_->priority) {
+                if (active_) preempted_++;
+                start(req, now_ms);
+            } else {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        while (active_ && now_ms - step_started_ >= active_->steps[step_].duration_ms) {
+            step_started_ += active_->steps[step_].duration_ms;
+            step_++;
+            if (step_ >= active_->step_count) {
+                active_ = nullptr;
+                break;
+            }
+            show(active_->steps[step_].color);
+        }
+
+        if (!active_) {
+            show(idle_color_.load(std::memory_order_relaxed));
+        }
+    }
+
+    bool busy() const { return active_ != nullptr; }
+    uint32_t preempted() const { return preempted_; }
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    void start(const led_animation_t* anim, uint32_t now_ms) {
+        active_ = anim;
+        step_ = 0;
+        step_started_ = now_ms;
+        if (anim->step_count == 0) {
+            active_ = nullptr;
+            return;
+        }
+        show(anim->steps[0].color);
+    }
+
+    void show(uint32_t color) {
+        if (color == shown_color_) return;
+        shown_color_ = color;
+        if (output_) output_(color);
+    }
+
+    led_output_fn output_ = nullptr;
+    std::atomic<const led_animation_t*> pending_{nullptr};
+    std::atomic<uint32_t> idle_color_{0};
+    std::atomic<uint32_t> dropped_{0};
+    const led_animation_t* active_ = nullptr;
+    uint8_t step_ = 0;
+    uint32_t step_started_ = 0;
+    uint32_t shown_color_ = 0;
+    uint32_t preempted_ = 0;
+};
+
+#endif // LED_ENGINE_H
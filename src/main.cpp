@@ -4,6 +4,7 @@
 #include <NimBLEScan.h>
 #include <NimBLEAdvertisedDevice.h>
 #include <ArduinoJson.h>
+#include <LittleFS.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
@@ -12,6 +13,23 @@
 #include "esp_wifi_types.h"
 #include <Adafruit_NeoPixel.h>
 #include "ble_broadcast.h"
+#include "frame_queue.h"
+#include "led_engine.h"
+#include "oui_table.h"
+#include "pattern_matcher.h"
+#include "signature_db.h"
+#include "known_macs.h"
+#include "ble_uuid.h"
+#include "device_table.h"
+#include "serial_protocol.h"
+#include "channel_scheduler.h"
+#include "radio_scheduler.h"
+#include "ble_scan_policy.h"
+#include "pipeline.h"
+#include "journal.h"
+#include "instrumentation.h"
+#include "serial_tx.h"
+#include <mutex>
 
 // ============================================================================
 // CONFIGURATION
@@ -37,15 +55,23 @@ Adafruit_NeoPixel pixel(NUM_PIXELS, RGB_DATA_PIN, NEO_GRB + NEO_KHZ800);
 #define BOOT_FLASH_DURATION 300   // Boot flash duration
 #define DETECT_FLASH_DURATION 150 // Detection flash duration (faster)
 #define HEARTBEAT_DURATION 100    // Short heartbeat pulse
+#define LED_GAP_DURATION 50       // Dark gap after each flash
+
+// Main loop polling interval (LED animations are advanced from loop())
+#define LOOP_INTERVAL_MS 10
 
 // WiFi Promiscuous Mode Configuration
-#define MAX_CHANNEL 13
-#define CHANNEL_HOP_INTERVAL 500  // milliseconds
+// (MAX_CHANNEL and the adaptive dwell settings are in channel_scheduler.h)
+#define CHANNEL_HOP_INTERVAL 500  // Round-robin dwell when CHANNEL_HOP_ADAPTIVE is 0 (milliseconds)
+
+// Task pipeline (cores, stacks and queue sizes are in pipeline.h)
+#define PIPELINE_REPORT_INTERVAL 60000  // Milliseconds between pipeline stats lines
 
 // BLE SCANNING CONFIGURATION
-#define BLE_SCAN_DURATION 1    // Seconds
-#define BLE_SCAN_INTERVAL 5000 // Milliseconds between scans
-static unsigned long last_ble_scan = 0;
+// (WiFi/BLE slot lengths are RADIO_CYCLE_MS and RADIO_BLE_SHARE_PCT in radio_scheduler.h)
+#define BLE_SCAN_INTERVAL_UNITS 100  // 0.625 ms units; the window is equal, so BLE slots scan continuously
+#define RADIO_REPORT_INTERVAL 60000  // Milliseconds between radio airtime/yield lines
+static unsigned long last_radio_report = 0;
 
 // Detection Pattern Limits
 #define MAX_SSID_PATTERNS 10
@@ -56,117 +82,224 @@ static unsigned long last_ble_scan = 0;
 // DETECTION PATTERNS (Extracted from Real Flock Safety Device Databases)
 // ============================================================================
 
-// WiFi SSID patterns to detect (case-insensitive)
-static const char* wifi_ssid_patterns[] = {
-    "flock",        // Standard Flock Safety naming
-    "Flock",        // Capitalized variant
-    "FLOCK",        // All caps variant
-    "FS Ext Battery", // Flock Safety Extended Battery devices
-    "Penguin",      // Penguin surveillance devices
-    "Pigvision"     // Pigvision surveillance systems
+// WiFi SSID patterns to detect (case-insensitive substring match)
+static const name_signature_t wifi_ssid_patterns[] = {
+    { "flock",          FAMILY_FLOCK },     // Standard Flock Safety naming
+    { "FS Ext Battery", FAMILY_FLOCK },     // Flock Safety Extended Battery devices
+    { "Penguin",        FAMILY_PENGUIN },   // Penguin surveillance devices
+    { "Pigvision",      FAMILY_PIGVISION }  // Pigvision surveillance systems
 };
 
 // Known Flock Safety MAC address prefixes (from real device databases)
-static const char* mac_prefixes[] = {
+// 24-bit OUIs; sorted into oui_table at compile time for binary search
+static constexpr uint32_t mac_prefixes[] = {
     // FS Ext Battery devices
-    "58:8e:81", "cc:cc:cc", "ec:1b:bd", "90:35:ea", "04:0d:84", 
-    "f0:82:c0", "1c:34:f1", "38:5b:44", "94:34:69", "b4:e3:f9",
+    0x588e81, 0xcccccc, 0xec1bbd, 0x9035ea, 0x040d84,
+    0xf082c0, 0x1c34f1, 0x385b44, 0x943469, 0xb4e3f9,
     
     // Flock WiFi devices
-    "70:c9:4e", "3c:91:80", "d8:f3:bc", "80:30:49", "14:5a:fc",
-    "74:4c:a1", "08:3a:88", "9c:2f:9d", "94:08:53", "e4:aa:ea"
+    0x70c94e, 0x3c9180, 0xd8f3bc, 0x803049, 0x145afc,
+    0x744ca1, 0x083a88, 0x9c2f9d, 0x940853, 0xe4aaea
     
     // Penguin devices - these are NOT OUI based, so use local ouis
     // from the wigle.net db relative to your location 
-    // "cc:09:24", "ed:c7:63", "e8:ce:56", "ea:0c:ea", "d8:8f:14",
-    // "f9:d9:c0", "f1:32:f9", "f6:a0:76", "e4:1c:9e", "e7:f2:43",
-    // "e2:71:33", "da:91:a9", "e1:0e:15", "c8:ae:87", "f4:ed:b2",
-    // "d8:bf:b5", "ee:8f:3c", "d7:2b:21", "ea:5a:98"
+    // 0xcc0924, 0xedc763, 0xe8ce56, 0xea0cea, 0xd88f14,
+    // 0xf9d9c0, 0xf132f9, 0xf6a076, 0xe41c9e, 0xe7f243,
+    // 0xe27133, 0xda91a9, 0xe10e15, 0xc8ae87, 0xf4edb2,
+    // 0xd8bfb5, 0xee8f3c, 0xd72b21, 0xea5a98
 };
 
-// Device name patterns for BLE advertisement detection
-static const char* device_name_patterns[] = {
-    "FS Ext Battery",  // Flock Safety Extended Battery
-    "Penguin",         // Penguin surveillance devices
-    "Flock",           // Standard Flock Safety devices
-    "Pigvision"        // Pigvision surveillance systems
+static constexpr auto oui_table = make_oui_table(mac_prefixes);
+static_assert(oui_table_is_unique(oui_table), "duplicate OUI in mac_prefixes");
+
+// Device name patterns for BLE advertisement detection (case-insensitive)
+static const name_signature_t device_name_patterns[] = {
+    { "FS Ext Battery", FAMILY_FLOCK },     // Flock Safety Extended Battery
+    { "Penguin",        FAMILY_PENGUIN },   // Penguin surveillance devices
+    { "Flock",          FAMILY_FLOCK },     // Standard Flock Safety devices
+    { "Pigvision",      FAMILY_PIGVISION }  // Pigvision surveillance systems
 };
 
+// The tables above are the built-in signature set; a signature pack stored
+// on LittleFS replaces them at boot, and one pushed over serial or BLE
+// replaces them at run time (see signature_db.h)
+static SignatureDb signature_db;
+#define SIGPACK_PATH "/sigpack.bin"
+#define SIGPACK_TMP_PATH "/sigpack.tmp"
+#define SIGPACK_TASK_STACK_SIZE 4096
+#define SIGPACK_TASK_PRIORITY 1
+#define SIGPACK_CHUNK_MAX 64         // Pack bytes per "sig data" line
+#define SIGPACK_RETRY_MS 1000        // Builder re-check interval while a pack waits
+
 // ============================================================================
 // RAVEN SURVEILLANCE DEVICE UUID PATTERNS
 // ============================================================================
 // These UUIDs are specific to Raven surveillance devices (acoustic gunshot detection)
 // Source: raven_configurations.json - firmware versions 1.1.7, 1.2.0, 1.3.1
 
+// All Raven services are 16-bit UUIDs on the Bluetooth SIG base
+// (0000xxxx-0000-1000-8000-00805f9b34fb), so they are matched as integers.
+
 // Raven Device Information Service (used across all firmware versions)
-#define RAVEN_DEVICE_INFO_SERVICE       "0000180a-0000-1000-8000-00805f9b34fb"
+#define RAVEN_DEVICE_INFO_SERVICE       0x180a
 
 // Raven GPS Location Service (firmware 1.2.0+)
-#define RAVEN_GPS_SERVICE               "00003100-0000-1000-8000-00805f9b34fb"
+#define RAVEN_GPS_SERVICE               0x3100
 
 // Raven Power/Battery Service (firmware 1.2.0+)
-#define RAVEN_POWER_SERVICE             "00003200-0000-1000-8000-00805f9b34fb"
+#define RAVEN_POWER_SERVICE             0x3200
 
 // Raven Network Status Service (firmware 1.2.0+)
-#define RAVEN_NETWORK_SERVICE           "00003300-0000-1000-8000-00805f9b34fb"
+#define RAVEN_NETWORK_SERVICE           0x3300
 
 // Raven Upload Statistics Service (firmware 1.2.0+)
-#define RAVEN_UPLOAD_SERVICE            "00003400-0000-1000-8000-00805f9b34fb"
+#define RAVEN_UPLOAD_SERVICE            0x3400
 
 // Raven Error/Failure Service (firmware 1.2.0+)
-#define RAVEN_ERROR_SERVICE             "00003500-0000-1000-8000-00805f9b34fb"
+#define RAVEN_ERROR_SERVICE             0x3500
 
 // Health Thermometer Service (firmware 1.1.7)
-#define RAVEN_OLD_HEALTH_SERVICE        "00001809-0000-1000-8000-00805f9b34fb"
+#define RAVEN_OLD_HEALTH_SERVICE        0x1809
 
 // Location and Navigation Service (firmware 1.1.7)
-#define RAVEN_OLD_LOCATION_SERVICE      "00001819-0000-1000-8000-00805f9b34fb"
-
-// Known Raven service UUIDs for detection
-static const char* raven_service_uuids[] = {
-    RAVEN_DEVICE_INFO_SERVICE,    // Device info (all versions)
-    RAVEN_GPS_SERVICE,            // GPS data (1.2.0+)
-    RAVEN_POWER_SERVICE,          // Battery/Solar (1.2.0+)
-    RAVEN_NETWORK_SERVICE,        // LTE/WiFi status (1.2.0+)
-    RAVEN_UPLOAD_SERVICE,         // Upload stats (1.2.0+)
-    RAVEN_ERROR_SERVICE,          // Error tracking (1.2.0+)
-    RAVEN_OLD_HEALTH_SERVICE,     // Old health service (1.1.7)
-    RAVEN_OLD_LOCATION_SERVICE    // Old location service (1.1.7)
+#define RAVEN_OLD_LOCATION_SERVICE      0x1819
+
+// Known Raven service UUIDs for detection. Bit i of a Raven service mask
+// corresponds to entry i of the active signature set's Raven list (this
+// table for the built-in set); the lowest set bit is reported as the matched
+// service.
+static const raven_service_t raven_service_uuids[] = {
+    { RAVEN_DEVICE_INFO_SERVICE,  "Device Information (Serial, Model, Firmware)" },  // All versions
+    { RAVEN_GPS_SERVICE,          "GPS Location Service (Lat/Lon/Alt)" },            // 1.2.0+
+    { RAVEN_POWER_SERVICE,        "Power Management (Battery/Solar)" },              // 1.2.0+
+    { RAVEN_NETWORK_SERVICE,      "Network Status (LTE/WiFi)" },                     // 1.2.0+
+    { RAVEN_UPLOAD_SERVICE,       "Upload Statistics Service" },                     // 1.2.0+
+    { RAVEN_ERROR_SERVICE,        "Error/Failure Tracking Service" },                // 1.2.0+
+    { RAVEN_OLD_HEALTH_SERVICE,   "Health/Temperature Service (Legacy)" },           // 1.1.7
+    { RAVEN_OLD_LOCATION_SERVICE, "Location Service (Legacy)" }                      // 1.1.7
 };
 
+#define RAVEN_SERVICE_COUNT (sizeof(raven_service_uuids)/sizeof(raven_service_uuids[0]))
+static_assert(RAVEN_SERVICE_COUNT <= SIGPACK_MAX_RAVEN, "Raven service mask must fit wire_detection_t.raven_mask");
+
 // ============================================================================
 // GLOBAL VARIABLES
 // ============================================================================
 
 static uint8_t current_channel = 1;
-static unsigned long last_channel_hop = 0;
-static bool triggered = false;
-static bool device_in_range = false;
-static unsigned long last_detection_time = 0;
-static unsigned long last_heartbeat = 0;
+static ChannelScheduler channel_scheduler;
+static RadioScheduler radio_scheduler;
+static BleScanPolicy ble_scan_policy;
+// Set by the LED task on alerts, cleared by loop()
+static std::atomic<bool> device_in_range{false};
+static std::atomic<unsigned long> last_heartbeat{0};
+
+// Per-MAC detection state, owned by the matching task (loop() expires entries)
+static DeviceTable device_table;
+static std::mutex device_table_mutex;
+static unsigned long last_device_expiry = 0;
+#define DEVICE_IN_RANGE_WINDOW 30000   // No hits for this long = out of range
+#define DEVICE_EXPIRY_CHECK_INTERVAL 10000
 static NimBLEScan* pBLEScan;
 
+// Serial output format (SERIAL_MODE_JSON or SERIAL_MODE_BINARY), switchable with "mode <json|binary>"
+static volatile uint8_t serial_output_mode = SERIAL_OUTPUT_MODE;
+#define SERIAL_COMMAND_MAX 160     // Fits "sig data" plus SIGPACK_CHUNK_MAX bytes of hex
+static char serial_command[SERIAL_COMMAND_MAX];
+static size_t serial_command_len = 0;
+
+// Capture queues (radio callbacks -> matching task)
+static SpscQueue<sniffed_frame_t, WIFI_FRAME_QUEUE_SIZE> wifi_frame_queue;
+static SpscQueue<sniffed_adv_t, BLE_ADV_QUEUE_SIZE> ble_adv_queue;
+static std::atomic<uint32_t> wifi_malformed_frames{0};
+
+// Output queues (matching task -> one output task each)
+static SpscQueue<detection_event_t, SERIAL_EVENT_QUEUE_SIZE> serial_event_queue;
+static SpscQueue<detection_event_t, NOTIFY_EVENT_QUEUE_SIZE> notify_event_queue;
+static SpscQueue<detection_event_t, LED_EVENT_QUEUE_SIZE> led_event_queue;
+
+static pipeline_task_t match_task;
+static pipeline_task_t serial_task;
+static pipeline_task_t notify_task;
+static pipeline_task_t led_task;
+static pipeline_task_t serial_tx_task;
+static unsigned long last_pipeline_report = 0;
+
+// Detection journal (owned by the serial output task)
+static DetectionJournal journal;
+static std::atomic<bool> journal_report_requested{false};
+#define JOURNAL_REPLAY_BATCH 16       // Records per serial task pass while replaying to serial
+#define JOURNAL_REPLAY_POLL_MS 10     // Serial task wake interval while a replay is in progress
+
+// Signature pack upload (serial commands run in loop(), app commands in the
+// NimBLE host task) and the received pack waiting for the builder task
+static pipeline_task_t sigpack_task;
+static std::mutex sigpack_mutex;
+static uint8_t* sigpack_upload = nullptr;
+static size_t sigpack_upload_len = 0;
+static size_t sigpack_upload_size = 0;
+static uint8_t* sigpack_pending = nullptr;
+static size_t sigpack_pending_len = 0;
+static bool sigpack_pending_builtin = false;  // "sig reset": rebuild the compiled-in set
+
 // ============================================================================
 // FORWARD DECLARATIONS
 // ============================================================================
-void led_flash(uint32_t color, int duration_ms);
 void init_led();
 void boot_led_sequence();
 void flock_detected_led_sequence();
 void heartbeat_pulse();
+bool check_mac_prefix(const uint8_t* mac);
+const char* signature_pattern(const AhoCorasick& matcher, const detection_event_t& event);
+void dispatch_detection(detection_event_t& event);
 
 // ============================================================================
 // LED VISUAL ALERT SYSTEM (FeatherS3 RGB LED)
 // ============================================================================
 
-void led_flash(uint32_t color, int duration_ms)
+static LedEngine led;
+
+// Animation priorities: a detection alert preempts a heartbeat or the boot sequence
+enum {
+    LED_PRIORITY_HEARTBEAT = 1,
+    LED_PRIORITY_BOOT = 2,
+    LED_PRIORITY_DETECT = 3
+};
+
+// Boot: Blue -> Green, then hold green briefly to show ready
+static const led_step_t boot_steps[] = {
+    { COLOR_BOOT_LOW, BOOT_FLASH_DURATION }, { COLOR_OFF, LED_GAP_DURATION },
+    { COLOR_BOOT_HIGH, BOOT_FLASH_DURATION }, { COLOR_OFF, LED_GAP_DURATION },
+    { COLOR_BOOT_HIGH, 500 }
+};
+
+// Detection: 3 fast RED flashes
+static const led_step_t detect_steps[] = {
+    { COLOR_DETECT, DETECT_FLASH_DURATION }, { COLOR_OFF, LED_GAP_DURATION * 2 },
+    { COLOR_DETECT, DETECT_FLASH_DURATION }, { COLOR_OFF, LED_GAP_DURATION * 2 },
+    { COLOR_DETECT, DETECT_FLASH_DURATION }, { COLOR_OFF, LED_GAP_DURATION }
+};
+
+// Heartbeat: purple double pulse
+static const led_step_t heartbeat_steps[] = {
+    { COLOR_HEARTBEAT, HEARTBEAT_DURATION }, { COLOR_OFF, LED_GAP_DURATION + 100 },
+    { COLOR_HEARTBEAT, HEARTBEAT_DURATION }, { COLOR_OFF, LED_GAP_DURATION }
+};
+
+static const led_animation_t boot_animation = {
+    boot_steps, sizeof(boot_steps) / sizeof(boot_steps[0]), LED_PRIORITY_BOOT
+};
+static const led_animation_t detect_animation = {
+    detect_steps, sizeof(detect_steps) / sizeof(detect_steps[0]), LED_PRIORITY_DETECT
+};
+static const led_animation_t heartbeat_animation = {
+    heartbeat_steps, sizeof(heartbeat_steps) / sizeof(heartbeat_steps[0]), LED_PRIORITY_HEARTBEAT
+};
+
+static void led_show_color(uint32_t color)
 {
     pixel.setPixelColor(0, color);
     pixel.show();
-    delay(duration_ms);
-    pixel.setPixelColor(0, COLOR_OFF);
-    pixel.show();
-    delay(50);
 }
 
 void init_led()
@@ -181,67 +314,159 @@ void init_led()
     pixel.setBrightness(50);  // Set to 50/255 brightness
     pixel.clear();
     pixel.show();
+    
+    led.begin(led_show_color, COLOR_OFF);
 }
 
 void boot_led_sequence()
 {
-    printf("Initializing LED visual system...\n");
-    printf("Playing boot sequence: Blue -> Green\n");
-    led_flash(COLOR_BOOT_LOW, BOOT_FLASH_DURATION);   // Blue flash
-    led_flash(COLOR_BOOT_HIGH, BOOT_FLASH_DURATION);  // Green flash
-    // Leave green on briefly to show ready
-    pixel.setPixelColor(0, COLOR_BOOT_HIGH);
-    pixel.show();
-    delay(500);
-    pixel.setPixelColor(0, COLOR_SCANNING);
-    pixel.show();
-    printf("LED system ready\n\n");
+    serial_log("Initializing LED visual system...\n");
+    serial_log("Playing boot sequence: Blue -> Green\n");
+    // Settle on dim cyan once the boot animation finishes
+    led.setIdleColor(COLOR_SCANNING);
+    led.request(&boot_animation);
+    serial_log("LED system ready\n\n");
 }
 
 void flock_detected_led_sequence()
 {
-    printf("FLOCK SAFETY DEVICE DETECTED!\n");
-    printf("LED alert sequence: 3 fast RED flashes\n");
-    for (int i = 0; i < 3; i++) {
-        led_flash(COLOR_DETECT, DETECT_FLASH_DURATION);
-        if (i < 2) delay(50); // Short gap between flashes
-    }
-    printf("Detection complete - device identified!\n\n");
+    serial_log("FLOCK SAFETY DEVICE DETECTED!\n");
+    serial_log("LED alert sequence: 3 fast RED flashes\n");
     
     // Mark device as in range and start heartbeat tracking
     device_in_range = true;
-    last_detection_time = millis();
     last_heartbeat = millis();
     
     // Keep LED red while device in range
-    pixel.setPixelColor(0, COLOR_DETECT);
-    pixel.show();
+    led.setIdleColor(COLOR_DETECT);
+    led.request(&detect_animation);
 }
 
 void heartbeat_pulse()
 {
-    printf("Heartbeat: Device still in range\n");
-    led_flash(COLOR_HEARTBEAT, HEARTBEAT_DURATION);
-    delay(100);
-    led_flash(COLOR_HEARTBEAT, HEARTBEAT_DURATION);
-    // Return to detection color
-    pixel.setPixelColor(0, COLOR_DETECT);
-    pixel.show();
+    serial_log("Heartbeat: Device still in range\n");
+    led.request(&heartbeat_animation);
+}
+
+// ============================================================================
+// PER-DEVICE TRACKING
+// ============================================================================
+
+// Record a matching hit and copy the device's aggregated state into *dev.
+// Returns why the hit should be reported, or DEVICE_REPORT_NONE for a duplicate.
+device_report_t track_detection(const uint8_t* mac, int8_t rssi, uint8_t channel, uint8_t family,
+                                uint8_t match_flags, uint8_t protocol, tracked_device_t* dev)
+{
+    std::lock_guard<std::mutex> lock(device_table_mutex);
+    const tracked_device_t* entry = nullptr;
+    device_report_t report = device_table.observe(mac, rssi, channel, family, match_flags,
+                                                  protocol, millis(), &entry);
+    *dev = *entry;
+    if (report != DEVICE_REPORT_NONE) {
+        radio_scheduler.noteDetection(protocol == DEVICE_PROTO_WIFI ? RADIO_SLOT_WIFI : RADIO_SLOT_BLE);
+    }
+    return report;
+}
+
+// ============================================================================
+// BINARY OUTPUT FUNCTIONS
+// ============================================================================
+
+// Every detection line or frame is queued whole for the serial_tx writer,
+// which ends the format stage a sink began. A full detection ring drops the
+// message; journaled detections can be replayed.
+void serial_emit(const uint8_t* data, size_t len)
+{
+    INSTRUMENT_END(STAGE_FORMAT);
+    INSTRUMENT_COUNT(COUNTER_SERIAL_WRITES, 1);
+    INSTRUMENT_COUNT(COUNTER_SERIAL_BYTES, len);
+    serial_tx.push(SERIAL_TX_DETECTION, data, len);
+}
+
+// Send one journaled record as a COBS frame
+void write_journal_frame(uint32_t seq, uint8_t flags, const uint8_t* rec, size_t len)
+{
+    wire_journal_t msg;
+    size_t msg_len = wire_journal_init(&msg, seq, flags, rec, len);
+    uint8_t frame[WIRE_FRAME_MAX(sizeof(wire_journal_t))];
+    size_t frame_len = wire_frame((const uint8_t*)&msg, msg_len, frame);
+    serial_emit(frame, frame_len);
+}
+
+// Binary sink: one COBS frame per detection, with its sequence number when
+// the detection is journaled
+void emit_detection_binary(const detection_event_t& event)
+{
+    INSTRUMENT_BEGIN(STAGE_FORMAT);
+    wire_detection_t rec;
+    size_t len = detection_event_to_wire(event, &rec);
+    if (event.seq) {
+        write_journal_frame(event.seq, 0, (const uint8_t*)&rec, len);
+        return;
+    }
+    uint8_t frame[WIRE_FRAME_MAX(sizeof(wire_detection_t))];
+    size_t frame_len = wire_frame((const uint8_t*)&rec, len, frame);
+    serial_emit(frame, frame_len);
 }
 
 // ============================================================================
 // JSON OUTPUT FUNCTIONS
 // ============================================================================
 
-void output_wifi_detection_json(const char* ssid, const uint8_t* mac, int rssi, const char* detection_type)
+// Serialize a detection document and send it as one line
+void emit_json_line(const JsonDocument& doc)
 {
+    String json_output;
+    serializeJson(doc, json_output);
+    json_output += "\n";
+    serial_emit((const uint8_t*)json_output.c_str(), json_output.length());
+}
+
+// Status reports and command replies go out as one line in the stats class
+void emit_report(const JsonDocument& doc)
+{
+    String line;
+    serializeJson(doc, line);
+    line += "\n";
+    serial_tx.push(SERIAL_TX_STATS, (const uint8_t*)line.c_str(), line.length());
+}
+
+// Aggregated per-device fields shared by all detection JSON lines
+void add_device_summary_json(JsonDocument& doc, const tracked_device_t& dev, device_report_t report)
+{
+    doc["report_reason"] = device_report_name(report);
+    doc["hit_count"] = dev.hits;
+    doc["first_seen_ms"] = dev.first_seen;
+    doc["last_seen_ms"] = dev.last_seen;
+    doc["rssi_min"] = dev.rssi_min;
+    doc["rssi_max"] = dev.rssi_max;
+    doc["rssi_avg"] = device_rssi_avg(dev);
+    if (dev.channels) {
+        JsonArray channels = doc.createNestedArray("channels_seen");
+        for (int ch = 1; ch < 16; ch++) {
+            if (dev.channels & (1u << ch)) channels.add(ch);
+        }
+    }
+}
+
+void emit_wifi_detection_json(const detection_event_t& event)
+{
+    const uint8_t* mac = event.mac;
+    int rssi = event.rssi;
+    char ssid_buf[WIRE_NAME_MAX + 1];
+    const char* ssid = event.payload_len ? detection_event_payload_str(event, ssid_buf) : "hidden";
+    
     DynamicJsonDocument doc(2048);
     
     // Core detection info
-    doc["timestamp"] = millis();
-    doc["detection_time"] = String(millis() / 1000.0, 3) + "s";
+    unsigned long now = event.timestamp_ms;
+    doc["timestamp"] = now;
+    if (event.seq) doc["seq"] = event.seq;
+    char detection_time[16];
+    snprintf(detection_time, sizeof(detection_time), "%lu.%03lus", now / 1000, now % 1000);
+    doc["detection_time"] = detection_time;
     doc["protocol"] = "wifi";
-    doc["detection_method"] = detection_type;
+    doc["detection_method"] = wire_method_name(event.method);
     doc["alert_level"] = "HIGH";
     doc["device_category"] = "FLOCK_SAFETY";
     
@@ -250,7 +475,24 @@ void output_wifi_detection_json(const char* ssid, const uint8_t* mac, int rssi,
     doc["ssid_length"] = strlen(ssid);
     doc["rssi"] = rssi;
     doc["signal_strength"] = rssi > -50 ? "STRONG" : (rssi > -70 ? "MEDIUM" : "WEAK");
-    doc["channel"] = current_channel;
+    doc["channel"] = event.channel;
+    if (event.rx_channel != event.channel) {
+        doc["rx_channel"] = event.rx_channel;
+    }
+    if (event.max_rate) {
+        // 500 kb/s units; 5.5 Mb/s is the only fractional legacy rate
+        doc["max_rate_mbps"] = event.max_rate / 2.0;
+    }
+    if (event.vendor_count) {
+        JsonArray vendor_ies = doc.createNestedArray("vendor_ie_ouis");
+        uint8_t kept = event.vendor_count < WLAN_MAX_VENDOR_IES ? event.vendor_count : WLAN_MAX_VENDOR_IES;
+        for (uint8_t i = 0; i < kept; i++) {
+            char oui[9];
+            snprintf(oui, sizeof(oui), "%02x:%02x:%02x",
+                     event.vendor_ouis[i][0], event.vendor_ouis[i][1], event.vendor_ouis[i][2]);
+            vendor_ies.add(oui);
+        }
+    }
     
     // MAC address info
     char mac_str[18];
@@ -263,254 +505,193 @@ void output_wifi_detection_json(const char* ssid, const uint8_t* mac, int rssi,
     doc["mac_prefix"] = mac_prefix;
     doc["vendor_oui"] = mac_prefix;
     
-    // Detection pattern matching
-    bool ssid_match = false;
-    bool mac_match = false;
-    
-    for (int i = 0; i < sizeof(wifi_ssid_patterns)/sizeof(wifi_ssid_patterns[0]); i++) {
-        if (strcasestr(ssid, wifi_ssid_patterns[i])) {
-            doc["matched_ssid_pattern"] = wifi_ssid_patterns[i];
-            doc["ssid_match_confidence"] = "HIGH";
-            ssid_match = true;
-            break;
-        }
+    // Detection pattern matching, as decided by the matcher
+    if (event.criteria & MATCH_SSID) {
+        doc["matched_ssid_pattern"] = signature_pattern(signature_db.slot(event.signature_set).ssid(), event);
+        doc["ssid_match_confidence"] = "HIGH";
     }
-    
-    for (int i = 0; i < sizeof(mac_prefixes)/sizeof(mac_prefixes[0]); i++) {
-        if (strncasecmp(mac_prefix, mac_prefixes[i], 8) == 0) {
-            doc["matched_mac_pattern"] = mac_prefixes[i];
-            doc["mac_match_confidence"] = "HIGH";
-            mac_match = true;
-            break;
-        }
+    if (event.criteria & MATCH_MAC) {
+        doc["matched_mac_pattern"] = mac_prefix;
+        doc["mac_match_confidence"] = "HIGH";
+    }
+    if (event.criteria & MATCH_KNOWN) {
+        doc["known_device"] = true;
     }
     
     // Detection summary
-    doc["detection_criteria"] = ssid_match && mac_match ? "SSID_AND_MAC" : (ssid_match ? "SSID_ONLY" : "MAC_ONLY");
-    doc["threat_score"] = ssid_match && mac_match ? 100 : (ssid_match || mac_match ? 85 : 70);
+    doc["detection_criteria"] = detection_criteria_name(event);
+    doc["threat_score"] = event.score;
     
     // Frame type details
-    if (strcmp(detection_type, "probe_request") == 0 || strcmp(detection_type, "probe_request_mac") == 0) {
+    if (event.frame_type == WLAN_SUBTYPE_PROBE_REQ) {
         doc["frame_type"] = "PROBE_REQUEST";
         doc["frame_description"] = "Device actively scanning for networks";
+    } else if (event.frame_type == WLAN_SUBTYPE_PROBE_RESP) {
+        doc["frame_type"] = "PROBE_RESPONSE";
+        doc["frame_description"] = "Device answering a network scan";
     } else {
         doc["frame_type"] = "BEACON";
         doc["frame_description"] = "Device advertising its network";
     }
     
-    String json_output;
-    serializeJson(doc, json_output);
-    Serial.println(json_output);
+    add_device_summary_json(doc, event.dev, (device_report_t)event.report);
+    emit_json_line(doc);
 }
 
-void output_ble_detection_json(const char* mac, const char* name, int rssi, const char* detection_method)
+void emit_ble_detection_json(const detection_event_t& event)
 {
+    const uint8_t* mac = event.mac;
+    int rssi = event.rssi;
+    char name[WIRE_NAME_MAX + 1];
+    detection_event_payload_str(event, name);
+    
     DynamicJsonDocument doc(2048);
     
     // Core detection info
-    doc["timestamp"] = millis();
-    doc["detection_time"] = String(millis() / 1000.0, 3) + "s";
+    unsigned long now = event.timestamp_ms;
+    doc["timestamp"] = now;
+    if (event.seq) doc["seq"] = event.seq;
+    char detection_time[16];
+    snprintf(detection_time, sizeof(detection_time), "%lu.%03lus", now / 1000, now % 1000);
+    doc["detection_time"] = detection_time;
     doc["protocol"] = "bluetooth_le";
-    doc["detection_method"] = detection_method;
+    doc["detection_method"] = wire_method_name(event.method);
     doc["alert_level"] = "HIGH";
     doc["device_category"] = "FLOCK_SAFETY";
     
     // BLE specific info
-    doc["mac_address"] = mac;
+    char mac_str[18];
+    snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x", 
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    doc["mac_address"] = mac_str;
     doc["rssi"] = rssi;
     doc["signal_strength"] = rssi > -50 ? "STRONG" : (rssi > -70 ? "MEDIUM" : "WEAK");
     
     // Device name info
-    if (name && strlen(name) > 0) {
-        doc["device_name"] = name;
-        doc["device_name_length"] = strlen(name);
-        doc["has_device_name"] = true;
-    } else {
-        doc["device_name"] = "";
-        doc["device_name_length"] = 0;
-        doc["has_device_name"] = false;
-    }
+    doc["device_name"] = name;
+    doc["device_name_length"] = event.payload_len;
+    doc["has_device_name"] = event.payload_len > 0;
     
     // MAC address analysis
     char mac_prefix[9];
-    strncpy(mac_prefix, mac, 8);
-    mac_prefix[8] = '\0';
+    oui_format(oui_from_mac(mac), mac_prefix);
     doc["mac_prefix"] = mac_prefix;
     doc["vendor_oui"] = mac_prefix;
     
-    // Detection pattern matching
-    bool name_match = false;
-    bool mac_match = false;
-    
-    // Check MAC prefix patterns
-    for (int i = 0; i < sizeof(mac_prefixes)/sizeof(mac_prefixes[0]); i++) {
-        if (strncasecmp(mac, mac_prefixes[i], strlen(mac_prefixes[i])) == 0) {
-            doc["matched_mac_pattern"] = mac_prefixes[i];
-            doc["mac_match_confidence"] = "HIGH";
-            mac_match = true;
-            break;
-        }
+    // Detection pattern matching, as decided by the matcher
+    if (event.criteria & MATCH_MAC) {
+        doc["matched_mac_pattern"] = mac_prefix;
+        doc["mac_match_confidence"] = "HIGH";
     }
-    
-    // Check device name patterns
-    if (name && strlen(name) > 0) {
-        for (int i = 0; i < sizeof(device_name_patterns)/sizeof(device_name_patterns[0]); i++) {
-            if (strcasestr(name, device_name_patterns[i])) {
-                doc["matched_name_pattern"] = device_name_patterns[i];
-                doc["name_match_confidence"] = "HIGH";
-                name_match = true;
-                break;
-            }
-        }
+    if (event.criteria & MATCH_KNOWN) {
+        doc["known_device"] = true;
+    }
+    if (event.criteria & MATCH_NAME) {
+        doc["matched_name_pattern"] = signature_pattern(signature_db.slot(event.signature_set).names(), event);
+        doc["name_match_confidence"] = "HIGH";
     }
     
     // Detection summary
-    doc["detection_criteria"] = name_match && mac_match ? "NAME_AND_MAC" : 
-                               (name_match ? "NAME_ONLY" : "MAC_ONLY");
-    doc["threat_score"] = name_match && mac_match ? 100 : 
-                         (name_match || mac_match ? 85 : 70);
+    doc["detection_criteria"] = detection_criteria_name(event);
+    doc["threat_score"] = event.score;
     
     // BLE advertisement type analysis
     doc["advertisement_type"] = "BLE_ADVERTISEMENT";
     doc["advertisement_description"] = "Bluetooth Low Energy device advertisement";
     
     // Detection method details
-    if (strcmp(detection_method, "mac_prefix") == 0) {
+    if (event.method == WIRE_METHOD_BLE_MAC_PREFIX) {
         doc["primary_indicator"] = "MAC_ADDRESS";
-        doc["detection_reason"] = "MAC address matches known Flock Safety prefix";
-    } else if (strcmp(detection_method, "device_name") == 0) {
+        doc["detection_reason"] = (event.criteria & MATCH_MAC) ? "MAC address matches known Flock Safety prefix"
+                                                               : "MAC address is a known Flock Safety device";
+    } else {
         doc["primary_indicator"] = "DEVICE_NAME";
         doc["detection_reason"] = "Device name matches Flock Safety pattern";
     }
     
-    String json_output;
-    serializeJson(doc, json_output);
-    Serial.println(json_output);
+    add_device_summary_json(doc, event.dev, (device_report_t)event.report);
+    emit_json_line(doc);
 }
 
 // ============================================================================
 // DETECTION HELPER FUNCTIONS
 // ============================================================================
 
+// The helpers below match against the active signature set. Only the
+// matching task calls them, and the set only changes between its records.
+
 bool check_mac_prefix(const uint8_t* mac)
 {
-    char mac_str[9];  // Only need first 3 octets for prefix check
-    snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x", mac[0], mac[1], mac[2]);
-    
-    for (int i = 0; i < sizeof(mac_prefixes)/sizeof(mac_prefixes[0]); i++) {
-        if (strncasecmp(mac_str, mac_prefixes[i], 8) == 0) {
-            return true;
-        }
-    }
-    return false;
+    return signature_db.active().matchOui(mac);
 }
 
-bool check_ssid_pattern(const char* ssid)
+// Single-pass scan of an SSID; result lists every matched pattern and family
+bool check_ssid_pattern(const char* ssid, size_t len, ac_result_t* result)
 {
-    if (!ssid) return false;
-    
-    for (int i = 0; i < sizeof(wifi_ssid_patterns)/sizeof(wifi_ssid_patterns[0]); i++) {
-        if (strcasestr(ssid, wifi_ssid_patterns[i])) {
-            return true;
-        }
-    }
-    return false;
+    signature_db.active().ssid().scan(ssid, len, result);
+    return result->count > 0;
 }
 
-bool check_device_name_pattern(const char* name)
+bool check_device_name_pattern(const char* name, size_t len, ac_result_t* result)
 {
-    if (!name) return false;
-    
-    for (int i = 0; i < sizeof(device_name_patterns)/sizeof(device_name_patterns[0]); i++) {
-        if (strcasestr(name, device_name_patterns[i])) {
-            return true;
-        }
-    }
-    return false;
+    signature_db.active().names().scan(name, len, result);
+    return result->count > 0;
+}
+
+// Pattern string of an event's first matched signature
+const char* signature_pattern(const AhoCorasick& matcher, const detection_event_t& event)
+{
+    uint16_t id = detection_event_first_signature(event);
+    return id < matcher.patternCount() ? matcher.signature(id).pattern : "";
+}
+
+// Device type of the highest-priority match (used for iOS app broadcasts)
+const char* matched_device_type(const AhoCorasick& matcher, const ac_result_t& result)
+{
+    if (result.count == 0) return device_family_name(FAMILY_FLOCK);
+    return device_family_name(matcher.signature(result.first).family);
 }
 
 // ============================================================================
 // RAVEN UUID DETECTION
 // ============================================================================
 
-// Check if a BLE device advertises any Raven surveillance service UUIDs
-bool check_raven_service_uuid(NimBLEAdvertisedDevice* device, char* detected_service_out = nullptr)
+// Single pass over the advertised services; returns a bitmask of matched
+// Raven services. Compares binary UUIDs, no string conversion or allocation.
+uint32_t classify_raven_services(const SignatureSet& sigs, const ble_uuid_any_t* services, size_t count)
 {
-    if (!device) return false;
-    
-    // Check if device has service UUIDs
-    if (!device->haveServiceUUID()) return false;
-    
-    // Get the number of service UUIDs
-    int serviceCount = device->getServiceUUIDCount();
-    if (serviceCount == 0) return false;
-    
-    // Check each advertised service UUID against known Raven UUIDs
-    for (int i = 0; i < serviceCount; i++) {
-        NimBLEUUID serviceUUID = device->getServiceUUID(i);
-        std::string uuidStr = serviceUUID.toString();
-        
-        // Compare against each known Raven service UUID
-        for (int j = 0; j < sizeof(raven_service_uuids)/sizeof(raven_service_uuids[0]); j++) {
-            if (strcasecmp(uuidStr.c_str(), raven_service_uuids[j]) == 0) {
-                // Match found! Store the detected service UUID if requested
-                if (detected_service_out != nullptr) {
-                    strncpy(detected_service_out, uuidStr.c_str(), 40);
-                }
-                return true;
-            }
+    uint32_t mask = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t uuid16;
+        if (ble_uuid_to_sig16(services[i], &uuid16)) {
+            mask |= sigs.ravenBit(uuid16);
         }
     }
-    
-    return false;
+    return mask;
+}
+
+// Index into the set's Raven list of the service reported as the match
+int raven_primary_service(const SignatureSet& sigs, uint32_t mask)
+{
+    for (size_t i = 0; i < sigs.ravenCount(); i++) {
+        if (mask & (1UL << i)) return (int)i;
+    }
+    return -1;
 }
 
 // Get a human-readable description of the Raven service
-const char* get_raven_service_description(const char* uuid)
-{
-    if (!uuid) return "Unknown Service";
-    
-    if (strcasecmp(uuid, RAVEN_DEVICE_INFO_SERVICE) == 0)
-        return "Device Information (Serial, Model, Firmware)";
-    if (strcasecmp(uuid, RAVEN_GPS_SERVICE) == 0)
-        return "GPS Location Service (Lat/Lon/Alt)";
-    if (strcasecmp(uuid, RAVEN_POWER_SERVICE) == 0)
-        return "Power Management (Battery/Solar)";
-    if (strcasecmp(uuid, RAVEN_NETWORK_SERVICE) == 0)
-        return "Network Status (LTE/WiFi)";
-    if (strcasecmp(uuid, RAVEN_UPLOAD_SERVICE) == 0)
-        return "Upload Statistics Service";
-    if (strcasecmp(uuid, RAVEN_ERROR_SERVICE) == 0)
-        return "Error/Failure Tracking Service";
-    if (strcasecmp(uuid, RAVEN_OLD_HEALTH_SERVICE) == 0)
-        return "Health/Temperature Service (Legacy)";
-    if (strcasecmp(uuid, RAVEN_OLD_LOCATION_SERVICE) == 0)
-        return "Location Service (Legacy)";
-    
-    return "Unknown Raven Service";
+const char* get_raven_service_description(const SignatureSet& sigs, uint32_t mask)
+{
+    int index = raven_primary_service(sigs, mask);
+    return index >= 0 ? sigs.raven(index).description : "Unknown Raven Service";
 }
 
 // Estimate firmware version based on detected service UUIDs
-const char* estimate_raven_firmware_version(NimBLEAdvertisedDevice* device)
+const char* estimate_raven_firmware_version(const SignatureSet& sigs, uint32_t mask)
 {
-    if (!device || !device->haveServiceUUID()) return "Unknown";
-    
-    bool has_new_gps = false;
-    bool has_old_location = false;
-    bool has_power_service = false;
-    
-    int serviceCount = device->getServiceUUIDCount();
-    for (int i = 0; i < serviceCount; i++) {
-        NimBLEUUID serviceUUID = device->getServiceUUID(i);
-        std::string uuidStr = serviceUUID.toString();
-        
-        if (strcasecmp(uuidStr.c_str(), RAVEN_GPS_SERVICE) == 0)
-            has_new_gps = true;
-        if (strcasecmp(uuidStr.c_str(), RAVEN_OLD_LOCATION_SERVICE) == 0)
-            has_old_location = true;
-        if (strcasecmp(uuidStr.c_str(), RAVEN_POWER_SERVICE) == 0)
-            has_power_service = true;
-    }
+    bool has_new_gps = mask & sigs.ravenBit(RAVEN_GPS_SERVICE);
+    bool has_old_location = mask & sigs.ravenBit(RAVEN_OLD_LOCATION_SERVICE);
+    bool has_power_service = mask & sigs.ravenBit(RAVEN_POWER_SERVICE);
     
     // Firmware version heuristics based on service presence
     if (has_old_location && !has_new_gps)
@@ -527,224 +708,1302 @@ const char* estimate_raven_firmware_version(NimBLEAdvertisedDevice* device)
 // WIFI PROMISCUOUS MODE HANDLER
 // ============================================================================
 
-typedef struct {
-    unsigned frame_ctrl:16;
-    unsigned duration_id:16;
-    uint8_t addr1[6]; /* receiver address */
-    uint8_t addr2[6]; /* sender address */
-    uint8_t addr3[6]; /* filtering address */
-    unsigned sequence_ctrl:16;
-    uint8_t addr4[6]; /* optional */
-} wifi_ieee80211_mac_hdr_t;
-
-typedef struct {
-    wifi_ieee80211_mac_hdr_t hdr;
-    uint8_t payload[0]; /* network data ended with 4 bytes csum (CRC32) */
-} wifi_ieee80211_packet_t;
-
 void wifi_sniffer_packet_handler(void* buff, wifi_promiscuous_pkt_type_t type)
 {
-    
+    // Runs in the WiFi driver task: copy what we need and get out. Matching
+    // happens in the matching task, output in the output tasks (pipeline.h).
+    if (type != WIFI_PKT_MGMT) {
+        return;
+    }
+    INSTRUMENT_SCOPE(STAGE_CAPTURE_WIFI);
     const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buff;
-    const wifi_ieee80211_packet_t *ipkt = (wifi_ieee80211_packet_t *)ppkt->payload;
-    const wifi_ieee80211_mac_hdr_t *hdr = &ipkt->hdr;
+    INSTRUMENT_CHANNEL(ppkt->rx_ctrl.channel);
     
-    // Check for probe requests (subtype 0x04) and beacons (subtype 0x08)
-    uint8_t frame_type = (hdr->frame_ctrl & 0xFF) >> 2;
-    if (frame_type != 0x20 && frame_type != 0x80) { // Probe request or beacon
+    // Probe requests, probe responses and beacons; everything else is rejected here
+    wlan_mgmt_info_t info;
+    INSTRUMENT_BEGIN(STAGE_PARSE);
+    bool parsed = wlan_parse_mgmt(ppkt->payload, ppkt->rx_ctrl.sig_len, &info);
+    INSTRUMENT_END(STAGE_PARSE);
+    if (!parsed) {
         return;
     }
+    if (info.malformed) {
+        wifi_malformed_frames.fetch_add(1, std::memory_order_relaxed);
+    }
     
-    // Extract SSID from probe request or beacon
-    char ssid[33] = {0};
-    uint8_t *payload = (uint8_t *)ipkt + 24; // Skip MAC header
-    
-    if (frame_type == 0x20) { // Probe request
-        payload += 0; // Probe requests start with SSID immediately
-    } else { // Beacon frame
-        payload += 12; // Skip fixed parameters in beacon
+    sniffed_frame_t frame;
+    memcpy(frame.addr2, info.addr2, sizeof(frame.addr2));
+    if (info.ssid_len) {
+        memcpy(frame.ssid, info.ssid, info.ssid_len);
     }
+    frame.ssid[info.ssid_len] = '\0';
+    frame.ssid_len = info.ssid_len;
+    frame.rssi = ppkt->rx_ctrl.rssi;
+    frame.rx_channel = ppkt->rx_ctrl.channel;
+    // Adjacent channels bleed through; the DS Parameter Set names the AP's real channel
+    frame.channel = info.ds_channel ? info.ds_channel : frame.rx_channel;
+    frame.subtype = info.subtype;
+    frame.max_rate = info.max_rate;
+    frame.vendor_count = info.vendor_count;
+    memcpy(frame.vendor_ouis, info.vendor_ouis, sizeof(frame.vendor_ouis));
     
-    // Parse SSID element (tag 0, length, data)
-    if (payload[0] == 0 && payload[1] <= 32) {
-        memcpy(ssid, &payload[2], payload[1]);
-        ssid[payload[1]] = '\0';
+    if (wifi_frame_queue.push(frame)) {
+        pipeline_task_wake(match_task);
     }
+}
+
+// Matching for one frame taken off the queue
+void process_wifi_frame(const sniffed_frame_t& frame)
+{
+    INSTRUMENT_SCOPE(STAGE_MATCH);
+    const char* ssid = frame.ssid;
+    channel_scheduler.noteFrame(frame.rx_channel);
     
-    const char* frameTypeStr = (frame_type == 0x20) ? "probe" : "beacon";
+    // Stream ALL WiFi packets to iOS app for debug view (batched, see ble_stream.h)
+    streamWiFiScan(ssid, frame.addr2, frame.rssi, frame.channel, frame.subtype);
     
-    // Stream ALL WiFi packets to iOS app for debug view
-    streamWiFiScan(ssid[0] ? ssid : "(hidden)", hdr->addr2, ppkt->rx_ctrl.rssi, current_channel, frameTypeStr);
+    // Scan the SSID once against every pattern
+    ac_result_t ssid_result;
+    check_ssid_pattern(ssid, frame.ssid_len, &ssid_result);
     
-    // Check if SSID matches our patterns
-    if (strlen(ssid) > 0 && check_ssid_pattern(ssid)) {
-        const char* detection_type = (frame_type == 0x20) ? "probe_request" : "beacon";
-        output_wifi_detection_json(ssid, hdr->addr2, ppkt->rx_ctrl.rssi, detection_type);
-        
-        // Broadcast to iOS app if connected
-        broadcastWiFiDetection(ssid, hdr->addr2, ppkt->rx_ctrl.rssi);
-        
-        if (!triggered) {
-            triggered = true;
-            flock_detected_led_sequence();
-        }
-        // Always update detection time for heartbeat tracking
-        last_detection_time = millis();
+    bool mac_match = check_mac_prefix(frame.addr2);
+    bool known = known_mac_contains(frame.addr2);
+    if (ssid_result.count == 0 && !mac_match && !known) {
         return;
     }
+    // Every hit (not just reported ones) keeps the target's channel pinned
+    channel_scheduler.noteDetection(frame.channel, millis());
     
-    // Check MAC address
-    if (check_mac_prefix(hdr->addr2)) {
-        const char* detection_type = (frame_type == 0x20) ? "probe_request_mac" : "beacon_mac";
-        output_wifi_detection_json(ssid[0] ? ssid : "hidden", hdr->addr2, ppkt->rx_ctrl.rssi, detection_type);
-        
-        // Broadcast to iOS app if connected
-        broadcastWiFiDetection(ssid[0] ? ssid : "unknown", hdr->addr2, ppkt->rx_ctrl.rssi);
-        
-        if (!triggered) {
-            triggered = true;
-            flock_detected_led_sequence();
-        }
-        // Always update detection time for heartbeat tracking
-        last_detection_time = millis();
+    // Update the per-device table; duplicates are counted but not re-reported
+    uint8_t match_flags = (ssid_result.count > 0 ? MATCH_SSID : 0) | (mac_match ? MATCH_MAC : 0) |
+                          (known ? MATCH_KNOWN : 0);
+    uint8_t family = ssid_result.count > 0 ? signature_db.active().ssid().signature(ssid_result.first).family
+                                           : (uint8_t)FAMILY_FLOCK;
+    tracked_device_t dev;
+    device_report_t report = track_detection(frame.addr2, frame.rssi, frame.channel, family,
+                                             match_flags, DEVICE_PROTO_WIFI, &dev);
+    if (report == DEVICE_REPORT_NONE) {
         return;
     }
+    
+    // Everything the sinks need, decided once here
+    bool ssid_match = ssid_result.count > 0;
+    uint8_t method;
+    if (frame.subtype == WLAN_SUBTYPE_PROBE_REQ) {
+        method = ssid_match ? WIRE_METHOD_PROBE_REQUEST : WIRE_METHOD_PROBE_REQUEST_MAC;
+    } else if (frame.subtype == WLAN_SUBTYPE_PROBE_RESP) {
+        method = ssid_match ? WIRE_METHOD_PROBE_RESPONSE : WIRE_METHOD_PROBE_RESPONSE_MAC;
+    } else {
+        method = ssid_match ? WIRE_METHOD_BEACON : WIRE_METHOD_BEACON_MAC;
+    }
+    detection_event_t event;
+    detection_event_init(&event, millis(), DEVICE_PROTO_WIFI, method, frame.addr2, frame.rssi,
+                         match_flags, family, report, dev);
+    event.frame_type = frame.subtype;
+    event.channel = frame.channel;
+    event.rx_channel = frame.rx_channel;
+    event.max_rate = frame.max_rate;
+    event.vendor_count = frame.vendor_count;
+    memcpy(event.vendor_ouis, frame.vendor_ouis, sizeof(event.vendor_ouis));
+    detection_event_set_signatures(&event, ssid_result);
+    detection_event_set_payload(&event, frame.ssid, frame.ssid_len);
+    dispatch_detection(event);
+}
+
+// Process every queued WiFi frame. Returns the number of frames handled.
+size_t drain_wifi_frames()
+{
+    sniffed_frame_t frame;
+    size_t processed = 0;
+    while (wifi_frame_queue.pop(frame)) {
+        process_wifi_frame(frame);
+        processed++;
+    }
+    return processed;
 }
 
 // ============================================================================
 // BLE SCANNING
 // ============================================================================
 
+// Runs in the NimBLE host task: copy the advertisement and hand it to the
+// matching task
 class AdvertisedDeviceCallbacks: public NimBLEAdvertisedDeviceCallbacks {
     void onResult(NimBLEAdvertisedDevice* advertisedDevice) {
+        INSTRUMENT_SCOPE(STAGE_CAPTURE_BLE);
+        INSTRUMENT_COUNT(COUNTER_BLE_ADVERTS, 1);
+        sniffed_adv_t adv;
         
+        // NimBLE stores the address little-endian; flip it to display order
         NimBLEAddress addr = advertisedDevice->getAddress();
-        std::string addrStr = addr.toString();
-        uint8_t mac[6];
-        sscanf(addrStr.c_str(), "%02x:%02x:%02x:%02x:%02x:%02x", 
-               &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]);
+        const uint8_t* native = addr.getNative();
+        for (int i = 0; i < 6; i++) {
+            adv.mac[i] = native[5 - i];
+        }
+        adv.addr_type = addr.getType();
+        uint8_t adv_type = advertisedDevice->getAdvType();
+        adv.scannable = adv_type == BLE_HCI_ADV_TYPE_ADV_IND || adv_type == BLE_HCI_ADV_TYPE_ADV_SCAN_IND;
+        adv.rssi = advertisedDevice->getRSSI();
+        ble_scan_policy.noteAdvert(adv.scannable);
         
-        int rssi = advertisedDevice->getRSSI();
-        std::string name = "";
+        adv.name_len = 0;
         if (advertisedDevice->haveName()) {
-            name = advertisedDevice->getName();
+            std::string name = advertisedDevice->getName();
+            adv.name_len = name.size() < sizeof(adv.name) ? name.size() : sizeof(adv.name) - 1;
+            memcpy(adv.name, name.data(), adv.name_len);
         }
+        adv.name[adv.name_len] = '\0';
         
-        bool hasServices = advertisedDevice->haveServiceUUID();
-        
-        // Stream ALL BLE devices to iOS app for debug view
-        streamBLEScan(name.c_str(), addrStr.c_str(), rssi, hasServices);
-        
-        // Check MAC prefix
-        if (check_mac_prefix(mac)) {
-            output_ble_detection_json(addrStr.c_str(), name.c_str(), rssi, "mac_prefix");
-            
-            // Broadcast to iOS app
-            broadcastBLEDetection(name.c_str(), addrStr.c_str(), rssi, "Flock Safety");
-            
-            if (!triggered) {
-                triggered = true;
-                flock_detected_led_sequence();
+        adv.has_services = advertisedDevice->haveServiceUUID();
+        adv.service_count = 0;
+        if (adv.has_services) {
+            int count = advertisedDevice->getServiceUUIDCount();
+            for (int i = 0; i < count && adv.service_count < BLE_ADV_MAX_SERVICES; i++) {
+                adv.services[adv.service_count++] = *advertisedDevice->getServiceUUID(i).getNative();
             }
-            // Always update detection time for heartbeat tracking
-            last_detection_time = millis();
-            return;
         }
         
-        // Check device name
-        if (!name.empty() && check_device_name_pattern(name.c_str())) {
-            output_ble_detection_json(addrStr.c_str(), name.c_str(), rssi, "device_name");
-            
-            // Broadcast to iOS app - determine type from name
-            const char* devType = "Flock Safety";
-            if (strcasestr(name.c_str(), "penguin")) devType = "Penguin";
-            else if (strcasestr(name.c_str(), "pigvision")) devType = "Pigvision";
-            broadcastBLEDetection(name.c_str(), addrStr.c_str(), rssi, devType);
-            
-            if (!triggered) {
-                triggered = true;
-                flock_detected_led_sequence();
-            }
-            // Always update detection time for heartbeat tracking
-            last_detection_time = millis();
-            return;
+        if (ble_adv_queue.push(adv)) {
+            pipeline_task_wake(match_task);
         }
-        
-        // Check for Raven surveillance device service UUIDs
-        char detected_service_uuid[41] = {0};
-        if (check_raven_service_uuid(advertisedDevice, detected_service_uuid)) {
-            // Raven device detected! Get firmware version estimate
-            const char* fw_version = estimate_raven_firmware_version(advertisedDevice);
-            const char* service_desc = get_raven_service_description(detected_service_uuid);
-            
-            // Create enhanced JSON output with Raven-specific data
-            StaticJsonDocument<1024> doc;
-            doc["protocol"] = "bluetooth_le";
-            doc["detection_method"] = "raven_service_uuid";
-            doc["device_type"] = "RAVEN_GUNSHOT_DETECTOR";
-            doc["manufacturer"] = "SoundThinking/ShotSpotter";
-            doc["mac_address"] = addrStr.c_str();
-            doc["rssi"] = rssi;
-            doc["signal_strength"] = rssi > -50 ? "STRONG" : (rssi > -70 ? "MEDIUM" : "WEAK");
-            
-            if (!name.empty()) {
-                doc["device_name"] = name.c_str();
-            }
-            
-            // Raven-specific information
-            doc["raven_service_uuid"] = detected_service_uuid;
-            doc["raven_service_description"] = service_desc;
-            doc["raven_firmware_version"] = fw_version;
-            doc["threat_level"] = "CRITICAL";
-            doc["threat_score"] = 100;
-            
-            // List all detected service UUIDs
-            if (advertisedDevice->haveServiceUUID()) {
-                JsonArray services = doc.createNestedArray("service_uuids");
-                int serviceCount = advertisedDevice->getServiceUUIDCount();
-                for (int i = 0; i < serviceCount; i++) {
-                    NimBLEUUID serviceUUID = advertisedDevice->getServiceUUID(i);
-                    services.add(serviceUUID.toString().c_str());
-                }
-            }
-            
-            // Output the detection
-            serializeJson(doc, Serial);
-            Serial.println();
-            
-            // Broadcast Raven detection to iOS app
-            broadcastBLEDetection(name.c_str(), addrStr.c_str(), rssi, "Raven (Gunshot Detector)");
-            
-            if (!triggered) {
-                triggered = true;
-                flock_detected_led_sequence();
-            }
-            // Always update detection time for heartbeat tracking
-            last_detection_time = millis();
-            return;
+    }
+};
+
+// Matching for one advertisement taken off the queue
+void process_ble_adv(const sniffed_adv_t& adv)
+{
+    INSTRUMENT_SCOPE(STAGE_MATCH);
+    // Stream ALL BLE devices to iOS app for debug view
+    streamBLEScan(adv.name, adv.mac, adv.rssi, adv.has_services);
+    
+    // Scan the device name once against every pattern
+    ac_result_t name_result;
+    check_device_name_pattern(adv.name, adv.name_len, &name_result);
+    
+    // Check MAC prefix, device name and Raven services
+    bool mac_match = check_mac_prefix(adv.mac);
+    bool known = known_mac_contains(adv.mac);
+    uint32_t raven_mask = (mac_match || name_result.count > 0) ? 0
+                        : classify_raven_services(signature_db.active(), adv.services, adv.service_count);
+    
+    // A passive scan only sees the advertisement. Likely targets get a short
+    // active burst so their scan response (full name, service list) is seen.
+    if (adv.scannable && (mac_match || known || raven_mask ||
+                          (name_result.count == 0 && name_result.tail >= BLE_PROBE_PARTIAL_MIN))) {
+        ble_scan_policy.requestProbe(adv.mac, adv.addr_type, millis());
+    }
+    if (!mac_match && !known && name_result.count == 0 && !raven_mask) {
+        return;
+    }
+    
+    // Update the per-device table; duplicates are counted but not re-reported
+    uint8_t match_flags = (mac_match ? MATCH_MAC : 0) | (name_result.count > 0 ? MATCH_NAME : 0) |
+                          (raven_mask ? MATCH_RAVEN : 0) | (known ? MATCH_KNOWN : 0);
+    uint8_t family = FAMILY_FLOCK;
+    if (raven_mask) {
+        family = FAMILY_RAVEN;
+    } else if (name_result.count > 0) {
+        family = signature_db.active().names().signature(name_result.first).family;
+    }
+    tracked_device_t dev;
+    device_report_t report = track_detection(adv.mac, adv.rssi, 0, family, match_flags, DEVICE_PROTO_BLE, &dev);
+    if (report == DEVICE_REPORT_NONE) {
+        return;
+    }
+    
+    uint8_t method = mac_match ? WIRE_METHOD_BLE_MAC_PREFIX
+                   : name_result.count > 0 ? WIRE_METHOD_BLE_DEVICE_NAME
+                   : raven_mask ? WIRE_METHOD_BLE_RAVEN_SERVICE : WIRE_METHOD_BLE_MAC_PREFIX;
+    detection_event_t event;
+    detection_event_init(&event, millis(), DEVICE_PROTO_BLE, method, adv.mac, adv.rssi,
+                         match_flags, family, report, dev);
+    event.raven_mask = raven_mask;
+    if (raven_mask) {
+        // Only the Raven output lists the advertised services
+        event.service_count = adv.service_count;
+        memcpy(event.services, adv.services, adv.service_count * sizeof(adv.services[0]));
+    }
+    detection_event_set_signatures(&event, name_result);
+    detection_event_set_payload(&event, adv.name, adv.name_len);
+    dispatch_detection(event);
+}
+
+// Process every queued advertisement. Returns the number handled.
+size_t drain_ble_adverts()
+{
+    sniffed_adv_t adv;
+    size_t processed = 0;
+    while (ble_adv_queue.pop(adv)) {
+        process_ble_adv(adv);
+        processed++;
+    }
+    return processed;
+}
+
+// ============================================================================
+// DETECTION OUTPUT
+// ============================================================================
+
+void emit_raven_detection_json(const detection_event_t& event)
+{
+    uint32_t raven_mask = event.raven_mask;
+    int rssi = event.rssi;
+    
+    // Raven device detected! Everything below is derived from the mask
+    const SignatureSet& sigs = signature_db.slot(event.signature_set);
+    const char* fw_version = estimate_raven_firmware_version(sigs, raven_mask);
+    const char* service_desc = get_raven_service_description(sigs, raven_mask);
+    char detected_service_uuid[37] = "";
+    int primary = raven_primary_service(sigs, raven_mask);
+    if (primary >= 0) {
+        ble_uuid16_format(sigs.raven(primary).uuid16, detected_service_uuid);
+    }
+    char addrStr[18];
+    snprintf(addrStr, sizeof(addrStr), "%02x:%02x:%02x:%02x:%02x:%02x",
+             event.mac[0], event.mac[1], event.mac[2], event.mac[3], event.mac[4], event.mac[5]);
+    
+    // Create enhanced JSON output with Raven-specific data
+    StaticJsonDocument<1536> doc;
+    if (event.seq) doc["seq"] = event.seq;
+    doc["protocol"] = "bluetooth_le";
+    doc["detection_method"] = wire_method_name(event.method);
+    doc["device_type"] = "RAVEN_GUNSHOT_DETECTOR";
+    doc["manufacturer"] = "SoundThinking/ShotSpotter";
+    doc["mac_address"] = addrStr;
+    doc["rssi"] = rssi;
+    doc["signal_strength"] = rssi > -50 ? "STRONG" : (rssi > -70 ? "MEDIUM" : "WEAK");
+    
+    char name[WIRE_NAME_MAX + 1];
+    if (event.payload_len) {
+        doc["device_name"] = detection_event_payload_str(event, name);
+    }
+    
+    // Raven-specific information
+    doc["raven_service_uuid"] = detected_service_uuid;
+    doc["raven_service_description"] = service_desc;
+    doc["raven_firmware_version"] = fw_version;
+    doc["threat_level"] = "CRITICAL";
+    doc["threat_score"] = event.score;
+    
+    // List all detected service UUIDs
+    if (event.service_count) {
+        JsonArray services = doc.createNestedArray("service_uuids");
+        for (int i = 0; i < event.service_count; i++) {
+            char uuid_str[37];
+            ble_uuid_format(event.services[i], uuid_str);
+            services.add(uuid_str);
         }
     }
+    
+    add_device_summary_json(doc, event.dev, (device_report_t)event.report);
+    emit_json_line(doc);
+}
+
+// JSON sink: one line per detection, laid out by protocol
+void emit_detection_json(const detection_event_t& event)
+{
+    INSTRUMENT_BEGIN(STAGE_FORMAT);
+    if (event.protocol == DEVICE_PROTO_WIFI) {
+        emit_wifi_detection_json(event);
+    } else if (event.method == WIRE_METHOD_BLE_RAVEN_SERVICE) {
+        emit_raven_detection_json(event);
+    } else {
+        emit_ble_detection_json(event);
+    }
+}
+
+// BLE sink: detection characteristic notify to the iOS app
+void emit_detection_notify(const detection_event_t& event)
+{
+    // MAC prefix matches are reported as Flock; otherwise the device type
+    // comes from the matched signature
+    const char* device_type = event.protocol == DEVICE_PROTO_BLE && (event.criteria & (MATCH_MAC | MATCH_KNOWN))
+                            ? "Flock Safety" : device_family_name(event.family);
+    char name[WIRE_NAME_MAX + 1];
+    detection_event_payload_str(event, name);
+    if (event.protocol == DEVICE_PROTO_WIFI) {
+        broadcastWiFiDetection(name[0] ? name : "unknown", event.mac, event.rssi, device_type, event.seq);
+    } else {
+        char addrStr[18];
+        snprintf(addrStr, sizeof(addrStr), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 event.mac[0], event.mac[1], event.mac[2], event.mac[3], event.mac[4], event.mac[5]);
+        broadcastBLEDetection(name, addrStr, event.rssi, device_type, event.seq);
+    }
+}
+
+// Journal sink: the same record the binary output sends, kept on flash for replay
+void emit_detection_journal(const detection_event_t& event)
+{
+    wire_detection_t rec;
+    size_t len = detection_event_to_wire(event, &rec);
+    journal.append(event.seq, (const uint8_t*)&rec, len, millis());
+}
+
+// LED sink: alert sequence (only newly seen devices are queued to it)
+void emit_detection_led(const detection_event_t& event)
+{
+    flock_detected_led_sequence();
+}
+
+static bool serial_json_enabled() { return serial_output_mode == SERIAL_MODE_JSON; }
+static bool serial_binary_enabled() { return serial_output_mode == SERIAL_MODE_BINARY; }
+static bool led_sink_enabled() { return true; }
+static bool journal_sink_enabled() { return journal.ready(); }
+
+// Sinks per output task; add an entry to plug in another output
+static const detection_sink_t serial_sinks[] = {
+    {"journal", journal_sink_enabled, emit_detection_journal},
+    {"json", serial_json_enabled, emit_detection_json},
+    {"binary", serial_binary_enabled, emit_detection_binary},
+};
+static const detection_sink_t notify_sinks[] = {
+    {"ble", isAppConnected, emit_detection_notify},
 };
+static const detection_sink_t led_sinks[] = {
+    {"led", led_sink_enabled, emit_detection_led},
+};
+
+#define SINK_COUNT(sinks) (sizeof(sinks) / sizeof(sinks[0]))
+
+// Number a reportable detection and hand it to the output tasks that have an
+// enabled sink. Matching task only: it is the single producer of every output
+// queue. A sequence number whose event the serial queue dropped is a gap.
+// Each queued copy holds the signature set it was matched with until its
+// output task is done with it (see SignatureDb::standby).
+void dispatch_detection(detection_event_t& event)
+{
+    event.seq = journal.nextSeq();
+    event.signature_set = signature_db.activeSlot();
+    // Held before the push so a consumer's release never comes first
+    signature_db.hold(event.signature_set);
+    if (detection_sinks_any_enabled(serial_sinks, SINK_COUNT(serial_sinks)) &&
+        serial_event_queue.push(event)) {
+        pipeline_task_wake(serial_task);
+        signature_db.hold(event.signature_set);
+    }
+    if (detection_sinks_any_enabled(notify_sinks, SINK_COUNT(notify_sinks)) &&
+        notify_event_queue.push(event)) {
+        pipeline_task_wake(notify_task);
+        signature_db.hold(event.signature_set);
+    }
+    // Alert once per newly seen device
+    if (event.report == DEVICE_REPORT_NEW && detection_sinks_any_enabled(led_sinks, SINK_COUNT(led_sinks)) &&
+        led_event_queue.push(event)) {
+        pipeline_task_wake(led_task);
+        signature_db.hold(event.signature_set);
+    }
+    signature_db.release(event.signature_set);
+}
+
+size_t drain_serial_events()
+{
+    detection_event_t event;
+    size_t processed = 0;
+    while (serial_event_queue.pop(event)) {
+        detection_sinks_emit(serial_sinks, SINK_COUNT(serial_sinks), event);
+        signature_db.release(event.signature_set);
+        processed++;
+    }
+    return processed;
+}
+
+size_t drain_notify_events()
+{
+    detection_event_t event;
+    size_t processed = 0;
+    while (notify_event_queue.pop(event)) {
+        detection_sinks_emit(notify_sinks, SINK_COUNT(notify_sinks), event);
+        signature_db.release(event.signature_set);
+        processed++;
+    }
+    return processed;
+}
+
+size_t drain_led_events()
+{
+    detection_event_t event;
+    size_t processed = 0;
+    while (led_event_queue.pop(event)) {
+        detection_sinks_emit(led_sinks, SINK_COUNT(led_sinks), event);
+        signature_db.release(event.signature_set);
+        processed++;
+    }
+    return processed;
+}
 
 // ============================================================================
-// CHANNEL HOPPING
+// DETECTION JOURNAL
 // ============================================================================
 
-void hop_channel()
+// Replays go to the serial port as binary journal frames in either output
+// mode; hosts read JSON lines and frames from the same stream.
+static void replay_to_serial(uint32_t seq, const uint8_t* rec, size_t len)
+{
+    write_journal_frame(seq, WIRE_JOURNAL_REPLAYED, rec, len);
+}
+
+static void replay_to_ble(uint32_t seq, const uint8_t* rec, size_t len)
+{
+    wire_detection_t det = {};
+    memcpy(&det, rec, len < sizeof(det) ? len : sizeof(det));
+    bool wifi = wire_method_is_wifi(det.method);
+    const char* device_type = det.method == WIRE_METHOD_BLE_MAC_PREFIX ? "Flock Safety" : device_family_name(det.family);
+    char name[WIRE_NAME_MAX + 1];
+    memcpy(name, det.name, det.name_len);
+    name[det.name_len] = '\0';
+    char addrStr[18];
+    snprintf(addrStr, sizeof(addrStr), "%02x:%02x:%02x:%02x:%02x:%02x",
+             det.mac[0], det.mac[1], det.mac[2], det.mac[3], det.mac[4], det.mac[5]);
+    broadcastDetection(device_type, addrStr, wifi && !name[0] ? "unknown" : name, det.rssi,
+                       wifi ? 0.9 : 0.85, seq, true);
+}
+
+void report_journal_stats()
+{
+    journal_stats_t st;
+    journal.getStats(&st);
+    StaticJsonDocument<768> doc;
+    doc["event"] = "journal";
+    doc["timestamp"] = millis();
+    doc["ready"] = journal.ready();
+    doc["next_seq"] = st.next_seq;
+    doc["oldest_seq"] = st.oldest_seq;
+    doc["acked_serial"] = st.acked[JOURNAL_CONSUMER_SERIAL];
+    doc["acked_ble"] = st.acked[JOURNAL_CONSUMER_BLE];
+    doc["segments"] = st.segments;
+    doc["flash_bytes"] = st.flash_bytes;
+    doc["capacity"] = st.capacity;
+    doc["buffered"] = st.buffered;
+    doc["buffer_size"] = st.buffer_size;
+    doc["records"] = st.records;
+    doc["flushes"] = st.flushes;
+    doc["replayed"] = st.replayed;
+    doc["dropped"] = st.dropped;
+    doc["write_errors"] = st.write_errors;
+    doc["pruned_segments"] = st.pruned_segments;
+    doc["pruned_unacked"] = st.pruned_unacked;
+    emit_report(doc);
+}
+
+static void report_replay_done(journal_consumer_t consumer)
+{
+    static const char* const names[JOURNAL_CONSUMER_COUNT] = { "serial", "ble" };
+    StaticJsonDocument<128> doc;
+    doc["event"] = "journal_replay";
+    doc["consumer"] = names[consumer];
+    doc["acked"] = journal.acked(consumer);
+    doc["done"] = true;
+    emit_report(doc);
+}
+
+bool journal_replaying()
+{
+    return journal.replaying(JOURNAL_CONSUMER_SERIAL) || journal.replaying(JOURNAL_CONSUMER_BLE);
+}
+
+// Serial task: timed flushes, ack persistence, replays and stats requests
+void service_journal()
+{
+    if (!journal.ready()) return;
+    journal.tick(millis());
+    
+    // Only read back what the detection ring can take; the rest waits for the writer
+    if (journal.replaying(JOURNAL_CONSUMER_SERIAL) &&
+        serial_tx.room(SERIAL_TX_DETECTION) >=
+            JOURNAL_REPLAY_BATCH * (WIRE_FRAME_MAX(sizeof(wire_journal_t)) + SERIAL_TX_MSG_HEADER)) {
+        journal.replayStep(JOURNAL_CONSUMER_SERIAL, JOURNAL_REPLAY_BATCH, replay_to_serial);
+        if (!journal.replaying(JOURNAL_CONSUMER_SERIAL)) report_replay_done(JOURNAL_CONSUMER_SERIAL);
+    }
+    // One notify per pass, and none while live detections wait for the link
+    if (journal.replaying(JOURNAL_CONSUMER_BLE) && isAppConnected() && !detectionRetryPending()) {
+        journal.replayStep(JOURNAL_CONSUMER_BLE, 1, replay_to_ble);
+        if (!journal.replaying(JOURNAL_CONSUMER_BLE)) report_replay_done(JOURNAL_CONSUMER_BLE);
+    }
+    
+    if (journal_report_requested.exchange(false)) {
+        report_journal_stats();
+    }
+}
+
+// Mount the filesystem and open the journal. Without a mountable partition
+// the journal stays off and detections go out unnumbered.
+void init_journal()
+{
+    if (!LittleFS.begin(true)) {
+        serial_log("[Journal] LittleFS mount failed - journal disabled\n");
+        return;
+    }
+    size_t capacity = LittleFS.totalBytes() / 4 * 3;
+    if (capacity > JOURNAL_MAX_BYTES) capacity = JOURNAL_MAX_BYTES;
+    size_t buffer_size = psramFound() ? JOURNAL_BUFFER_BYTES : JOURNAL_BUFFER_FALLBACK_BYTES;
+    uint8_t* buffer = (uint8_t*)(psramFound() ? ps_malloc(buffer_size) : malloc(buffer_size));
+    if (!journal.begin(&LittleFS, capacity, buffer, buffer_size)) {
+        serial_log("[Journal] Could not open %s - journal disabled\n", JOURNAL_DIR);
+        free(buffer);
+        return;
+    }
+    journal_stats_t st;
+    journal.getStats(&st);
+    serial_log("[Journal] %u segments, %u bytes of %u, next seq %u, %u byte %s buffer\n",
+               (unsigned)st.segments, (unsigned)st.flash_bytes, (unsigned)st.capacity,
+               (unsigned)st.next_seq, (unsigned)buffer_size, psramFound() ? "PSRAM" : "RAM");
+}
+
+// ============================================================================
+// SIGNATURE PACKS
+// ============================================================================
+
+bool build_builtin_signatures(SignatureSet* sigs)
+{
+    return sigs->buildBuiltin(wifi_ssid_patterns, sizeof(wifi_ssid_patterns) / sizeof(wifi_ssid_patterns[0]),
+                              oui_table.keys, oui_table.size(),
+                              device_name_patterns, sizeof(device_name_patterns) / sizeof(device_name_patterns[0]),
+                              raven_service_uuids, RAVEN_SERVICE_COUNT);
+}
+
+// One "sigpack" line: what a set holds, the RAM it takes and, after a
+// rebuild, how long the rebuild took
+void report_signature_set(const char* status, const SignatureSet& sigs, long build_us)
+{
+    StaticJsonDocument<384> doc;
+    doc["event"] = "sigpack";
+    doc["timestamp"] = millis();
+    doc["status"] = status;
+    doc["source"] = sigs.builtin() ? "builtin" : "pack";
+    doc["version"] = sigs.version();
+    doc["ssid_patterns"] = sigs.ssid().patternCount();
+    doc["ouis"] = sigs.ouiCount();
+    doc["name_patterns"] = sigs.names().patternCount();
+    doc["raven_services"] = sigs.ravenCount();
+    doc["pack_bytes"] = sigs.packBytes();
+    doc["memory_bytes"] = sigs.memoryBytes();
+    if (build_us >= 0) doc["build_us"] = build_us;
+    emit_report(doc);
+}
+
+void report_signature_error(const char* message)
+{
+    StaticJsonDocument<128> doc;
+    doc["event"] = "sigpack";
+    doc["status"] = "error";
+    doc["message"] = message;
+    emit_report(doc);
+}
+
+// Keep a received pack for the next boot. Written aside and renamed so a
+// power cut leaves the previous pack in place.
+bool store_signature_pack(const uint8_t* pack, size_t len)
+{
+    File file = LittleFS.open(SIGPACK_TMP_PATH, FILE_WRITE);
+    if (!file) return false;
+    bool written = file.write(pack, len) == len;
+    file.close();
+    if (!written) {
+        LittleFS.remove(SIGPACK_TMP_PATH);
+        return false;
+    }
+    LittleFS.remove(SIGPACK_PATH);
+    return LittleFS.rename(SIGPACK_TMP_PATH, SIGPACK_PATH);
+}
+
+// Boot: replace the built-in set with the stored pack, if there is one.
+// Runs before the pipeline tasks start, so the swap is immediate.
+void load_stored_signatures()
+{
+    File file = LittleFS.open(SIGPACK_PATH, FILE_READ);
+    if (!file) return;
+    size_t len = file.size();
+    uint8_t* pack = len <= SIGPACK_MAX_BYTES ? (uint8_t*)malloc(len ? len : 1) : nullptr;
+    bool read = pack && file.read(pack, len) == len;
+    file.close();
+    const char* error = read ? sigpack_check(pack, len) : "unreadable";
+    SignatureSet* standby = signature_db.standby();
+    uint32_t start = micros();
+    if (!error && standby->build(pack, len, &error)) {
+        long build_us = (long)(micros() - start);
+        signature_db.activateStandby();
+        report_signature_set("loaded", *standby, build_us);
+    } else {
+        serial_log("[Signatures] Stored pack rejected (%s) - using built-in signatures\n", error);
+    }
+    free(pack);
+}
+
+// Builder task: build the pending pack into the standby set and stage it for
+// the matching task. Returns false if there was nothing to do or the standby
+// set is still referenced by queued events (the pack stays pending for the
+// next pass).
+bool service_signature_build()
+{
+    uint8_t* pack;
+    size_t len;
+    bool builtin;
+    {
+        std::lock_guard<std::mutex> lock(sigpack_mutex);
+        if (!sigpack_pending && !sigpack_pending_builtin) return false;
+        if (!signature_db.standby()) return false;
+        pack = sigpack_pending;
+        len = sigpack_pending_len;
+        builtin = sigpack_pending_builtin;
+        sigpack_pending = nullptr;
+        sigpack_pending_len = 0;
+        sigpack_pending_builtin = false;
+    }
+    SignatureSet* standby = signature_db.standby();
+    const char* error = "patterns exceed AC_MAX_NODES";
+    uint32_t start = micros();
+    bool built = builtin ? build_builtin_signatures(standby) : standby->build(pack, len, &error);
+    long build_us = (long)(micros() - start);
+    if (!built) {
+        report_signature_error(error);
+        free(pack);
+        return true;
+    }
+    
+    // Persist before going live, so a reboot comes back to the same set
+    if (builtin) {
+        LittleFS.remove(SIGPACK_PATH);
+    } else if (!store_signature_pack(pack, len)) {
+        serial_log("[Signatures] Could not store the pack - it will not survive a reboot\n");
+    }
+    free(pack);
+    signature_db.stage();
+    pipeline_task_wake(match_task);
+    report_signature_set("loaded", *standby, build_us);
+    return true;
+}
+
+// Matching task, between records: go live with a staged set
+void apply_signature_swap()
+{
+    signature_db.swapIfStaged();
+}
+
+static inline int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_hex(const char* hex, uint8_t* out, size_t max, size_t* len)
+{
+    size_t n = 0;
+    for (const char* p = hex; *p; p += 2) {
+        int hi = hex_digit(p[0]);
+        int lo = p[1] ? hex_digit(p[1]) : -1;
+        if (hi < 0 || lo < 0 || n >= max) return false;
+        out[n++] = (uint8_t)((hi << 4) | lo);
+    }
+    *len = n;
+    return true;
+}
+
+// Signature pack commands, accepted from the console and the app:
+//   sig               print the active set
+//   sig begin <len>   start uploading a pack of len bytes
+//   sig data <hex>    next chunk, up to SIGPACK_CHUNK_MAX bytes
+//   sig end           check the pack and hand it to the builder task
+//   sig reset         go back to the built-in signatures
+// Returns false for anything else.
+bool execute_signature_command(const char* cmd)
+{
+    if (strcmp(cmd, "sig") == 0) {
+        report_signature_set("active", signature_db.active(), -1);
+        return true;
+    }
+    if (strncmp(cmd, "sig ", 4) != 0) {
+        return false;
+    }
+    const char* arg = cmd + 4;
+    std::lock_guard<std::mutex> lock(sigpack_mutex);
+    if (strncmp(arg, "begin ", 6) == 0) {
+        size_t size = strtoul(arg + 6, nullptr, 10);
+        free(sigpack_upload);
+        sigpack_upload = nullptr;
+        sigpack_upload_len = 0;
+        sigpack_upload_size = 0;
+        if (size < sizeof(sigpack_header_t) || size > SIGPACK_MAX_BYTES) {
+            report_signature_error("bad size");
+        } else if (!(sigpack_upload = (uint8_t*)malloc(size))) {
+            report_signature_error("out of memory");
+        } else {
+            sigpack_upload_size = size;
+        }
+    } else if (strncmp(arg, "data ", 5) == 0) {
+        uint8_t chunk[SIGPACK_CHUNK_MAX];
+        size_t len;
+        if (!sigpack_upload) {
+            report_signature_error("no upload in progress");
+        } else if (!parse_hex(arg + 5, chunk, sizeof(chunk), &len) ||
+                   len > sigpack_upload_size - sigpack_upload_len) {
+            report_signature_error("bad chunk - upload aborted");
+            free(sigpack_upload);
+            sigpack_upload = nullptr;
+        } else {
+            memcpy(sigpack_upload + sigpack_upload_len, chunk, len);
+            sigpack_upload_len += len;
+        }
+    } else if (strcmp(arg, "end") == 0) {
+        const char* error = !sigpack_upload ? "no upload in progress"
+                          : sigpack_upload_len != sigpack_upload_size ? "incomplete"
+                          : sigpack_check(sigpack_upload, sigpack_upload_len);
+        if (error) {
+            report_signature_error(error);
+            free(sigpack_upload);
+        } else {
+            // A newer pack replaces one that is still waiting to be built
+            free(sigpack_pending);
+            sigpack_pending = sigpack_upload;
+            sigpack_pending_len = sigpack_upload_len;
+            sigpack_pending_builtin = false;
+            pipeline_task_wake(sigpack_task);
+        }
+        sigpack_upload = nullptr;
+    } else if (strcmp(arg, "reset") == 0) {
+        free(sigpack_pending);
+        sigpack_pending = nullptr;
+        sigpack_pending_builtin = true;
+        pipeline_task_wake(sigpack_task);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// PIPELINE TASKS
+// ============================================================================
+
+void match_task_main(void* param)
+{
+    pipeline_task_t* task = (pipeline_task_t*)param;
+    for (;;) {
+        // Sleep until a radio callback signals new input (or time out and re-check)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PIPELINE_IDLE_WAIT_MS));
+        PipelineWork work(task);
+        apply_signature_swap();
+        size_t n = drain_wifi_frames() + drain_ble_adverts();
+        task->items.fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+void serial_task_main(void* param)
+{
+    pipeline_task_t* task = (pipeline_task_t*)param;
+    for (;;) {
+        // Wake more often while a replay is streaming out
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(journal_replaying() ? JOURNAL_REPLAY_POLL_MS : PIPELINE_IDLE_WAIT_MS));
+        PipelineWork work(task);
+        task->items.fetch_add(drain_serial_events(), std::memory_order_relaxed);
+        service_journal();
+    }
+}
+
+// A stream batch filled up: send it now rather than at the next tick
+void wake_notify_task()
+{
+    pipeline_task_wake(notify_task);
+}
+
+void notify_task_main(void* param)
+{
+    pipeline_task_t* task = (pipeline_task_t*)param;
+    for (;;) {
+        // Also wakes every NOTIFY_TICK_MS so partial stream batches go out
+        // once they have waited BLE_STREAM_COALESCE_MS
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NOTIFY_TICK_MS));
+        PipelineWork work(task);
+        task->items.fetch_add(drain_notify_events(), std::memory_order_relaxed);
+        bleStreamTick();
+    }
+}
+
+// One LED frame: queued alerts, then the animation step. Returns the alerts handled.
+size_t service_led()
+{
+    size_t processed = drain_led_events();
+    led.tick(millis());
+    return processed;
+}
+
+bool led_animating() { return led.busy(); }
+
+void led_task_main(void* param)
+{
+    pipeline_task_t* task = (pipeline_task_t*)param;
+    for (;;) {
+        // The animation engine needs a tick every frame, alert or not
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOOP_INTERVAL_MS));
+        PipelineWork work(task);
+        task->items.fetch_add(service_led(), std::memory_order_relaxed);
+    }
+}
+
+void serial_tx_task_main(void* param)
+{
+    pipeline_task_t* task = (pipeline_task_t*)param;
+    for (;;) {
+        // Woken by the first message into an empty queue; polls while the
+        // port is backed up
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(serial_tx.pending() ? SERIAL_TX_POLL_MS : PIPELINE_IDLE_WAIT_MS));
+        PipelineWork work(task);
+        task->items.fetch_add(serial_tx.drain(), std::memory_order_relaxed);
+    }
+}
+
+// The host harness calls this in place of the serial_tx task
+size_t drain_serial_tx()
+{
+    return serial_tx.drain();
+}
+
+void sigpack_task_main(void* param)
+{
+    pipeline_task_t* task = (pipeline_task_t*)param;
+    for (;;) {
+        // Woken by "sig end" / "sig reset"; the timeout retries a pack that
+        // arrived while queued events still held the standby set
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SIGPACK_RETRY_MS));
+        PipelineWork work(task);
+        if (service_signature_build()) {
+            task->items.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Started first thing in setup() so boot messages reach the port
+void start_serial_tx_task()
+{
+    pipeline_task_create(&serial_tx_task, serial_tx_task_main, "serial_tx", SERIAL_TX_TASK_STACK_SIZE,
+                         SERIAL_TX_TASK_PRIORITY, PIPELINE_OUTPUT_CORE);
+    serial_tx.begin(serial_tx_task.handle);
+}
+
+void start_pipeline_tasks()
+{
+    pipeline_task_create(&match_task, match_task_main, "match", MATCH_TASK_STACK_SIZE,
+                         MATCH_TASK_PRIORITY, PIPELINE_MATCH_CORE);
+    pipeline_task_create(&serial_task, serial_task_main, "serial_out", SERIAL_TASK_STACK_SIZE,
+                         SERIAL_TASK_PRIORITY, PIPELINE_OUTPUT_CORE);
+    pipeline_task_create(&notify_task, notify_task_main, "ble_out", NOTIFY_TASK_STACK_SIZE,
+                         NOTIFY_TASK_PRIORITY, PIPELINE_OUTPUT_CORE);
+    pipeline_task_create(&led_task, led_task_main, "led", LED_TASK_STACK_SIZE,
+                         LED_TASK_PRIORITY, PIPELINE_OUTPUT_CORE);
+    pipeline_task_create(&sigpack_task, sigpack_task_main, "sig_build", SIGPACK_TASK_STACK_SIZE,
+                         SIGPACK_TASK_PRIORITY, PIPELINE_OUTPUT_CORE);
+}
+
+template <typename T, size_t N>
+static void add_queue_stats_json(JsonObject obj, const SpscQueue<T, N>& queue)
+{
+    obj["capacity"] = queue.capacity();
+    obj["depth"] = queue.depth();
+    obj["high_water"] = queue.highWater();
+    obj["pushed"] = queue.pushed();
+    obj["dropped"] = queue.dropped();
+}
+
+static void add_serial_tx_stats_json(JsonObject obj, uint8_t cls)
+{
+    serial_tx_stats_t st = serial_tx.stats(cls);
+    obj["capacity"] = st.capacity;
+    obj["depth"] = st.depth;
+    obj["high_water"] = st.high_water;
+    obj["pushed"] = st.pushed;
+    obj["dropped"] = st.dropped;
+}
+
+static void add_task_stats_json(JsonObject obj, pipeline_task_t& task, uint32_t now_us)
+{
+    uint32_t busy = task.busy_us.load(std::memory_order_relaxed);
+    uint32_t wall = now_us - task.reported_at_us;
+    obj["core"] = task.core;
+    obj["cpu_pct"] = wall ? (float)(busy - task.reported_busy_us) * 100.0f / wall : 0.0f;
+    obj["items"] = task.items.load(std::memory_order_relaxed);
+    obj["stack_free"] = task.handle ? uxTaskGetStackHighWaterMark(task.handle) : 0;
+    task.reported_busy_us = busy;
+    task.reported_at_us = now_us;
+}
+
+// Periodic per-task CPU/stack use and per-queue depth, for sizing the
+// pipeline. cpu_pct covers the time since the previous report. The serial_tx
+// classes are counted in bytes, their pushed/dropped in messages.
+void report_pipeline_stats()
+{
+    uint32_t now_us = micros();
+    StaticJsonDocument<2048> doc;
+    doc["event"] = "pipeline";
+    doc["timestamp"] = millis();
+    
+    JsonObject tasks = doc.createNestedObject("tasks");
+    add_task_stats_json(tasks.createNestedObject(match_task.name), match_task, now_us);
+    add_task_stats_json(tasks.createNestedObject(serial_task.name), serial_task, now_us);
+    add_task_stats_json(tasks.createNestedObject(notify_task.name), notify_task, now_us);
+    add_task_stats_json(tasks.createNestedObject(led_task.name), led_task, now_us);
+    add_task_stats_json(tasks.createNestedObject(serial_tx_task.name), serial_tx_task, now_us);
+    add_task_stats_json(tasks.createNestedObject(sigpack_task.name), sigpack_task, now_us);
+    
+    JsonObject queues = doc.createNestedObject("queues");
+    add_queue_stats_json(queues.createNestedObject("wifi_frames"), wifi_frame_queue);
+    add_queue_stats_json(queues.createNestedObject("ble_adverts"), ble_adv_queue);
+    add_queue_stats_json(queues.createNestedObject("serial"), serial_event_queue);
+    add_queue_stats_json(queues.createNestedObject("notify"), notify_event_queue);
+    add_queue_stats_json(queues.createNestedObject("led"), led_event_queue);
+    
+    JsonObject tx = doc.createNestedObject("serial_tx");
+    for (uint8_t cls = 0; cls < SERIAL_TX_CLASS_COUNT; cls++) {
+        add_serial_tx_stats_json(tx.createNestedObject(serial_tx_class_name(cls)), cls);
+    }
+    
+    doc["malformed"] = wifi_malformed_frames.load(std::memory_order_relaxed);
+    emit_report(doc);
+}
+
+// ============================================================================
+// INSTRUMENTATION REPORTS
+// ============================================================================
+
+static std::atomic<bool> stats_app_requested{false};
+static uint32_t stats_interval_ms = STATS_REPORT_INTERVAL_MS;
+static unsigned long last_stats_report = 0;
+
+#if INSTRUMENTATION
+static uint32_t stats_prev_frames[INSTRUMENT_WIFI_CHANNELS];
+static unsigned long stats_prev_at = 0;
+
+static float cycles_to_us(uint64_t cycles, uint32_t mhz)
+{
+    return mhz ? (float)cycles / mhz : 0.0f;
+}
+
+// Upper edge of a histogram bucket, capped at the largest sample
+static float bucket_us(uint8_t stage, uint8_t bucket, uint32_t mhz)
+{
+    uint64_t edge = (uint64_t)1 << (INSTRUMENT_HIST_SHIFT + bucket);
+    uint32_t max = instrumentation.max(stage);
+    return cycles_to_us(edge < max ? edge : max, mhz);
+}
+#endif
+
+// Stage latencies and counters on the serial port: a JSON line (with the
+// histograms when full is set) or, in binary mode, a wire_stats_t frame.
+// WiFi frames per second per channel cover the time since the last report.
+void report_stats(bool full)
 {
+#if INSTRUMENTATION
     unsigned long now = millis();
-    if (now - last_channel_hop > CHANNEL_HOP_INTERVAL) {
-        current_channel++;
-        if (current_channel > MAX_CHANNEL) {
-            current_channel = 1;
+    uint32_t mhz = ESP.getCpuFreqMHz();
+    if (serial_output_mode == SERIAL_MODE_BINARY) {
+        wire_stats_t rec;
+        size_t len = instrumentation.snapshot(&rec, now, mhz);
+        uint8_t frame[WIRE_FRAME_MAX(sizeof(wire_stats_t))];
+        serial_tx.push(SERIAL_TX_STATS, frame, wire_frame((const uint8_t*)&rec, len, frame));
+        return;
+    }
+    
+    DynamicJsonDocument doc(4096);
+    doc["event"] = "stats";
+    doc["timestamp"] = now;
+    doc["cpu_mhz"] = mhz;
+    JsonObject stages = doc.createNestedObject("stages");
+    for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+        JsonObject stage = stages.createNestedObject(instrument_stage_name(i));
+        stage["count"] = instrumentation.samples(i);
+        stage["mean_us"] = cycles_to_us(instrumentation.meanCycles(i), mhz);
+        stage["p50_us"] = bucket_us(i, instrumentation.percentileBucket(i, 500), mhz);
+        stage["p99_us"] = bucket_us(i, instrumentation.percentileBucket(i, 990), mhz);
+        stage["max_us"] = cycles_to_us(instrumentation.max(i), mhz);
+        if (full) {
+            JsonArray hist = stage.createNestedArray("hist");
+            for (uint8_t b = 0; b < INSTRUMENT_HIST_BUCKETS; b++) hist.add(instrumentation.bucket(i, b));
         }
+    }
+    
+    JsonArray frames = doc.createNestedArray("wifi_frames");
+    JsonArray fps = doc.createNestedArray("wifi_fps");
+    unsigned long elapsed = now - stats_prev_at;
+    for (uint8_t ch = 1; ch <= INSTRUMENT_WIFI_CHANNELS; ch++) {
+        uint32_t n = instrumentation.wifiFrames(ch);
+        frames.add(n);
+        fps.add(elapsed ? (float)(n - stats_prev_frames[ch - 1]) * 1000.0f / elapsed : 0.0f);
+        stats_prev_frames[ch - 1] = n;
+    }
+    stats_prev_at = now;
+    
+    doc["ble_adverts"] = instrumentation.counter(COUNTER_BLE_ADVERTS);
+    JsonObject notify = doc.createNestedObject("notify");
+    notify["calls"] = instrumentation.counter(COUNTER_NOTIFY_CALLS);
+    notify["congested"] = instrumentation.counter(COUNTER_NOTIFY_CONGESTED);
+    JsonObject serial = doc.createNestedObject("serial");
+    serial["writes"] = instrumentation.counter(COUNTER_SERIAL_WRITES);
+    serial["bytes"] = instrumentation.counter(COUNTER_SERIAL_BYTES);
+    serial["blocked"] = instrumentation.counter(COUNTER_SERIAL_BLOCKED);
+    serial["dropped"] = serial_tx.stats(SERIAL_TX_DETECTION).dropped;
+    emit_report(doc);
+#else
+    StaticJsonDocument<64> doc;
+    doc["event"] = "stats";
+    doc["enabled"] = false;
+    emit_report(doc);
+#endif
+}
+
+// The compact record to the app as a STREAM_REC_STATS stream record
+void send_stats_to_app()
+{
+#if INSTRUMENTATION
+    wire_stats_t rec;
+    size_t len = instrumentation.snapshot(&rec, millis(), ESP.getCpuFreqMHz());
+    streamStats((const uint8_t*)&rec, len);
+#endif
+}
+
+// loop(): app requests and the periodic record
+void service_stats()
+{
+    if (stats_app_requested.exchange(false)) {
+        send_stats_to_app();
+    }
+    if (stats_interval_ms && millis() - last_stats_report >= stats_interval_ms) {
+        report_stats(false);
+        if (isAppConnected()) send_stats_to_app();
+        last_stats_report = millis();
+    }
+}
+
+// ============================================================================
+// CHANNEL HOPPING
+// ============================================================================
+
+void hop_channel()
+{
+    uint8_t next = channel_scheduler.tick(millis());
+    if (next) {
+        current_channel = next;
         esp_wifi_set_channel(current_channel, WIFI_SECOND_CHAN_NONE);
-        last_channel_hop = now;
         // Stream channel hop to iOS app
         streamChannelHop(current_channel);
     }
 }
 
+// ============================================================================
+// RADIO TIME-SLICING
+// ============================================================================
+
+// (Re)start the BLE scan in the mode the scan policy asks for. Restarting
+// also clears the controller's duplicate filter.
+void start_ble_scan()
+{
+    if (pBLEScan->isScanning()) {
+        pBLEScan->stop();
+    }
+    pBLEScan->clearResults();
+    
+    // Probe bursts only scan the whitelisted targets
+    while (NimBLEDevice::getWhiteListCount() > 0) {
+        NimBLEDevice::whiteListRemove(NimBLEDevice::getWhiteListAddress(0));
+    }
+    const ble_probe_t* targets;
+    size_t count = ble_scan_policy.targets(&targets);
+    for (size_t i = 0; i < count; i++) {
+        ble_addr_t addr;
+        addr.type = targets[i].addr_type;
+        for (int b = 0; b < 6; b++) {
+            addr.val[b] = targets[i].mac[5 - b];
+        }
+        NimBLEDevice::whiteListAdd(NimBLEAddress(addr));
+    }
+    pBLEScan->setFilterPolicy(count > 0 ? BLE_HCI_SCAN_FILT_USE_WL : BLE_HCI_SCAN_FILT_NO_WL);
+    pBLEScan->setActiveScan(ble_scan_policy.mode() == BLE_SCAN_ACTIVE);
+    
+    // Duration 0 scans until stop()
+    pBLEScan->start(0, nullptr, false);
+}
+
+// Apply slot changes from the radio scheduler: promiscuous capture during
+// WiFi slots, BLE scanning during BLE slots. Within a BLE slot the scan is
+// only restarted for probe bursts and duplicate filter resets.
+void run_radio_scheduler()
+{
+    unsigned long now = millis();
+    if (!radio_scheduler.tick(now)) {
+        if (radio_scheduler.current() == RADIO_SLOT_BLE && ble_scan_policy.tick(now)) {
+            start_ble_scan();
+        }
+        return;
+    }
+    if (radio_scheduler.current() == RADIO_SLOT_BLE) {
+        channel_scheduler.pause(now);
+        esp_wifi_set_promiscuous(false);
+        ble_scan_policy.slotStarted(now);
+        start_ble_scan();
+    } else {
+        ble_scan_policy.slotEnded(now);
+        if (pBLEScan->isScanning()) {
+            pBLEScan->stop();
+        }
+        pBLEScan->clearResults();
+        channel_scheduler.resume(now);
+        esp_wifi_set_promiscuous(true);
+        esp_wifi_set_channel(current_channel, WIFI_SECOND_CHAN_NONE);
+    }
+}
+
+// Advertisement rate and scan requests per scan mode. The controller does
+// not report the SCAN_REQs it sends, so scan_requests counts the scannable
+// advertisements seen while active (one request each, at least) and
+// scan_requests_avoided the ones seen while passive.
+void report_ble_scan_stats()
+{
+    unsigned long now = millis();
+    StaticJsonDocument<512> doc;
+    doc["event"] = "ble_scan";
+    doc["timestamp"] = now;
+    doc["passive_first"] = ble_scan_policy.passiveFirst();
+    static const char* const names[BLE_SCAN_MODE_COUNT] = { "passive", "active" };
+    for (int i = 0; i < BLE_SCAN_MODE_COUNT; i++) {
+        ble_scan_mode_stats_t st = ble_scan_policy.stats((ble_scan_mode_t)i, now);
+        JsonObject mode = doc.createNestedObject(names[i]);
+        mode["airtime_ms"] = st.airtime_ms;
+        mode["adverts"] = st.adverts;
+        mode["adv_per_s"] = st.airtime_ms ? (float)st.adverts * 1000.0f / st.airtime_ms : 0.0f;
+        mode[i == BLE_SCAN_ACTIVE ? "scan_requests" : "scan_requests_avoided"] = st.scannable;
+    }
+    JsonObject probes = doc.createNestedObject("probes");
+    probes["requested"] = ble_scan_policy.probesRequested();
+    probes["dropped"] = ble_scan_policy.probesDropped();
+    probes["bursts"] = ble_scan_policy.bursts();
+    doc["duplicate_resets"] = ble_scan_policy.duplicateResets();
+    emit_report(doc);
+}
+
+// Per-radio airtime and detection yield for tuning RADIO_BLE_SHARE_PCT
+void report_radio_stats()
+{
+    StaticJsonDocument<384> doc;
+    doc["event"] = "radio";
+    doc["timestamp"] = millis();
+    doc["ble_share_pct"] = radio_scheduler.bleSharePct();
+    static const char* const names[RADIO_SLOT_COUNT] = { "wifi", "ble" };
+    for (int i = 0; i < RADIO_SLOT_COUNT; i++) {
+        const radio_slot_stats_t& st = radio_scheduler.stats((radio_slot_t)i);
+        JsonObject radio = doc.createNestedObject(names[i]);
+        radio["airtime_ms"] = st.airtime_ms;
+        radio["slots"] = st.slots;
+        radio["detections"] = st.detections;
+        radio["yield_per_min"] = radio_scheduler.yieldPerMinute((radio_slot_t)i);
+    }
+    emit_report(doc);
+    report_ble_scan_stats();
+}
+
+// ============================================================================
+// SERIAL COMMANDS
+// ============================================================================
+
+// Journal commands, accepted from the console and the app:
+//   journal       print the journal stats line
+//   ack <seq>     everything up to seq has been received
+//   replay [seq]  resend everything after seq (default: the last ack)
+// Returns false for anything else.
+bool execute_journal_command(const char* cmd, journal_consumer_t consumer)
+{
+    if (strcmp(cmd, "journal") == 0) {
+        journal_report_requested = true;
+    } else if (strncmp(cmd, "ack ", 4) == 0) {
+        journal.ack(consumer, strtoul(cmd + 4, nullptr, 10));
+        return true;
+    } else if (strcmp(cmd, "replay") == 0) {
+        journal.requestReplay(consumer, journal.acked(consumer));
+    } else if (strncmp(cmd, "replay ", 7) == 0) {
+        journal.requestReplay(consumer, strtoul(cmd + 7, nullptr, 10));
+    } else {
+        return false;
+    }
+    pipeline_task_wake(serial_task);
+    return true;
+}
+
+// Stats commands, accepted from the console and the app:
+//   stats            one report (the app gets a STREAM_REC_STATS record)
+//   stats every <s>  also send the compact record every s seconds (0 = off,
+//                    at most STATS_INTERVAL_MAX_S)
+// Returns false for anything else.
+bool execute_stats_command(const char* cmd, bool from_app)
+{
+    if (strcmp(cmd, "stats") == 0) {
+        if (from_app) {
+            stats_app_requested = true;
+        } else {
+            report_stats(true);
+        }
+        return true;
+    }
+    if (strncmp(cmd, "stats every ", 12) == 0) {
+        unsigned long seconds = strtoul(cmd + 12, nullptr, 10);
+        if (seconds > STATS_INTERVAL_MAX_S) {
+            serial_log("[Stats] %lu s is too long - reporting every %u s\n", seconds, (unsigned)STATS_INTERVAL_MAX_S);
+            seconds = STATS_INTERVAL_MAX_S;
+        }
+        stats_interval_ms = (uint32_t)seconds * 1000;
+        last_stats_report = millis();
+        return true;
+    }
+    return false;
+}
+
+// Commands written to the command characteristic that ble_broadcast.h does
+// not handle itself
+void handle_app_command(const char* cmd)
+{
+    if (!execute_signature_command(cmd) && !execute_journal_command(cmd, JOURNAL_CONSUMER_BLE) &&
+        !execute_stats_command(cmd, true)) {
+        serial_log("[BLE Server] Unknown command: %s\n", cmd);
+    }
+}
+
+void execute_serial_command(const char* cmd)
+{
+    if (execute_signature_command(cmd) || execute_journal_command(cmd, JOURNAL_CONSUMER_SERIAL) ||
+        execute_stats_command(cmd, false)) {
+        return;
+    }
+    StaticJsonDocument<128> doc;
+    if (strcmp(cmd, "mode json") == 0) {
+        serial_output_mode = SERIAL_MODE_JSON;
+    } else if (strcmp(cmd, "mode binary") == 0) {
+        serial_output_mode = SERIAL_MODE_BINARY;
+    } else {
+        doc["event"] = "error";
+        doc["message"] = "unknown command";
+        emit_report(doc);
+        return;
+    }
+    doc["event"] = "serial_mode";
+    doc["mode"] = serial_output_mode == SERIAL_MODE_BINARY ? "binary" : "json";
+    doc["protocol_version"] = SERIAL_PROTOCOL_VERSION;
+    emit_report(doc);
+}
+
+// Collect newline-terminated commands without blocking loop()
+void handle_serial_commands()
+{
+    while (Serial.available() > 0) {
+        char c = (char)Serial.read();
+        if (c == '\r' || c == '\n') {
+            if (serial_command_len > 0) {
+                serial_command[serial_command_len] = '\0';
+                execute_serial_command(serial_command);
+                serial_command_len = 0;
+            }
+        } else if (serial_command_len < SERIAL_COMMAND_MAX - 1) {
+            serial_command[serial_command_len++] = c;
+        }
+    }
+}
+
 // ============================================================================
 // MAIN FUNCTIONS
 // ============================================================================
@@ -752,52 +2011,90 @@ void hop_channel()
 void setup()
 {
     Serial.begin(115200);
+    start_serial_tx_task();
     delay(1000);
     
     // Initialize RGB LED (FeatherS3)
     init_led();
     boot_led_sequence();
     
-    printf("Starting Flock Squawk Enhanced Detection System...\n\n");
+    serial_log("Starting Flock Squawk Enhanced Detection System...\n\n");
+    
+    // Build the SSID and device name matchers before any scanning starts
+    SignatureSet* builtin = signature_db.standby();
+    if (!build_builtin_signatures(builtin)) {
+        serial_log("ERROR: signature patterns exceed AC_MAX_NODES\n");
+    }
+    signature_db.activateStandby();
+    serial_log("Pattern matchers ready: %u SSID nodes, %u name nodes\n",
+               (unsigned)builtin->ssid().nodeCount(), (unsigned)builtin->names().nodeCount());
     
     // Initialize WiFi in promiscuous mode for surveillance device detection
-    printf("[WiFi] Initializing promiscuous scanning mode...\n");
+    serial_log("[WiFi] Initializing promiscuous scanning mode...\n");
     WiFi.mode(WIFI_STA);
     WiFi.disconnect();
     delay(100);
     
+    // Open the journal before the serial task that owns it starts
+    init_journal();
+    
+    // The last signature pack pushed to the board replaces the built-in set
+    load_stored_signatures();
+    
+    // Start the matching and output tasks before frames can arrive
+    start_pipeline_tasks();
+    
+    // Only management frames reach the callback; data and control frames are dropped in the driver
+    wifi_promiscuous_filter_t filter = {};
+    filter.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT;
+    esp_wifi_set_promiscuous_filter(&filter);
     esp_wifi_set_promiscuous(true);
     esp_wifi_set_promiscuous_rx_cb(&wifi_sniffer_packet_handler);
     esp_wifi_set_channel(current_channel, WIFI_SECOND_CHAN_NONE);
     
-    printf("WiFi promiscuous mode enabled on channel %d\n", current_channel);
-    printf("Monitoring probe requests and beacons...\n");
+    serial_log("WiFi promiscuous mode enabled on channel %d\n", current_channel);
+    serial_log("Monitoring probe requests, probe responses and beacons...\n");
     
     // Initialize BLE with device name for iOS app discovery
-    printf("Initializing BLE...\n");
+    serial_log("Initializing BLE...\n");
+    // Controller duplicate filtering has to be configured before init
+    NimBLEDevice::setScanFilterMode(BLE_DUPLICATE_MODE);
+    NimBLEDevice::setScanDuplicateCacheSize(BLE_DUPLICATE_CACHE_SIZE);
     NimBLEDevice::init("FlockFinder-S3");
     
     // Initialize BLE broadcast service for iOS app connection
     initBLEBroadcast();
+    setCommandCallback(handle_app_command);
+    setStreamReadyCallback(wake_notify_task);
     
     // Initialize BLE scanner for detecting surveillance devices
     pBLEScan = NimBLEDevice::getScan();
     pBLEScan->setAdvertisedDeviceCallbacks(new AdvertisedDeviceCallbacks());
-    pBLEScan->setActiveScan(true);
-    pBLEScan->setInterval(100);
-    pBLEScan->setWindow(99);
+    pBLEScan->setInterval(BLE_SCAN_INTERVAL_UNITS);
+    pBLEScan->setWindow(BLE_SCAN_INTERVAL_UNITS);
+    pBLEScan->setDuplicateFilter(true);
+    ble_scan_policy.begin(BLE_SCAN_PASSIVE_FIRST);
     
-    printf("BLE scanner initialized\n");
-    printf("System ready - hunting for Flock Safety devices...\n");
-    printf("iOS app can connect via Bluetooth to 'FlockFinder-S3'\n\n");
+    serial_log("BLE scanner initialized (%s)\n", BLE_SCAN_PASSIVE_FIRST ? "passive, active probes" : "active");
+    serial_log("System ready - hunting for Flock Safety devices...\n");
+    serial_log("iOS app can connect via Bluetooth to 'FlockFinder-S3'\n\n");
     
-    last_channel_hop = millis();
+    channel_scheduler.begin(millis(), current_channel, CHANNEL_HOP_ADAPTIVE, CHANNEL_HOP_INTERVAL);
+    radio_scheduler.begin(millis());
+    last_radio_report = millis();
+    last_pipeline_report = millis();
+    last_stats_report = millis();
 }
 
 void loop()
 {
-    // Handle channel hopping for WiFi promiscuous mode
-    hop_channel();
+    handle_serial_commands();
+    
+    // Hand the radio between WiFi and BLE, then hop channels while WiFi has it
+    run_radio_scheduler();
+    if (radio_scheduler.current() == RADIO_SLOT_WIFI) {
+        hop_channel();
+    }
     
     // Handle heartbeat pulse if device is in range
     if (device_in_range) {
@@ -809,23 +2106,37 @@ void loop()
             last_heartbeat = now;
         }
         
-        // Check if device has gone out of range (no detection for 30 seconds)
-        if (now - last_detection_time >= 30000) {
-            printf("Device out of range - stopping heartbeat\n");
+        // Check if every tracked device has gone out of range (no hits for 30 seconds)
+        size_t active;
+        {
+            std::lock_guard<std::mutex> lock(device_table_mutex);
+            active = device_table.activeCount(now, DEVICE_IN_RANGE_WINDOW);
+        }
+        if (active == 0) {
+            serial_log("Device out of range - stopping heartbeat\n");
             device_in_range = false;
-            triggered = false; // Allow new detections
+            led.setIdleColor(COLOR_SCANNING);
         }
     }
     
-    if (millis() - last_ble_scan >= BLE_SCAN_INTERVAL && !pBLEScan->isScanning()) {
-        streamStatus("BLE scan starting...");
-        pBLEScan->start(BLE_SCAN_DURATION, false);
-        last_ble_scan = millis();
+    // Forget devices that have not been seen for DEVICE_EXPIRY_MS
+    if (millis() - last_device_expiry >= DEVICE_EXPIRY_CHECK_INTERVAL) {
+        std::lock_guard<std::mutex> lock(device_table_mutex);
+        device_table.expire(millis(), DEVICE_EXPIRY_MS);
+        last_device_expiry = millis();
     }
     
-    if (pBLEScan->isScanning() == false && millis() - last_ble_scan > BLE_SCAN_DURATION * 1000) {
-        pBLEScan->clearResults();
+    if (millis() - last_radio_report >= RADIO_REPORT_INTERVAL) {
+        report_radio_stats();
+        last_radio_report = millis();
     }
     
-    delay(100);
+    if (millis() - last_pipeline_report >= PIPELINE_REPORT_INTERVAL) {
+        report_pipeline_stats();
+        last_pipeline_report = millis();
+    }
+    
+    service_stats();
+    
+    delay(LOOP_INTERVAL_MS);
 }
@@ -0,0 +1,81 @@
+#ifndef OUI_TABLE_H
+#define OUI_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// BINARY OUI MATCH TABLE
+// ============================================================================
+// Known MAC prefixes are stored as 24-bit integers and sorted at compile time,
+// so a lookup is a handful of integer compares on the raw 6-byte address.
+// No string formatting, no strncasecmp.
+
+// First three octets of a MAC address as a 24-bit integer
+static inline uint32_t oui_from_mac(const uint8_t* mac)
+{
+    return ((uint32_t)mac[0] << 16) | ((uint32_t)mac[1] << 8) | (uint32_t)mac[2];
+}
+
+template <size_t N>
+struct OuiTable {
+    uint32_t keys[N];
+
+    static constexpr size_t size() { return N; }
+};
+
+// Copy and insertion-sort the OUIs at compile time
+template <size_t N>
+constexpr OuiTable<N> make_oui_table(const uint32_t (&ouis)[N])
+{
+    OuiTable<N> table{};
+    for (size_t i = 0; i < N; i++) {
+        uint32_t key = ouis[i] & 0xFFFFFF;
+        size_t j = i;
+        while (j > 0 && table.keys[j - 1] > key) {
+            table.keys[j] = table.keys[j - 1];
+            j--;
+        }
+        table.keys[j] = key;
+    }
+    return table;
+}
+
+template <size_t N>
+constexpr bool oui_table_is_unique(const OuiTable<N>& table)
+{
+    for (size_t i = 1; i < N; i++) {
+        if (table.keys[i] == table.keys[i - 1]) return false;
+    }
+    return true;
+}
+
+// Binary search a sorted OUI array. Returns the index of the match or -1.
+static inline int oui_lookup(const uint32_t* keys, size_t count, uint32_t oui)
+{
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) >> 1;
+        if (keys[mid] < oui) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < count && keys[lo] == oui) ? (int)lo : -1;
+}
+
+// Format a 24-bit OUI as "xx:xx:xx" (buffer must hold 9 bytes)
+static inline void oui_format(uint32_t oui, char* out)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < 3; i++) {
+        uint8_t b = (oui >> (16 - 8 * i)) & 0xFF;
+        out[i * 3] = hex[b >> 4];
+        out[i * 3 + 1] = hex[b & 0x0F];
+        out[i * 3 + 2] = (i < 2) ? ':' : '\0';
+    }
+}
+
+#endif // OUI_TABLE_H
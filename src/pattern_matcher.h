@@ -0,0 +1,209 @@
+#ifndef PATTERN_MATCHER_H
+#define PATTERN_MATCHER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// MULTI-PATTERN MATCHER (case-folded Aho-Corasick)
+// ============================================================================
+// Built from a signature table (at boot, and again when a signature pack is
+// loaded), then scans an SSID or BLE device name in a single pass and
+// reports every matched pattern ID together with a bitmask of the device
+// families they belong to. Scan cost depends on the input length only, not
+// on how many patterns are loaded.
+
+#ifndef AC_MAX_NODES
+#define AC_MAX_NODES 1024       // Trie nodes (roughly total pattern characters)
+#endif
+#define AC_MAX_MATCHES 8        // Distinct pattern IDs reported per scan
+#define AC_NO_PATTERN 0xFFFF
+
+// Device families a signature can belong to
+enum device_family_t : uint8_t {
+    FAMILY_FLOCK = 0,
+    FAMILY_PENGUIN,
+    FAMILY_PIGVISION,
+    FAMILY_RAVEN,
+    FAMILY_COUNT
+};
+
+// Name shown to the iOS app and in JSON output for each family
+static inline const char* device_family_name(uint8_t family)
+{
+    switch (family) {
+        case FAMILY_FLOCK:     return "Flock Safety";
+        case FAMILY_PENGUIN:   return "Penguin";
+        case FAMILY_PIGVISION: return "Pigvision";
+        case FAMILY_RAVEN:     return "Raven (Gunshot Detector)";
+        default:               return "Unknown";
+    }
+}
+
+typedef struct {
+    const char* pattern;   // Matched case-insensitively anywhere in the input
+    uint8_t family;
+} name_signature_t;
+
+typedef struct {
+    uint8_t count;                  // Number of distinct patterns matched
+    uint16_t first;                 // Lowest matched pattern ID (AC_NO_PATTERN if none)
+    uint32_t family_mask;           // Bit per device_family_t
+    uint8_t tail;                   // Length of the longest pattern prefix the input ends with
+    uint16_t ids[AC_MAX_MATCHES];
+} ac_result_t;
+
+class AhoCorasick {
+public:
+    // Build the automaton. Returns false if the patterns do not fit in
+    // AC_MAX_NODES or the link pass cannot get its scratch queue.
+    bool build(const name_signature_t* signatures, size_t count) {
+        signatures_ = signatures;
+        signature_count_ = 0;
+        node_count_ = 1;
+        memset(&nodes_[0], 0, sizeof(nodes_[0]));
+        nodes_[0].pattern = AC_NO_PATTERN;
+        memset(root_next_, 0, sizeof(root_next_));
+
+        for (size_t i = 0; i < count; i++) {
+            if (!insert(signatures[i].pattern, (uint16_t)i)) {
+                return false;
+            }
+        }
+        if (!link()) {
+            return false;
+        }
+        signature_count_ = count;
+        return true;
+    }
+
+    void scan(const char* text, size_t len, ac_result_t* result) const {
+        result->count = 0;
+        result->first = AC_NO_PATTERN;
+        result->family_mask = 0;
+
+        uint16_t state = 0;
+        for (size_t i = 0; i < len; i++) {
+            uint8_t ch = fold((uint8_t)text[i]);
+            state = step(state, ch);
+
+            uint16_t out = (nodes_[state].pattern != AC_NO_PATTERN) ? state : nodes_[state].dict;
+            while (out) {
+                record(nodes_[out].pattern, result);
+                out = nodes_[out].dict;
+            }
+        }
+        // A truncated name (e.g. a shortened local name) ends part way into a pattern
+        result->tail = nodes_[state].depth;
+    }
+
+    size_t nodeCount() const { return node_count_; }
+    size_t patternCount() const { return signature_count_; }
+    size_t memoryBytes() const { return node_count_ * sizeof(Node); }
+    const name_signature_t& signature(uint16_t id) const { return signatures_[id]; }
+
+private:
+    struct Node {
+        uint16_t first_child;
+        uint16_t next_sibling;
+        uint16_t fail;
+        uint16_t dict;       // Next node on the fail chain that ends a pattern
+        uint16_t pattern;    // Pattern ending here, or AC_NO_PATTERN
+        uint8_t ch;
+        uint8_t depth;       // Characters from the root (capped at 255)
+    };
+
+    static uint8_t fold(uint8_t c) {
+        return (c >= 'A' && c <= 'Z') ? (uint8_t)(c + 32) : c;
+    }
+
+    uint16_t child(uint16_t node, uint8_t ch) const {
+        if (node == 0) return root_next_[ch];
+        for (uint16_t c = nodes_[node].first_child; c; c = nodes_[c].next_sibling) {
+            if (nodes_[c].ch == ch) return c;
+        }
+        return 0;
+    }
+
+    uint16_t step(uint16_t state, uint8_t ch) const {
+        for (;;) {
+            uint16_t next = child(state, ch);
+            if (next || state == 0) return next;
+            state = nodes_[state].fail;
+        }
+    }
+
+    bool insert(const char* pattern, uint16_t id) {
+        if (!pattern || !pattern[0]) return true;
+        uint16_t node = 0;
+        for (const char* p = pattern; *p; p++) {
+            uint8_t ch = fold((uint8_t)*p);
+            uint16_t next = child(node, ch);
+            if (!next) {
+                if (node_count_ >= AC_MAX_NODES) return false;
+                next = (uint16_t)node_count_++;
+                memset(&nodes_[next], 0, sizeof(nodes_[next]));
+                nodes_[next].ch = ch;
+                nodes_[next].depth = nodes_[node].depth < 255 ? nodes_[node].depth + 1 : 255;
+                nodes_[next].pattern = AC_NO_PATTERN;
+                if (node == 0) {
+                    root_next_[ch] = next;
+                }
+                nodes_[next].next_sibling = nodes_[node].first_child;
+                nodes_[node].first_child = next;
+            }
+            node = next;
+        }
+        // Keep the lowest ID if two signatures fold to the same pattern
+        if (nodes_[node].pattern == AC_NO_PATTERN) {
+            nodes_[node].pattern = id;
+        }
+        return true;
+    }
+
+    // Breadth-first pass to fill in fail and dictionary links. The queue
+    // (one entry per non-root node) lives only for the pass, so builders on
+    // different tasks do not share it and it costs no RAM between builds.
+    bool link() {
+        uint16_t* queue = (uint16_t*)malloc(node_count_ * sizeof(uint16_t));
+        if (!queue) return false;
+        size_t head = 0, tail = 0;
+        for (uint16_t c = nodes_[0].first_child; c; c = nodes_[c].next_sibling) {
+            nodes_[c].fail = 0;
+            nodes_[c].dict = 0;
+            queue[tail++] = c;
+        }
+        while (head < tail) {
+            uint16_t u = queue[head++];
+            for (uint16_t c = nodes_[u].first_child; c; c = nodes_[c].next_sibling) {
+                uint16_t f = step(nodes_[u].fail, nodes_[c].ch);
+                nodes_[c].fail = f;
+                nodes_[c].dict = (nodes_[f].pattern != AC_NO_PATTERN) ? f : nodes_[f].dict;
+                queue[tail++] = c;
+            }
+        }
+        free(queue);
+        return true;
+    }
+
+    void record(uint16_t id, ac_result_t* result) const {
+        for (uint8_t i = 0; i < result->count; i++) {
+            if (result->ids[i] == id) return;
+        }
+        if (result->count < AC_MAX_MATCHES) {
+            result->ids[result->count++] = id;
+        }
+        if (id < result->first) result->first = id;
+        result->family_mask |= 1UL << signatures_[id].family;
+    }
+
+    Node nodes_[AC_MAX_NODES];
+    uint16_t root_next_[256];
+    size_t node_count_ = 0;
+    const name_signature_t* signatures_ = nullptr;
+    size_t signature_count_ = 0;
+};
+
+#endif // PATTERN_MATCHER_H
@@ -0,0 +1,127 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "frame_queue.h"
+#include "detection_event.h"
+
+// ============================================================================
+// CAPTURE -> MATCH -> OUTPUT TASK PIPELINE
+// ============================================================================
+// The radio callbacks only copy what they captured into SPSC queues. One
+// matching task, pinned to PIPELINE_MATCH_CORE, drains them, runs the
+// pattern matchers and the device table, and hands each reportable detection
+// (a detection_event_t) to the output tasks on PIPELINE_OUTPUT_CORE: serial
+// (JSON or binary), BLE (GATT notify and stream flushing) and LED (alerts and
+// animation). Every queue has exactly one producer and one consumer. The
+// serial_tx task, also on the output core, is the only writer to the port
+// (see serial_tx.h).
+//
+// On the dual-core S3 the radio drivers and the NimBLE host run on core 0
+// and loop() on core 1, so matching shares core 1 with loop() and the output
+// tasks sit next to the BLE stack they notify through.
+
+#if defined(CONFIG_FREERTOS_UNICORE) && CONFIG_FREERTOS_UNICORE
+#define PIPELINE_DEFAULT_MATCH_CORE 0
+#define PIPELINE_DEFAULT_OUTPUT_CORE 0
+#else
+#define PIPELINE_DEFAULT_MATCH_CORE 1
+#define PIPELINE_DEFAULT_OUTPUT_CORE 0
+#endif
+
+#ifndef PIPELINE_MATCH_CORE
+#define PIPELINE_MATCH_CORE PIPELINE_DEFAULT_MATCH_CORE
+#endif
+#ifndef PIPELINE_OUTPUT_CORE
+#define PIPELINE_OUTPUT_CORE PIPELINE_DEFAULT_OUTPUT_CORE
+#endif
+
+#define MATCH_TASK_STACK_SIZE 6144
+#define MATCH_TASK_PRIORITY 3
+#define SERIAL_TASK_STACK_SIZE 6144     // ArduinoJson documents live on this stack
+#define SERIAL_TASK_PRIORITY 2
+#define SERIAL_TX_TASK_STACK_SIZE 2048  // Writer of the serial_tx.h queue
+#define SERIAL_TX_TASK_PRIORITY 2
+#define NOTIFY_TASK_STACK_SIZE 4096
+#define NOTIFY_TASK_PRIORITY 2
+#define LED_TASK_STACK_SIZE 2048
+#define LED_TASK_PRIORITY 1
+
+// Queue capacities (powers of two)
+#ifndef BLE_ADV_QUEUE_SIZE
+#define BLE_ADV_QUEUE_SIZE 32
+#endif
+#ifndef SERIAL_EVENT_QUEUE_SIZE
+#define SERIAL_EVENT_QUEUE_SIZE 16
+#endif
+#ifndef NOTIFY_EVENT_QUEUE_SIZE
+#define NOTIFY_EVENT_QUEUE_SIZE 8
+#endif
+#define LED_EVENT_QUEUE_SIZE 4
+
+#define PIPELINE_IDLE_WAIT_MS 100       // Longest a task sleeps without a notification
+#define NOTIFY_TICK_MS 20               // BLE output task wakes this often to flush stream batches
+
+// Fields copied out of a BLE advertisement by the scan callback
+typedef struct {
+    uint8_t mac[6];        // Display order
+    uint8_t addr_type;     // BLE_ADDR_PUBLIC / BLE_ADDR_RANDOM
+    bool scannable;        // Advertiser accepts scan requests
+    int8_t rssi;
+    uint8_t name_len;
+    char name[33];         // NUL-terminated, truncated to 32 bytes
+    bool has_services;
+    uint8_t service_count; // Entries used in services[]
+    ble_uuid_any_t services[BLE_ADV_MAX_SERVICES];
+} sniffed_adv_t;
+
+// Per-task accounting. Only the task itself writes busy_us and items.
+typedef struct {
+    const char* name;
+    TaskHandle_t handle;
+    int8_t core;
+    uint32_t stack_size;
+    std::atomic<uint32_t> busy_us;   // Wraps after ~71 minutes; reports use deltas
+    std::atomic<uint32_t> items;
+    uint32_t reported_busy_us;       // Values at the previous report
+    uint32_t reported_at_us;
+} pipeline_task_t;
+
+// Time a unit of work and charge it to the task
+class PipelineWork {
+public:
+    explicit PipelineWork(pipeline_task_t* task) : task_(task), start_(micros()) {}
+    ~PipelineWork() {
+        task_->busy_us.fetch_add((uint32_t)(micros() - start_), std::memory_order_relaxed);
+    }
+
+private:
+    pipeline_task_t* task_;
+    uint32_t start_;
+};
+
+static inline void pipeline_task_create(pipeline_task_t* task, TaskFunction_t fn, const char* name,
+                                        uint32_t stack_size, UBaseType_t priority, int8_t core)
+{
+    task->name = name;
+    task->core = core;
+    task->stack_size = stack_size;
+    task->busy_us.store(0, std::memory_order_relaxed);
+    task->items.store(0, std::memory_order_relaxed);
+    task->reported_busy_us = 0;
+    task->reported_at_us = micros();
+    xTaskCreatePinnedToCore(fn, name, stack_size, task, priority, &task->handle, core);
+}
+
+static inline void pipeline_task_wake(const pipeline_task_t& task)
+{
+    if (task.handle) xTaskNotifyGive(task.handle);
+}
+
+#endif // PIPELINE_H
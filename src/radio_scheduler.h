@@ -0,0 +1,148 @@
+#ifndef RADIO_SCHEDULER_H
+#define RADIO_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// ============================================================================
+// WIFI / BLE RADIO TIME-SLICING
+// ============================================================================
+// The ESP32 has one 2.4 GHz radio. Instead of leaving the split between
+// promiscuous WiFi and BLE scanning to whatever the coexistence arbiter makes
+// of our timing, every RADIO_CYCLE_MS is divided into a WiFi slot followed by
+// one BLE slot, during which the BLE scanner runs continuously (scan window
+// equal to the scan interval). The BLE share starts at RADIO_BLE_SHARE_PCT
+// and moves by RADIO_SHARE_STEP_PCT per cycle toward whichever radio is
+// producing more detections per second of airtime, within
+// RADIO_BLE_SHARE_MIN_PCT..RADIO_BLE_SHARE_MAX_PCT. With no detections on
+// either side it drifts back to the configured share.
+//
+// noteDetection() is called from the matching task (WiFi frames and BLE
+// adverts alike) and tick() from loop(), so the counters are atomics.
+
+#ifndef RADIO_CYCLE_MS
+#define RADIO_CYCLE_MS 2000           // One WiFi slot + one BLE slot
+#endif
+#ifndef RADIO_BLE_SHARE_PCT
+#define RADIO_BLE_SHARE_PCT 30        // Configured BLE share of each cycle
+#endif
+#ifndef RADIO_BLE_SHARE_MIN_PCT
+#define RADIO_BLE_SHARE_MIN_PCT 10
+#endif
+#ifndef RADIO_BLE_SHARE_MAX_PCT
+#define RADIO_BLE_SHARE_MAX_PCT 60
+#endif
+#ifndef RADIO_SHARE_STEP_PCT
+#define RADIO_SHARE_STEP_PCT 5        // Share moved per cycle when yields differ
+#endif
+#ifndef RADIO_ADAPTIVE_SHARE
+#define RADIO_ADAPTIVE_SHARE 1        // 0 = fixed RADIO_BLE_SHARE_PCT
+#endif
+
+enum radio_slot_t : uint8_t {
+    RADIO_SLOT_WIFI = 0,
+    RADIO_SLOT_BLE,
+    RADIO_SLOT_COUNT
+};
+
+typedef struct {
+    uint64_t airtime_ms;        // Total time spent in this radio's slots
+    uint32_t slots;             // Slots started
+    uint32_t detections;        // Reported detections from this radio
+    uint32_t last_slot_ms;      // Length of the most recent slot
+} radio_slot_stats_t;
+
+class RadioScheduler {
+public:
+    void begin(uint32_t now) {
+        ble_share_ = RADIO_BLE_SHARE_PCT;
+        for (int i = 0; i < RADIO_SLOT_COUNT; i++) {
+            stats_[i] = {};
+            cycle_detections_[i].store(0, std::memory_order_relaxed);
+            yield_[i] = 0;
+        }
+        start(RADIO_SLOT_WIFI, now);
+    }
+
+    // A detection worth reporting (not a duplicate hit) from either radio
+    void noteDetection(radio_slot_t radio) {
+        cycle_detections_[radio].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns true when the slot changed; current() is then the new slot
+    bool tick(uint32_t now) {
+        if ((int32_t)(now - slot_end_) < 0) return false;
+        finish(now);
+        if (slot_ == RADIO_SLOT_WIFI) {
+            start(RADIO_SLOT_BLE, now);
+        } else {
+            adapt();
+            start(RADIO_SLOT_WIFI, now);
+        }
+        return true;
+    }
+
+    radio_slot_t current() const { return slot_; }
+    uint8_t bleSharePct() const { return ble_share_; }
+    const radio_slot_stats_t& stats(radio_slot_t radio) const { return stats_[radio]; }
+    // Smoothed detections per minute of airtime
+    uint32_t yieldPerMinute(radio_slot_t radio) const { return yield_[radio] >> 4; }
+
+private:
+    void start(radio_slot_t slot, uint32_t now) {
+        slot_ = slot;
+        slot_start_ = now;
+        uint32_t ble_ms = RADIO_CYCLE_MS * ble_share_ / 100;
+        slot_end_ = now + (slot == RADIO_SLOT_BLE ? ble_ms : RADIO_CYCLE_MS - ble_ms);
+        stats_[slot].slots++;
+    }
+
+    void finish(uint32_t now) {
+        radio_slot_stats_t& s = stats_[slot_];
+        uint32_t elapsed = now - slot_start_;
+        s.airtime_ms += elapsed;
+        s.last_slot_ms = elapsed;
+        cycle_airtime_[slot_] = elapsed;
+    }
+
+    // Once per cycle, after both slots have run
+    void adapt() {
+        for (int i = 0; i < RADIO_SLOT_COUNT; i++) {
+            uint32_t hits = cycle_detections_[i].exchange(0, std::memory_order_relaxed);
+            stats_[i].detections += hits;
+            uint32_t airtime = cycle_airtime_[i] ? cycle_airtime_[i] : 1;
+            // Detections/minute in 1/16 units, smoothed 1/8 per cycle
+            uint32_t rate = (uint32_t)((uint64_t)hits * 60000 * 16 / airtime);
+            yield_[i] = yield_[i] - (yield_[i] >> 3) + (rate >> 3);
+        }
+        if (!RADIO_ADAPTIVE_SHARE) return;
+
+        uint32_t wifi = yield_[RADIO_SLOT_WIFI];
+        uint32_t ble = yield_[RADIO_SLOT_BLE];
+        int target;
+        if (wifi == 0 && ble == 0) {
+            target = RADIO_BLE_SHARE_PCT;
+        } else {
+            // Share proportional to yield, clamped to the configured range
+            target = (int)((uint64_t)ble * 100 / (wifi + ble));
+            if (target < RADIO_BLE_SHARE_MIN_PCT) target = RADIO_BLE_SHARE_MIN_PCT;
+            if (target > RADIO_BLE_SHARE_MAX_PCT) target = RADIO_BLE_SHARE_MAX_PCT;
+        }
+        int share = ble_share_;
+        if (share < target) share = share + RADIO_SHARE_STEP_PCT > target ? target : share + RADIO_SHARE_STEP_PCT;
+        if (share > target) share = share - RADIO_SHARE_STEP_PCT < target ? target : share - RADIO_SHARE_STEP_PCT;
+        ble_share_ = (uint8_t)share;
+    }
+
+    radio_slot_t slot_ = RADIO_SLOT_WIFI;
+    uint32_t slot_start_ = 0;
+    uint32_t slot_end_ = 0;
+    uint8_t ble_share_ = RADIO_BLE_SHARE_PCT;
+    uint32_t cycle_airtime_[RADIO_SLOT_COUNT] = {};
+    uint32_t yield_[RADIO_SLOT_COUNT] = {};
+    radio_slot_stats_t stats_[RADIO_SLOT_COUNT] = {};
+    std::atomic<uint32_t> cycle_detections_[RADIO_SLOT_COUNT];
+};
+
+#endif // RADIO_SCHEDULER_H
@@ -0,0 +1,214 @@
+#ifndef SERIAL_PROTOCOL_H
+#define SERIAL_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ============================================================================
+// BINARY SERIAL PROTOCOL (COBS + CRC-16)
+// ============================================================================
+// Compact alternative to the JSON detection lines. Each record is a packed
+// little-endian struct with enum codes in place of strings, followed by a
+// CRC-16/CCITT-FALSE, COBS-encoded and wrapped in 0x00 delimiters:
+//
+//   0x00 | COBS( version | type | payload... | crc16 ) | 0x00
+//
+// Detections that went through the on-device journal (journal.h) are sent as
+// WIRE_MSG_JOURNAL: a sequence number and flags followed by the complete
+// detection record, so a host can acknowledge and de-duplicate them.
+//
+// COBS output never contains 0x00 and JSON/text lines never do either, so a
+// reader can tell the two apart on the same stream and resynchronise on the
+// next delimiter after line noise. api/flock_protocol.py is the decoder.
+
+#define SERIAL_PROTOCOL_VERSION 1
+
+#define SERIAL_MODE_JSON   0
+#define SERIAL_MODE_BINARY 1
+
+#ifndef SERIAL_OUTPUT_MODE
+#define SERIAL_OUTPUT_MODE SERIAL_MODE_JSON   // Override with -DSERIAL_OUTPUT_MODE=SERIAL_MODE_BINARY
+#endif
+
+#define WIRE_NAME_MAX 32        // SSIDs are at most 32 bytes; BLE names are truncated
+
+enum wire_msg_type_t : uint8_t {
+    WIRE_MSG_DETECTION = 1,
+    WIRE_MSG_JOURNAL,
+    WIRE_MSG_STATS             // wire_stats_t, see instrumentation.h
+};
+
+// Replaces the detection_method strings
+enum wire_method_t : uint8_t {
+    WIRE_METHOD_PROBE_REQUEST = 1,
+    WIRE_METHOD_PROBE_REQUEST_MAC,
+    WIRE_METHOD_BEACON,
+    WIRE_METHOD_BEACON_MAC,
+    WIRE_METHOD_BLE_MAC_PREFIX,
+    WIRE_METHOD_BLE_DEVICE_NAME,
+    WIRE_METHOD_BLE_RAVEN_SERVICE,
+    WIRE_METHOD_PROBE_RESPONSE,
+    WIRE_METHOD_PROBE_RESPONSE_MAC
+};
+
+// The detection_method string the JSON output uses for each method
+static inline const char* wire_method_name(uint8_t method)
+{
+    switch (method) {
+        case WIRE_METHOD_PROBE_REQUEST:      return "probe_request";
+        case WIRE_METHOD_PROBE_REQUEST_MAC:  return "probe_request_mac";
+        case WIRE_METHOD_BEACON:             return "beacon";
+        case WIRE_METHOD_BEACON_MAC:         return "beacon_mac";
+        case WIRE_METHOD_BLE_MAC_PREFIX:     return "mac_prefix";
+        case WIRE_METHOD_BLE_DEVICE_NAME:    return "device_name";
+        case WIRE_METHOD_BLE_RAVEN_SERVICE:  return "raven_service_uuid";
+        case WIRE_METHOD_PROBE_RESPONSE:     return "probe_response";
+        case WIRE_METHOD_PROBE_RESPONSE_MAC: return "probe_response_mac";
+        default:                             return "unknown";
+    }
+}
+
+// WiFi methods carry an SSID, BLE methods a device name
+static inline bool wire_method_is_wifi(uint8_t method)
+{
+    return method < WIRE_METHOD_BLE_MAC_PREFIX || method > WIRE_METHOD_BLE_RAVEN_SERVICE;
+}
+
+#define WIRE_NO_PATTERN 0xFF
+
+// Only the first name_len bytes of name[] are sent
+typedef struct __attribute__((packed)) {
+    uint8_t version;           // SERIAL_PROTOCOL_VERSION
+    uint8_t type;              // wire_msg_type_t
+    uint32_t timestamp_ms;     // millis() when the record was built
+    uint8_t mac[6];
+    int8_t rssi;
+    uint8_t channel;           // 0 for BLE
+    uint8_t method;            // wire_method_t
+    uint8_t family;            // device_family_t
+    uint8_t match_flags;       // MATCH_* from device_table.h
+    uint8_t report;            // device_report_t
+    uint8_t pattern_id;        // First matched SSID/name signature, WIRE_NO_PATTERN if none
+    uint8_t raven_mask;        // Bit per raven_service_uuids entry
+    uint32_t hits;
+    uint32_t first_seen_ms;
+    uint32_t last_seen_ms;
+    int8_t rssi_min;
+    int8_t rssi_max;
+    int8_t rssi_avg;
+    uint16_t channels;         // Bit n set if seen on WiFi channel n
+    uint8_t name_len;
+    char name[WIRE_NAME_MAX];  // SSID or BLE device name, not NUL-terminated
+} wire_detection_t;
+
+#define WIRE_DETECTION_HEADER_SIZE offsetof(wire_detection_t, name)
+
+#define WIRE_JOURNAL_REPLAYED 0x01   // Read back from flash, not live
+
+// Journaled detection; only the used part of detection is sent
+typedef struct __attribute__((packed)) {
+    uint8_t version;           // SERIAL_PROTOCOL_VERSION
+    uint8_t type;              // WIRE_MSG_JOURNAL
+    uint32_t seq;              // Journal sequence number, never 0
+    uint8_t flags;             // WIRE_JOURNAL_*
+    wire_detection_t detection;
+} wire_journal_t;
+
+#define WIRE_JOURNAL_HEADER_SIZE offsetof(wire_journal_t, detection)
+
+#define WIRE_PAYLOAD_MAX 192   // Largest message wire_frame() accepts (wire_stats_t)
+static_assert(sizeof(wire_journal_t) <= WIRE_PAYLOAD_MAX, "wire_journal_t exceeds WIRE_PAYLOAD_MAX");
+
+// Worst-case encoded size of a payload: COBS overhead, CRC and both delimiters
+#define WIRE_FRAME_MAX(payload_len) ((payload_len) + 2 + ((payload_len) + 2) / 254 + 1 + 2)
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF); matches Python's binascii.crc_hqx(data, 0xFFFF)
+static inline uint16_t wire_crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF)
+{
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Consistent Overhead Byte Stuffing. out must hold len + len / 254 + 1 bytes.
+// Returns the encoded length.
+static inline size_t cobs_encode(const uint8_t* in, size_t len, uint8_t* out)
+{
+    size_t code_pos = 0;
+    size_t out_pos = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            out[code_pos] = code;
+            code_pos = out_pos++;
+            code = 1;
+        } else {
+            out[out_pos++] = in[i];
+            if (++code == 0xFF) {
+                out[code_pos] = code;
+                code_pos = out_pos++;
+                code = 1;
+            }
+        }
+    }
+    out[code_pos] = code;
+    return out_pos;
+}
+
+// Build a complete delimited frame from a payload (version and type included).
+// out must hold WIRE_FRAME_MAX(len) bytes. Returns the number of bytes to send.
+static inline size_t wire_frame(const uint8_t* payload, size_t len, uint8_t* out)
+{
+    uint8_t raw[WIRE_PAYLOAD_MAX + 2];
+    if (len > sizeof(raw) - 2) return 0;
+    memcpy(raw, payload, len);
+    uint16_t crc = wire_crc16(payload, len);
+    raw[len] = crc & 0xFF;
+    raw[len + 1] = crc >> 8;
+
+    out[0] = 0x00;
+    size_t n = cobs_encode(raw, len + 2, out + 1);
+    out[n + 1] = 0x00;
+    return n + 2;
+}
+
+// Fill the common header of a detection record and copy in the name
+static inline size_t wire_detection_init(wire_detection_t* rec, uint32_t now, const uint8_t* mac,
+                                         int8_t rssi, uint8_t channel, uint8_t method,
+                                         const char* name, size_t name_len)
+{
+    memset(rec, 0, WIRE_DETECTION_HEADER_SIZE);
+    rec->version = SERIAL_PROTOCOL_VERSION;
+    rec->type = WIRE_MSG_DETECTION;
+    rec->timestamp_ms = now;
+    memcpy(rec->mac, mac, sizeof(rec->mac));
+    rec->rssi = rssi;
+    rec->channel = channel;
+    rec->method = method;
+    rec->pattern_id = WIRE_NO_PATTERN;
+    if (name_len > WIRE_NAME_MAX) name_len = WIRE_NAME_MAX;
+    rec->name_len = (uint8_t)name_len;
+    if (name_len) memcpy(rec->name, name, name_len);
+    return WIRE_DETECTION_HEADER_SIZE + name_len;
+}
+
+// Wrap a detection record of len bytes (header and name) in a journal
+// message. Returns the payload length.
+static inline size_t wire_journal_init(wire_journal_t* msg, uint32_t seq, uint8_t flags,
+                                       const uint8_t* detection, size_t len)
+{
+    if (len > sizeof(msg->detection)) len = sizeof(msg->detection);
+    msg->version = SERIAL_PROTOCOL_VERSION;
+    msg->type = WIRE_MSG_JOURNAL;
+    msg->seq = seq;
+    msg->flags = flags;
+    memcpy(&msg->detection, detection, len);
+    return WIRE_JOURNAL_HEADER_SIZE + len;
+}
+
+#endif // SERIAL_PROTOCOL_H
@@ -0,0 +1,289 @@
+#ifndef SERIAL_TX_H
+#define SERIAL_TX_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include "instrumentation.h"
+
+// ============================================================================
+// PRIORITIZED SERIAL TX QUEUE
+// ============================================================================
+// Nothing but the serial_tx writer task touches the UART/CDC. Every other
+// task hands it whole messages (a JSON line, a COBS frame, a log line) that
+// are copied into one bounded byte ring per priority class:
+//
+//   detection  detection lines and frames, journal replays
+//   stats      reports (stats, pipeline, radio, journal...) and command replies
+//   log        human-readable debug lines
+//
+// A producer only takes the queue mutex for the memcpy and never waits for
+// the port. The writer sends no more than Serial.availableForWrite() at a
+// time, finishes the message it started, then takes the next one from the
+// highest class with anything queued.
+//
+// When a class fills up (the port is slower than its producers) it sheds
+// load in its own way, and the drops are counted per class:
+//   detection  the new message is dropped; it stays in the journal and the
+//              gap in sequence numbers tells the host to replay it
+//   stats      the oldest reports are evicted so the newest survive
+//   log        the new line is dropped; one "[Serial] N log lines dropped"
+//              line replaces the run once there is room again
+//
+// Classes never take each other's space, so debug output cannot push out
+// detections; under sustained backpressure the lower classes starve first.
+
+#ifndef SERIAL_TX_DETECTION_BYTES
+#define SERIAL_TX_DETECTION_BYTES 8192   // Power of two
+#endif
+#ifndef SERIAL_TX_STATS_BYTES
+#define SERIAL_TX_STATS_BYTES 4096       // Holds a full "stats" line
+#endif
+#ifndef SERIAL_TX_LOG_BYTES
+#define SERIAL_TX_LOG_BYTES 2048
+#endif
+#define SERIAL_TX_CHUNK 256              // Largest single Serial.write
+#define SERIAL_TX_POLL_MS 5              // Writer wake interval while the port is backed up
+#define SERIAL_TX_LOG_LINE_MAX 192       // Longer log lines are truncated
+#define SERIAL_TX_MSG_HEADER 2           // Length prefix of each queued message
+
+enum serial_tx_class_t : uint8_t {
+    SERIAL_TX_DETECTION = 0,
+    SERIAL_TX_STATS,
+    SERIAL_TX_LOG,
+    SERIAL_TX_CLASS_COUNT
+};
+
+static inline const char* serial_tx_class_name(uint8_t cls)
+{
+    static const char* const names[SERIAL_TX_CLASS_COUNT] = { "detection", "stats", "log" };
+    return cls < SERIAL_TX_CLASS_COUNT ? names[cls] : "unknown";
+}
+
+// Per-class accounting, in bytes except for the message counts
+typedef struct {
+    uint32_t capacity;
+    uint32_t depth;
+    uint32_t high_water;
+    uint32_t pushed;       // Messages accepted
+    uint32_t dropped;      // Messages refused or evicted
+} serial_tx_stats_t;
+
+typedef struct {
+    uint8_t* buf;
+    uint32_t size;         // Power of two
+    uint32_t head;         // Free-running byte positions
+    uint32_t tail;
+    uint32_t messages;     // Whole messages queued, not counting one being sent
+    uint32_t high_water;
+    uint32_t pushed;
+    uint32_t dropped;
+    uint32_t unreported;   // Log lines dropped since the last marker
+} serial_tx_ring_t;
+
+class SerialTxQueue {
+public:
+    SerialTxQueue() {
+        initRing(SERIAL_TX_DETECTION, detection_buf_, sizeof(detection_buf_));
+        initRing(SERIAL_TX_STATS, stats_buf_, sizeof(stats_buf_));
+        initRing(SERIAL_TX_LOG, log_buf_, sizeof(log_buf_));
+    }
+
+    // The task woken when the queue goes from empty to non-empty
+    void begin(TaskHandle_t writer) { writer_ = writer; }
+
+    // Producer side, any task. Returns false if the message was dropped.
+    bool push(uint8_t cls, const uint8_t* data, size_t len) {
+        if (!len || cls >= SERIAL_TX_CLASS_COUNT) return false;
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            serial_tx_ring_t& r = rings_[cls];
+            uint32_t need = (uint32_t)len + SERIAL_TX_MSG_HEADER;
+            if (need > r.size) {
+                r.dropped++;
+                return false;
+            }
+            if (cls == SERIAL_TX_STATS) {
+                // Keep the newest reports; a message already being sent stays
+                while (freeBytes(r) < need && r.messages && !(active_ == cls && partial_)) {
+                    evictOldest(r);
+                }
+            }
+            if (cls == SERIAL_TX_LOG && r.unreported) {
+                char marker[48];
+                int n = snprintf(marker, sizeof(marker), "[Serial] %u log lines dropped\n", (unsigned)r.unreported);
+                if (freeBytes(r) >= need + n + SERIAL_TX_MSG_HEADER) {
+                    put(r, (const uint8_t*)marker, n);
+                    r.unreported = 0;
+                }
+            }
+            if (freeBytes(r) < need || r.unreported) {
+                r.dropped++;
+                if (cls == SERIAL_TX_LOG) r.unreported++;
+                return false;
+            }
+            wake = queued_.load(std::memory_order_relaxed) == 0;
+            put(r, data, len);
+            r.pushed++;
+        }
+        if (wake && writer_) xTaskNotifyGive(writer_);
+        return true;
+    }
+
+    // Writer side (serial_tx task only). Sends whatever the TX buffer takes
+    // and returns the number of messages completed.
+    size_t drain() {
+        size_t completed = 0;
+        uint8_t chunk[SERIAL_TX_CHUNK];
+        for (;;) {
+            size_t room = (size_t)Serial.availableForWrite();
+            if (!room) break;
+            size_t n;
+            bool finished;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!partial_ && !startNext(room)) break;
+                serial_tx_ring_t& r = rings_[active_];
+                n = partial_;
+                if (n > room) n = room;
+                if (n > sizeof(chunk)) n = sizeof(chunk);
+                copyOut(r, chunk, n);
+                partial_ -= n;
+                queued_.fetch_sub((uint32_t)n, std::memory_order_relaxed);
+                finished = partial_ == 0;
+            }
+            {
+                INSTRUMENT_SCOPE(STAGE_EMIT);
+                Serial.write(chunk, n);
+            }
+            if (finished) completed++;
+        }
+        return completed;
+    }
+
+    bool pending() const { return queued_.load(std::memory_order_relaxed) != 0; }
+
+    // Bytes a message of this class can use right now
+    size_t room(uint8_t cls) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t free = freeBytes(rings_[cls]);
+        return free > SERIAL_TX_MSG_HEADER ? free - SERIAL_TX_MSG_HEADER : 0;
+    }
+
+    serial_tx_stats_t stats(uint8_t cls) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const serial_tx_ring_t& r = rings_[cls];
+        serial_tx_stats_t st;
+        st.capacity = r.size;
+        st.depth = r.head - r.tail;
+        st.high_water = r.high_water;
+        st.pushed = r.pushed;
+        st.dropped = r.dropped;
+        return st;
+    }
+
+private:
+    void initRing(uint8_t cls, uint8_t* buf, uint32_t size) {
+        memset(&rings_[cls], 0, sizeof(rings_[cls]));
+        rings_[cls].buf = buf;
+        rings_[cls].size = size;
+    }
+
+    static uint32_t freeBytes(const serial_tx_ring_t& r) { return r.size - (r.head - r.tail); }
+
+    static void copyIn(serial_tx_ring_t& r, const uint8_t* data, size_t len) {
+        uint32_t pos = r.head & (r.size - 1);
+        size_t first = len < r.size - pos ? len : r.size - pos;
+        memcpy(r.buf + pos, data, first);
+        memcpy(r.buf, data + first, len - first);
+        r.head += len;
+    }
+
+    static void copyOut(serial_tx_ring_t& r, uint8_t* out, size_t len) {
+        uint32_t pos = r.tail & (r.size - 1);
+        size_t first = len < r.size - pos ? len : r.size - pos;
+        memcpy(out, r.buf + pos, first);
+        memcpy(out + first, r.buf, len - first);
+        r.tail += len;
+    }
+
+    void put(serial_tx_ring_t& r, const uint8_t* data, size_t len) {
+        uint8_t header[SERIAL_TX_MSG_HEADER] = { (uint8_t)(len & 0xFF), (uint8_t)(len >> 8) };
+        copyIn(r, header, sizeof(header));
+        copyIn(r, data, len);
+        r.messages++;
+        if (r.head - r.tail > r.high_water) r.high_water = r.head - r.tail;
+        queued_.fetch_add((uint32_t)len, std::memory_order_relaxed);
+    }
+
+    uint32_t takeHeader(serial_tx_ring_t& r) {
+        uint8_t header[SERIAL_TX_MSG_HEADER];
+        copyOut(r, header, sizeof(header));
+        r.messages--;
+        return header[0] | ((uint32_t)header[1] << 8);
+    }
+
+    void evictOldest(serial_tx_ring_t& r) {
+        uint32_t len = takeHeader(r);
+        r.tail += len;
+        r.dropped++;
+        queued_.fetch_sub(len, std::memory_order_relaxed);
+    }
+
+    // Front message of the highest class with one queued
+    bool startNext(size_t room) {
+        for (uint8_t cls = 0; cls < SERIAL_TX_CLASS_COUNT; cls++) {
+            serial_tx_ring_t& r = rings_[cls];
+            if (!r.messages) continue;
+            active_ = cls;
+            partial_ = takeHeader(r);
+            if (partial_ > room) INSTRUMENT_COUNT(COUNTER_SERIAL_BLOCKED, 1);
+            return true;
+        }
+        return false;
+    }
+
+    std::mutex mutex_;
+    serial_tx_ring_t rings_[SERIAL_TX_CLASS_COUNT];
+    uint8_t active_ = SERIAL_TX_DETECTION;   // Class of the message being sent
+    uint32_t partial_ = 0;                   // Bytes of it still to send
+    std::atomic<uint32_t> queued_{0};        // Payload bytes queued, all classes
+    TaskHandle_t writer_ = nullptr;
+    uint8_t detection_buf_[SERIAL_TX_DETECTION_BYTES];
+    uint8_t stats_buf_[SERIAL_TX_STATS_BYTES];
+    uint8_t log_buf_[SERIAL_TX_LOG_BYTES];
+
+    static_assert((SERIAL_TX_DETECTION_BYTES & (SERIAL_TX_DETECTION_BYTES - 1)) == 0 &&
+                  (SERIAL_TX_STATS_BYTES & (SERIAL_TX_STATS_BYTES - 1)) == 0 &&
+                  (SERIAL_TX_LOG_BYTES & (SERIAL_TX_LOG_BYTES - 1)) == 0,
+                  "serial TX ring sizes must be powers of two");
+};
+
+static SerialTxQueue serial_tx;
+
+// printf-style debug line in the log class
+static inline void serial_log(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+static inline void serial_log(const char* fmt, ...)
+{
+    char line[SERIAL_TX_LOG_LINE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n <= 0) return;
+    if ((size_t)n >= sizeof(line)) {
+        n = sizeof(line) - 1;
+        line[n - 1] = '\n';
+    }
+    serial_tx.push(SERIAL_TX_LOG, (const uint8_t*)line, n);
+}
+
+#endif // SERIAL_TX_H
@@ -0,0 +1,349 @@
+#ifndef SIGNATURE_DB_H
+#define SIGNATURE_DB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "oui_table.h"
+#include "pattern_matcher.h"
+#include "serial_protocol.h"
+
+// ============================================================================
+// HOT-SWAPPABLE SIGNATURE DATABASE
+// ============================================================================
+// The SSID patterns, MAC prefixes, BLE name patterns and Raven service UUIDs
+// live in a SignatureSet. The compiled-in tables are one; a signature pack
+// (a versioned binary file pushed over serial or the app's command
+// characteristic and kept on LittleFS) is another.
+//
+// SignatureDb holds two sets. A new pack is built into the standby set by a
+// background task while the matching task keeps scanning with the active
+// one; once the build is done the matching task flips the active index
+// between two records, so no record is matched against a half-built set and
+// scanning never pauses. Detection events remember which set matched them
+// (the output tasks look pattern strings up after the fact), and each slot
+// counts the queued events that refer to it: the set that was swapped out is
+// not rebuilt until every output task has finished with them, however long
+// a slow host or an absent BLE client keeps its queue backed up.
+//
+// Pack layout, little-endian: a sigpack_header_t, then header.sections
+// sections of one sigpack_section_t followed by count entries:
+//   SIGPACK_SECTION_SSID / _NAME  [u8 family][u8 len][len bytes of pattern]
+//   SIGPACK_SECTION_OUI           [3 bytes, display order]
+//   SIGPACK_SECTION_RAVEN         [u16 uuid16][u8 len][len bytes of description]
+
+#define SIGPACK_MAGIC 0x50535946      // "FYSP"
+#define SIGPACK_FORMAT 1
+#ifndef SIGPACK_MAX_BYTES
+#define SIGPACK_MAX_BYTES 32768       // Largest pack accepted
+#endif
+#define SIGPACK_MAX_PATTERNS 64       // Per matcher (pattern_id is one byte on the wire)
+#define SIGPACK_MAX_OUIS 4096
+#define SIGPACK_MAX_RAVEN 8           // One bit each in wire_detection_t.raven_mask
+
+enum sigpack_section_type_t : uint8_t {
+    SIGPACK_SECTION_SSID = 1,
+    SIGPACK_SECTION_OUI = 2,
+    SIGPACK_SECTION_NAME = 3,
+    SIGPACK_SECTION_RAVEN = 4
+};
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;        // SIGPACK_MAGIC
+    uint8_t format;        // SIGPACK_FORMAT
+    uint8_t sections;      // Sections that follow
+    uint16_t crc;          // wire_crc16 over everything after the header
+    uint32_t version;      // Chosen by the pack's author, reported back
+    uint32_t length;       // Bytes after the header
+} sigpack_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;          // sigpack_section_type_t
+    uint8_t reserved;
+    uint16_t count;        // Entries in this section
+} sigpack_section_t;
+
+typedef struct {
+    uint16_t uuid16;
+    const char* description;
+} raven_service_t;
+
+// Check the header, length and CRC of a pack. Returns nullptr if it is
+// intact, otherwise why not.
+static inline const char* sigpack_check(const uint8_t* pack, size_t len)
+{
+    if (len < sizeof(sigpack_header_t)) return "truncated";
+    if (len > SIGPACK_MAX_BYTES) return "too large";
+    sigpack_header_t hdr;
+    memcpy(&hdr, pack, sizeof(hdr));
+    if (hdr.magic != SIGPACK_MAGIC) return "bad magic";
+    if (hdr.format != SIGPACK_FORMAT) return "unsupported format";
+    if (hdr.length != len - sizeof(hdr)) return "length mismatch";
+    if (wire_crc16(pack + sizeof(hdr), hdr.length) != hdr.crc) return "bad crc";
+    return nullptr;
+}
+
+class SignatureSet {
+public:
+    ~SignatureSet() { release(); }
+
+    // Use the compiled-in tables as they are. ouis must be sorted.
+    bool buildBuiltin(const name_signature_t* ssids, size_t ssid_count, const uint32_t* ouis, size_t oui_count,
+                      const name_signature_t* names, size_t name_count,
+                      const raven_service_t* raven, size_t raven_count) {
+        release();
+        ouis_ = ouis;
+        oui_count_ = oui_count;
+        raven_ = raven;
+        raven_count_ = raven_count;
+        version_ = 0;
+        pack_bytes_ = 0;
+        return ssid_.build(ssids, ssid_count) && name_.build(names, name_count);
+    }
+
+    // Parse a pack (already checked with sigpack_check) into tables of our
+    // own and build the matchers. On failure the set is left empty.
+    bool build(const uint8_t* pack, size_t len, const char** error) {
+        release();
+        sigpack_header_t hdr;
+        memcpy(&hdr, pack, sizeof(hdr));
+
+        // First pass: validate and size everything
+        size_t counts[5] = {0, 0, 0, 0, 0};
+        size_t text_bytes = 0;
+        if (!walk(pack, len, hdr.sections, counts, &text_bytes, nullptr, error)) return false;
+        if (counts[SIGPACK_SECTION_SSID] > SIGPACK_MAX_PATTERNS ||
+            counts[SIGPACK_SECTION_NAME] > SIGPACK_MAX_PATTERNS) {
+            *error = "too many patterns";
+            return false;
+        }
+        if (counts[SIGPACK_SECTION_OUI] > SIGPACK_MAX_OUIS) {
+            *error = "too many OUIs";
+            return false;
+        }
+        if (counts[SIGPACK_SECTION_RAVEN] > SIGPACK_MAX_RAVEN) {
+            *error = "too many Raven services";
+            return false;
+        }
+
+        // One allocation holds every table and the NUL-terminated strings
+        size_t pattern_count = counts[SIGPACK_SECTION_SSID] + counts[SIGPACK_SECTION_NAME];
+        size_t bytes = pattern_count * sizeof(name_signature_t) +
+                       counts[SIGPACK_SECTION_RAVEN] * sizeof(raven_service_t) +
+                       counts[SIGPACK_SECTION_OUI] * sizeof(uint32_t) + text_bytes;
+        arena_ = (uint8_t*)malloc(bytes ? bytes : 1);
+        if (!arena_) {
+            *error = "out of memory";
+            return false;
+        }
+        arena_bytes_ = bytes;
+        tables_t t;
+        t.ssids = (name_signature_t*)arena_;
+        t.names = t.ssids + counts[SIGPACK_SECTION_SSID];
+        t.raven = (raven_service_t*)(t.names + counts[SIGPACK_SECTION_NAME]);
+        t.ouis = (uint32_t*)(t.raven + counts[SIGPACK_SECTION_RAVEN]);
+        t.text = (char*)(t.ouis + counts[SIGPACK_SECTION_OUI]);
+        t.ssid_count = t.name_count = t.raven_count = t.oui_count = 0;
+
+        // Second pass: fill the tables
+        walk(pack, len, hdr.sections, counts, &text_bytes, &t, error);
+        std::sort(t.ouis, t.ouis + t.oui_count);
+        t.oui_count = std::unique(t.ouis, t.ouis + t.oui_count) - t.ouis;
+
+        ouis_ = t.ouis;
+        oui_count_ = t.oui_count;
+        raven_ = t.raven;
+        raven_count_ = t.raven_count;
+        if (!ssid_.build(t.ssids, t.ssid_count) || !name_.build(t.names, t.name_count)) {
+            *error = "patterns exceed AC_MAX_NODES (or out of memory)";
+            release();
+            return false;
+        }
+        version_ = hdr.version;
+        pack_bytes_ = len;
+        return true;
+    }
+
+    const AhoCorasick& ssid() const { return ssid_; }
+    const AhoCorasick& names() const { return name_; }
+
+    bool matchOui(const uint8_t* mac) const {
+        return oui_lookup(ouis_, oui_count_, oui_from_mac(mac)) >= 0;
+    }
+
+    size_t ouiCount() const { return oui_count_; }
+    size_t ravenCount() const { return raven_count_; }
+    const raven_service_t& raven(size_t i) const { return raven_[i]; }
+
+    // Bit for one 16-bit service UUID in a Raven service mask (0 if not listed)
+    uint32_t ravenBit(uint16_t uuid16) const {
+        for (size_t i = 0; i < raven_count_; i++) {
+            if (raven_[i].uuid16 == uuid16) return 1UL << i;
+        }
+        return 0;
+    }
+
+    bool builtin() const { return pack_bytes_ == 0; }
+    uint32_t version() const { return version_; }
+    size_t packBytes() const { return pack_bytes_; }
+    // RAM taken by the parsed tables and the used matcher nodes
+    size_t memoryBytes() const { return arena_bytes_ + ssid_.memoryBytes() + name_.memoryBytes(); }
+
+private:
+    typedef struct {
+        name_signature_t* ssids;
+        name_signature_t* names;
+        raven_service_t* raven;
+        uint32_t* ouis;
+        char* text;
+        size_t ssid_count, name_count, raven_count, oui_count;
+    } tables_t;
+
+    void release() {
+        free(arena_);
+        arena_ = nullptr;
+        arena_bytes_ = 0;
+        ouis_ = nullptr;
+        oui_count_ = 0;
+        raven_ = nullptr;
+        raven_count_ = 0;
+        ssid_.build(nullptr, 0);
+        name_.build(nullptr, 0);
+    }
+
+    static char* copyText(tables_t* t, const uint8_t* src, uint8_t len) {
+        char* out = t->text;
+        memcpy(out, src, len);
+        out[len] = '\0';
+        t->text += len + 1;
+        return out;
+    }
+
+    // Walk the sections. Without tables it validates and counts entries and
+    // string bytes; with tables it fills them in.
+    static bool walk(const uint8_t* pack, size_t len, uint8_t sections, size_t* counts,
+                     size_t* text_bytes, tables_t* t, const char** error) {
+        const uint8_t* p = pack + sizeof(sigpack_header_t);
+        const uint8_t* end = pack + len;
+        for (uint8_t s = 0; s < sections; s++) {
+            if (end - p < (ptrdiff_t)sizeof(sigpack_section_t)) {
+                *error = "truncated section";
+                return false;
+            }
+            sigpack_section_t sec;
+            memcpy(&sec, p, sizeof(sec));
+            p += sizeof(sec);
+            if (sec.type < SIGPACK_SECTION_SSID || sec.type > SIGPACK_SECTION_RAVEN) {
+                *error = "unknown section";
+                return false;
+            }
+            for (uint16_t i = 0; i < sec.count; i++) {
+                if (end - p < 3) {
+                    *error = "truncated entry";
+                    return false;
+                }
+                if (sec.type == SIGPACK_SECTION_OUI) {
+                    if (t) t->ouis[t->oui_count++] = oui_from_mac(p);
+                    p += 3;
+                    continue;
+                }
+                // Pattern and Raven entries: 2-byte prefix, length, text
+                uint8_t text_len = p[2];
+                if (end - p < 3 + text_len) {
+                    *error = "truncated entry";
+                    return false;
+                }
+                if (!t) {
+                    if (sec.type != SIGPACK_SECTION_RAVEN && (text_len == 0 || p[0] >= FAMILY_COUNT)) {
+                        *error = "bad pattern";
+                        return false;
+                    }
+                    *text_bytes += text_len + 1;
+                } else if (sec.type == SIGPACK_SECTION_RAVEN) {
+                    raven_service_t* r = &t->raven[t->raven_count++];
+                    r->uuid16 = (uint16_t)(p[0] | (p[1] << 8));
+                    r->description = copyText(t, p + 3, text_len);
+                } else {
+                    bool ssid = sec.type == SIGPACK_SECTION_SSID;
+                    name_signature_t* sig = ssid ? &t->ssids[t->ssid_count++] : &t->names[t->name_count++];
+                    sig->family = p[0];
+                    sig->pattern = copyText(t, p + 3, text_len);
+                }
+                p += 3 + text_len;
+            }
+            if (!t) counts[sec.type] += sec.count;
+        }
+        if (p != end) {
+            *error = "trailing bytes";
+            return false;
+        }
+        return true;
+    }
+
+    AhoCorasick ssid_;
+    AhoCorasick name_;
+    const uint32_t* ouis_ = nullptr;
+    size_t oui_count_ = 0;
+    const raven_service_t* raven_ = nullptr;
+    size_t raven_count_ = 0;
+    uint8_t* arena_ = nullptr;
+    size_t arena_bytes_ = 0;
+    uint32_t version_ = 0;
+    size_t pack_bytes_ = 0;
+};
+
+class SignatureDb {
+public:
+    // The set the matching task scans with
+    const SignatureSet& active() const { return slots_[active_.load(std::memory_order_acquire)]; }
+    uint8_t activeSlot() const { return active_.load(std::memory_order_acquire); }
+
+    // The set an event was matched with (output tasks)
+    const SignatureSet& slot(uint8_t index) const { return slots_[index & 1]; }
+
+    // Matching task: a queued event refers to this slot. Output tasks:
+    // finished with one.
+    void hold(uint8_t index) { inflight_[index & 1].fetch_add(1, std::memory_order_relaxed); }
+    void release(uint8_t index) { inflight_[index & 1].fetch_sub(1, std::memory_order_release); }
+    uint32_t inflight(uint8_t index) const { return inflight_[index & 1].load(std::memory_order_acquire); }
+
+    // Builder: the standby set, or nullptr while a build is waiting to be
+    // swapped in or queued events still refer to the swapped-out set. Only
+    // the active slot gains holds, so once the standby count reaches zero it
+    // stays there.
+    SignatureSet* standby() {
+        if (staged_.load(std::memory_order_acquire)) return nullptr;
+        uint8_t index = activeSlot() ^ 1;
+        if (inflight(index)) return nullptr;
+        return &slots_[index];
+    }
+
+    // Builder: the standby set is complete
+    void stage() { staged_.store(true, std::memory_order_release); }
+
+    // Matching task, between records. Returns true if a new set went live.
+    bool swapIfStaged() {
+        if (!staged_.load(std::memory_order_acquire)) return false;
+        active_.store(activeSlot() ^ 1, std::memory_order_release);
+        staged_.store(false, std::memory_order_release);
+        return true;
+    }
+
+    // Boot only, before any task runs: make the standby set active now
+    void activateStandby() {
+        active_.store(activeSlot() ^ 1, std::memory_order_release);
+    }
+
+    bool staged() const { return staged_.load(std::memory_order_acquire); }
+
+private:
+    SignatureSet slots_[2];
+    std::atomic<uint8_t> active_{0};
+    std::atomic<bool> staged_{false};
+    std::atomic<uint32_t> inflight_[2] = {{0}, {0}};  // Queued events per slot
+};
+
+#endif // SIGNATURE_DB_H